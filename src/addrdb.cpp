@@ -16,15 +16,12 @@
 
 namespace {
 
-template <typename Stream, typename Data>
-bool SerializeDB(const CChainParams &chainParams, Stream &stream,
-                 const Data &data) {
+template <typename Stream>
+bool SerializeDB(Stream &stream, const CDataStream &ssData) {
     // Write and commit header, data
     try {
-        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
-        stream << chainParams.DiskMagic() << data;
-        hasher << chainParams.DiskMagic() << data;
-        stream << hasher.GetHash();
+        stream.write(ssData.data(), ssData.size());
+        stream << Hash(ssData.begin(), ssData.end());
     } catch (const std::exception &e) {
         return error("%s: Serialize or I/O error - %s", __func__, e.what());
     }
@@ -35,6 +32,15 @@ bool SerializeDB(const CChainParams &chainParams, Stream &stream,
 template <typename Data>
 bool SerializeFileDB(const CChainParams &chainParams, const std::string &prefix,
                      const fs::path &path, const Data &data) {
+    // Serialize the data once, in memory, so that the locks it takes are not
+    // held while the file is written and synced.
+    CDataStream ssData(SER_DISK, CLIENT_VERSION);
+    try {
+        ssData << chainParams.DiskMagic() << data;
+    } catch (const std::exception &e) {
+        return error("%s: Serialize error - %s", __func__, e.what());
+    }
+
     // Generate random temporary filename
     unsigned short randv = 0;
     GetRandBytes((uint8_t *)&randv, sizeof(randv));
@@ -51,7 +57,7 @@ bool SerializeFileDB(const CChainParams &chainParams, const std::string &prefix,
     }
 
     // Serialize
-    if (!SerializeDB(chainParams, fileout, data)) {
+    if (!SerializeDB(fileout, ssData)) {
         fileout.fclose();
         remove(pathTmp);
         return false;
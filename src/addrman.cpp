@@ -5,11 +5,14 @@
 
 #include <addrman.h>
 
+#include <crypto/siphash.h>
 #include <hash.h>
 #include <logging.h>
 #include <serialize.h>
 
 #include <cmath>
+#include <limits>
+#include <unordered_map>
 
 int CAddrInfo::GetTriedBucket(const uint256 &nKey,
                               const std::vector<bool> &asmap) const {
@@ -97,72 +100,108 @@ double CAddrInfo::GetChance(int64_t nNow) const {
     return fChance;
 }
 
+CAddrMan::CAddrMan()
+    : m_shard_k0(GetRand(std::numeric_limits<uint64_t>::max())),
+      m_shard_k1(GetRand(std::numeric_limits<uint64_t>::max())) {
+    Clear();
+}
+
+CAddrMan::ShardLock::ShardLock(const CAddrMan &addrman, uint32_t shards)
+    : m_addrman(addrman), m_shards(shards) {
+    for (int i = 0; i < ADDRMAN_SHARD_COUNT; i++) {
+        if (m_shards & ShardBit(i)) {
+            ENTER_CRITICAL_SECTION(m_addrman.m_shards[i].mutex);
+        }
+    }
+}
+
+CAddrMan::ShardLock::~ShardLock() {
+    for (int i = ADDRMAN_SHARD_COUNT - 1; i >= 0; i--) {
+        if (m_shards & ShardBit(i)) {
+            LEAVE_CRITICAL_SECTION(m_addrman.m_shards[i].mutex);
+        }
+    }
+}
+
+int CAddrMan::GetShard(const CNetAddr &addr) const {
+    uint64_t high = 0;
+    uint64_t low = 0;
+    for (int n = 0; n < 8; n++) {
+        high = (high << 8) | addr.GetByte(15 - n);
+        low = (low << 8) | addr.GetByte(7 - n);
+    }
+    return CSipHasher(m_shard_k0, m_shard_k1)
+               .Write(high)
+               .Write(low)
+               .Finalize() %
+           ADDRMAN_SHARD_COUNT;
+}
+
 CAddrInfo *CAddrMan::Find(const CNetAddr &addr, int *pnId) {
-    std::map<CNetAddr, int>::iterator it = mapAddr.find(addr);
-    if (it == mapAddr.end()) {
+    Shard &shard = m_shards[GetShard(addr)];
+    std::map<CNetAddr, int>::iterator it = shard.mapAddr.find(addr);
+    if (it == shard.mapAddr.end()) {
         return nullptr;
     }
     if (pnId) {
         *pnId = (*it).second;
     }
-    std::map<int, CAddrInfo>::iterator it2 = mapInfo.find((*it).second);
-    if (it2 != mapInfo.end()) {
+    std::map<int, CAddrInfo>::iterator it2 = shard.mapInfo.find((*it).second);
+    if (it2 != shard.mapInfo.end()) {
         return &(*it2).second;
     }
     return nullptr;
 }
 
+CAddrInfo &CAddrMan::GetInfo(int nId) {
+    Shard &shard = m_shards[GetShardOfId(nId)];
+    assert(shard.mapInfo.count(nId) == 1);
+    return shard.mapInfo[nId];
+}
+
+const CAddrInfo &CAddrMan::GetInfo(int nId) const {
+    const Shard &shard = m_shards[GetShardOfId(nId)];
+    auto it = shard.mapInfo.find(nId);
+    assert(it != shard.mapInfo.end());
+    return it->second;
+}
+
 CAddrInfo *CAddrMan::Create(const CAddress &addr, const CNetAddr &addrSource,
                             int *pnId) {
-    int nId = nIdCount++;
-    mapInfo[nId] = CAddrInfo(addr, addrSource);
-    mapAddr[addr] = nId;
-    mapInfo[nId].nRandomPos = vRandom.size();
-    vRandom.push_back(nId);
+    const int nShard = GetShard(addr);
+    Shard &shard = m_shards[nShard];
+    int nId = shard.nIdCount++ * ADDRMAN_SHARD_COUNT + nShard;
+    CAddrInfo &info = shard.mapInfo[nId];
+    info = CAddrInfo(addr, addrSource);
+    shard.mapAddr[addr] = nId;
+    m_entry_count++;
+    m_version++;
     if (pnId) {
         *pnId = nId;
     }
-    return &mapInfo[nId];
-}
-
-void CAddrMan::SwapRandom(unsigned int nRndPos1, unsigned int nRndPos2) {
-    if (nRndPos1 == nRndPos2) {
-        return;
-    }
-
-    assert(nRndPos1 < vRandom.size() && nRndPos2 < vRandom.size());
-
-    int nId1 = vRandom[nRndPos1];
-    int nId2 = vRandom[nRndPos2];
-
-    assert(mapInfo.count(nId1) == 1);
-    assert(mapInfo.count(nId2) == 1);
-
-    mapInfo[nId1].nRandomPos = nRndPos2;
-    mapInfo[nId2].nRandomPos = nRndPos1;
-
-    vRandom[nRndPos1] = nId2;
-    vRandom[nRndPos2] = nId1;
+    return &info;
 }
 
 void CAddrMan::Delete(int nId) {
-    assert(mapInfo.count(nId) != 0);
-    CAddrInfo &info = mapInfo[nId];
+    Shard &shard = m_shards[GetShardOfId(nId)];
+    std::map<int, CAddrInfo>::iterator it = shard.mapInfo.find(nId);
+    assert(it != shard.mapInfo.end());
+    const CAddrInfo &info = it->second;
     assert(!info.fInTried);
     assert(info.nRefCount == 0);
 
-    SwapRandom(info.nRandomPos, vRandom.size() - 1);
-    vRandom.pop_back();
-    mapAddr.erase(info);
-    mapInfo.erase(nId);
+    shard.mapAddr.erase(info);
+    shard.mapInfo.erase(it);
     nNew--;
+    m_entry_count--;
+    m_version++;
 }
 
 void CAddrMan::ClearNew(int nUBucket, int nUBucketPos) {
     // if there is an entry in the specified bucket, delete it.
     if (vvNew[nUBucket][nUBucketPos] != -1) {
         int nIdDelete = vvNew[nUBucket][nUBucketPos];
-        CAddrInfo &infoDelete = mapInfo[nIdDelete];
+        CAddrInfo &infoDelete = GetInfo(nIdDelete);
         assert(infoDelete.nRefCount > 0);
         infoDelete.nRefCount--;
         vvNew[nUBucket][nUBucketPos] = -1;
@@ -194,8 +233,7 @@ void CAddrMan::MakeTried(CAddrInfo &info, int nId) {
     if (vvTried[nKBucket][nKBucketPos] != -1) {
         // find an item to evict
         int nIdEvict = vvTried[nKBucket][nKBucketPos];
-        assert(mapInfo.count(nIdEvict) == 1);
-        CAddrInfo &infoOld = mapInfo[nIdEvict];
+        CAddrInfo &infoOld = GetInfo(nIdEvict);
 
         // Remove the to-be-evicted item from the tried set.
         infoOld.fInTried = false;
@@ -278,14 +316,10 @@ void CAddrMan::Good_(const CService &addr, bool test_before_evict,
     // Will moving this address into tried evict another entry?
     if (test_before_evict && (vvTried[tried_bucket][tried_bucket_pos] != -1)) {
         // Output the entry we'd be colliding with, for debugging purposes
-        auto colliding_entry =
-            mapInfo.find(vvTried[tried_bucket][tried_bucket_pos]);
         LogPrint(BCLog::ADDRMAN,
                  "Collision inserting element into tried table (%s), moving %s "
                  "to m_tried_collisions=%d\n",
-                 colliding_entry != mapInfo.end()
-                     ? colliding_entry->second.ToString()
-                     : "",
+                 GetInfo(vvTried[tried_bucket][tried_bucket_pos]).ToString(),
                  addr.ToString(), m_tried_collisions.size());
         if (m_tried_collisions.size() < ADDRMAN_SET_TRIED_COLLISION_SIZE) {
             m_tried_collisions.insert(nId);
@@ -304,86 +338,150 @@ bool CAddrMan::Add_(const CAddress &addr, const CNetAddr &source,
         return false;
     }
 
-    bool fNew = false;
-    int nId;
-    CAddrInfo *pinfo = Find(addr, &nId);
-
     // Do not set a penalty for a source's self-announcement
     if (addr == source) {
         nTimePenalty = 0;
     }
 
-    if (pinfo) {
-        // periodically update nTime
-        bool fCurrentlyOnline = (GetAdjustedTime() - addr.nTime < 24 * 60 * 60);
-        int64_t nUpdateInterval = (fCurrentlyOnline ? 60 * 60 : 24 * 60 * 60);
-        if (addr.nTime &&
-            (!pinfo->nTime ||
-             pinfo->nTime < addr.nTime - nUpdateInterval - nTimePenalty)) {
-            pinfo->nTime = std::max((int64_t)0, addr.nTime - nTimePenalty);
-        }
+    const int nShard = GetShard(addr);
+    while (true) {
+        // First look the entry up with only its shard locked, to find out
+        // which bucket it goes to and whether there is anything to do at all.
+        int nIdFound = -1;
+        int nRefCount = 0;
+        int nUBucket = -1;
+        int nUBucketPos = -1;
+        {
+            LOCK(m_shards[nShard].mutex);
+            CAddrInfo *pinfo = Find(addr, &nIdFound);
+            if (pinfo) {
+                // periodically update nTime
+                bool fCurrentlyOnline =
+                    (GetAdjustedTime() - addr.nTime < 24 * 60 * 60);
+                int64_t nUpdateInterval =
+                    (fCurrentlyOnline ? 60 * 60 : 24 * 60 * 60);
+                if (addr.nTime &&
+                    (!pinfo->nTime || pinfo->nTime < addr.nTime -
+                                                         nUpdateInterval -
+                                                         nTimePenalty)) {
+                    pinfo->nTime =
+                        std::max((int64_t)0, addr.nTime - nTimePenalty);
+                }
 
-        // add services
-        pinfo->nServices = ServiceFlags(pinfo->nServices | addr.nServices);
+                // add services
+                pinfo->nServices =
+                    ServiceFlags(pinfo->nServices | addr.nServices);
 
-        // do not update if no new information is present
-        if (!addr.nTime || (pinfo->nTime && addr.nTime <= pinfo->nTime)) {
-            return false;
-        }
+                // do not update if no new information is present
+                if (!addr.nTime ||
+                    (pinfo->nTime && addr.nTime <= pinfo->nTime)) {
+                    return false;
+                }
 
-        // do not update if the entry was already in the "tried" table
-        if (pinfo->fInTried) {
-            return false;
-        }
+                // do not update if the entry was already in the "tried" table
+                if (pinfo->fInTried) {
+                    return false;
+                }
 
-        // do not update if the max reference count is reached
-        if (pinfo->nRefCount == ADDRMAN_NEW_BUCKETS_PER_ADDRESS) {
-            return false;
-        }
+                // do not update if the max reference count is reached
+                if (pinfo->nRefCount == ADDRMAN_NEW_BUCKETS_PER_ADDRESS) {
+                    return false;
+                }
+                nRefCount = pinfo->nRefCount;
+            } else {
+                nIdFound = -1;
+            }
 
-        // stochastic test: previous nRefCount == N: 2^N times harder to
-        // increase it
-        int nFactor = 1;
-        for (int n = 0; n < pinfo->nRefCount; n++) {
-            nFactor *= 2;
+            if (nRefCount == 0) {
+                const CAddrInfo &info =
+                    pinfo ? *pinfo : CAddrInfo(addr, source);
+                nUBucket = info.GetNewBucket(nKey, source, m_asmap);
+                nUBucketPos = info.GetBucketPosition(nKey, true, nUBucket);
+            }
         }
 
-        if (nFactor > 1 && (insecure_rand.randrange(nFactor) != 0)) {
-            return false;
-        }
-    } else {
-        pinfo = Create(addr, source, &nId);
-        pinfo->nTime =
-            std::max((int64_t)0, (int64_t)pinfo->nTime - nTimePenalty);
-        nNew++;
-        fNew = true;
-    }
-
-    int nUBucket = pinfo->GetNewBucket(nKey, source, m_asmap);
-    int nUBucketPos = pinfo->GetBucketPosition(nKey, true, nUBucket);
-    if (vvNew[nUBucket][nUBucketPos] != nId) {
-        bool fInsert = vvNew[nUBucket][nUBucketPos] == -1;
-        if (!fInsert) {
-            CAddrInfo &infoExisting = mapInfo[vvNew[nUBucket][nUBucketPos]];
-            if (infoExisting.IsTerrible() ||
-                (infoExisting.nRefCount > 1 && pinfo->nRefCount == 0)) {
-                // Overwrite the existing new table entry.
-                fInsert = true;
+        if (nRefCount > 0) {
+            // stochastic test: previous nRefCount == N: 2^N times harder to
+            // increase it
+            int nFactor = 1;
+            for (int n = 0; n < nRefCount; n++) {
+                nFactor *= 2;
+            }
+
+            if (WITH_LOCK(m_rand_mutex,
+                          return insecure_rand.randrange(nFactor)) != 0) {
+                return false;
+            }
+
+            // Only hash the entry into its bucket once it passed the test.
+            LOCK(m_shards[nShard].mutex);
+            const CAddrInfo *pinfo = Find(addr);
+            if (!pinfo) {
+                continue;
             }
+            nUBucket = pinfo->GetNewBucket(nKey, source, m_asmap);
+            nUBucketPos = pinfo->GetBucketPosition(nKey, true, nUBucket);
         }
-        if (fInsert) {
-            ClearNew(nUBucket, nUBucketPos);
-            pinfo->nRefCount++;
-            vvNew[nUBucket][nUBucketPos] = nId;
-        } else if (pinfo->nRefCount == 0) {
-            Delete(nId);
+
+        // Then lock the shard of the bucket as well, and the one of the entry
+        // occupying the position if it is to be replaced. Start over if the
+        // entry was created or deleted in the meantime.
+        uint32_t shards =
+            ShardBit(nShard) | ShardBit(GetShardOfBucket(nUBucket));
+        while (true) {
+            ShardLock lock(*this, shards);
+            int nId = -1;
+            CAddrInfo *pinfo = Find(addr, &nId);
+            if ((pinfo ? nId : -1) != nIdFound) {
+                break;
+            }
+            if (pinfo &&
+                (pinfo->fInTried ||
+                 pinfo->nRefCount == ADDRMAN_NEW_BUCKETS_PER_ADDRESS)) {
+                return false;
+            }
+            const int nIdExisting = vvNew[nUBucket][nUBucketPos];
+            if (nIdExisting != -1 &&
+                !(shards & ShardBit(GetShardOfId(nIdExisting)))) {
+                shards |= ShardBit(GetShardOfId(nIdExisting));
+                continue;
+            }
+
+            bool fNew = false;
+            if (!pinfo) {
+                pinfo = Create(addr, source, &nId);
+                pinfo->nTime =
+                    std::max((int64_t)0, (int64_t)pinfo->nTime - nTimePenalty);
+                nNew++;
+                fNew = true;
+            }
+
+            if (nIdExisting != nId) {
+                bool fInsert = nIdExisting == -1;
+                if (!fInsert) {
+                    CAddrInfo &infoExisting = GetInfo(nIdExisting);
+                    if (infoExisting.IsTerrible() ||
+                        (infoExisting.nRefCount > 1 && pinfo->nRefCount == 0)) {
+                        // Overwrite the existing new table entry.
+                        fInsert = true;
+                    }
+                }
+                if (fInsert) {
+                    ClearNew(nUBucket, nUBucketPos);
+                    pinfo->nRefCount++;
+                    vvNew[nUBucket][nUBucketPos] = nId;
+                } else if (pinfo->nRefCount == 0) {
+                    Delete(nId);
+                }
+            }
+            return fNew;
         }
     }
-    return fNew;
 }
 
 void CAddrMan::Attempt_(const CService &addr, bool fCountFailure,
                         int64_t nTime) {
+    LOCK(m_shards[GetShard(addr)].mutex);
     CAddrInfo *pinfo = Find(addr);
 
     // if not found, bail out
@@ -407,6 +505,27 @@ void CAddrMan::Attempt_(const CService &addr, bool fCountFailure,
     }
 }
 
+bool CAddrMan::CopyEntry(const int nTable[][ADDRMAN_BUCKET_SIZE], int nBucket,
+                         int nBucketPos, CAddrInfo &info) const {
+    int nId;
+    {
+        LOCK(m_shards[GetShardOfBucket(nBucket)].mutex);
+        nId = nTable[nBucket][nBucketPos];
+    }
+    if (nId == -1) {
+        return false;
+    }
+    const Shard &shard = m_shards[GetShardOfId(nId)];
+    LOCK(shard.mutex);
+    auto it = shard.mapInfo.find(nId);
+    if (it == shard.mapInfo.end()) {
+        // It was deleted in the meantime.
+        return false;
+    }
+    info = it->second;
+    return true;
+}
+
 CAddrInfo CAddrMan::Select_(bool newOnly) {
     if (size() == 0) {
         return CAddrInfo();
@@ -416,6 +535,9 @@ CAddrInfo CAddrMan::Select_(bool newOnly) {
         return CAddrInfo();
     }
 
+    // The buckets are read without locking them all, so the tables may get
+    // empty while looking for an entry.
+    CAddrInfo info;
     // Use a 50% chance for choosing between tried and new table entries.
     if (!newOnly &&
         (nTried > 0 && (nNew == 0 || insecure_rand.randbool() == 0))) {
@@ -424,7 +546,10 @@ CAddrInfo CAddrMan::Select_(bool newOnly) {
         while (1) {
             int nKBucket = insecure_rand.randrange(ADDRMAN_TRIED_BUCKET_COUNT);
             int nKBucketPos = insecure_rand.randrange(ADDRMAN_BUCKET_SIZE);
-            while (vvTried[nKBucket][nKBucketPos] == -1) {
+            while (!CopyEntry(vvTried, nKBucket, nKBucketPos, info)) {
+                if (nTried == 0) {
+                    return CAddrInfo();
+                }
                 nKBucket = (nKBucket + insecure_rand.randbits(
                                            ADDRMAN_TRIED_BUCKET_COUNT_LOG2)) %
                            ADDRMAN_TRIED_BUCKET_COUNT;
@@ -432,9 +557,6 @@ CAddrInfo CAddrMan::Select_(bool newOnly) {
                                                  ADDRMAN_BUCKET_SIZE_LOG2)) %
                               ADDRMAN_BUCKET_SIZE;
             }
-            int nId = vvTried[nKBucket][nKBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo &info = mapInfo[nId];
             if (insecure_rand.randbits(30) <
                 fChanceFactor * info.GetChance() * (1 << 30)) {
                 return info;
@@ -447,7 +569,10 @@ CAddrInfo CAddrMan::Select_(bool newOnly) {
         while (1) {
             int nUBucket = insecure_rand.randrange(ADDRMAN_NEW_BUCKET_COUNT);
             int nUBucketPos = insecure_rand.randrange(ADDRMAN_BUCKET_SIZE);
-            while (vvNew[nUBucket][nUBucketPos] == -1) {
+            while (!CopyEntry(vvNew, nUBucket, nUBucketPos, info)) {
+                if (nNew == 0) {
+                    return CAddrInfo();
+                }
                 nUBucket = (nUBucket + insecure_rand.randbits(
                                            ADDRMAN_NEW_BUCKET_COUNT_LOG2)) %
                            ADDRMAN_NEW_BUCKET_COUNT;
@@ -455,9 +580,6 @@ CAddrInfo CAddrMan::Select_(bool newOnly) {
                                                  ADDRMAN_BUCKET_SIZE_LOG2)) %
                               ADDRMAN_BUCKET_SIZE;
             }
-            int nId = vvNew[nUBucket][nUBucketPos];
-            assert(mapInfo.count(nId) == 1);
-            CAddrInfo &info = mapInfo[nId];
             if (insecure_rand.randbits(30) <
                 fChanceFactor * info.GetChance() * (1 << 30)) {
                 return info;
@@ -472,43 +594,41 @@ int CAddrMan::Check_() {
     std::set<int> setTried;
     std::map<int, int> mapNew;
 
-    if (vRandom.size() != size_t(nTried + nNew)) {
+    if (m_entry_count != nTried + nNew) {
         return -7;
     }
 
-    for (const auto &entry : mapInfo) {
-        int n = entry.first;
-        const CAddrInfo &info = entry.second;
-        if (info.fInTried) {
-            if (!info.nLastSuccess) {
-                return -1;
+    for (Shard &shard : m_shards) {
+        for (const auto &entry : shard.mapInfo) {
+            int n = entry.first;
+            const CAddrInfo &info = entry.second;
+            if (info.fInTried) {
+                if (!info.nLastSuccess) {
+                    return -1;
+                }
+                if (info.nRefCount) {
+                    return -2;
+                }
+                setTried.insert(n);
+            } else {
+                if (info.nRefCount < 0 ||
+                    info.nRefCount > ADDRMAN_NEW_BUCKETS_PER_ADDRESS) {
+                    return -3;
+                }
+                if (!info.nRefCount) {
+                    return -4;
+                }
+                mapNew[n] = info.nRefCount;
             }
-            if (info.nRefCount) {
-                return -2;
+            if (shard.mapAddr[info] != n) {
+                return -5;
             }
-            setTried.insert(n);
-        } else {
-            if (info.nRefCount < 0 ||
-                info.nRefCount > ADDRMAN_NEW_BUCKETS_PER_ADDRESS) {
-                return -3;
+            if (info.nLastTry < 0) {
+                return -6;
             }
-            if (!info.nRefCount) {
-                return -4;
+            if (info.nLastSuccess < 0) {
+                return -8;
             }
-            mapNew[n] = info.nRefCount;
-        }
-        if (mapAddr[info] != n) {
-            return -5;
-        }
-        if (info.nRandomPos < 0 || size_t(info.nRandomPos) >= vRandom.size() ||
-            vRandom[info.nRandomPos] != n) {
-            return -14;
-        }
-        if (info.nLastTry < 0) {
-            return -6;
-        }
-        if (info.nLastSuccess < 0) {
-            return -8;
         }
     }
 
@@ -525,10 +645,10 @@ int CAddrMan::Check_() {
                 if (!setTried.count(vvTried[n][i])) {
                     return -11;
                 }
-                if (mapInfo[vvTried[n][i]].GetTriedBucket(nKey, m_asmap) != n) {
+                if (GetInfo(vvTried[n][i]).GetTriedBucket(nKey, m_asmap) != n) {
                     return -17;
                 }
-                if (mapInfo[vvTried[n][i]].GetBucketPosition(nKey, false, n) !=
+                if (GetInfo(vvTried[n][i]).GetBucketPosition(nKey, false, n) !=
                     i) {
                     return -18;
                 }
@@ -543,7 +663,7 @@ int CAddrMan::Check_() {
                 if (!mapNew.count(vvNew[n][i])) {
                     return -12;
                 }
-                if (mapInfo[vvNew[n][i]].GetBucketPosition(nKey, true, n) !=
+                if (GetInfo(vvNew[n][i]).GetBucketPosition(nKey, true, n) !=
                     i) {
                     return -19;
                 }
@@ -568,23 +688,62 @@ int CAddrMan::Check_() {
 }
 #endif
 
-void CAddrMan::GetAddr_(std::vector<CAddress> &vAddr) {
-    unsigned int nNodes = ADDRMAN_GETADDR_MAX_PCT * vRandom.size() / 100;
+std::shared_ptr<const CAddrMan::Snapshot> CAddrMan::GetSnapshot() {
+    std::shared_ptr<const Snapshot> snapshot = std::atomic_load(&m_snapshot);
+    const int64_t now = GetTime();
+    if (snapshot && snapshot->version == m_version &&
+        snapshot->time + ADDRMAN_SNAPSHOT_MAX_AGE >= now) {
+        return snapshot;
+    }
+
+    ShardLock lock(*this, ALL_SHARDS);
+    // Another thread may have taken it while waiting for the locks.
+    snapshot = std::atomic_load(&m_snapshot);
+    if (snapshot && snapshot->version == m_version &&
+        snapshot->time + ADDRMAN_SNAPSHOT_MAX_AGE >= now) {
+        return snapshot;
+    }
+
+    auto new_snapshot = std::make_shared<Snapshot>();
+    new_snapshot->version = m_version;
+    new_snapshot->time = now;
+    new_snapshot->entries.reserve(m_entry_count);
+    for (const Shard &shard : m_shards) {
+        for (const auto &entry : shard.mapInfo) {
+            new_snapshot->entries.push_back(entry.second);
+        }
+    }
+    snapshot = std::move(new_snapshot);
+    std::atomic_store(&m_snapshot, snapshot);
+    return snapshot;
+}
+
+void CAddrMan::GetAddr_(const Snapshot &snapshot,
+                        std::vector<CAddress> &vAddr) const {
+    const std::vector<CAddrInfo> &entries = snapshot.entries;
+    unsigned int nNodes = ADDRMAN_GETADDR_MAX_PCT * entries.size() / 100;
     if (nNodes > ADDRMAN_GETADDR_MAX) {
         nNodes = ADDRMAN_GETADDR_MAX;
     }
 
-    // gather a list of random nodes, skipping those of low quality
-    for (unsigned int n = 0; n < vRandom.size(); n++) {
+    // gather a list of random nodes, skipping those of low quality. The
+    // snapshot is shared, so the shuffle only records the swapped positions.
+    FastRandomContext rng;
+    std::unordered_map<size_t, size_t> swapped;
+    auto position = [&swapped](size_t n) {
+        auto it = swapped.find(n);
+        return it == swapped.end() ? n : it->second;
+    };
+    for (size_t n = 0; n < entries.size(); n++) {
         if (vAddr.size() >= nNodes) {
             break;
         }
 
-        int nRndPos = insecure_rand.randrange(vRandom.size() - n) + n;
-        SwapRandom(n, nRndPos);
-        assert(mapInfo.count(vRandom[n]) == 1);
+        size_t nRndPos = rng.randrange(entries.size() - n) + n;
+        const size_t nPos = position(nRndPos);
+        swapped[nRndPos] = position(n);
 
-        const CAddrInfo &ai = mapInfo[vRandom[n]];
+        const CAddrInfo &ai = entries[nPos];
         if (!ai.IsTerrible()) {
             vAddr.push_back(ai);
         }
@@ -592,6 +751,7 @@ void CAddrMan::GetAddr_(std::vector<CAddress> &vAddr) {
 }
 
 void CAddrMan::Connected_(const CService &addr, int64_t nTime) {
+    LOCK(m_shards[GetShard(addr)].mutex);
     CAddrInfo *pinfo = Find(addr);
 
     // if not found, bail out
@@ -615,6 +775,7 @@ void CAddrMan::Connected_(const CService &addr, int64_t nTime) {
 }
 
 void CAddrMan::SetServices_(const CService &addr, ServiceFlags nServices) {
+    LOCK(m_shards[GetShard(addr)].mutex);
     CAddrInfo *pinfo = Find(addr);
 
     // if not found, bail out
@@ -644,11 +805,12 @@ void CAddrMan::ResolveCollisions_() {
         bool erase_collision = false;
 
         // If id_new not found in mapInfo remove it from m_tried_collisions.
-        auto id_new_it = mapInfo.find(id_new);
-        if (id_new_it == mapInfo.end()) {
+        const Shard &shard_new = m_shards[GetShardOfId(id_new)];
+        auto id_new_it = shard_new.mapInfo.find(id_new);
+        if (id_new_it == shard_new.mapInfo.end()) {
             erase_collision = true;
         } else {
-            CAddrInfo &info_new = id_new_it->second;
+            const CAddrInfo &info_new = id_new_it->second;
 
             // Which tried bucket to move the entry to.
             int tried_bucket = info_new.GetTriedBucket(nKey, m_asmap);
@@ -662,7 +824,7 @@ void CAddrMan::ResolveCollisions_() {
 
                 // Get the to-be-evicted address that is being tested
                 int id_old = vvTried[tried_bucket][tried_bucket_pos];
-                CAddrInfo &info_old = mapInfo[id_old];
+                CAddrInfo &info_old = GetInfo(id_old);
 
                 // Has successfully connected in last X hours
                 if (adjustedTime - info_old.nLastSuccess <
@@ -722,13 +884,14 @@ CAddrInfo CAddrMan::SelectTriedCollision_() {
     int id_new = *it;
 
     // If id_new not found in mapInfo remove it from m_tried_collisions.
-    auto id_new_it = mapInfo.find(id_new);
-    if (id_new_it == mapInfo.end()) {
+    const Shard &shard_new = m_shards[GetShardOfId(id_new)];
+    auto id_new_it = shard_new.mapInfo.find(id_new);
+    if (id_new_it == shard_new.mapInfo.end()) {
         m_tried_collisions.erase(it);
         return CAddrInfo();
     }
 
-    CAddrInfo &newInfo = id_new_it->second;
+    const CAddrInfo &newInfo = id_new_it->second;
 
     // which tried bucket to move the entry to
     int tried_bucket = newInfo.GetTriedBucket(nKey, m_asmap);
@@ -736,7 +899,7 @@ CAddrInfo CAddrMan::SelectTriedCollision_() {
 
     int id_old = vvTried[tried_bucket][tried_bucket_pos];
 
-    return mapInfo[id_old];
+    return GetInfo(id_old);
 }
 
 std::vector<bool> CAddrMan::DecodeAsmap(fs::path path) {
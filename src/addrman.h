@@ -17,10 +17,14 @@
 #include <timedata.h>
 #include <util/system.h>
 
+#include <array>
+#include <atomic>
 #include <cstdint>
 #include <iostream>
 #include <map>
+#include <memory>
 #include <set>
+#include <tuple>
 #include <vector>
 
 /**
@@ -50,9 +54,6 @@ private:
     //! in tried set? (memory only)
     bool fInTried{false};
 
-    //! position in vRandom
-    int nRandomPos{-1};
-
     friend class CAddrMan;
 
 public:
@@ -130,6 +131,23 @@ public:
  *    * Several indexes are kept for high performance. Defining DEBUG_ADDRMAN
  * will introduce frequent (and expensive)
  *      consistency checks for the entire data structure.
+ *
+ * Concurrency:
+ *  * The entries and the buckets are split into ADDRMAN_SHARD_COUNT shards,
+ * each with its own lock, so that addresses relayed by different peers can be
+ * added at the same time as addresses are selected.
+ *    * An entry belongs to the shard its address hashes to, and its nId
+ * encodes that shard.
+ *    * A new or tried bucket belongs to the shard of its index modulo
+ * ADDRMAN_SHARD_COUNT.
+ *    * Add, Select, Attempt, Connected and SetServices only lock the shards
+ * of the entries and buckets they touch. Several shards are always locked in
+ * increasing order.
+ *    * The operations which move entries between the tables or touch all of
+ * them, like Good or serialization, lock every shard.
+ *  * GetAddr samples an immutable snapshot of the entries, published RCU
+ * style, without taking any lock. It is rebuilt when entries were added or
+ * removed since, or when it gets old.
  */
 
 //! total number of buckets for tried addresses
@@ -187,116 +205,182 @@ public:
 //! seconds (40 minutes)
 static const int64_t ADDRMAN_TEST_WINDOW = 40 * 60;
 
+//! number of shards the entries and buckets are split into
+#define ADDRMAN_SHARD_COUNT_LOG2 4
+#define ADDRMAN_SHARD_COUNT (1 << ADDRMAN_SHARD_COUNT_LOG2)
+
+//! how long the snapshot GetAddr samples from may be reused, in seconds, when
+//! no entry was added or removed since it was taken
+static const int64_t ADDRMAN_SNAPSHOT_MAX_AGE = 60;
+
 /**
  * Stochastical (IP) address manager
  */
 class CAddrMan {
     friend class CAddrManTest;
 
-protected:
-    //! critical section to protect the inner data structures
-    mutable RecursiveMutex cs;
-
 private:
-    //! last used nId
-    int nIdCount GUARDED_BY(cs);
+    //! A shard of the entries, see the concurrency notes above. Its lock also
+    //! guards the buckets of the shard.
+    struct Shard {
+        mutable Mutex mutex;
+
+        //! last used index of an nId in this shard
+        int nIdCount{0};
+
+        //! table with information about the nIds of this shard
+        std::map<int, CAddrInfo> mapInfo;
+
+        //! find an nId based on its network address
+        std::map<CNetAddr, int> mapAddr;
+    };
+
+    //! The entries GetAddr samples from.
+    struct Snapshot {
+        //! m_version when the snapshot was taken
+        uint64_t version;
+        int64_t time;
+        std::vector<CAddrInfo> entries;
+    };
 
-    //! table with information about all nIds
-    std::map<int, CAddrInfo> mapInfo GUARDED_BY(cs);
+    std::array<Shard, ADDRMAN_SHARD_COUNT> m_shards;
 
-    //! find an nId based on its network address
-    std::map<CNetAddr, int> mapAddr GUARDED_BY(cs);
+    //! number of entries in all shards
+    std::atomic<int> m_entry_count{0};
 
-    //! randomly-ordered vector of all nIds
-    std::vector<int> vRandom GUARDED_BY(cs);
+    //! number of times entries were created or deleted
+    std::atomic<uint64_t> m_version{0};
+
+    //! latest snapshot, only accessed with std::atomic_load and
+    //! std::atomic_store
+    std::shared_ptr<const Snapshot> m_snapshot;
+
+    //! keys of the hash which picks the shard of an address
+    const uint64_t m_shard_k0;
+    const uint64_t m_shard_k1;
 
     // number of "tried" entries
-    int nTried GUARDED_BY(cs);
+    std::atomic<int> nTried;
 
     //! list of "tried" buckets
-    int vvTried[ADDRMAN_TRIED_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE] GUARDED_BY(cs);
+    int vvTried[ADDRMAN_TRIED_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE];
 
     //! number of (unique) "new" entries
-    int nNew GUARDED_BY(cs);
+    std::atomic<int> nNew;
 
     //! list of "new" buckets
-    int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE] GUARDED_BY(cs);
+    int vvNew[ADDRMAN_NEW_BUCKET_COUNT][ADDRMAN_BUCKET_SIZE];
 
     //! last time Good was called (memory only)
-    int64_t nLastGood GUARDED_BY(cs);
+    std::atomic<int64_t> nLastGood;
 
     //! Holds addrs inserted into tried table that collide with existing
     //! entries. Test-before-evict discipline used to resolve these collisions.
+    //! Only accessed with all the shards locked.
     std::set<int> m_tried_collisions;
 
 protected:
-    //! secret key to randomize bucket select with
+    //! Locks a set of shards, given as a bit mask, in increasing order.
+    class ShardLock {
+    public:
+        ShardLock(const CAddrMan &addrman, uint32_t shards);
+        ~ShardLock();
+
+    private:
+        const CAddrMan &m_addrman;
+        const uint32_t m_shards;
+    };
+
+    static constexpr uint32_t ALL_SHARDS =
+        uint32_t((uint64_t(1) << ADDRMAN_SHARD_COUNT) - 1);
+
+    static uint32_t ShardBit(int shard) { return uint32_t(1) << shard; }
+    static int GetShardOfId(int nId) { return nId % ADDRMAN_SHARD_COUNT; }
+    static int GetShardOfBucket(int nBucket) {
+        return nBucket % ADDRMAN_SHARD_COUNT;
+    }
+    int GetShard(const CNetAddr &addr) const;
+
+    //! secret key to randomize bucket select with. Only written with all the
+    //! shards locked, so that it can be read with any of them locked.
     uint256 nKey;
 
-    //! Source of random numbers for randomization in inner loops
-    FastRandomContext insecure_rand;
+    //! Source of random numbers for randomization in inner loops. Its lock is
+    //! taken before any shard lock.
+    Mutex m_rand_mutex;
+    FastRandomContext insecure_rand GUARDED_BY(m_rand_mutex);
+
+    //! Find an entry. Its shard must be locked.
+    CAddrInfo *Find(const CNetAddr &addr, int *pnId = nullptr);
 
-    //! Find an entry.
-    CAddrInfo *Find(const CNetAddr &addr, int *pnId = nullptr)
-        EXCLUSIVE_LOCKS_REQUIRED(cs);
+    //! Return an existing entry. Its shard must be locked.
+    CAddrInfo &GetInfo(int nId);
+    const CAddrInfo &GetInfo(int nId) const;
 
-    //! find an entry, creating it if necessary.
+    //! find an entry, creating it if necessary. Its shard must be locked.
     //! nTime and nServices of the found node are updated, if necessary.
     CAddrInfo *Create(const CAddress &addr, const CNetAddr &addrSource,
-                      int *pnId = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs);
+                      int *pnId = nullptr);
 
-    //! Swap two elements in vRandom.
-    void SwapRandom(unsigned int nRandomPos1, unsigned int nRandomPos2)
-        EXCLUSIVE_LOCKS_REQUIRED(cs);
+    //! Move an entry from the "new" table(s) to the "tried" table. All the
+    //! shards must be locked.
+    void MakeTried(CAddrInfo &info, int nId);
 
-    //! Move an entry from the "new" table(s) to the "tried" table
-    void MakeTried(CAddrInfo &info, int nId) EXCLUSIVE_LOCKS_REQUIRED(cs);
-
-    //! Delete an entry. It must not be in tried, and have refcount 0.
-    void Delete(int nId) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    //! Delete an entry. It must not be in tried, and have refcount 0. Its
+    //! shard must be locked.
+    void Delete(int nId);
 
     //! Clear a position in a "new" table. This is the only place where entries
-    //! are actually deleted.
-    void ClearNew(int nUBucket, int nUBucketPos) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    //! are actually deleted. The shards of the bucket and of the entry there
+    //! must be locked.
+    void ClearNew(int nUBucket, int nUBucketPos);
 
-    //! Mark an entry "good", possibly moving it from "new" to "tried".
+    //! Mark an entry "good", possibly moving it from "new" to "tried". All the
+    //! shards must be locked.
     void Good_(const CService &addr, bool test_before_evict, int64_t time)
-        EXCLUSIVE_LOCKS_REQUIRED(cs);
+        EXCLUSIVE_LOCKS_REQUIRED(m_rand_mutex);
 
     //! Add an entry to the "new" table.
     bool Add_(const CAddress &addr, const CNetAddr &source,
-              int64_t nTimePenalty) EXCLUSIVE_LOCKS_REQUIRED(cs);
+              int64_t nTimePenalty);
 
     //! Mark an entry as attempted to connect.
-    void Attempt_(const CService &addr, bool fCountFailure, int64_t nTime)
-        EXCLUSIVE_LOCKS_REQUIRED(cs);
+    void Attempt_(const CService &addr, bool fCountFailure, int64_t nTime);
+
+    //! Copy the entry at a position of a table, locking the shards of the
+    //! bucket and of the entry in turn. Returns false if there is none.
+    bool CopyEntry(const int nTable[][ADDRMAN_BUCKET_SIZE], int nBucket,
+                   int nBucketPos, CAddrInfo &info) const;
 
     //! Select an address to connect to, if newOnly is set to true, only the new
     //! table is selected from.
-    CAddrInfo Select_(bool newOnly) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    CAddrInfo Select_(bool newOnly) EXCLUSIVE_LOCKS_REQUIRED(m_rand_mutex);
 
     //! See if any to-be-evicted tried table entries have been tested and if so
-    //! resolve the collisions.
-    void ResolveCollisions_() EXCLUSIVE_LOCKS_REQUIRED(cs);
+    //! resolve the collisions. All the shards must be locked.
+    void ResolveCollisions_() EXCLUSIVE_LOCKS_REQUIRED(m_rand_mutex);
 
-    //! Return a random to-be-evicted tried table address.
-    CAddrInfo SelectTriedCollision_() EXCLUSIVE_LOCKS_REQUIRED(cs);
+    //! Return a random to-be-evicted tried table address. All the shards must
+    //! be locked.
+    CAddrInfo SelectTriedCollision_() EXCLUSIVE_LOCKS_REQUIRED(m_rand_mutex);
 
 #ifdef DEBUG_ADDRMAN
-    //! Perform consistency check. Returns an error code or zero.
-    int Check_() EXCLUSIVE_LOCKS_REQUIRED(cs);
+    //! Perform consistency check. Returns an error code or zero. All the
+    //! shards must be locked.
+    int Check_();
 #endif
 
-    //! Select several addresses at once.
-    void GetAddr_(std::vector<CAddress> &vAddr) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    //! Return the latest snapshot, taking a new one if it is outdated.
+    std::shared_ptr<const Snapshot> GetSnapshot();
+
+    //! Select several addresses at once from a snapshot.
+    void GetAddr_(const Snapshot &snapshot, std::vector<CAddress> &vAddr) const;
 
     //! Mark an entry as currently-connected-to.
-    void Connected_(const CService &addr, int64_t nTime)
-        EXCLUSIVE_LOCKS_REQUIRED(cs);
+    void Connected_(const CService &addr, int64_t nTime);
 
     //! Update an entry's service bits.
-    void SetServices_(const CService &addr, ServiceFlags nServices)
-        EXCLUSIVE_LOCKS_REQUIRED(cs);
+    void SetServices_(const CService &addr, ServiceFlags nServices);
 
 public:
     // Compressed IP->ASN mapping, loaded from a file when a node starts.
@@ -321,7 +405,7 @@ public:
     /**
      * serialized format:
      * * version byte (1 for pre-asmap files, 2 for files including asmap
-     * version)
+     * version, 3 for files including the bucket positions)
      * * 0x20 + nKey (serialized as if it were a vector, for backward
      * compatibility)
      * * nNew
@@ -332,6 +416,11 @@ public:
      * * for each bucket:
      *   * number of elements
      *   * for each element: index
+     * * asmap version
+     * * number of "tried" buckets
+     * * bucket size
+     * * for each element of the "new" buckets: position in its bucket
+     * * for each addrinfo in vvTried: bucket and position in it
      *
      * 2**30 is xorred with the number of buckets to make addrman deserializer
      * v0 detect it as incompatible. This is necessary because it did not check
@@ -343,6 +432,10 @@ public:
      * vvNew is serialized, but only used if ADDRMAN_UNKNOWN_BUCKET_COUNT didn't
      * change, otherwise it is reconstructed as well.
      *
+     * The bucket positions are a function of nKey, so they are only stored to
+     * place the entries at startup without hashing each of them again. They
+     * are ignored if the bucket counts or the asmap changed.
+     *
      * This format is more complex, but significantly smaller (at most 1.5 MiB),
      * and supports changes to the ADDRMAN_ parameters without breaking the
      * on-disk structure.
@@ -351,37 +444,42 @@ public:
      * deserialization code has very little in common.
      */
     template <typename Stream> void Serialize(Stream &s) const {
-        LOCK(cs);
+        ShardLock lock(*this, ALL_SHARDS);
 
-        uint8_t nVersion = 2;
+        uint8_t nVersion = 3;
         s << nVersion;
         s << uint8_t(32);
         s << nKey;
-        s << nNew;
-        s << nTried;
+        const int nNewCount = nNew;
+        const int nTriedCount = nTried;
+        s << nNewCount;
+        s << nTriedCount;
 
         int nUBuckets = ADDRMAN_NEW_BUCKET_COUNT ^ (1 << 30);
         s << nUBuckets;
         std::map<int, int> mapUnkIds;
         int nIds = 0;
-        for (const auto &entry : mapInfo) {
-            mapUnkIds[entry.first] = nIds;
-            const CAddrInfo &info = entry.second;
-            if (info.nRefCount) {
-                // this means nNew was wrong, oh ow
-                assert(nIds != nNew);
-                s << info;
-                nIds++;
+        for (const Shard &shard : m_shards) {
+            for (const auto &entry : shard.mapInfo) {
+                mapUnkIds[entry.first] = nIds;
+                const CAddrInfo &info = entry.second;
+                if (info.nRefCount) {
+                    // this means nNew was wrong, oh ow
+                    assert(nIds != nNewCount);
+                    s << info;
+                    nIds++;
+                }
             }
         }
         nIds = 0;
-        for (const auto &entry : mapInfo) {
-            const CAddrInfo &info = entry.second;
-            if (info.fInTried) {
-                // this means nTried was wrong, oh ow
-                assert(nIds != nTried);
-                s << info;
-                nIds++;
+        for (int bucket = 0; bucket < ADDRMAN_TRIED_BUCKET_COUNT; bucket++) {
+            for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
+                if (vvTried[bucket][i] != -1) {
+                    // this means nTried was wrong, oh ow
+                    assert(nIds != nTriedCount);
+                    s << GetInfo(vvTried[bucket][i]);
+                    nIds++;
+                }
             }
         }
         for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
@@ -404,12 +502,32 @@ public:
             asmap_version = SerializeHash(m_asmap);
         }
         s << asmap_version;
+
+        int nKBuckets = ADDRMAN_TRIED_BUCKET_COUNT;
+        int nBucketSize = ADDRMAN_BUCKET_SIZE;
+        s << nKBuckets;
+        s << nBucketSize;
+        for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
+            for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
+                if (vvNew[bucket][i] != -1) {
+                    s << i;
+                }
+            }
+        }
+        for (int bucket = 0; bucket < ADDRMAN_TRIED_BUCKET_COUNT; bucket++) {
+            for (int i = 0; i < ADDRMAN_BUCKET_SIZE; i++) {
+                if (vvTried[bucket][i] != -1) {
+                    s << bucket;
+                    s << i;
+                }
+            }
+        }
     }
 
     template <typename Stream> void Unserialize(Stream &s) {
-        LOCK(cs);
-
         Clear();
+
+        ShardLock lock(*this, ALL_SHARDS);
         uint8_t nVersion;
         s >> nVersion;
         uint8_t nKeySize;
@@ -420,59 +538,50 @@ public:
         }
 
         s >> nKey;
-        s >> nNew;
-        s >> nTried;
+        int nNewCount = 0;
+        int nTriedCount = 0;
+        s >> nNewCount;
+        s >> nTriedCount;
         int nUBuckets = 0;
         s >> nUBuckets;
         if (nVersion != 0) {
             nUBuckets ^= (1 << 30);
         }
 
-        if (nNew > ADDRMAN_NEW_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE) {
+        if (nNewCount > ADDRMAN_NEW_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE) {
             throw std::ios_base::failure(
                 "Corrupt CAddrMan serialization, nNew exceeds limit.");
         }
 
-        if (nTried > ADDRMAN_TRIED_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE) {
+        if (nTriedCount > ADDRMAN_TRIED_BUCKET_COUNT * ADDRMAN_BUCKET_SIZE) {
             throw std::ios_base::failure(
                 "Corrupt CAddrMan serialization, nTried exceeds limit.");
         }
 
-        // Deserialize entries from the new table.
-        for (int n = 0; n < nNew; n++) {
-            CAddrInfo &info = mapInfo[n];
+        // Deserialize entries from the new table, remembering the nId each of
+        // them got in its shard.
+        std::vector<int> vNewIds(nNewCount);
+        for (int n = 0; n < nNewCount; n++) {
+            CAddrInfo info;
             s >> info;
-            mapAddr[info] = n;
-            info.nRandomPos = vRandom.size();
-            vRandom.push_back(n);
+            Create(info, info.source, &vNewIds[n]);
+            GetInfo(vNewIds[n]) = info;
         }
-        nIdCount = nNew;
+        nNew = nNewCount;
 
-        // Deserialize entries from the tried table.
-        int nLost = 0;
-        for (int n = 0; n < nTried; n++) {
-            CAddrInfo info;
-            s >> info;
-            int nKBucket = info.GetTriedBucket(nKey, m_asmap);
-            int nKBucketPos = info.GetBucketPosition(nKey, false, nKBucket);
-            if (vvTried[nKBucket][nKBucketPos] == -1) {
-                info.nRandomPos = vRandom.size();
-                info.fInTried = true;
-                vRandom.push_back(nIdCount);
-                mapInfo[nIdCount] = info;
-                mapAddr[info] = nIdCount;
-                vvTried[nKBucket][nKBucketPos] = nIdCount;
-                nIdCount++;
-            } else {
-                nLost++;
-            }
+        // Deserialize entries from the tried table. They are placed once their
+        // positions, if any, are known.
+        std::vector<CAddrInfo> vTried(nTriedCount);
+        for (int n = 0; n < nTriedCount; n++) {
+            s >> vTried[n];
         }
-        nTried -= nLost;
 
         // Store positions in the new table buckets to apply later (if
         // possible). Represents which entry belonged to which bucket when
         // serializing
         std::map<int, int> entryToBucket;
+        // The index of each element of the new buckets, in order.
+        std::vector<int> vNewIndexes;
 
         for (int bucket = 0; bucket < nUBuckets; bucket++) {
             int nSize = 0;
@@ -480,7 +589,8 @@ public:
             for (int n = 0; n < nSize; n++) {
                 int nIndex = 0;
                 s >> nIndex;
-                if (nIndex >= 0 && nIndex < nNew) {
+                vNewIndexes.push_back(nIndex);
+                if (nIndex >= 0 && nIndex < nNewCount) {
                     entryToBucket[nIndex] = bucket;
                 }
             }
@@ -495,17 +605,85 @@ public:
             s >> serialized_asmap_version;
         }
 
-        for (int n = 0; n < nNew; n++) {
-            CAddrInfo &info = mapInfo[n];
+        // Read the bucket positions, if the buckets did not change since they
+        // were computed.
+        std::map<int, int> entryToPos;
+        std::vector<std::pair<int, int>> vTriedPos;
+        if (nVersion > 2) {
+            int nKBuckets = 0;
+            int nBucketSize = 0;
+            s >> nKBuckets;
+            s >> nBucketSize;
+            const bool fUsePos =
+                nBucketSize == ADDRMAN_BUCKET_SIZE &&
+                serialized_asmap_version == supplied_asmap_version;
+            for (const int nIndex : vNewIndexes) {
+                int nPos = 0;
+                s >> nPos;
+                if (fUsePos && nIndex >= 0 && nIndex < nNewCount) {
+                    entryToPos[nIndex] = nPos;
+                }
+            }
+            for (int n = 0; n < nTriedCount; n++) {
+                int nKBucket = 0;
+                int nKBucketPos = 0;
+                s >> nKBucket;
+                s >> nKBucketPos;
+                if (fUsePos && nKBuckets == ADDRMAN_TRIED_BUCKET_COUNT) {
+                    vTriedPos.emplace_back(nKBucket, nKBucketPos);
+                }
+            }
+        }
+
+        int nLost = 0;
+        for (int n = 0; n < nTriedCount; n++) {
+            const CAddrInfo &info = vTried[n];
+            int nKBucket;
+            int nKBucketPos;
+            if (vTriedPos.empty()) {
+                nKBucket = info.GetTriedBucket(nKey, m_asmap);
+                nKBucketPos = info.GetBucketPosition(nKey, false, nKBucket);
+            } else {
+                std::tie(nKBucket, nKBucketPos) = vTriedPos[n];
+                if (nKBucket < 0 || nKBucket >= ADDRMAN_TRIED_BUCKET_COUNT ||
+                    nKBucketPos < 0 || nKBucketPos >= ADDRMAN_BUCKET_SIZE) {
+                    throw std::ios_base::failure(
+                        "Corrupt CAddrMan serialization, tried position out "
+                        "of range.");
+                }
+            }
+            if (vvTried[nKBucket][nKBucketPos] == -1) {
+                int nId;
+                CAddrInfo &entry = *Create(info, info.source, &nId);
+                entry = info;
+                entry.fInTried = true;
+                vvTried[nKBucket][nKBucketPos] = nId;
+            } else {
+                nLost++;
+            }
+        }
+        nTried = nTriedCount - nLost;
+
+        for (int n = 0; n < nNewCount; n++) {
+            const int nId = vNewIds[n];
+            CAddrInfo &info = GetInfo(nId);
             int bucket = entryToBucket[n];
-            int nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
-            if (nVersion == 2 && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT &&
+            auto pos_it = entryToPos.find(n);
+            int nUBucketPos = pos_it == entryToPos.end()
+                                  ? info.GetBucketPosition(nKey, true, bucket)
+                                  : pos_it->second;
+            if (nUBucketPos < 0 || nUBucketPos >= ADDRMAN_BUCKET_SIZE) {
+                throw std::ios_base::failure(
+                    "Corrupt CAddrMan serialization, new position out of "
+                    "range.");
+            }
+            if (nVersion >= 2 && nUBuckets == ADDRMAN_NEW_BUCKET_COUNT &&
                 vvNew[bucket][nUBucketPos] == -1 &&
                 info.nRefCount < ADDRMAN_NEW_BUCKETS_PER_ADDRESS &&
                 serialized_asmap_version == supplied_asmap_version) {
                 // Bucketing has not changed, using existing bucket positions
                 // for the new table
-                vvNew[bucket][nUBucketPos] = n;
+                vvNew[bucket][nUBucketPos] = nId;
                 info.nRefCount++;
             } else {
                 // In case the new table data cannot be used (nVersion unknown,
@@ -517,7 +695,7 @@ public:
                 bucket = info.GetNewBucket(nKey, m_asmap);
                 nUBucketPos = info.GetBucketPosition(nKey, true, bucket);
                 if (vvNew[bucket][nUBucketPos] == -1) {
-                    vvNew[bucket][nUBucketPos] = n;
+                    vvNew[bucket][nUBucketPos] = nId;
                     info.nRefCount++;
                 }
             }
@@ -525,14 +703,18 @@ public:
 
         // Prune new entries with refcount 0 (as a result of collisions).
         int nLostUnk = 0;
-        for (std::map<int, CAddrInfo>::const_iterator it = mapInfo.begin();
-             it != mapInfo.end();) {
-            if (it->second.fInTried == false && it->second.nRefCount == 0) {
-                std::map<int, CAddrInfo>::const_iterator itCopy = it++;
-                Delete(itCopy->first);
-                nLostUnk++;
-            } else {
-                it++;
+        for (Shard &shard : m_shards) {
+            for (std::map<int, CAddrInfo>::const_iterator it =
+                     shard.mapInfo.begin();
+                 it != shard.mapInfo.end();) {
+                if (it->second.fInTried == false &&
+                    it->second.nRefCount == 0) {
+                    std::map<int, CAddrInfo>::const_iterator itCopy = it++;
+                    Delete(itCopy->first);
+                    nLostUnk++;
+                } else {
+                    it++;
+                }
             }
         }
         if (nLost + nLostUnk > 0) {
@@ -542,12 +724,16 @@ public:
                      nLostUnk, nLost);
         }
 
-        Check();
+#ifdef DEBUG_ADDRMAN
+        if (int err = Check_()) {
+            LogPrintf("ADDRMAN CONSISTENCY CHECK FAILED!!! err=%i\n", err);
+        }
+#endif
     }
 
     void Clear() {
-        LOCK(cs);
-        std::vector<int>().swap(vRandom);
+        LOCK(m_rand_mutex);
+        ShardLock lock(*this, ALL_SHARDS);
         nKey = insecure_rand.rand256();
         for (size_t bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; bucket++) {
             for (size_t entry = 0; entry < ADDRMAN_BUCKET_SIZE; entry++) {
@@ -560,31 +746,33 @@ public:
             }
         }
 
-        nIdCount = 0;
+        for (Shard &shard : m_shards) {
+            shard.nIdCount = 0;
+            shard.mapInfo.clear();
+            shard.mapAddr.clear();
+        }
+        m_entry_count = 0;
         nTried = 0;
         nNew = 0;
         // Initially at 1 so that "never" is strictly worse.
         nLastGood = 1;
-        mapInfo.clear();
-        mapAddr.clear();
+        m_tried_collisions.clear();
+        m_version++;
+        std::atomic_store(&m_snapshot, std::shared_ptr<const Snapshot>());
     }
 
-    CAddrMan() { Clear(); }
+    CAddrMan();
 
     ~CAddrMan() { nKey.SetNull(); }
 
     //! Return the number of (unique) addresses in all tables.
-    size_t size() const {
-        // TODO: Cache this in an atomic to avoid this overhead
-        LOCK(cs);
-        return vRandom.size();
-    }
+    size_t size() const { return m_entry_count; }
 
     //! Consistency check
     void Check() {
 #ifdef DEBUG_ADDRMAN
         {
-            LOCK(cs);
+            ShardLock lock(*this, ALL_SHARDS);
             int err;
             if ((err = Check_())) {
                 LogPrintf("ADDRMAN CONSISTENCY CHECK FAILED!!! err=%i\n", err);
@@ -596,7 +784,6 @@ public:
     //! Add a single address.
     bool Add(const CAddress &addr, const CNetAddr &source,
              int64_t nTimePenalty = 0) {
-        LOCK(cs);
         bool fRet = false;
         Check();
         fRet |= Add_(addr, source, nTimePenalty);
@@ -611,7 +798,6 @@ public:
     //! Add multiple addresses.
     bool Add(const std::vector<CAddress> &vAddr, const CNetAddr &source,
              int64_t nTimePenalty = 0) {
-        LOCK(cs);
         int nAdd = 0;
         Check();
         for (const CAddress &a : vAddr) {
@@ -629,16 +815,18 @@ public:
     //! Mark an entry as accessible.
     void Good(const CService &addr, bool test_before_evict = true,
               int64_t nTime = GetAdjustedTime()) {
-        LOCK(cs);
         Check();
-        Good_(addr, test_before_evict, nTime);
+        {
+            LOCK(m_rand_mutex);
+            ShardLock lock(*this, ALL_SHARDS);
+            Good_(addr, test_before_evict, nTime);
+        }
         Check();
     }
 
     //! Mark an entry as connection attempted to.
     void Attempt(const CService &addr, bool fCountFailure,
                  int64_t nTime = GetAdjustedTime()) {
-        LOCK(cs);
         Check();
         Attempt_(addr, fCountFailure, nTime);
         Check();
@@ -647,9 +835,12 @@ public:
     //! See if any to-be-evicted tried table entries have been tested and if so
     //! resolve the collisions.
     void ResolveCollisions() {
-        LOCK(cs);
         Check();
-        ResolveCollisions_();
+        {
+            LOCK(m_rand_mutex);
+            ShardLock lock(*this, ALL_SHARDS);
+            ResolveCollisions_();
+        }
         Check();
     }
 
@@ -657,12 +848,13 @@ public:
     //! to evict.
     CAddrInfo SelectTriedCollision() {
         CAddrInfo ret;
+        Check();
         {
-            LOCK(cs);
-            Check();
+            LOCK(m_rand_mutex);
+            ShardLock lock(*this, ALL_SHARDS);
             ret = SelectTriedCollision_();
-            Check();
         }
+        Check();
         return ret;
     }
 
@@ -671,12 +863,12 @@ public:
      */
     CAddrInfo Select(bool newOnly = false) {
         CAddrInfo addrRet;
+        Check();
         {
-            LOCK(cs);
-            Check();
+            LOCK(m_rand_mutex);
             addrRet = Select_(newOnly);
-            Check();
         }
+        Check();
         return addrRet;
     }
 
@@ -684,24 +876,19 @@ public:
     std::vector<CAddress> GetAddr() {
         Check();
         std::vector<CAddress> vAddr;
-        {
-            LOCK(cs);
-            GetAddr_(vAddr);
-        }
+        GetAddr_(*GetSnapshot(), vAddr);
         Check();
         return vAddr;
     }
 
     //! Mark an entry as currently-connected-to.
     void Connected(const CService &addr, int64_t nTime = GetAdjustedTime()) {
-        LOCK(cs);
         Check();
         Connected_(addr, nTime);
         Check();
     }
 
     void SetServices(const CService &addr, ServiceFlags nServices) {
-        LOCK(cs);
         Check();
         SetServices_(addr, nServices);
         Check();
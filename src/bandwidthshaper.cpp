@@ -0,0 +1,133 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bandwidthshaper.h>
+
+#include <protocol.h>
+
+#include <algorithm>
+#include <cassert>
+#include <limits>
+
+TrafficClass GetTrafficClass(const std::string &msg_type) {
+    if (msg_type == NetMsgType::BLOCK || msg_type == NetMsgType::CMPCTBLOCK ||
+        msg_type == NetMsgType::BLOCKTXN || msg_type == NetMsgType::GRBLK ||
+        msg_type == NetMsgType::MERKLEBLOCK) {
+        return TrafficClass::RECENT_BLOCKS;
+    }
+    if (msg_type == NetMsgType::TX || msg_type == NetMsgType::INV ||
+        msg_type == NetMsgType::NOTFOUND ||
+        msg_type == NetMsgType::REQTXRCNCL || msg_type == NetMsgType::SKETCH ||
+        msg_type == NetMsgType::RECONCILDIFF) {
+        return TrafficClass::TRANSACTIONS;
+    }
+    if (msg_type == NetMsgType::ADDR || msg_type == NetMsgType::GETADDR) {
+        return TrafficClass::ADDR;
+    }
+    if (msg_type == NetMsgType::CFILTER || msg_type == NetMsgType::CFHEADERS ||
+        msg_type == NetMsgType::CFCHECKPT) {
+        return TrafficClass::FILTERS;
+    }
+    if (msg_type == NetMsgType::AVAPOLL ||
+        msg_type == NetMsgType::AVARESPONSE) {
+        return TrafficClass::AVALANCHE;
+    }
+    return TrafficClass::OTHER;
+}
+
+bool ParseTrafficClass(const std::string &str, TrafficClass &traffic_class) {
+    for (size_t i = 0; i < NUM_TRAFFIC_CLASSES; i++) {
+        if (str == TrafficClassToString(static_cast<TrafficClass>(i))) {
+            traffic_class = static_cast<TrafficClass>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string TrafficClassToString(TrafficClass traffic_class) {
+    switch (traffic_class) {
+        case TrafficClass::HISTORICAL_BLOCKS:
+            return "historicalblocks";
+        case TrafficClass::RECENT_BLOCKS:
+            return "recentblocks";
+        case TrafficClass::TRANSACTIONS:
+            return "transactions";
+        case TrafficClass::ADDR:
+            return "addr";
+        case TrafficClass::FILTERS:
+            return "filters";
+        case TrafficClass::AVALANCHE:
+            return "avalanche";
+        case TrafficClass::OTHER:
+            return "other";
+    }
+    assert(false);
+}
+
+void TokenBucket::SetRate(uint64_t rate, uint64_t burst) {
+    m_rate = rate;
+    m_burst = burst;
+    m_level = burst;
+    m_last_refill = 0;
+}
+
+void TokenBucket::Refill(int64_t nTimeMicros) {
+    if (m_last_refill != 0 && nTimeMicros > m_last_refill) {
+        m_level = std::min<double>(
+            m_burst, m_level + double(nTimeMicros - m_last_refill) * m_rate /
+                                   1000000);
+    }
+    m_last_refill = std::max(m_last_refill, nTimeMicros);
+}
+
+uint64_t TokenBucket::GetAvailable(int64_t nTimeMicros) {
+    if (!IsLimited()) {
+        return std::numeric_limits<uint64_t>::max();
+    }
+    Refill(nTimeMicros);
+    return m_level > 0 ? uint64_t(m_level) : 0;
+}
+
+void TokenBucket::Consume(uint64_t nBytes, int64_t nTimeMicros) {
+    if (!IsLimited()) {
+        return;
+    }
+    Refill(nTimeMicros);
+    m_level -= nBytes;
+}
+
+void BandwidthShaper::SetRate(TrafficClass traffic_class, uint64_t rate) {
+    LOCK(m_mutex);
+    const size_t i = static_cast<size_t>(traffic_class);
+    // Allow bursts of up to one second of traffic.
+    m_buckets[i].SetRate(rate, rate);
+    m_rates[i] = rate;
+    m_active = std::any_of(m_rates.begin(), m_rates.end(),
+                           [](uint64_t r) { return r > 0; });
+}
+
+uint64_t BandwidthShaper::GetRate(TrafficClass traffic_class) const {
+    LOCK(m_mutex);
+    return m_rates[static_cast<size_t>(traffic_class)];
+}
+
+BandwidthShaper::ByteCounts
+BandwidthShaper::GetAvailable(int64_t nTimeMicros) {
+    ByteCounts available;
+    LOCK(m_mutex);
+    for (size_t i = 0; i < NUM_TRAFFIC_CLASSES; i++) {
+        available[i] = m_buckets[i].GetAvailable(nTimeMicros);
+    }
+    return available;
+}
+
+void BandwidthShaper::Consume(const ByteCounts &sent, int64_t nTimeMicros) {
+    LOCK(m_mutex);
+    for (size_t i = 0; i < NUM_TRAFFIC_CLASSES; i++) {
+        if (sent[i] > 0) {
+            m_buckets[i].Consume(sent[i], nTimeMicros);
+        }
+    }
+}
@@ -0,0 +1,98 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BANDWIDTHSHAPER_H
+#define BITCOIN_BANDWIDTHSHAPER_H
+
+#include <sync.h>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/** The classes of outbound traffic which can be rate limited separately */
+enum class TrafficClass {
+    //! Blocks older than a week, typically served to syncing peers.
+    HISTORICAL_BLOCKS,
+    RECENT_BLOCKS,
+    TRANSACTIONS,
+    ADDR,
+    FILTERS,
+    AVALANCHE,
+    //! Everything else, e.g. version handshake, headers and pings.
+    OTHER,
+};
+
+static constexpr size_t NUM_TRAFFIC_CLASSES =
+    static_cast<size_t>(TrafficClass::OTHER) + 1;
+
+/**
+ * Return the traffic class of a message type. Blocks are always considered
+ * recent, the caller knows better.
+ */
+TrafficClass GetTrafficClass(const std::string &msg_type);
+
+/** Return the class matching a -uploadrate name, false if there is none */
+bool ParseTrafficClass(const std::string &str, TrafficClass &traffic_class);
+std::string TrafficClassToString(TrafficClass traffic_class);
+
+/**
+ * A token bucket, refilled at a constant rate up to a maximum burst.
+ *
+ * The level may go below zero when more bytes are sent than were available,
+ * e.g. when several threads share the bucket; the debt is then paid back
+ * before anything else can be sent. A bucket with a zero rate is unlimited.
+ * This class is not thread safe.
+ */
+class TokenBucket {
+public:
+    TokenBucket() = default;
+
+    /** Set the rate in bytes per second, and the burst size in bytes */
+    void SetRate(uint64_t rate, uint64_t burst);
+    bool IsLimited() const { return m_rate > 0; }
+
+    /** Return the number of bytes which can be sent at the given time */
+    uint64_t GetAvailable(int64_t nTimeMicros);
+    void Consume(uint64_t nBytes, int64_t nTimeMicros);
+
+private:
+    uint64_t m_rate{0};
+    uint64_t m_burst{0};
+    double m_level{0};
+    int64_t m_last_refill{0};
+
+    void Refill(int64_t nTimeMicros);
+};
+
+/**
+ * The outbound bandwidth limits of each traffic class, shared by all the
+ * peers.
+ */
+class BandwidthShaper {
+public:
+    using ByteCounts = std::array<uint64_t, NUM_TRAFFIC_CLASSES>;
+
+    /** Limit a traffic class to rate bytes per second, 0 for unlimited */
+    void SetRate(TrafficClass traffic_class, uint64_t rate);
+    uint64_t GetRate(TrafficClass traffic_class) const;
+
+    /** Whether any traffic class is limited */
+    bool IsActive() const { return m_active; }
+
+    /** Return the number of bytes each traffic class can send */
+    ByteCounts GetAvailable(int64_t nTimeMicros);
+    /** Account for the bytes sent in each traffic class */
+    void Consume(const ByteCounts &sent, int64_t nTimeMicros);
+
+private:
+    mutable Mutex m_mutex;
+    std::array<TokenBucket, NUM_TRAFFIC_CLASSES> m_buckets GUARDED_BY(m_mutex);
+    ByteCounts m_rates GUARDED_BY(m_mutex){};
+    std::atomic<bool> m_active{false};
+};
+
+#endif // BITCOIN_BANDWIDTHSHAPER_H
@@ -0,0 +1,157 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <addrman.h>
+#include <bench/bench.h>
+#include <random.h>
+#include <streams.h>
+#include <util/time.h>
+
+#include <thread>
+#include <vector>
+
+/* A "source" is a source address from which we have received a bunch of other
+ * addresses. */
+
+static constexpr size_t NUM_SOURCES = 64;
+static constexpr size_t NUM_ADDRESSES_PER_SOURCE = 256;
+static constexpr size_t NUM_THREADS = 4;
+
+static std::vector<CAddress> g_sources;
+static std::vector<std::vector<CAddress>> g_addresses;
+
+static CAddress RandomAddress(FastRandomContext &rng) {
+    in_addr addr;
+    // Avoid the reserved and private ranges.
+    addr.s_addr = htonl(0x05000000 + rng.randrange(0xC0000000));
+    CAddress ret(CService(addr, 8333), NODE_NETWORK);
+    // Old enough to be refreshed when announced again.
+    ret.nTime = GetAdjustedTime() - 20 * 24 * 60 * 60;
+    return ret;
+}
+
+static void CreateAddresses() {
+    if (g_sources.size() > 0) {
+        return;
+    }
+
+    FastRandomContext rng(uint256(std::vector<uint8_t>(32, 123)));
+    for (size_t source_i = 0; source_i < NUM_SOURCES; ++source_i) {
+        g_sources.emplace_back(RandomAddress(rng));
+        g_addresses.emplace_back();
+        for (size_t addr_i = 0; addr_i < NUM_ADDRESSES_PER_SOURCE; ++addr_i) {
+            g_addresses[source_i].emplace_back(RandomAddress(rng));
+        }
+    }
+}
+
+static void FillAddrMan(CAddrMan &addrman) {
+    CreateAddresses();
+    for (size_t source_i = 0; source_i < NUM_SOURCES; ++source_i) {
+        addrman.Add(g_addresses[source_i], g_sources[source_i]);
+    }
+}
+
+static void AddrManAdd(benchmark::State &state) {
+    CreateAddresses();
+    CAddrMan addrman;
+    while (state.KeepRunning()) {
+        FillAddrMan(addrman);
+        addrman.Clear();
+    }
+}
+
+static void AddrManSelect(benchmark::State &state) {
+    CAddrMan addrman;
+    FillAddrMan(addrman);
+    while (state.KeepRunning()) {
+        const CAddress &address = addrman.Select();
+        assert(address.GetPort() > 0);
+    }
+}
+
+static void AddrManGetAddr(benchmark::State &state) {
+    CAddrMan addrman;
+    FillAddrMan(addrman);
+    while (state.KeepRunning()) {
+        const std::vector<CAddress> addresses = addrman.GetAddr();
+        assert(addresses.size() > 0);
+    }
+}
+
+// Relay addresses from several threads, as when many peers send addr messages,
+// while another one selects addresses to connect to, as ThreadOpenConnections.
+static void AddrManAddSelectConcurrent(benchmark::State &state) {
+    CAddrMan addrman;
+    FillAddrMan(addrman);
+    int64_t time_offset = 0;
+    while (state.KeepRunning()) {
+        time_offset += 2 * 60 * 60;
+        std::vector<std::thread> threads;
+        for (size_t thread_i = 0; thread_i < NUM_THREADS; thread_i++) {
+            threads.emplace_back([&addrman, thread_i, time_offset] {
+                for (size_t source_i = thread_i; source_i < NUM_SOURCES;
+                     source_i += NUM_THREADS) {
+                    // Announce the addresses again as if they were fresher,
+                    // and from another source.
+                    std::vector<CAddress> addresses = g_addresses[source_i];
+                    for (CAddress &address : addresses) {
+                        address.nTime += time_offset;
+                    }
+                    addrman.Add(addresses,
+                                g_sources[(source_i + 1) % NUM_SOURCES]);
+                }
+            });
+        }
+        threads.emplace_back([&addrman] {
+            for (int i = 0; i < 1000; i++) {
+                addrman.Select();
+            }
+        });
+        for (std::thread &thread : threads) {
+            thread.join();
+        }
+    }
+}
+
+static void FillAddrManWithTried(CAddrMan &addrman) {
+    FillAddrMan(addrman);
+    // Mark some of the addresses as good, so that the tried table is used.
+    for (size_t source_i = 0; source_i < NUM_SOURCES; ++source_i) {
+        for (size_t addr_i = 0; addr_i < NUM_ADDRESSES_PER_SOURCE;
+             addr_i += 8) {
+            addrman.Good(g_addresses[source_i][addr_i]);
+        }
+    }
+}
+
+static void AddrManSerialize(benchmark::State &state) {
+    CAddrMan addrman;
+    FillAddrManWithTried(addrman);
+    while (state.KeepRunning()) {
+        CDataStream stream(SER_DISK, CLIENT_VERSION);
+        stream << addrman;
+        assert(stream.size() > 0);
+    }
+}
+
+static void AddrManDeserialize(benchmark::State &state) {
+    CAddrMan addrman;
+    FillAddrManWithTried(addrman);
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    stream << addrman;
+    while (state.KeepRunning()) {
+        CDataStream copy(stream);
+        CAddrMan loaded;
+        copy >> loaded;
+        assert(loaded.size() == addrman.size());
+    }
+}
+
+BENCHMARK(AddrManAdd, 5);
+BENCHMARK(AddrManSelect, 1000000);
+BENCHMARK(AddrManGetAddr, 500);
+BENCHMARK(AddrManAddSelectConcurrent, 10);
+BENCHMARK(AddrManSerialize, 10);
+BENCHMARK(AddrManDeserialize, 5);
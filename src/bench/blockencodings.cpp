@@ -0,0 +1,112 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <blockencodings.h>
+#include <config.h>
+#include <random.h>
+#include <streams.h>
+#include <txmempool.h>
+#include <validation.h>
+#include <version.h>
+
+#include <algorithm>
+#include <cassert>
+
+/** Number of transactions in the block, all of which are in the mempool */
+static constexpr size_t BLOCK_TX_COUNT = 2000;
+
+/**
+ * Fill a mempool of the given size, in which the transactions of the block
+ * are spread evenly so the whole mempool is scanned.
+ */
+static CBlock BuildBlockAndMempool(CTxMemPool &pool, size_t mempool_size)
+    EXCLUSIVE_LOCKS_REQUIRED(pool.cs) {
+    FastRandomContext rng(true);
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx.vout[0].nValue = 10 * COIN;
+
+    CBlock block;
+    block.nBits = 0x207fffff;
+    block.vtx.push_back(MakeTransactionRef(tx));
+    for (size_t i = 0; i < mempool_size; i++) {
+        tx.vin[0].prevout = COutPoint(TxId(rng.rand256()), 0);
+        const CTransactionRef ref = MakeTransactionRef(tx);
+        pool.addUnchecked(
+            CTxMemPoolEntry(ref, 1000 * SATOSHI, 0, 1, false, 1, LockPoints()));
+        if ((i + 1) % (mempool_size / BLOCK_TX_COUNT) == 0) {
+            block.vtx.push_back(ref);
+        }
+    }
+    std::sort(block.vtx.begin() + 1, block.vtx.end(),
+              [](const CTransactionRef &a, const CTransactionRef &b) {
+                  return a->GetId() < b->GetId();
+              });
+    return block;
+}
+
+// Reconstruct a compact block from a mempool of the given size.
+static void ReconstructCompactBlock(benchmark::State &state,
+                                    size_t mempool_size) {
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    const CBlock block = BuildBlockAndMempool(pool, mempool_size);
+
+    const CBlockHeaderAndShortTxIDs cmpctblock(block);
+    const std::vector<std::pair<TxHash, CTransactionRef>> extra_txns;
+    while (state.KeepRunning()) {
+        PartiallyDownloadedBlock partial_block(GetConfig(), &pool);
+        bool ok = partial_block.InitData(cmpctblock, extra_txns) ==
+                  READ_STATUS_OK;
+        assert(ok);
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            assert(partial_block.IsTxAvailable(i));
+        }
+    }
+}
+
+static void ReconstructCompactBlock10k(benchmark::State &state) {
+    ReconstructCompactBlock(state, 10000);
+}
+
+static void ReconstructCompactBlock100k(benchmark::State &state) {
+    ReconstructCompactBlock(state, 100000);
+}
+
+static void ReconstructCompactBlock500k(benchmark::State &state) {
+    ReconstructCompactBlock(state, 500000);
+}
+
+// Encode a block as a graphene block and reconstruct it from a mempool of
+// 100k transactions, and check that it is smaller than a compact block.
+static void ReconstructGrapheneBlock100k(benchmark::State &state) {
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    const CBlock block = BuildBlockAndMempool(pool, 100000);
+    assert(CGrapheneBlock::CanEncode(block));
+
+    const std::vector<std::pair<TxHash, CTransactionRef>> extra_txns;
+    while (state.KeepRunning()) {
+        const CGrapheneBlock grblock(block, pool.size());
+        assert(GetSerializeSize(grblock, PROTOCOL_VERSION) <
+               GetSerializeSize(CBlockHeaderAndShortTxIDs(block),
+                                PROTOCOL_VERSION));
+        PartiallyDownloadedBlock partial_block(GetConfig(), &pool);
+        bool ok =
+            partial_block.InitData(grblock, extra_txns) == READ_STATUS_OK;
+        assert(ok);
+        for (size_t i = 0; i < block.vtx.size(); i++) {
+            assert(partial_block.IsTxAvailable(i));
+        }
+    }
+}
+
+BENCHMARK(ReconstructCompactBlock10k, 1000);
+BENCHMARK(ReconstructCompactBlock100k, 100);
+BENCHMARK(ReconstructCompactBlock500k, 20);
+BENCHMARK(ReconstructGrapheneBlock100k, 20);
@@ -0,0 +1,91 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <config.h>
+#include <consensus/validation.h>
+#include <pow/pow.h>
+#include <test/util/setup_common.h>
+#include <validation.h>
+#include <versionbits.h>
+
+#include <cassert>
+#include <vector>
+
+/**
+ * Mine a chain of headers on top of the tip, split into batches of the size
+ * of a headers message.
+ */
+static std::vector<std::vector<CBlockHeader>>
+MineHeaders(const Consensus::Params &params, size_t num_batches) {
+    const CBlockIndex *tip = WITH_LOCK(cs_main, return ::ChainActive().Tip());
+    BlockHash prev = tip->GetBlockHash();
+    uint32_t time = tip->nTime;
+
+    std::vector<std::vector<CBlockHeader>> batches(num_batches);
+    for (std::vector<CBlockHeader> &headers : batches) {
+        headers.resize(MAX_HEADERS_RESULTS);
+        for (CBlockHeader &header : headers) {
+            header.nVersion = VERSIONBITS_TOP_BITS;
+            header.hashPrevBlock = prev;
+            header.nTime = ++time;
+            header.nBits = tip->nBits;
+            while (!CheckProofOfWork(header.GetHash(), header.nBits, params)) {
+                header.nNonce++;
+            }
+            prev = header.GetHash();
+        }
+    }
+    return batches;
+}
+
+// Sync headers the way they were before the pipeline: one at a time under
+// cs_main, hashing each of them several times.
+static void HeadersSyncSerial(benchmark::State &state) {
+    const Config &config = GetConfig();
+    const std::vector<std::vector<CBlockHeader>> batches = MineHeaders(
+        config.GetChainParams().GetConsensus(),
+        state.m_num_evals * state.m_num_iters);
+    fCheckBlockIndex = false;
+
+    auto batch = batches.begin();
+    while (state.KeepRunning()) {
+        LOCK(cs_main);
+        for (const CBlockHeader &header : *batch) {
+            BlockValidationState validation_state;
+            CBlockIndex *pindex = nullptr;
+            bool accepted = g_chainman.m_blockman.AcceptBlockHeader(
+                config, header, validation_state, &pindex);
+            assert(accepted);
+        }
+        ++batch;
+    }
+}
+
+// Sync a regtest chain of 1M headers (with the default 5 evaluations) through
+// ProcessNewBlockHeaders, which checks the proof of work of each batch on the
+// header checking threads before committing it.
+static void HeadersSyncParallel(benchmark::State &state) {
+    const Config &config = GetConfig();
+    const std::vector<std::vector<CBlockHeader>> batches = MineHeaders(
+        config.GetChainParams().GetConsensus(),
+        state.m_num_evals * state.m_num_iters);
+    fCheckBlockIndex = false;
+
+    auto batch = batches.begin();
+    while (state.KeepRunning()) {
+        BlockValidationState validation_state;
+        bool accepted =
+            g_chainman.ProcessNewBlockHeaders(config, *batch, validation_state);
+        assert(accepted);
+        ++batch;
+    }
+    assert(WITH_LOCK(cs_main, return pindexBestHeader->nHeight) ==
+           int(batches.size() * MAX_HEADERS_RESULTS));
+}
+
+BENCHMARK(HeadersSyncSerial, 100);
+BENCHMARK(HeadersSyncParallel, 100);
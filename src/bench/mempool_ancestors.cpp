@@ -0,0 +1,110 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <policy/mempool.h>
+#include <policy/policy.h>
+#include <txmempool.h>
+
+#include <limits>
+#include <vector>
+
+static void AddTx(const CTransactionRef &tx, CTxMemPool &pool)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs) {
+    int64_t nTime = 0;
+    unsigned int nHeight = 1;
+    bool spendsCoinbase = false;
+    unsigned int sigOpCost = 1;
+    LockPoints lp;
+    pool.addUnchecked(CTxMemPoolEntry(tx, 1000 * SATOSHI, nTime, nHeight,
+                                      spendsCoinbase, sigOpCost, lp));
+}
+
+/**
+ * Build a single chain of chain_length unconfirmed transactions, each one
+ * spending the only output of the previous one.
+ */
+static std::vector<CTransactionRef> CreateChain(size_t chain_length) {
+    std::vector<CTransactionRef> chain;
+    chain.reserve(chain_length);
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << OP_1;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    tx.vout[0].nValue = 10 * COIN;
+    chain.push_back(MakeTransactionRef(tx));
+
+    for (size_t i = 1; i < chain_length; ++i) {
+        tx.vin[0].prevout = COutPoint(chain.back()->GetId(), 0);
+        tx.vout[0].nValue -= 1000 * SATOSHI;
+        chain.push_back(MakeTransactionRef(tx));
+    }
+
+    return chain;
+}
+
+static CTxMemPoolEntry MakeChildEntry(const CTransactionRef &parent) {
+    CMutableTransaction child;
+    child.vin.resize(1);
+    child.vin[0].prevout = COutPoint(parent->GetId(), 0);
+    child.vin[0].scriptSig = CScript() << OP_1;
+    child.vout.resize(1);
+    child.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+    child.vout[0].nValue = parent->vout[0].nValue - 1000 * SATOSHI;
+
+    LockPoints lp;
+    return CTxMemPoolEntry(MakeTransactionRef(child), 1000 * SATOSHI, 0, 1,
+                           false, 1, lp);
+}
+
+// Compute the ancestors of a transaction extending a long unconfirmed chain,
+// with limits that are large enough for the whole chain to be walked.
+static void MempoolAncestorsLongChain(benchmark::State &state) {
+    const size_t chain_length = 1000;
+    std::vector<CTransactionRef> chain = CreateChain(chain_length);
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    for (const auto &tx : chain) {
+        AddTx(tx, pool);
+    }
+
+    const CTxMemPoolEntry entry = MakeChildEntry(chain.back());
+    const uint64_t limit = std::numeric_limits<uint64_t>::max();
+    while (state.KeepRunning()) {
+        CTxMemPool::setEntries setAncestors;
+        std::string errString;
+        bool ok = pool.CalculateMemPoolAncestors(
+            entry, setAncestors, limit, limit, limit, limit, errString);
+        assert(ok);
+        assert(setAncestors.size() == chain_length);
+    }
+}
+
+// Compute the ancestors of a transaction extending a long unconfirmed chain,
+// with the default policy limits, so that the transaction gets rejected.
+static void MempoolAncestorsLongChainRejected(benchmark::State &state) {
+    const size_t chain_length = 1000;
+    std::vector<CTransactionRef> chain = CreateChain(chain_length);
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    for (const auto &tx : chain) {
+        AddTx(tx, pool);
+    }
+
+    const CTxMemPoolEntry entry = MakeChildEntry(chain.back());
+    while (state.KeepRunning()) {
+        CTxMemPool::setEntries setAncestors;
+        std::string errString;
+        bool ok = pool.CalculateMemPoolAncestors(
+            entry, setAncestors, DEFAULT_ANCESTOR_LIMIT,
+            DEFAULT_ANCESTOR_SIZE_LIMIT * 1000, DEFAULT_DESCENDANT_LIMIT,
+            DEFAULT_DESCENDANT_SIZE_LIMIT * 1000, errString);
+        assert(!ok);
+    }
+}
+
+BENCHMARK(MempoolAncestorsLongChain, 100);
+BENCHMARK(MempoolAncestorsLongChainRejected, 100 * 1000);
@@ -0,0 +1,154 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <compat.h>
+#include <netbase.h>
+#include <socketevents.h>
+#include <util/system.h>
+
+#ifdef USE_EPOLL
+
+#include <poll.h>
+
+#include <cassert>
+#include <vector>
+
+namespace {
+
+/** Pairs of connected loopback TCP sockets, as seen by a listening node */
+class LoopbackConnections {
+public:
+    explicit LoopbackConnections(size_t count) {
+        // Each connection uses two file descriptors.
+        assert(RaiseFileDescriptorLimit(2 * count + 64) >= int(2 * count));
+
+        SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        assert(listener != INVALID_SOCKET);
+        struct sockaddr_in addr {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        addr.sin_port = 0;
+        socklen_t len = sizeof(addr);
+        assert(bind(listener, reinterpret_cast<struct sockaddr *>(&addr),
+                    len) == 0);
+        assert(listen(listener, SOMAXCONN) == 0);
+        assert(getsockname(listener, reinterpret_cast<struct sockaddr *>(&addr),
+                           &len) == 0);
+
+        for (size_t i = 0; i < count; i++) {
+            SOCKET client = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+            assert(client != INVALID_SOCKET);
+            assert(connect(client, reinterpret_cast<struct sockaddr *>(&addr),
+                           sizeof(addr)) == 0);
+            SOCKET server = accept(listener, nullptr, nullptr);
+            assert(server != INVALID_SOCKET);
+            assert(SetSocketNonBlocking(server, true));
+            clients.push_back(client);
+            servers.push_back(server);
+        }
+        CloseSocket(listener);
+    }
+
+    ~LoopbackConnections() {
+        for (SOCKET &socket : clients) {
+            CloseSocket(socket);
+        }
+        for (SOCKET &socket : servers) {
+            CloseSocket(socket);
+        }
+    }
+
+    //! Make one connection readable on the listening side, in turn.
+    void SendOne() {
+        const char byte = 0;
+        assert(send(clients[m_next], &byte, 1, MSG_NOSIGNAL) == 1);
+        m_next = (m_next + 1) % clients.size();
+    }
+
+    static void ReceiveOne(SOCKET socket) {
+        char byte;
+        assert(recv(socket, &byte, 1, MSG_DONTWAIT) == 1);
+    }
+
+    std::vector<SOCKET> clients;
+    std::vector<SOCKET> servers;
+
+private:
+    size_t m_next{0};
+};
+
+} // namespace
+
+// Wait for a single active connection among many with poll(), rebuilding the
+// set of sockets for each wait as CConnman::SocketEvents does.
+static void SocketEventsPoll(benchmark::State &state, size_t count) {
+    LoopbackConnections connections(count);
+    while (state.KeepRunning()) {
+        connections.SendOne();
+
+        std::vector<struct pollfd> pollfds;
+        pollfds.reserve(count);
+        for (SOCKET socket : connections.servers) {
+            struct pollfd entry {};
+            entry.fd = socket;
+            entry.events = POLLIN;
+            pollfds.push_back(entry);
+        }
+        assert(poll(pollfds.data(), pollfds.size(), 1000) == 1);
+        for (const struct pollfd &entry : pollfds) {
+            if (entry.revents & POLLIN) {
+                LoopbackConnections::ReceiveOne(entry.fd);
+            }
+        }
+    }
+}
+
+// Wait for a single active connection among many with a persistent epoll set.
+static void SocketEventsEpoll(benchmark::State &state, size_t count) {
+    LoopbackConnections connections(count);
+    EpollSocketEvents events;
+    assert(events.IsValid());
+    for (size_t i = 0; i < count; i++) {
+        assert(events.Add(connections.servers[i], i));
+    }
+
+    std::vector<EpollSocketEvents::Event> ready;
+    while (state.KeepRunning()) {
+        connections.SendOne();
+
+        // Send events are reported too, skip them.
+        bool received = false;
+        while (!received) {
+            assert(events.Wait(ready, 1000) && !ready.empty());
+            for (const EpollSocketEvents::Event &event : ready) {
+                if (event.recv) {
+                    LoopbackConnections::ReceiveOne(
+                        connections.servers[event.id]);
+                    received = true;
+                }
+            }
+        }
+    }
+}
+
+static void SocketEventsPoll100(benchmark::State &state) {
+    SocketEventsPoll(state, 100);
+}
+static void SocketEventsPoll1000(benchmark::State &state) {
+    SocketEventsPoll(state, 1000);
+}
+static void SocketEventsEpoll100(benchmark::State &state) {
+    SocketEventsEpoll(state, 100);
+}
+static void SocketEventsEpoll1000(benchmark::State &state) {
+    SocketEventsEpoll(state, 1000);
+}
+
+BENCHMARK(SocketEventsPoll100, 20000);
+BENCHMARK(SocketEventsPoll1000, 2000);
+BENCHMARK(SocketEventsEpoll100, 50000);
+BENCHMARK(SocketEventsEpoll1000, 50000);
+
+#endif // USE_EPOLL
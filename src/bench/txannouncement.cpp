@@ -0,0 +1,66 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <random.h>
+#include <txannouncement.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <cassert>
+#include <vector>
+
+static constexpr size_t NUM_TXS = 5000;
+static constexpr NodeId NUM_PEERS = 125;
+/** As many as a peer is announced at once with 8MB blocks */
+static constexpr size_t MAX_ANNOUNCED = 280;
+
+// Announce a large backlog of transactions to many peers: each peer only reads
+// the few transactions it is due, whatever the size of the backlog.
+static void TxAnnouncementRead(benchmark::State &state) {
+    FastRandomContext rng(true);
+    CTxMemPool pool;
+    std::vector<TxId> txids;
+    {
+        LOCK2(cs_main, pool.cs);
+        for (size_t i = 0; i < NUM_TXS; i++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(TxId(rng.rand256()), 0);
+            tx.vin[0].scriptSig = CScript() << OP_1;
+            tx.vout.resize(1);
+            tx.vout[0].scriptPubKey = CScript() << OP_1 << OP_EQUAL;
+            tx.vout[0].nValue = 10 * COIN;
+            const Amount fee = int64_t(1000 + rng.randrange(1000)) * SATOSHI;
+            LockPoints lp;
+            pool.addUnchecked(CTxMemPoolEntry(MakeTransactionRef(tx), fee, 0,
+                                              1, false, 1, lp));
+            txids.push_back(tx.GetId());
+        }
+    }
+
+    TxAnnouncementScheduler scheduler;
+    for (NodeId peer = 0; peer < NUM_PEERS; peer++) {
+        scheduler.RegisterPeer(peer);
+    }
+    std::chrono::microseconds now{0};
+    while (state.KeepRunning()) {
+        for (const TxId &txid : txids) {
+            scheduler.Add(txid);
+        }
+        now += TX_ANNOUNCEMENT_BATCH_INTERVAL;
+        size_t announced = 0;
+        for (NodeId peer = 0; peer < NUM_PEERS; peer++) {
+            scheduler.Read(peer, pool, now, MAX_ANNOUNCED,
+                           [&announced](const TxAnnouncement &) {
+                               announced++;
+                               return true;
+                           });
+            scheduler.SkipAll(peer);
+        }
+        assert(announced == NUM_PEERS * MAX_ANNOUNCED);
+    }
+}
+
+BENCHMARK(TxAnnouncementRead, 5);
@@ -0,0 +1,217 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <pinsketch.h>
+#include <random.h>
+#include <serialize.h>
+#include <txreconciliation.h>
+
+#include <cassert>
+#include <deque>
+#include <memory>
+#include <set>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace {
+
+/** Size of the announcement of a transaction in an inv message */
+constexpr size_t INV_ENTRY_SIZE = 36;
+/** Size of the header of the messages specific to reconciliation */
+constexpr size_t MESSAGE_HEADER_SIZE = 24;
+
+/**
+ * A network of nodes relaying transactions to each other in memory, either by
+ * flooding them or by reconciling them, which counts the bytes spent
+ * announcing them.
+ */
+class RelaySimulation {
+public:
+    RelaySimulation(size_t num_nodes, size_t num_outbound, bool reconcile)
+        : m_reconcile(reconcile) {
+        FastRandomContext rng(true);
+        for (size_t i = 0; i < num_nodes; i++) {
+            m_nodes.push_back(std::make_unique<Node>());
+        }
+        for (size_t i = 0; i < num_nodes; i++) {
+            while (m_nodes[i]->outbound.size() < num_outbound) {
+                const NodeId peer = rng.randrange(num_nodes);
+                if (peer != NodeId(i) && !m_nodes[i]->peers.count(peer)) {
+                    Connect(i, peer);
+                }
+            }
+        }
+    }
+
+    /**
+     * Relay batches of new transactions, reconciling once after each batch,
+     * until every node knows every transaction.
+     */
+    void Run(size_t num_batches, size_t batch_size) {
+        FastRandomContext rng(true);
+        std::chrono::microseconds now{0};
+        for (size_t batch = 0; batch < num_batches; batch++) {
+            for (size_t i = 0; i < batch_size; i++) {
+                const TxId txid(rng.rand256());
+                Receive(rng.randrange(m_nodes.size()), -1, txid);
+                m_total_txs++;
+            }
+            now += RECON_REQUEST_INTERVAL;
+            Reconcile(now);
+        }
+
+        while (!IsSynced()) {
+            now += RECON_REQUEST_INTERVAL;
+            Reconcile(now);
+        }
+    }
+
+    size_t GetBytes() const { return m_bytes; }
+
+private:
+    struct Node {
+        std::set<NodeId> peers;
+        std::vector<NodeId> outbound;
+        std::set<TxId> txs;
+        //! The transactions each peer announced to us.
+        std::set<std::pair<NodeId, TxId>> known;
+        TxReconciliationTracker tracker;
+    };
+
+    void Connect(NodeId from, NodeId to) {
+        Node &initiator = *m_nodes[from];
+        Node &responder = *m_nodes[to];
+        initiator.outbound.push_back(to);
+        initiator.peers.insert(to);
+        responder.peers.insert(from);
+        if (m_reconcile) {
+            const uint64_t initiator_salt =
+                initiator.tracker.PreRegisterPeer(to);
+            const uint64_t responder_salt =
+                responder.tracker.PreRegisterPeer(from);
+            initiator.tracker.RegisterPeer(to, false, TXRECONCILIATION_VERSION,
+                                           responder_salt);
+            responder.tracker.RegisterPeer(from, true, TXRECONCILIATION_VERSION,
+                                           initiator_salt);
+        }
+    }
+
+    /** Deliver a transaction, and everything it gets flooded to */
+    void Receive(NodeId id, NodeId from, const TxId &txid) {
+        // Pairs of recipient and sender.
+        std::deque<std::pair<NodeId, NodeId>> queue;
+        queue.emplace_back(id, from);
+        while (!queue.empty()) {
+            NodeId to;
+            std::tie(to, from) = queue.front();
+            queue.pop_front();
+
+            Node &node = *m_nodes[to];
+            node.known.emplace(from, txid);
+            if (!node.txs.insert(txid).second) {
+                continue;
+            }
+            for (NodeId peer : node.peers) {
+                if (peer == from || node.known.count({peer, txid})) {
+                    continue;
+                }
+                if (!m_reconcile || node.tracker.ShouldFlood(peer, txid) ||
+                    !node.tracker.AddToSet(peer, txid)) {
+                    m_bytes += INV_ENTRY_SIZE;
+                    queue.emplace_back(peer, to);
+                }
+            }
+        }
+    }
+
+    void Announce(NodeId from, NodeId to, const std::vector<TxId> &txids) {
+        for (const TxId &txid : txids) {
+            m_bytes += INV_ENTRY_SIZE;
+            Receive(to, from, txid);
+        }
+    }
+
+    void Reconcile(std::chrono::microseconds now) {
+        if (!m_reconcile) {
+            return;
+        }
+        for (size_t i = 0; i < m_nodes.size(); i++) {
+            Node &initiator = *m_nodes[i];
+            for (NodeId peer : initiator.outbound) {
+                Node &responder = *m_nodes[peer];
+                uint16_t local_size;
+                uint16_t q;
+                if (!initiator.tracker.InitiateReconciliation(peer, now,
+                                                              local_size, q)) {
+                    continue;
+                }
+                m_bytes += MESSAGE_HEADER_SIZE + 4;
+
+                std::vector<uint8_t> sketch;
+                assert(responder.tracker.HandleReconciliationRequest(
+                    i, local_size, q, sketch));
+                m_bytes += MESSAGE_HEADER_SIZE +
+                           GetSizeOfCompactSize(sketch.size()) + sketch.size();
+
+                TxReconciliationTracker::Result result;
+                assert(initiator.tracker.HandleSketch(peer, sketch, result));
+                Announce(i, peer, result.announce);
+                m_bytes += MESSAGE_HEADER_SIZE + 1 +
+                           GetSizeOfCompactSize(result.missing.size()) +
+                           4 * result.missing.size();
+
+                std::vector<TxId> announce;
+                assert(responder.tracker.HandleReconciliationDiff(
+                    i, result.success, result.missing, announce));
+                Announce(peer, i, announce);
+            }
+        }
+    }
+
+    bool IsSynced() const {
+        for (const auto &node : m_nodes) {
+            if (node->txs.size() != m_total_txs) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const bool m_reconcile;
+    std::vector<std::unique_ptr<Node>> m_nodes;
+    size_t m_total_txs{0};
+    size_t m_bytes{0};
+};
+
+} // namespace
+
+// Decode the difference between two sets from their sketches.
+static void PinSketchDecode(benchmark::State &state) {
+    FastRandomContext rng(true);
+    PinSketch sketch(MAX_SKETCH_CAPACITY / 4);
+    for (size_t i = 0; i < sketch.GetCapacity(); i++) {
+        sketch.Add(rng.rand32() | 1);
+    }
+    std::vector<uint32_t> elements;
+    while (state.KeepRunning()) {
+        assert(sketch.Decode(elements));
+    }
+}
+
+// Relay transactions across a small network, and check that reconciling them
+// takes less bandwidth than flooding them.
+static void TxReconciliationRelay(benchmark::State &state) {
+    while (state.KeepRunning()) {
+        RelaySimulation flooding(30, 8, false);
+        flooding.Run(10, 20);
+        RelaySimulation reconciling(30, 8, true);
+        reconciling.Run(10, 20);
+        assert(reconciling.GetBytes() < flooding.GetBytes());
+    }
+}
+
+BENCHMARK(PinSketchDecode, 1000);
+BENCHMARK(TxReconciliationRelay, 2);
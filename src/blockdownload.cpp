@@ -0,0 +1,154 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockdownload.h>
+
+#include <validation.h>
+
+#include <algorithm>
+
+BlockDownloadScheduler g_block_download;
+
+size_t BlockDownloadScheduler::ComputeWindow(const PeerState &state) {
+    if (state.block_interval.count() == 0) {
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    }
+    const size_t window = BLOCK_DOWNLOAD_TARGET_TIME / state.block_interval;
+    return std::max(MIN_BLOCKS_IN_TRANSIT_PER_PEER,
+                    std::min(window, MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER));
+}
+
+void BlockDownloadScheduler::BlockRequested(NodeId peer, const BlockHash &hash,
+                                            std::chrono::microseconds now) {
+    LOCK(m_mutex);
+    PeerState &state = m_peers[peer];
+    if (!state.in_flight.insert(hash).second) {
+        return;
+    }
+    if (state.in_flight.size() == 1) {
+        state.busy_since = now;
+    }
+
+    std::vector<Request> &requests = m_requests[hash];
+    if (!requests.empty()) {
+        m_duplicate_requests++;
+    }
+    requests.push_back({peer, now});
+}
+
+bool BlockDownloadScheduler::BlockReceived(NodeId peer, const BlockHash &hash,
+                                           std::chrono::microseconds now) {
+    LOCK(m_mutex);
+    auto it = m_requests.find(hash);
+    if (it == m_requests.end()) {
+        return false;
+    }
+
+    bool requested = false;
+    for (size_t i = 0; i < it->second.size(); i++) {
+        const Request &request = it->second[i];
+        PeerState &state = m_peers[request.peer];
+        state.in_flight.erase(hash);
+        if (request.peer != peer) {
+            continue;
+        }
+
+        requested = true;
+        // Only count the time the peer spent on this block, not the time it
+        // spent delivering the blocks requested before.
+        const std::chrono::microseconds sample =
+            std::max(now - std::max(state.busy_since, request.time),
+                     std::chrono::microseconds{1});
+        state.block_interval = state.block_interval.count() == 0
+                                   ? sample
+                                   : (3 * state.block_interval + sample) / 4;
+        state.busy_since = now;
+        state.blocks_received++;
+        if (i > 0) {
+            m_duplicate_wins++;
+        }
+    }
+    m_requests.erase(it);
+    return requested;
+}
+
+void BlockDownloadScheduler::ForgetPeer(NodeId peer) {
+    LOCK(m_mutex);
+    auto peer_it = m_peers.find(peer);
+    if (peer_it == m_peers.end()) {
+        return;
+    }
+    for (const BlockHash &hash : peer_it->second.in_flight) {
+        auto it = m_requests.find(hash);
+        if (it == m_requests.end()) {
+            continue;
+        }
+        std::vector<Request> &requests = it->second;
+        requests.erase(std::remove_if(requests.begin(), requests.end(),
+                                      [peer](const Request &request) {
+                                          return request.peer == peer;
+                                      }),
+                       requests.end());
+        if (requests.empty()) {
+            m_requests.erase(it);
+        }
+    }
+    m_peers.erase(peer_it);
+}
+
+size_t BlockDownloadScheduler::GetWindow(NodeId peer) const {
+    LOCK(m_mutex);
+    auto it = m_peers.find(peer);
+    if (it == m_peers.end()) {
+        return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    }
+    return ComputeWindow(it->second);
+}
+
+bool BlockDownloadScheduler::ShouldRequestDuplicate(
+    NodeId peer, const BlockHash &hash, std::chrono::microseconds now) const {
+    LOCK(m_mutex);
+    auto it = m_requests.find(hash);
+    if (it == m_requests.end() || it->second.size() != 1) {
+        return false;
+    }
+    const Request &request = it->second.front();
+    if (request.peer == peer) {
+        return false;
+    }
+
+    // Give the peer the block was requested from a chance to deliver it in
+    // about the time it usually takes.
+    const std::chrono::microseconds waiting = now - request.time;
+    auto owner_it = m_peers.find(request.peer);
+    const std::chrono::microseconds owner_interval =
+        owner_it == m_peers.end() ? std::chrono::microseconds{0}
+                                  : owner_it->second.block_interval;
+    if (waiting < std::max<std::chrono::microseconds>(
+                      MIN_DUPLICATE_BLOCK_REQUEST_DELAY, 2 * owner_interval)) {
+        return false;
+    }
+
+    // Don't bother if this peer is not expected to be any faster.
+    auto peer_it = m_peers.find(peer);
+    return peer_it == m_peers.end() ||
+           peer_it->second.block_interval < waiting;
+}
+
+void BlockDownloadScheduler::GetStats(Stats &stats) const {
+    LOCK(m_mutex);
+    stats.in_flight = m_requests.size();
+    stats.duplicated = std::count_if(
+        m_requests.begin(), m_requests.end(),
+        [](const auto &entry) { return entry.second.size() > 1; });
+    stats.duplicate_requests = m_duplicate_requests;
+    stats.duplicate_wins = m_duplicate_wins;
+    stats.peers.clear();
+    for (const auto &entry : m_peers) {
+        stats.peers.push_back({entry.first, ComputeWindow(entry.second),
+                               entry.second.in_flight.size(),
+                               entry.second.block_interval,
+                               entry.second.blocks_received});
+    }
+}
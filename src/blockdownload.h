@@ -0,0 +1,125 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKDOWNLOAD_H
+#define BITCOIN_BLOCKDOWNLOAD_H
+
+#include <net.h>
+#include <primitives/blockhash.h>
+#include <sync.h>
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <set>
+#include <vector>
+
+/** Smallest number of blocks in flight from a single peer */
+static constexpr size_t MIN_BLOCKS_IN_TRANSIT_PER_PEER = 2;
+/** Largest number of blocks in flight from a single fast peer */
+static constexpr size_t MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER = 64;
+/**
+ * How long it should take a peer to deliver all the blocks in flight from
+ * it, which sizes its window.
+ */
+static constexpr std::chrono::seconds BLOCK_DOWNLOAD_TARGET_TIME{5};
+/**
+ * Minimum time a block holding back validation must have been in flight
+ * before it is requested from another peer as well.
+ */
+static constexpr std::chrono::seconds MIN_DUPLICATE_BLOCK_REQUEST_DELAY{1};
+
+/**
+ * Schedule the parallel download of blocks according to the throughput of
+ * each peer.
+ *
+ * The time each peer takes to deliver a block, while it has blocks in
+ * flight, is tracked as a moving average. It sizes the number of blocks
+ * requested from the peer, so that fast peers are kept busy and slow ones do
+ * not hold many of the next blocks to validate. When the block validation is
+ * waiting for has been in flight from a peer for much longer than the peer
+ * usually takes, it can be requested from a second peer, and the first copy
+ * to arrive wins.
+ *
+ * The requests are tracked here independently of mapBlocksInFlight, which
+ * only knows about the first peer a block was requested from.
+ *
+ * This class is thread safe.
+ */
+class BlockDownloadScheduler {
+public:
+    struct PeerStats {
+        NodeId id;
+        size_t window;
+        size_t in_flight;
+        //! Zero while unknown.
+        std::chrono::microseconds block_interval;
+        uint64_t blocks_received;
+    };
+
+    struct Stats {
+        //! Number of blocks in flight.
+        size_t in_flight;
+        //! Number of blocks in flight from more than one peer.
+        size_t duplicated;
+        uint64_t duplicate_requests;
+        //! Number of duplicate requests which were answered first.
+        uint64_t duplicate_wins;
+        std::vector<PeerStats> peers;
+    };
+
+    /**
+     * Record that a block was requested from a peer. The request is a
+     * duplicate if the block is already in flight from another peer.
+     */
+    void BlockRequested(NodeId peer, const BlockHash &hash,
+                        std::chrono::microseconds now);
+    /**
+     * Record that a block was received from a peer, or that it is no longer
+     * expected from anyone if peer is -1, and cancel the other requests for
+     * it. Returns whether the block was requested from that peer.
+     */
+    bool BlockReceived(NodeId peer, const BlockHash &hash,
+                       std::chrono::microseconds now);
+    void ForgetPeer(NodeId peer);
+
+    /** Return how many blocks may be in flight from a peer */
+    size_t GetWindow(NodeId peer) const;
+    /**
+     * Whether a block holding back validation, which is in flight from
+     * another peer only, should be requested from this peer as well.
+     */
+    bool ShouldRequestDuplicate(NodeId peer, const BlockHash &hash,
+                                std::chrono::microseconds now) const;
+
+    void GetStats(Stats &stats) const;
+
+private:
+    struct Request {
+        NodeId peer;
+        std::chrono::microseconds time;
+    };
+
+    struct PeerState {
+        std::set<BlockHash> in_flight;
+        //! When the peer started working on its oldest block in flight.
+        std::chrono::microseconds busy_since{0};
+        //! Average time taken to deliver a block, zero while unknown.
+        std::chrono::microseconds block_interval{0};
+        uint64_t blocks_received{0};
+    };
+
+    static size_t ComputeWindow(const PeerState &state);
+
+    mutable Mutex m_mutex;
+    //! The peers each block in flight was requested from, oldest first.
+    std::map<BlockHash, std::vector<Request>> m_requests GUARDED_BY(m_mutex);
+    std::map<NodeId, PeerState> m_peers GUARDED_BY(m_mutex);
+    uint64_t m_duplicate_requests GUARDED_BY(m_mutex){0};
+    uint64_t m_duplicate_wins GUARDED_BY(m_mutex){0};
+};
+
+extern BlockDownloadScheduler g_block_download;
+
+#endif // BITCOIN_BLOCKDOWNLOAD_H
@@ -16,6 +16,9 @@
 #include <util/system.h>
 #include <validation.h>
 
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <unordered_map>
 
 CBlockHeaderAndShortTxIDs::CBlockHeaderAndShortTxIDs(const CBlock &block)
@@ -48,6 +51,114 @@ uint64_t CBlockHeaderAndShortTxIDs::GetShortID(const TxHash &txhash) const {
     return SipHashUint256(shorttxidk0, shorttxidk1, txhash) & 0xffffffffffffL;
 }
 
+void CBlockHeaderAndShortTxIDs::GetShortIDs(const uint256 *const *txhashes,
+                                            size_t count,
+                                            uint64_t *shortids) const {
+    SipHashUint256Batch(shorttxidk0, shorttxidk1, txhashes, count, shortids);
+    for (size_t i = 0; i < count; i++) {
+        shortids[i] &= 0xffffffffffffL;
+    }
+}
+
+/**
+ * Size of the IBLT of a CGrapheneBlock per transaction it can list, in bytes:
+ * twice as many cells as transactions, of 16 bytes each.
+ */
+static constexpr double IBLT_BYTES_PER_TX = 32;
+/**
+ * The IBLT can also list about one in that many transactions of the block,
+ * plus a few, which the receiver does not have.
+ */
+static constexpr size_t GRAPHENE_MISSING_TX_RATIO = 100;
+static constexpr size_t GRAPHENE_EXTRA_MISSING_TXS = 10;
+
+CGrapheneBlock::CGrapheneBlock(const CBlock &block, uint64_t mempool_size)
+    : header(block), tx_count(block.vtx.size()), coinbase(block.vtx[0]) {
+    const size_t n = block.vtx.size() - 1;
+    // The number of transactions of the receiver which are not in the block,
+    // among which the filter has false positives.
+    const uint64_t excess = mempool_size > n ? mempool_size - n : 0;
+
+    // With n * log(excess / a) / log(2)^2 bits, the filter lets a of them
+    // through on average. The IBLT has to list them, and a is chosen to
+    // minimize the combined size.
+    const double ln2_squared = std::log(2) * std::log(2);
+    double false_positives =
+        std::max(1.0, n / (8 * ln2_squared * IBLT_BYTES_PER_TX));
+    const uint32_t tweak = GetRand(std::numeric_limits<uint32_t>::max());
+    if (n > 0 && false_positives < excess) {
+        filter = CBloomFilter(n, false_positives / excess, tweak,
+                              BLOOM_UPDATE_NONE, MAX_GRAPHENE_FILTER_SIZE);
+        for (size_t i = 1; i < block.vtx.size(); i++) {
+            filter.insert(block.vtx[i]->GetId());
+        }
+    } else {
+        // The filter would not save much, let everything through.
+        false_positives = excess;
+    }
+
+    // Leave room for three standard deviations more false positives.
+    const size_t capacity = false_positives + 3 * std::sqrt(false_positives) +
+                            n / GRAPHENE_MISSING_TX_RATIO +
+                            GRAPHENE_EXTRA_MISSING_TXS;
+    iblt = CIBLT(capacity, tweak);
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        iblt.Insert(GetKey(block.vtx[i]->GetId()));
+    }
+}
+
+bool CGrapheneBlock::CanEncode(const CBlock &block) {
+    if (block.vtx.empty()) {
+        return false;
+    }
+    for (size_t i = 2; i < block.vtx.size(); i++) {
+        if (block.vtx[i - 1]->GetId() >= block.vtx[i]->GetId()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+namespace {
+
+/** Number of short ids computed at once when scanning for transactions */
+constexpr size_t SHORTID_BATCH_SIZE = 64;
+
+/**
+ * Call f(entry, shortid) for the entries of a vector of <txhash, ...> pairs
+ * whose short id may be in the block according to filter, a bitmap indexed
+ * by the low bits of the short ids of the block, until f returns false.
+ *
+ * Nearly all the mempool transactions are usually not in the block, so
+ * checking the filter is much cheaper than looking them all up in the map of
+ * the short ids, and the short ids are computed in batches which is faster.
+ */
+template <typename Entry, typename Callable>
+void ForEachCandidate(const CBlockHeaderAndShortTxIDs &cmpctblock,
+                      const std::vector<bool> &filter,
+                      const std::vector<Entry> &entries, Callable f) {
+    const uint64_t filter_mask = filter.size() - 1;
+    const uint256 *txhashes[SHORTID_BATCH_SIZE];
+    uint64_t shortids[SHORTID_BATCH_SIZE];
+    for (size_t start = 0; start < entries.size();
+         start += SHORTID_BATCH_SIZE) {
+        const size_t count =
+            std::min(SHORTID_BATCH_SIZE, entries.size() - start);
+        for (size_t i = 0; i < count; i++) {
+            txhashes[i] = &entries[start + i].first;
+        }
+        cmpctblock.GetShortIDs(txhashes, count, shortids);
+        for (size_t i = 0; i < count; i++) {
+            if (filter[shortids[i] & filter_mask] &&
+                !f(entries[start + i], shortids[i])) {
+                return;
+            }
+        }
+    }
+}
+
+} // namespace
+
 ReadStatus PartiallyDownloadedBlock::InitData(
     const CBlockHeaderAndShortTxIDs &cmpctblock,
     const std::vector<std::pair<TxHash, CTransactionRef>> &extra_txns) {
@@ -128,72 +239,84 @@ ReadStatus PartiallyDownloadedBlock::InitData(
         return READ_STATUS_FAILED;
     }
 
+    // A bitmap with 16 bits or more per short id, so that about 1 in 16
+    // transactions which are not in the block get looked up in the map.
+    size_t filter_size = 64;
+    while (filter_size < 16 * shorttxids.size()) {
+        filter_size *= 2;
+    }
+    std::vector<bool> filter(filter_size);
+    for (uint64_t shortid : cmpctblock.shorttxids) {
+        filter[shortid & (filter_size - 1)] = true;
+    }
+
     std::vector<bool> have_txn(txns_available.size());
-    {
+    if (!shorttxids.empty()) {
         LOCK(pool->cs);
-        for (size_t i = 0; i < pool->vTxHashes.size(); i++) {
-            uint64_t shortid = cmpctblock.GetShortID(pool->vTxHashes[i].first);
-            std::unordered_map<uint64_t, uint32_t>::iterator idit =
-                shorttxids.find(shortid);
-            if (idit != shorttxids.end()) {
-                if (!have_txn[idit->second]) {
-                    txns_available[idit->second] =
-                        pool->vTxHashes[i].second->GetSharedTx();
-                    have_txn[idit->second] = true;
-                    mempool_count++;
-                } else {
-                    // If we find two mempool txn that match the short id, just
-                    // request it. This should be rare enough that the extra
-                    // bandwidth doesn't matter, but eating a round-trip due to
-                    // FillBlock failure would be annoying.
-                    if (txns_available[idit->second]) {
-                        txns_available[idit->second].reset();
-                        mempool_count--;
+        ForEachCandidate(
+            cmpctblock, filter, pool->vTxHashes,
+            [&](const auto &entry, uint64_t shortid) {
+                auto idit = shorttxids.find(shortid);
+                if (idit != shorttxids.end()) {
+                    if (!have_txn[idit->second]) {
+                        txns_available[idit->second] =
+                            entry.second->GetSharedTx();
+                        have_txn[idit->second] = true;
+                        mempool_count++;
+                    } else {
+                        // If we find two mempool txn that match the short id,
+                        // just request it. This should be rare enough that the
+                        // extra bandwidth doesn't matter, but eating a
+                        // round-trip due to FillBlock failure would be
+                        // annoying.
+                        if (txns_available[idit->second]) {
+                            txns_available[idit->second].reset();
+                            mempool_count--;
+                        }
                     }
                 }
-            }
-            // Though ideally we'd continue scanning for the
-            // two-txn-match-shortid case, the performance win of an early exit
-            // here is too good to pass up and worth the extra risk.
-            if (mempool_count == shorttxids.size()) {
-                break;
-            }
-        }
+                // Though ideally we'd continue scanning for the
+                // two-txn-match-shortid case, the performance win of an early
+                // exit here is too good to pass up and worth the extra risk.
+                return mempool_count != shorttxids.size();
+            });
     }
 
-    for (auto &extra_txn : extra_txns) {
-        uint64_t shortid = cmpctblock.GetShortID(extra_txn.first);
-        std::unordered_map<uint64_t, uint32_t>::iterator idit =
-            shorttxids.find(shortid);
-        if (idit != shorttxids.end()) {
-            if (!have_txn[idit->second]) {
-                txns_available[idit->second] = extra_txn.second;
-                have_txn[idit->second] = true;
-                mempool_count++;
-                extra_count++;
-            } else {
-                // If we find two mempool/extra txn that match the short id,
-                // just request it. This should be rare enough that the extra
-                // bandwidth doesn't matter, but eating a round-trip due to
-                // FillBlock failure would be annoying. Note that we don't want
-                // duplication between extra_txns and mempool to trigger this
-                // case, so we compare hashes first.
-                if (txns_available[idit->second] &&
-                    txns_available[idit->second]->GetHash() !=
-                        extra_txn.second->GetHash()) {
-                    txns_available[idit->second].reset();
-                    mempool_count--;
-                    extra_count--;
+    if (mempool_count != shorttxids.size()) {
+        ForEachCandidate(
+            cmpctblock, filter, extra_txns,
+            [&](const std::pair<TxHash, CTransactionRef> &extra_txn,
+                uint64_t shortid) {
+                auto idit = shorttxids.find(shortid);
+                if (idit != shorttxids.end()) {
+                    if (!have_txn[idit->second]) {
+                        txns_available[idit->second] = extra_txn.second;
+                        have_txn[idit->second] = true;
+                        mempool_count++;
+                        extra_count++;
+                    } else {
+                        // If we find two mempool/extra txn that match the
+                        // short id, just request it. This should be rare
+                        // enough that the extra bandwidth doesn't matter, but
+                        // eating a round-trip due to FillBlock failure would
+                        // be annoying. Note that we don't want duplication
+                        // between extra_txns and mempool to trigger this
+                        // case, so we compare hashes first.
+                        if (txns_available[idit->second] &&
+                            txns_available[idit->second]->GetHash() !=
+                                extra_txn.second->GetHash()) {
+                            txns_available[idit->second].reset();
+                            mempool_count--;
+                            extra_count--;
+                        }
+                    }
                 }
-            }
-        }
 
-        // Though ideally we'd continue scanning for the two-txn-match-shortid
-        // case, the performance win of an early exit here is too good to pass
-        // up and worth the extra risk.
-        if (mempool_count == shorttxids.size()) {
-            break;
-        }
+                // Though ideally we'd continue scanning for the
+                // two-txn-match-shortid case, the performance win of an early
+                // exit here is too good to pass up and worth the extra risk.
+                return mempool_count != shorttxids.size();
+            });
     }
 
     LogPrint(BCLog::CMPCTBLOCK,
@@ -205,6 +328,141 @@ ReadStatus PartiallyDownloadedBlock::InitData(
     return READ_STATUS_OK;
 }
 
+ReadStatus PartiallyDownloadedBlock::InitData(
+    const CGrapheneBlock &grblock,
+    const std::vector<std::pair<TxHash, CTransactionRef>> &extra_txns) {
+    if (grblock.header.IsNull() || grblock.tx_count == 0 ||
+        !grblock.coinbase->IsCoinBase()) {
+        return READ_STATUS_INVALID;
+    }
+    if (grblock.tx_count > config->GetMaxBlockSize() / MIN_TRANSACTION_SIZE) {
+        return READ_STATUS_INVALID;
+    }
+    if (!grblock.filter.IsWithinSizeConstraints(MAX_GRAPHENE_FILTER_SIZE) ||
+        !grblock.iblt.IsValid()) {
+        return READ_STATUS_INVALID;
+    }
+
+    assert(header.IsNull() && txns_available.empty());
+
+    struct Candidate {
+        uint64_t key;
+        //! Whether the transaction comes from extra_txns.
+        bool extra;
+        CTransactionRef tx;
+    };
+    std::vector<Candidate> candidates;
+    {
+        LOCK(pool->cs);
+        for (const auto &entry : pool->vTxHashes) {
+            const TxId &txid = entry.second->GetTx().GetId();
+            if (grblock.filter.contains(txid)) {
+                candidates.push_back({CGrapheneBlock::GetKey(txid), false,
+                                      entry.second->GetSharedTx()});
+            }
+        }
+    }
+    for (const auto &extra_txn : extra_txns) {
+        if (extra_txn.second &&
+            grblock.filter.contains(extra_txn.second->GetId())) {
+            candidates.push_back(
+                {CGrapheneBlock::GetKey(extra_txn.second->GetId()), true,
+                 extra_txn.second});
+        }
+    }
+
+    // Keep one candidate per key, preferring those from the mempool. If
+    // different transactions have the same key, we cannot tell which one is
+    // in the block, so drop them all and let the IBLT report the one which
+    // is as missing.
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate &a, const Candidate &b) {
+                  return a.key != b.key ? a.key < b.key : a.extra < b.extra;
+              });
+    size_t kept = 0;
+    for (size_t i = 0; i < candidates.size();) {
+        size_t end = i + 1;
+        bool collision = false;
+        while (end < candidates.size() &&
+               candidates[end].key == candidates[i].key) {
+            collision |=
+                candidates[end].tx->GetId() != candidates[i].tx->GetId();
+            end++;
+        }
+        if (!collision) {
+            candidates[kept++] = std::move(candidates[i]);
+        }
+        i = end;
+    }
+    candidates.resize(kept);
+
+    CIBLT difference(grblock.iblt);
+    for (const Candidate &candidate : candidates) {
+        difference.Erase(candidate.key);
+    }
+    std::vector<uint64_t> missing;
+    std::vector<uint64_t> false_positives;
+    if (!difference.Decode(missing, false_positives)) {
+        return READ_STATUS_FAILED;
+    }
+    std::sort(missing.begin(), missing.end());
+    std::sort(false_positives.begin(), false_positives.end());
+
+    // Remove the false positives, which must all be candidates.
+    size_t fp_index = 0;
+    kept = 0;
+    for (Candidate &candidate : candidates) {
+        if (fp_index < false_positives.size() &&
+            false_positives[fp_index] == candidate.key) {
+            fp_index++;
+            continue;
+        }
+        candidates[kept++] = std::move(candidate);
+    }
+    candidates.resize(kept);
+    if (fp_index != false_positives.size() ||
+        candidates.size() + missing.size() + 1 != grblock.tx_count) {
+        return READ_STATUS_FAILED;
+    }
+
+    // Interleave the candidates and the missing transactions in the order of
+    // their keys, which is the order of the block unless keys are equal.
+    std::vector<CTransactionRef> txns(grblock.tx_count);
+    txns[0] = grblock.coinbase;
+    size_t missing_index = 0;
+    size_t candidate_index = 0;
+    size_t candidate_extra_count = 0;
+    for (size_t i = 1; i < txns.size(); i++) {
+        if (missing_index < missing.size() &&
+            (candidate_index == candidates.size() ||
+             missing[missing_index] < candidates[candidate_index].key)) {
+            missing_index++;
+            continue;
+        }
+        const Candidate &candidate = candidates[candidate_index++];
+        if (missing_index < missing.size() &&
+            missing[missing_index] == candidate.key) {
+            return READ_STATUS_FAILED;
+        }
+        txns[i] = candidate.tx;
+        candidate_extra_count += candidate.extra;
+    }
+
+    header = grblock.header;
+    txns_available = std::move(txns);
+    prefilled_count = 1;
+    mempool_count = candidates.size();
+    extra_count = candidate_extra_count;
+
+    LogPrint(BCLog::CMPCTBLOCK,
+             "Initialized PartiallyDownloadedBlock for block %s using a "
+             "grblk of size %lu\n",
+             grblock.header.GetHash().ToString(),
+             GetSerializeSize(grblock, PROTOCOL_VERSION));
+
+    return READ_STATUS_OK;
+}
+
 bool PartiallyDownloadedBlock::IsTxAvailable(size_t index) const {
     assert(!header.IsNull());
     assert(index < txns_available.size());
@@ -5,6 +5,9 @@
 #ifndef BITCOIN_BLOCKENCODINGS_H
 #define BITCOIN_BLOCKENCODINGS_H
 
+#include <bloom.h>
+#include <crypto/common.h>
+#include <iblt.h>
 #include <primitives/block.h>
 
 class Config;
@@ -165,6 +168,9 @@ public:
     explicit CBlockHeaderAndShortTxIDs(const CBlock &block);
 
     uint64_t GetShortID(const TxHash &txhash) const;
+    /** Compute the short ids of several transactions at once, faster */
+    void GetShortIDs(const uint256 *const *txhashes, size_t count,
+                     uint64_t *shortids) const;
 
     size_t BlockTxCount() const {
         return shorttxids.size() + prefilledtxn.size();
@@ -216,6 +222,82 @@ public:
     }
 };
 
+static constexpr bool DEFAULT_GRAPHENE_ENABLE = false;
+
+/**
+ * Upper bound on the size of the Bloom filter of a CGrapheneBlock, in bytes,
+ * which is enough for about 20 bits per transaction of the largest blocks.
+ */
+static const uint32_t MAX_GRAPHENE_FILTER_SIZE = 1000000;
+
+/** Request for a CGrapheneBlock */
+class GrapheneBlockRequest {
+public:
+    BlockHash blockhash;
+    //! The number of transactions in the mempool of the requester.
+    uint64_t mempool_size;
+
+    SERIALIZE_METHODS(GrapheneBlockRequest, obj) {
+        READWRITE(obj.blockhash, obj.mempool_size);
+    }
+};
+
+/**
+ * A block encoded with a Bloom filter of the ids of its transactions, which
+ * selects candidates among the transactions the receiver has, and an IBLT of
+ * their keys, which lists the differences between the candidates and the
+ * block: the false positives of the filter, and the transactions the receiver
+ * does not have. Blocks are in canonical transaction order, so the position of
+ * the transactions follows from their ids and needs not be sent, and for large
+ * blocks this is several times smaller than a CBlockHeaderAndShortTxIDs.
+ */
+class CGrapheneBlock {
+public:
+    CBlockHeader header;
+    //! The number of transactions in the block, including the coinbase.
+    uint32_t tx_count{0};
+    //! The coinbase, which the receiver cannot have.
+    CTransactionRef coinbase;
+    //! Matches everything when no transaction needs to be filtered out.
+    CBloomFilter filter;
+    CIBLT iblt;
+
+    // Dummy for deserialization
+    CGrapheneBlock() {}
+
+    /**
+     * Encode a block for a receiver which has the given number of
+     * transactions in its mempool. The block must satisfy CanEncode().
+     */
+    CGrapheneBlock(const CBlock &block, uint64_t mempool_size);
+
+    /** Whether the transactions of a block are in canonical order */
+    static bool CanEncode(const CBlock &block);
+
+    /**
+     * The key of a transaction in the IBLT: the most significant bytes of its
+     * id, so the keys are in the same order as the ids.
+     */
+    static uint64_t GetKey(const TxId &txid) {
+        return ReadLE64(txid.begin() + 24);
+    }
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream &s, Operation ser_action) {
+        READWRITE(header);
+        READWRITE(tx_count);
+        READWRITE(TransactionCompressor(coinbase));
+        READWRITE(filter);
+        READWRITE(iblt);
+
+        if (ser_action.ForRead()) {
+            filter.UpdateEmptyFull();
+        }
+    }
+};
+
 class PartiallyDownloadedBlock {
 protected:
     std::vector<CTransactionRef> txns_available;
@@ -233,6 +315,15 @@ public:
     ReadStatus
     InitData(const CBlockHeaderAndShortTxIDs &cmpctblock,
              const std::vector<std::pair<TxHash, CTransactionRef>> &extra_txn);
+    /**
+     * Use the transactions of the mempool and extra_txn which match the filter
+     * of grblock, and decode its IBLT to find which of them are in the block
+     * and which transactions of the block are missing. Returns
+     * READ_STATUS_FAILED if the IBLT cannot be decoded.
+     */
+    ReadStatus
+    InitData(const CGrapheneBlock &grblock,
+             const std::vector<std::pair<TxHash, CTransactionRef>> &extra_txn);
     bool IsTxAvailable(size_t index) const;
     ReadStatus FillBlock(CBlock &block,
                          const std::vector<CTransactionRef> &vtx_missing);
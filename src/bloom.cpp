@@ -33,9 +33,10 @@
  * formulas.
  */
 CBloomFilter::CBloomFilter(const uint32_t nElements, const double nFPRate,
-                           const uint32_t nTweakIn, uint8_t nFlagsIn)
+                           const uint32_t nTweakIn, uint8_t nFlagsIn,
+                           const uint32_t nMaxSize)
     : vData(std::min<uint32_t>(-1 / LN2SQUARED * nElements * log(nFPRate),
-                               MAX_BLOOM_FILTER_SIZE * 8) /
+                               nMaxSize * 8) /
             8),
       isFull(false), isEmpty(true),
       nHashFuncs(std::min<uint32_t>(vData.size() * 8 / nElements * LN2,
@@ -116,8 +117,8 @@ void CBloomFilter::reset(const uint32_t nNewTweak) {
     nTweak = nNewTweak;
 }
 
-bool CBloomFilter::IsWithinSizeConstraints() const {
-    return vData.size() <= MAX_BLOOM_FILTER_SIZE &&
+bool CBloomFilter::IsWithinSizeConstraints(const uint32_t nMaxSize) const {
+    return vData.size() <= nMaxSize &&
            nHashFuncs <= MAX_HASH_FUNCS;
 }
 
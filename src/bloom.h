@@ -65,9 +65,12 @@ public:
      * added to the seed value passed to the hash function. It should generally
      * always be a random value (and is largely only exposed for unit testing)
      * nFlags should be one of the BLOOM_UPDATE_* enums (not _MASK)
+     * nMaxSize overrides the protocol limit on the size, for filters which are
+     * not used by SPV clients.
      */
     CBloomFilter(const uint32_t nElements, const double nFPRate,
-                 const uint32_t nTweak, uint8_t nFlagsIn);
+                 const uint32_t nTweak, uint8_t nFlagsIn,
+                 const uint32_t nMaxSize = MAX_BLOOM_FILTER_SIZE);
     CBloomFilter()
         : isFull(true), isEmpty(false), nHashFuncs(0), nTweak(0), nFlags(0) {}
 
@@ -92,10 +95,11 @@ public:
     void clear();
     void reset(const uint32_t nNewTweak);
 
-    //! True if the size is <= MAX_BLOOM_FILTER_SIZE and the number of hash
-    //! functions is <= MAX_HASH_FUNCS (catch a filter which was just
-    //! deserialized which was too big)
-    bool IsWithinSizeConstraints() const;
+    //! True if the size is <= nMaxSize and the number of hash functions is <=
+    //! MAX_HASH_FUNCS (catch a filter which was just deserialized which was
+    //! too big)
+    bool IsWithinSizeConstraints(
+        const uint32_t nMaxSize = MAX_BLOOM_FILTER_SIZE) const;
 
     //! Scans output scripts for matches and adds those outpoints to the filter
     //! for spend detection. Returns true if any output matched, or the txid
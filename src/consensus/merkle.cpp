@@ -74,3 +74,18 @@ uint256 BlockMerkleRoot(const CBlock &block, bool *mutated) {
     }
     return ComputeMerkleRoot(std::move(leaves), mutated);
 }
+
+std::vector<uint256> ComputeMerkleBranch(std::vector<uint256> hashes,
+                                         uint32_t position) {
+    std::vector<uint256> branch;
+    while (hashes.size() > 1) {
+        if (hashes.size() & 1) {
+            hashes.push_back(hashes.back());
+        }
+        branch.push_back(hashes[position ^ 1]);
+        SHA256D64(hashes[0].begin(), hashes[0].begin(), hashes.size() / 2);
+        hashes.resize(hashes.size() / 2);
+        position >>= 1;
+    }
+    return branch;
+}
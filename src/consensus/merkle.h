@@ -18,4 +18,11 @@ uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool *mutated = nullptr);
  */
 uint256 BlockMerkleRoot(const CBlock &block, bool *mutated = nullptr);
 
+/**
+ * Compute the merkle branch for the leaf at the given position, i.e. the list
+ * of sibling hashes needed to recompute the root from that leaf alone.
+ */
+std::vector<uint256> ComputeMerkleBranch(std::vector<uint256> hashes,
+                                         uint32_t position);
+
 #endif // BITCOIN_CONSENSUS_MERKLE_H
@@ -47,4 +47,13 @@ uint64_t SipHashUint256(uint64_t k0, uint64_t k1, const uint256 &val);
 uint64_t SipHashUint256Extra(uint64_t k0, uint64_t k1, const uint256 &val,
                              uint32_t extra);
 
+/**
+ * Compute SipHashUint256(k0, k1, *vals[i]) into out[i] for count values.
+ *
+ * This processes 4 values at a time when AVX2 is available, which is about
+ * twice as fast as hashing them one by one.
+ */
+void SipHashUint256Batch(uint64_t k0, uint64_t k1, const uint256 *const *vals,
+                         size_t count, uint64_t *out);
+
 #endif // BITCOIN_CRYPTO_SIPHASH_H
@@ -0,0 +1,73 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifdef ENABLE_AVX2
+
+#include <uint256.h>
+
+#include <cstdint>
+#include <immintrin.h>
+
+namespace siphash_avx2 {
+namespace {
+
+    __m256i inline K(uint64_t x) { return _mm256_set1_epi64x(x); }
+    __m256i inline Add(__m256i x, __m256i y) { return _mm256_add_epi64(x, y); }
+    __m256i inline Xor(__m256i x, __m256i y) { return _mm256_xor_si256(x, y); }
+    __m256i inline Rotl(__m256i x, int b) {
+        return _mm256_or_si256(_mm256_slli_epi64(x, b),
+                               _mm256_srli_epi64(x, 64 - b));
+    }
+    /** Rotating by 32 bits is swapping the halves of each word */
+    __m256i inline Rotl32(__m256i x) { return _mm256_shuffle_epi32(x, 0xb1); }
+
+    void inline Round(__m256i &v0, __m256i &v1, __m256i &v2, __m256i &v3) {
+        v0 = Add(v0, v1);
+        v1 = Xor(Rotl(v1, 13), v0);
+        v0 = Rotl32(v0);
+        v2 = Add(v2, v3);
+        v3 = Xor(Rotl(v3, 16), v2);
+        v0 = Add(v0, v3);
+        v3 = Xor(Rotl(v3, 21), v0);
+        v2 = Add(v2, v1);
+        v1 = Xor(Rotl(v1, 17), v2);
+        v2 = Rotl32(v2);
+    }
+
+    __m256i inline Word(const uint256 *const vals[4], int pos) {
+        return _mm256_set_epi64x(
+            vals[3]->GetUint64(pos), vals[2]->GetUint64(pos),
+            vals[1]->GetUint64(pos), vals[0]->GetUint64(pos));
+    }
+
+} // namespace
+
+void SipHashUint256_4way(uint64_t k0, uint64_t k1,
+                         const uint256 *const vals[4], uint64_t out[4]) {
+    __m256i v0 = K(0x736f6d6570736575ULL ^ k0);
+    __m256i v1 = K(0x646f72616e646f6dULL ^ k1);
+    __m256i v2 = K(0x6c7967656e657261ULL ^ k0);
+    __m256i v3 = K(0x7465646279746573ULL ^ k1);
+
+    // The 4 words of the values, then the length.
+    for (int i = 0; i < 5; i++) {
+        const __m256i d = i < 4 ? Word(vals, i) : K(uint64_t(4) << 59);
+        v3 = Xor(v3, d);
+        Round(v0, v1, v2, v3);
+        Round(v0, v1, v2, v3);
+        v0 = Xor(v0, d);
+    }
+    v2 = Xor(v2, K(0xFF));
+    Round(v0, v1, v2, v3);
+    Round(v0, v1, v2, v3);
+    Round(v0, v1, v2, v3);
+    Round(v0, v1, v2, v3);
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(out),
+                        Xor(Xor(v0, v1), Xor(v2, v3)));
+}
+
+} // namespace siphash_avx2
+
+#endif
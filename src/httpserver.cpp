@@ -655,6 +655,26 @@ std::string HTTPRequest::GetURI() const {
     return evhttp_request_get_uri(req);
 }
 
+std::optional<std::string>
+HTTPRequest::GetQueryParameter(const std::string &key) const {
+    const evhttp_uri *uri = evhttp_request_get_evhttp_uri(req);
+    const char *query = uri ? evhttp_uri_get_query(uri) : nullptr;
+    if (!query) {
+        return std::nullopt;
+    }
+
+    std::optional<std::string> result;
+    struct evkeyvalq params;
+    if (evhttp_parse_query_str(query, &params) == 0) {
+        const char *value = evhttp_find_header(&params, key.c_str());
+        if (value) {
+            result = value;
+        }
+    }
+    evhttp_clear_headers(&params);
+    return result;
+}
+
 HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod() const {
     switch (evhttp_request_get_command(req)) {
         case EVHTTP_REQ_GET:
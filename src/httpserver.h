@@ -7,6 +7,7 @@
 #define BITCOIN_HTTPSERVER_H
 
 #include <functional>
+#include <optional>
 #include <string>
 
 static const int DEFAULT_HTTP_THREADS = 4;
@@ -85,6 +86,12 @@ public:
     /** Get requested URI */
     std::string GetURI() const;
 
+    /**
+     * Get the decoded value of the query string parameter specified by key,
+     * or nullopt if it is not present.
+     */
+    std::optional<std::string> GetQueryParameter(const std::string &key) const;
+
     /** Get CService (address:ip) for the origin of the http request */
     CService GetPeer() const;
 
@@ -0,0 +1,96 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <iblt.h>
+
+#include <crypto/siphash.h>
+
+/**
+ * The keys are listed by repeatedly removing them from the cells which hold
+ * only them. Twice as many cells as keys, plus some more which matter for
+ * small tables, makes this fail about 1% of the time at most.
+ */
+static constexpr size_t CELLS_PER_KEY = 2;
+static constexpr size_t EXTRA_CELLS = 30;
+
+CIBLT::CIBLT(size_t capacity, uint32_t tweak) : m_tweak(tweak) {
+    const size_t cells = capacity * CELLS_PER_KEY + EXTRA_CELLS;
+    m_cells.resize((cells + HASH_COUNT - 1) / HASH_COUNT * HASH_COUNT);
+}
+
+size_t CIBLT::GetIndex(uint64_t key, size_t part) const {
+    const size_t part_size = m_cells.size() / HASH_COUNT;
+    return part * part_size +
+           CSipHasher(m_tweak, part).Write(key).Finalize() % part_size;
+}
+
+uint32_t CIBLT::GetCheckHash(uint64_t key) const {
+    return uint32_t(CSipHasher(m_tweak, HASH_COUNT).Write(key).Finalize());
+}
+
+bool CIBLT::IsPure(const Cell &cell) const {
+    return (cell.count == 1 || cell.count == -1) &&
+           cell.hash_sum == GetCheckHash(cell.key_sum);
+}
+
+void CIBLT::Update(uint64_t key, int32_t count) {
+    if (!IsValid()) {
+        return;
+    }
+    const uint32_t check_hash = GetCheckHash(key);
+    for (size_t part = 0; part < HASH_COUNT; part++) {
+        Cell &cell = m_cells[GetIndex(key, part)];
+        cell.count += count;
+        cell.key_sum ^= key;
+        cell.hash_sum ^= check_hash;
+    }
+}
+
+bool CIBLT::Decode(std::vector<uint64_t> &inserted,
+                   std::vector<uint64_t> &erased) const {
+    inserted.clear();
+    erased.clear();
+    if (!IsValid()) {
+        return false;
+    }
+
+    CIBLT table(*this);
+    std::vector<size_t> pure;
+    for (size_t i = 0; i < table.m_cells.size(); i++) {
+        if (table.IsPure(table.m_cells[i])) {
+            pure.push_back(i);
+        }
+    }
+
+    while (!pure.empty()) {
+        const Cell cell = table.m_cells[pure.back()];
+        pure.pop_back();
+        if (!table.IsPure(cell)) {
+            // Another key was removed from this cell in the meantime.
+            continue;
+        }
+        // A table cannot list more keys than it has cells, so this bounds
+        // the work spent on a malicious one.
+        if (inserted.size() + erased.size() >= table.m_cells.size()) {
+            break;
+        }
+        (cell.count == 1 ? inserted : erased).push_back(cell.key_sum);
+        table.Update(cell.key_sum, -cell.count);
+        for (size_t part = 0; part < HASH_COUNT; part++) {
+            const size_t index = table.GetIndex(cell.key_sum, part);
+            if (table.IsPure(table.m_cells[index])) {
+                pure.push_back(index);
+            }
+        }
+    }
+
+    for (const Cell &cell : table.m_cells) {
+        if (cell.count != 0 || cell.key_sum != 0 || cell.hash_sum != 0) {
+            inserted.clear();
+            erased.clear();
+            return false;
+        }
+    }
+    return true;
+}
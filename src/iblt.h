@@ -0,0 +1,77 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_IBLT_H
+#define BITCOIN_IBLT_H
+
+#include <serialize.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * An invertible Bloom lookup table of 64-bit keys.
+ *
+ * The table is split into HASH_COUNT parts of the same size, and each key is
+ * added to one cell of each part, which counts the keys and sums them along
+ * with a hash of them. Keys can be erased without being inserted first, so
+ * after inserting the keys of a set and erasing those of another one, the
+ * table can list the keys which are in only one of the sets, as long as there
+ * are not many more of them than the capacity it was created with.
+ */
+class CIBLT {
+public:
+    static constexpr size_t HASH_COUNT = 3;
+
+    //! Dummy for deserialization
+    CIBLT() {}
+    /**
+     * Create a table which can list up to capacity keys, except with a
+     * probability of about 1%. tweak is added to the seeds of the hashes.
+     */
+    CIBLT(size_t capacity, uint32_t tweak);
+
+    void Insert(uint64_t key) { Update(key, 1); }
+    void Erase(uint64_t key) { Update(key, -1); }
+
+    /**
+     * List the keys which were inserted but not erased, and those which were
+     * erased but not inserted. Returns false if the table cannot be decoded,
+     * usually because it lists too many keys.
+     */
+    bool Decode(std::vector<uint64_t> &inserted,
+                std::vector<uint64_t> &erased) const;
+
+    size_t GetCellCount() const { return m_cells.size(); }
+
+    /** Check that a table which was just deserialized can be used */
+    bool IsValid() const {
+        return !m_cells.empty() && m_cells.size() % HASH_COUNT == 0;
+    }
+
+    SERIALIZE_METHODS(CIBLT, obj) { READWRITE(obj.m_tweak, obj.m_cells); }
+
+private:
+    struct Cell {
+        int32_t count{0};
+        uint64_t key_sum{0};
+        uint32_t hash_sum{0};
+
+        SERIALIZE_METHODS(Cell, obj) {
+            READWRITE(obj.count, obj.key_sum, obj.hash_sum);
+        }
+    };
+
+    void Update(uint64_t key, int32_t count);
+    size_t GetIndex(uint64_t key, size_t part) const;
+    uint32_t GetCheckHash(uint64_t key) const;
+    //! Whether a cell holds a single key, which is then known.
+    bool IsPure(const Cell &cell) const;
+
+    uint32_t m_tweak{0};
+    std::vector<Cell> m_cells;
+};
+
+#endif // BITCOIN_IBLT_H
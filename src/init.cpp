@@ -14,6 +14,7 @@
 #include <avalanche/processor.h>
 #include <banman.h>
 #include <blockdb.h>
+#include <blockencodings.h>
 #include <blockfilter.h>
 #include <chain.h>
 #include <chainparams.h>
@@ -50,13 +51,17 @@
 #include <script/sigcache.h>
 #include <script/standard.h>
 #include <shutdown.h>
+#include <socketevents.h>
 #include <timedata.h>
 #include <torcontrol.h>
 #include <txdb.h>
 #include <txmempool.h>
+#include <txreconciliation.h>
 #include <util/asmap.h>
 #include <util/check.h>
 #include <util/moneystr.h>
+#include <util/strencodings.h>
+#include <util/string.h>
 #include <util/threadnames.h>
 #include <util/translation.h>
 #include <validation.h>
@@ -220,7 +225,7 @@ void Shutdown(NodeContext &node) {
     // * ProcessMessage locks cs_main and g_cs_orphans before indirectly calling
     //   ForEachNode which locks cs_vNodes.
     // * CConnman::Stop calls DeleteNode, which calls FinalizeNode, which locks
-    //   cs_main and calls EraseOrphansFor, which locks g_cs_orphans.
+    //   cs_main and g_cs_orphans to call TxOrphanage::EraseForPeer.
     //
     // Thus the implicit locking order requirement is:
     // (1) cs_main, (2) g_cs_orphans, (3) cs_vNodes.
@@ -529,8 +534,9 @@ void SetupServerArgs(NodeContext &node) {
         OptionsCategory::OPTIONS);
     argsman.AddArg(
         "-par=<n>",
-        strprintf("Set the number of script verification threads (%u to %d, 0 "
-                  "= auto, <0 = leave that many cores free, default: %d)",
+        strprintf("Set the number of script and header verification threads "
+                  "(%u to %d, 0 = auto, <0 = leave that many cores free, "
+                  "default: %d)",
                   -GetNumCores(), MAX_SCRIPTCHECK_THREADS,
                   DEFAULT_SCRIPTCHECK_THREADS),
         ArgsManager::ALLOW_ANY, OptionsCategory::OPTIONS);
@@ -662,6 +668,13 @@ void SetupServerArgs(NodeContext &node) {
             "Always query for peer addresses via DNS lookup (default: %d)",
             DEFAULT_FORCEDNSSEED),
         ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    argsman.AddArg(
+        "-graphene",
+        strprintf("Download blocks from the peers which support it as a Bloom "
+                  "filter and an IBLT of their transactions, which is smaller "
+                  "than a compact block, and serve them (default: %d)",
+                  DEFAULT_GRAPHENE_ENABLE),
+        ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     argsman.AddArg(
         "-listen",
         "Accept connections from outside (default: 1 if no -proxy or -connect)",
@@ -696,6 +709,14 @@ void SetupServerArgs(NodeContext &node) {
                   "backward by this amount. (default: %u seconds)",
                   DEFAULT_MAX_TIME_ADJUSTMENT),
         ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    argsman.AddArg(
+        "-msgworkers=<n>",
+        strprintf("Number of threads processing the messages which do not "
+                  "require the main lock, such as block and filter requests, "
+                  "alongside the message handler thread (0 to %d, default: "
+                  "%d)",
+                  MAX_MESSAGE_WORKERS, DEFAULT_MESSAGE_WORKERS),
+        ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     argsman.AddArg("-onion=<ip:port>",
                    strprintf("Use separate SOCKS5 proxy to reach peers via Tor "
                              "hidden services (default: %s)",
@@ -742,6 +763,18 @@ void SetupServerArgs(NodeContext &node) {
         "-seednode=<ip>",
         "Connect to a node to retrieve peer addresses, and disconnect",
         ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    argsman.AddArg(
+        "-socketevents=<mode>",
+        strprintf("Socket events mode, which must be one of: %s (default: %s)",
+                  Join(GetSupportedSocketEventsModes(), std::string(", ")),
+                  SocketEventsModeToString(GetDefaultSocketEventsMode())),
+        ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    argsman.AddArg(
+        "-socketthreads=<n>",
+        strprintf("Number of threads servicing the peer sockets in epoll mode "
+                  "(1 to %d, default: %d)",
+                  MAX_SOCKET_THREADS, DEFAULT_SOCKET_THREADS),
+        ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
     argsman.AddArg("-timeout=<n>",
                    strprintf("Specify connection timeout in milliseconds "
                              "(minimum: 1, default: %d)",
@@ -764,6 +797,12 @@ void SetupServerArgs(NodeContext &node) {
                    "Tor control port password (default: empty)",
                    ArgsManager::ALLOW_ANY | ArgsManager::SENSITIVE,
                    OptionsCategory::CONNECTION);
+    argsman.AddArg(
+        "-txreconciliation",
+        strprintf("Reconcile transactions with the peers which support it "
+                  "rather than announce them all (default: %d)",
+                  DEFAULT_TXRECONCILIATION_ENABLE),
+        ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
 #ifdef USE_UPNP
 #if USE_UPNP
     argsman.AddArg("-upnp",
@@ -804,6 +843,18 @@ void SetupServerArgs(NodeContext &node) {
                   "MiB per 24h), 0 = no limit (default: %d)",
                   DEFAULT_MAX_UPLOAD_TARGET),
         ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    argsman.AddArg(
+        "-uploadrate=<class>:<n>",
+        "Limit the outbound traffic of the given class to <n> kB per second "
+        "across all peers, 0 = no limit (default: 0). Can be specified "
+        "multiple times. Classes are historicalblocks, recentblocks, "
+        "transactions, addr, filters, avalanche and other. Blocks older than "
+        "a week are historical.",
+        ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
+    argsman.AddArg("-peeruploadrate=<n>",
+                   "Limit the outbound traffic to each peer to <n> kB per "
+                   "second, 0 = no limit (default: 0)",
+                   ArgsManager::ALLOW_ANY, OptionsCategory::CONNECTION);
 
     g_wallet_init_interface.AddWalletOptions(argsman);
 
@@ -1631,6 +1682,9 @@ int nUserMaxConnections;
 int nFD;
 ServiceFlags nLocalServices = ServiceFlags(NODE_NETWORK | NODE_NETWORK_LIMITED);
 int64_t peer_connect_timeout;
+SocketEventsMode socket_events_mode;
+int socket_threads;
+int message_workers;
 std::set<BlockFilterType> g_enabled_filter_types;
 
 } // namespace
@@ -1958,6 +2012,29 @@ bool AppInitParameterInteraction(Config &config, const ArgsManager &args) {
             "peertimeout cannot be configured with a negative value."));
     }
 
+    const std::string socket_events =
+        args.GetArg("-socketevents",
+                    SocketEventsModeToString(GetDefaultSocketEventsMode()));
+    if (!ParseSocketEventsMode(socket_events, socket_events_mode)) {
+        return InitError(strprintf(
+            Untranslated("Unsupported socket events mode: -socketevents=%s"),
+            socket_events));
+    }
+
+    socket_threads = args.GetArg("-socketthreads", DEFAULT_SOCKET_THREADS);
+    if (socket_threads < 1 || socket_threads > MAX_SOCKET_THREADS) {
+        return InitError(strprintf(
+            Untranslated("socketthreads must be between 1 and %d"),
+            MAX_SOCKET_THREADS));
+    }
+
+    message_workers = args.GetArg("-msgworkers", DEFAULT_MESSAGE_WORKERS);
+    if (message_workers < 0 || message_workers > MAX_MESSAGE_WORKERS) {
+        return InitError(
+            strprintf(Untranslated("msgworkers must be between 0 and %d"),
+                      MAX_MESSAGE_WORKERS));
+    }
+
     // Obtain the amount to charge excess UTXO
     if (args.IsArgSet("-excessutxocharge")) {
         Amount n = Amount::zero();
@@ -2031,6 +2108,14 @@ bool AppInitParameterInteraction(Config &config, const ArgsManager &args) {
         nLocalServices = ServiceFlags(nLocalServices | NODE_BLOOM);
     }
 
+    if (args.GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION_ENABLE)) {
+        nLocalServices = ServiceFlags(nLocalServices | NODE_TXRECONCILIATION);
+    }
+
+    if (args.GetBoolArg("-graphene", DEFAULT_GRAPHENE_ENABLE)) {
+        nLocalServices = ServiceFlags(nLocalServices | NODE_GRAPHENE);
+    }
+
     nMaxTipAge = args.GetArg("-maxtipage", DEFAULT_MAX_TIP_AGE);
 
     return true;
@@ -2181,6 +2266,10 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
         for (int i = 0; i < script_threads; ++i) {
             threadGroup.create_thread([i]() { return ThreadScriptCheck(i); });
         }
+        // Header checks are batched the same way, use as many threads.
+        for (int i = 0; i < script_threads; ++i) {
+            threadGroup.create_thread([i]() { return ThreadHeaderCheck(i); });
+        }
     }
 
     assert(!node.scheduler);
@@ -2418,6 +2507,27 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
             1024;
     }
 
+    // upload rates are unlimited unless set, peers with the noban permission
+    // are never limited
+    std::map<TrafficClass, uint64_t> upload_rates;
+    for (const std::string &str : args.GetArgs("-uploadrate")) {
+        const size_t pos = str.find(':');
+        TrafficClass traffic_class;
+        int64_t rate;
+        if (pos == std::string::npos ||
+            !ParseTrafficClass(str.substr(0, pos), traffic_class) ||
+            !ParseInt64(str.substr(pos + 1), &rate) || rate < 0) {
+            return InitError(
+                strprintf(Untranslated("Invalid -uploadrate=%s"), str));
+        }
+        upload_rates[traffic_class] = uint64_t(rate) * 1000;
+    }
+    const int64_t peer_upload_rate = args.GetArg("-peeruploadrate", 0);
+    if (peer_upload_rate < 0) {
+        return InitError(Untranslated(
+            "peeruploadrate cannot be configured with a negative value."));
+    }
+
     // Step 6.5 (I guess ?): Initialize Avalanche.
     g_avalanche =
         std::make_unique<avalanche::Processor>(*node.chain, node.connman.get());
@@ -2888,7 +2998,12 @@ bool AppInitMain(Config &config, RPCServer &rpcServer,
 
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
+    connOptions.m_upload_rates = upload_rates;
+    connOptions.m_peer_upload_rate = uint64_t(peer_upload_rate) * 1000;
     connOptions.m_peer_connect_timeout = peer_connect_timeout;
+    connOptions.m_socket_events_mode = socket_events_mode;
+    connOptions.m_socket_threads = socket_threads;
+    connOptions.m_message_workers = message_workers;
 
     for (const std::string &strBind : args.GetArgs("-bind")) {
         CService addrBind;
@@ -25,6 +25,7 @@
 #include <cstring>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_POLL
@@ -44,6 +45,7 @@ static_assert(MINIUPNPC_API_VERSION >= 10,
 #include <unordered_map>
 
 #include <cmath>
+#include <limits>
 
 // How often to dump addresses to peers.dat
 static constexpr std::chrono::minutes DUMP_PEERS_INTERVAL{15};
@@ -68,6 +70,22 @@ static constexpr std::chrono::minutes DNSSEEDS_DELAY_MANY_PEERS{5};
 // "many" vs "few" peers
 static constexpr int DNSSEEDS_DELAY_PEER_THRESHOLD = 1000;
 
+/** Maximum number of queued buffers handed to a single send call */
+static constexpr size_t MAX_SEND_BUFFERS = 256;
+/**
+ * Payloads up to this size are sent in the same buffer as their header,
+ * saving an allocation and an entry in the send queue.
+ */
+static constexpr size_t MAX_COALESCED_PAYLOAD_SIZE = 4 * 1024;
+/**
+ * Minimum number of bytes sent at once by a peer subject to upload rate
+ * limits, unless that empties its send queue, so that a slow rate does not
+ * result in a flurry of tiny sends.
+ */
+static constexpr size_t MIN_SHAPED_SEND_SIZE = 1000;
+/** How often to retry sending to peers over their upload rate limit */
+static constexpr int SEND_THROTTLED_RETRY_MILLISECONDS = 10;
+
 // We add a random period time (0 to 1 seconds) to feeler connections to prevent
 // synchronization.
 #define FEELER_SLEEP_WINDOW 1
@@ -462,7 +480,13 @@ CNode *CConnman::ConnectNode(CAddress addrConnect, const char *pszDest,
         return nullptr;
     }
 
-    // Add node
+    return CreateOutboundNode(hSocket, addrConnect, pszDest, block_relay_only);
+}
+
+CNode *CConnman::CreateOutboundNode(SOCKET hSocket,
+                                    const CAddress &addrConnect,
+                                    const char *pszDest,
+                                    bool block_relay_only) {
     NodeId id = GetNewNodeId();
     uint64_t nonce = GetDeterministicRandomizer(RANDOMIZER_ID_LOCALHOSTNONCE)
                          .Write(id)
@@ -473,6 +497,10 @@ CNode *CConnman::ConnectNode(CAddress addrConnect, const char *pszDest,
                   CalculateKeyedNetGroup(addrConnect), nonce, addr_bind,
                   pszDest ? pszDest : "", false, block_relay_only);
     pnode->AddRef();
+    if (m_peer_upload_rate > 0) {
+        LOCK(pnode->cs_vSend);
+        pnode->m_upload_bucket.SetRate(m_peer_upload_rate, m_peer_upload_rate);
+    }
 
     // We're making a new connection, harvest entropy from the time (and our
     // peer count)
@@ -638,6 +666,31 @@ bool CNode::ReceiveMsgBytes(const Config &config, const char *pch,
     return true;
 }
 
+void CNode::SampleTelemetry(int64_t time) {
+    uint64_t bytes_recv;
+    mapMsgCmdSize bytes_recv_per_msg_type;
+    {
+        LOCK(cs_vRecv);
+        bytes_recv = nRecvBytes;
+        bytes_recv_per_msg_type = mapRecvBytesPerMsgCmd;
+    }
+    uint64_t bytes_sent;
+    mapMsgCmdSize bytes_sent_per_msg_type;
+    size_t send_queue_size;
+    {
+        LOCK(cs_vSend);
+        bytes_sent = nSendBytes;
+        bytes_sent_per_msg_type = mapSendBytesPerMsgCmd;
+        send_queue_size = nSendSize;
+    }
+    size_t process_queue_size =
+        WITH_LOCK(cs_vProcessMsg, return nProcessQueueSize);
+
+    m_telemetry.Sample(time, bytes_recv, bytes_sent, bytes_recv_per_msg_type,
+                       bytes_sent_per_msg_type, send_queue_size,
+                       process_queue_size);
+}
+
 void CNode::SetSendVersion(int nVersionIn) {
     // Send version may only be changed in the version message, and only one
     // version message is allowed per session. We can therefore treat this value
@@ -708,12 +761,37 @@ int V1TransportDeserializer::readData(const char *pch, uint32_t nBytes) {
     }
 
     hasher.Write((const uint8_t *)pch, nCopy);
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    // The data may have been received in place, see GetReadBuffer().
+    if (pch != &vRecv[nDataPos]) {
+        memcpy(&vRecv[nDataPos], pch, nCopy);
+    }
     nDataPos += nCopy;
 
     return nCopy;
 }
 
+Span<char> V1TransportDeserializer::GetReadBuffer() {
+    if (!in_data) {
+        return {};
+    }
+
+    // Small payloads are better received along with the messages following
+    // them, in a single recv() call.
+    const uint32_t nRemaining = hdr.nMessageSize - nDataPos;
+    if (nRemaining < DIRECT_RECV_MIN_SIZE) {
+        return {};
+    }
+
+    // Like readData(), never allocate more than 256 KiB ahead of the data
+    // actually received. The vector capacity grows geometrically, so large
+    // payloads are only reallocated a logarithmic number of times.
+    const uint32_t nSize = std::min(nRemaining, DIRECT_RECV_MAX_SIZE);
+    if (vRecv.size() < nDataPos + nSize) {
+        vRecv.resize(nDataPos + nSize);
+    }
+    return Span<char>(&vRecv[nDataPos], nSize);
+}
+
 const uint256 &V1TransportDeserializer::GetMessageHash() const {
     assert(Complete());
     if (data_hash.IsNull()) {
@@ -782,14 +860,110 @@ void V1TransportSerializer::prepareForTransport(const Config &config,
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, header, 0, hdr};
 }
 
-size_t CConnman::SocketSendData(CNode *pnode) const
+/**
+ * Send as many buffers of the queue as possible in a single call, starting at
+ * offset in the first one, up to nLimit bytes. nAttempted is set to the number
+ * of bytes which were passed to the call. Returns the result of the call.
+ */
+static ssize_t SendBuffers(SOCKET hSocket,
+                           std::deque<CSendBuffer>::const_iterator it,
+                           std::deque<CSendBuffer>::const_iterator end,
+                           size_t offset, size_t nLimit, size_t &nAttempted) {
+#ifdef WIN32
+    nAttempted = std::min(it->size() - offset, nLimit);
+    return send(hSocket, reinterpret_cast<const char *>(it->data()) + offset,
+                nAttempted, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+    struct iovec iov[MAX_SEND_BUFFERS];
+    size_t nBuffers = 0;
+    nAttempted = 0;
+    for (; it != end && nBuffers < MAX_SEND_BUFFERS && nAttempted < nLimit;
+         ++it, ++nBuffers) {
+        iov[nBuffers].iov_base = const_cast<uint8_t *>(it->data()) + offset;
+        iov[nBuffers].iov_len =
+            std::min(it->size() - offset, nLimit - nAttempted);
+        nAttempted += iov[nBuffers].iov_len;
+        offset = 0;
+    }
+
+    struct msghdr msg {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = nBuffers;
+    return sendmsg(hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
+}
+
+size_t CConnman::GetSendAllowance(CNode *pnode, size_t nFirst,
+                                  int64_t nTimeMicros) {
+    const BandwidthShaper::ByteCounts available =
+        m_shaper.GetAvailable(nTimeMicros);
+    const uint64_t nPeerAvailable =
+        pnode->m_upload_bucket.GetAvailable(nTimeMicros);
+
+    BandwidthShaper::ByteCounts used{};
+    uint64_t nAllowed = 0;
+    size_t offset = pnode->nSendOffset;
+    for (size_t i = nFirst;
+         i < pnode->vSendMsg.size() && i < nFirst + MAX_SEND_BUFFERS; i++) {
+        const CSendBuffer &buffer = pnode->vSendMsg[i];
+        const size_t c = static_cast<size_t>(buffer.GetTrafficClass());
+        const uint64_t nRemaining = buffer.size() - offset;
+        offset = 0;
+
+        const uint64_t nPart = std::min(
+            {nRemaining, available[c] - used[c], nPeerAvailable - nAllowed});
+        used[c] += nPart;
+        nAllowed += nPart;
+        if (nPart < nRemaining) {
+            // The rest of the queue has to wait for this buffer.
+            return nAllowed < MIN_SHAPED_SEND_SIZE ? 0 : nAllowed;
+        }
+    }
+    return nAllowed;
+}
+
+void CConnman::SetSendThrottled(CNode *pnode, bool throttled) {
+    pnode->fSendThrottled = throttled;
+    if (!UseSocketIOThreads()) {
+        // The socket handler thread checks the flag directly.
+        return;
+    }
+
+    SocketIOThread &io =
+        *m_socket_io_threads[pnode->GetId() % m_socket_io_threads.size()];
+    LOCK(io.cs_send_throttled);
+    if (throttled) {
+        io.send_throttled.insert(pnode->GetId());
+    } else {
+        io.send_throttled.erase(pnode->GetId());
+    }
+}
+
+size_t CConnman::SocketSendData(CNode *pnode)
     EXCLUSIVE_LOCKS_REQUIRED(pnode->cs_vSend) {
     size_t nSentSize = 0;
     size_t nMsgCount = 0;
 
-    for (const auto &data : pnode->vSendMsg) {
-        assert(data.size() > pnode->nSendOffset);
-        int nBytes = 0;
+    // Peers with the noban permission are not subject to upload rate limits,
+    // like they are not subject to the upload target.
+    const bool fShaped =
+        (m_shaper.IsActive() || pnode->m_upload_bucket.IsLimited()) &&
+        !pnode->HasPermission(PF_NOBAN);
+    bool fThrottled = false;
+
+    while (nMsgCount < pnode->vSendMsg.size()) {
+        assert(pnode->vSendMsg[nMsgCount].size() > pnode->nSendOffset);
+        ssize_t nBytes = 0;
+        size_t nAttempted = 0;
+
+        size_t nLimit = std::numeric_limits<size_t>::max();
+        if (fShaped) {
+            nLimit = GetSendAllowance(pnode, nMsgCount, GetTimeMicros());
+            if (nLimit == 0) {
+                fThrottled = true;
+                break;
+            }
+        }
 
         {
             LOCK(pnode->cs_hSocket);
@@ -797,12 +971,12 @@ size_t CConnman::SocketSendData(CNode *pnode) const
                 break;
             }
 
-            nBytes = send(pnode->hSocket,
-                          reinterpret_cast<const char *>(data.data()) +
-                              pnode->nSendOffset,
-                          data.size() - pnode->nSendOffset,
-                          MSG_NOSIGNAL | MSG_DONTWAIT);
+            nBytes = SendBuffers(pnode->hSocket,
+                                 pnode->vSendMsg.cbegin() + nMsgCount,
+                                 pnode->vSendMsg.cend(), pnode->nSendOffset,
+                                 nLimit, nAttempted);
         }
+        nTotalSendCalls++;
 
         if (nBytes == 0) {
             // couldn't send anything at all
@@ -824,21 +998,44 @@ size_t CConnman::SocketSendData(CNode *pnode) const
         assert(nBytes > 0);
         pnode->nLastSend = GetSystemTimeInSeconds();
         pnode->nSendBytes += nBytes;
-        pnode->nSendOffset += nBytes;
         nSentSize += nBytes;
-        if (pnode->nSendOffset != data.size()) {
-            // could not send full message; stop sending more
-            break;
-        }
 
-        pnode->nSendOffset = 0;
-        pnode->nSendSize -= data.size();
+        // Pop the buffers which have been sent completely.
+        BandwidthShaper::ByteCounts sent{};
+        size_t nLeft = nBytes;
+        while (nLeft > 0) {
+            const CSendBuffer &buffer = pnode->vSendMsg[nMsgCount];
+            const size_t nSize = buffer.size();
+            sent[static_cast<size_t>(buffer.GetTrafficClass())] +=
+                std::min(nLeft, nSize - pnode->nSendOffset);
+            if (nLeft < nSize - pnode->nSendOffset) {
+                pnode->nSendOffset += nLeft;
+                break;
+            }
+            nLeft -= nSize - pnode->nSendOffset;
+            pnode->nSendOffset = 0;
+            pnode->nSendSize -= nSize;
+            nMsgCount++;
+        }
         pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
-        nMsgCount++;
+
+        if (fShaped) {
+            const int64_t nTimeMicros = GetTimeMicros();
+            m_shaper.Consume(sent, nTimeMicros);
+            pnode->m_upload_bucket.Consume(nBytes, nTimeMicros);
+        }
+
+        if (size_t(nBytes) != nAttempted) {
+            // could not send everything; stop sending more
+            break;
+        }
     }
 
     pnode->vSendMsg.erase(pnode->vSendMsg.begin(),
                           pnode->vSendMsg.begin() + nMsgCount);
+    if (fThrottled != pnode->fSendThrottled) {
+        SetSendThrottled(pnode, fThrottled);
+    }
 
     if (pnode->vSendMsg.empty()) {
         assert(pnode->nSendOffset == 0);
@@ -1164,10 +1361,15 @@ void CConnman::AcceptConnection(const ListenSocket &hListenSocket) {
     // it as whitelisted (backward compatibility)
     pnode->m_legacyWhitelisted = legacyWhitelisted;
     pnode->m_prefer_evict = discouraged;
+    if (m_peer_upload_rate > 0) {
+        LOCK(pnode->cs_vSend);
+        pnode->m_upload_bucket.SetRate(m_peer_upload_rate, m_peer_upload_rate);
+    }
     m_msgproc->InitializeNode(*config, pnode);
 
     LogPrint(BCLog::NET, "connection from %s accepted\n", addr.ToString());
 
+    RegisterNode(pnode);
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
@@ -1205,6 +1407,8 @@ void CConnman::DisconnectNodes() {
                 // release outbound grant (if any)
                 pnode->grantOutbound.Release();
 
+                UnregisterNode(pnode);
+
                 // close socket and cleanup
                 pnode->CloseSocketDisconnect();
 
@@ -1294,6 +1498,20 @@ bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set,
     }
 
     {
+        // Wait for the connection attempts to complete, then for the proxy to
+        // be ready for the next step of the SOCKS5 handshake.
+        LOCK(cs_pending_connections);
+        for (const PendingConnection &conn : m_pending_connections) {
+            error_set.insert(conn.hSocket);
+            if (!conn.connected || (conn.socks5 && conn.socks5->WantsSend())) {
+                send_set.insert(conn.hSocket);
+            } else {
+                recv_set.insert(conn.hSocket);
+            }
+        }
+    }
+
+    if (!UseSocketIOThreads()) {
         LOCK(cs_vNodes);
         for (CNode *pnode : vNodes) {
             // Implement the following logic:
@@ -1307,6 +1525,9 @@ bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set,
             //   select() for receiving data.
             // * Hand off all complete messages to the processor, to be handled
             //   without blocking here.
+            // * Peers over their upload rate limit are not waited on at all:
+            //   their socket is likely writable, and sending is retried after
+            //   each wait anyway (see SocketHandler).
 
             bool select_recv = !pnode->fPauseRecv;
             bool select_send;
@@ -1321,6 +1542,9 @@ bool CConnman::GenerateSelectSet(std::set<SOCKET> &recv_set,
             }
 
             error_set.insert(pnode->hSocket);
+            if (pnode->fSendThrottled) {
+                continue;
+            }
             if (select_send) {
                 send_set.insert(pnode->hSocket);
                 continue;
@@ -1474,6 +1698,86 @@ void CConnman::SocketEvents(std::set<SOCKET> &recv_set,
 }
 #endif
 
+bool CConnman::SocketRecvData(CNode *pnode) {
+    // typical socket buffer is 8K-64K
+    char pchBuf[0x10000];
+    // The payload of large messages is received straight into the message
+    // buffer, saving a copy. Only this thread reads into the deserializer, so
+    // the buffer remains valid once cs_vRecv is released.
+    Span<char> buf;
+    {
+        LOCK(pnode->cs_vRecv);
+        buf = pnode->m_deserializer->GetReadBuffer();
+    }
+    if (buf.size() == 0) {
+        buf = Span<char>(pchBuf, sizeof(pchBuf));
+    }
+    int32_t nBytes = 0;
+    {
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET) {
+            return false;
+        }
+        nBytes = recv(pnode->hSocket, buf.data(), size_t(buf.size()),
+                      MSG_DONTWAIT);
+    }
+    nTotalRecvCalls++;
+    if (nBytes > 0) {
+        bool notify = false;
+        if (!pnode->ReceiveMsgBytes(*config, buf.data(), nBytes, notify)) {
+            pnode->CloseSocketDisconnect();
+        }
+        RecordBytesRecv(nBytes);
+        if (notify) {
+            size_t nSizeAdded = 0;
+            auto it(pnode->vRecvMsg.begin());
+            for (; it != pnode->vRecvMsg.end(); ++it) {
+                // vRecvMsg contains only completed CNetMessage
+                // the single possible partially deserialized message
+                // are held by TransportDeserializer
+                nSizeAdded += it->m_raw_message_size;
+            }
+            {
+                LOCK(pnode->cs_vProcessMsg);
+                pnode->vProcessMsg.splice(pnode->vProcessMsg.end(),
+                                          pnode->vRecvMsg,
+                                          pnode->vRecvMsg.begin(), it);
+                pnode->nProcessQueueSize += nSizeAdded;
+                pnode->fPauseRecv =
+                    pnode->nProcessQueueSize > nReceiveFloodSize;
+            }
+            WakeMessageHandler();
+        }
+        // A short read means the socket buffer has been drained: any data
+        // arriving later will trigger a new event.
+        return nBytes == int32_t(buf.size());
+    }
+
+    if (nBytes == 0) {
+        // socket closed gracefully
+        if (!pnode->fDisconnect) {
+            LogPrint(BCLog::NET, "socket closed for peer=%d\n",
+                     pnode->GetId());
+        }
+        pnode->CloseSocketDisconnect();
+        return false;
+    }
+
+    // error
+    int nErr = WSAGetLastError();
+    if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR &&
+        nErr != WSAEINPROGRESS) {
+        if (!pnode->fDisconnect) {
+            LogPrint(BCLog::NET, "socket recv error for peer=%d: %s\n",
+                     pnode->GetId(), NetworkErrorString(nErr));
+        }
+        pnode->CloseSocketDisconnect();
+        return false;
+    }
+    // Interrupted calls may be retried.
+    return nErr == WSAEINTR;
+}
+
 void CConnman::SocketHandler() {
     std::set<SOCKET> recv_set, send_set, error_set;
     SocketEvents(recv_set, send_set, error_set);
@@ -1492,6 +1796,13 @@ void CConnman::SocketHandler() {
         }
     }
 
+    PendingConnectionsHandler(recv_set, send_set, error_set);
+
+    // The peers are serviced by their own I/O thread in epoll mode.
+    if (UseSocketIOThreads()) {
+        return;
+    }
+
     //
     // Service each socket
     //
@@ -1524,69 +1835,13 @@ void CConnman::SocketHandler() {
             errorSet = error_set.count(pnode->hSocket) > 0;
         }
         if (recvSet || errorSet) {
-            // typical socket buffer is 8K-64K
-            char pchBuf[0x10000];
-            int32_t nBytes = 0;
-            {
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET) {
-                    continue;
-                }
-                nBytes =
-                    recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-            }
-            if (nBytes > 0) {
-                bool notify = false;
-                if (!pnode->ReceiveMsgBytes(*config, pchBuf, nBytes, notify)) {
-                    pnode->CloseSocketDisconnect();
-                }
-                RecordBytesRecv(nBytes);
-                if (notify) {
-                    size_t nSizeAdded = 0;
-                    auto it(pnode->vRecvMsg.begin());
-                    for (; it != pnode->vRecvMsg.end(); ++it) {
-                        // vRecvMsg contains only completed CNetMessage
-                        // the single possible partially deserialized message
-                        // are held by TransportDeserializer
-                        nSizeAdded += it->m_raw_message_size;
-                    }
-                    {
-                        LOCK(pnode->cs_vProcessMsg);
-                        pnode->vProcessMsg.splice(pnode->vProcessMsg.end(),
-                                                  pnode->vRecvMsg,
-                                                  pnode->vRecvMsg.begin(), it);
-                        pnode->nProcessQueueSize += nSizeAdded;
-                        pnode->fPauseRecv =
-                            pnode->nProcessQueueSize > nReceiveFloodSize;
-                    }
-                    WakeMessageHandler();
-                }
-            } else if (nBytes == 0) {
-                // socket closed gracefully
-                if (!pnode->fDisconnect) {
-                    LogPrint(BCLog::NET, "socket closed for peer=%d\n",
-                             pnode->GetId());
-                }
-                pnode->CloseSocketDisconnect();
-            } else if (nBytes < 0) {
-                // error
-                int nErr = WSAGetLastError();
-                if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE &&
-                    nErr != WSAEINTR && nErr != WSAEINPROGRESS) {
-                    if (!pnode->fDisconnect) {
-                        LogPrint(BCLog::NET,
-                                 "socket recv error for peer=%d: %s\n",
-                                 pnode->GetId(), NetworkErrorString(nErr));
-                    }
-                    pnode->CloseSocketDisconnect();
-                }
-            }
+            SocketRecvData(pnode);
         }
 
         //
         // Send
         //
-        if (sendSet) {
+        if (sendSet || pnode->fSendThrottled) {
             LOCK(pnode->cs_vSend);
             size_t nBytes = SocketSendData(pnode);
             if (nBytes) {
@@ -1604,6 +1859,93 @@ void CConnman::SocketHandler() {
     }
 }
 
+void CConnman::PendingConnectionsHandler(const std::set<SOCKET> &recv_set,
+                                         const std::set<SOCKET> &send_set,
+                                         const std::set<SOCKET> &error_set) {
+    const int64_t nNow = GetTimeMillis();
+    std::vector<std::list<PendingConnection>::iterator> established;
+    {
+        LOCK(cs_pending_connections);
+        for (auto it = m_pending_connections.begin();
+             it != m_pending_connections.end();) {
+            PendingConnection &conn = *it;
+            const bool ready = recv_set.count(conn.hSocket) > 0 ||
+                               send_set.count(conn.hSocket) > 0 ||
+                               error_set.count(conn.hSocket) > 0;
+            bool failed = !fNetworkActive;
+            // Failures to connect to the proxy are not the fault of the peer.
+            bool count_attempt = fNetworkActive;
+            if (!failed && !conn.connected) {
+                if (ready) {
+                    conn.connected = FinishConnectSocket(
+                        conn.target, conn.hSocket, conn.socks5 != nullptr);
+                    failed = !conn.connected;
+                    conn.nDeadline = nNow + SOCKS5_RECV_TIMEOUT;
+                } else if (nNow > conn.nDeadline) {
+                    LogPrint(BCLog::NET, "connection to %s timeout\n",
+                             conn.target.ToString());
+                    failed = true;
+                }
+                count_attempt &= !failed || !conn.socks5;
+            }
+            if (!failed && conn.connected && conn.socks5) {
+                if (ready) {
+                    conn.socks5->Advance(conn.hSocket);
+                }
+                switch (conn.socks5->GetStatus()) {
+                    case Socks5Handshake::Status::IN_PROGRESS:
+                        if (nNow > conn.nDeadline) {
+                            LogPrint(BCLog::NET,
+                                     "SOCKS5 connection to %s timeout\n",
+                                     conn.addr.ToString());
+                            failed = true;
+                        }
+                        break;
+                    case Socks5Handshake::Status::FAILED:
+                        failed = true;
+                        break;
+                    case Socks5Handshake::Status::SUCCEEDED:
+                        break;
+                }
+            }
+
+            if (failed) {
+                if (count_attempt) {
+                    addrman.Attempt(conn.addr, conn.fCountFailure);
+                }
+                CloseSocket(conn.hSocket);
+                it = m_pending_connections.erase(it);
+                continue;
+            }
+            if (conn.connected &&
+                (!conn.socks5 || conn.socks5->GetStatus() ==
+                                     Socks5Handshake::Status::SUCCEEDED)) {
+                addrman.Attempt(conn.addr, conn.fCountFailure);
+                established.push_back(it);
+            }
+            ++it;
+        }
+    }
+
+    // Only this thread modifies the pending connections, so they can be
+    // turned into nodes without holding the lock. They are replaced by their
+    // node in one go, so that ThreadOpenConnections always accounts for them.
+    for (auto it : established) {
+        PendingConnection &conn = *it;
+        CNode *pnode = CreateOutboundNode(conn.hSocket, conn.addr, nullptr,
+                                          conn.block_relay_only);
+        conn.hSocket = INVALID_SOCKET;
+        conn.grant.MoveTo(pnode->grantOutbound);
+        pnode->fFeeler = conn.fFeeler;
+
+        m_msgproc->InitializeNode(*config, pnode);
+        RegisterNode(pnode);
+        LOCK2(cs_pending_connections, cs_vNodes);
+        vNodes.push_back(pnode);
+        m_pending_connections.erase(it);
+    }
+}
+
 void CConnman::ThreadSocketHandler() {
     while (!interruptNet) {
         DisconnectNodes();
@@ -1612,6 +1954,179 @@ void CConnman::ThreadSocketHandler() {
     }
 }
 
+void CConnman::RegisterNode(CNode *pnode) {
+    if (!UseSocketIOThreads()) {
+        return;
+    }
+
+    SocketIOThread &io =
+        *m_socket_io_threads[pnode->GetId() % m_socket_io_threads.size()];
+    {
+        LOCK(io.cs_nodes);
+        pnode->AddRef();
+        io.nodes.emplace(pnode->GetId(), pnode);
+    }
+
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket != INVALID_SOCKET &&
+        !io.events.Add(pnode->hSocket, pnode->GetId())) {
+        LogPrintf("Failed to register socket of peer=%d: %s\n",
+                  pnode->GetId(), NetworkErrorString(WSAGetLastError()));
+        pnode->fDisconnect = true;
+    }
+}
+
+void CConnman::UnregisterNode(CNode *pnode) {
+    if (!UseSocketIOThreads()) {
+        return;
+    }
+
+    SocketIOThread &io =
+        *m_socket_io_threads[pnode->GetId() % m_socket_io_threads.size()];
+    WITH_LOCK(io.cs_send_throttled, io.send_throttled.erase(pnode->GetId()));
+    {
+        // Closed sockets are removed from the epoll set by the kernel.
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket != INVALID_SOCKET) {
+            io.events.Remove(pnode->hSocket);
+        }
+    }
+
+    LOCK(io.cs_nodes);
+    if (io.nodes.erase(pnode->GetId())) {
+        pnode->Release();
+    }
+}
+
+void CConnman::ThreadSocketIO(SocketIOThread &io) {
+    // The epoll set is edge-triggered, so the peers whose socket may still
+    // hold data are remembered until a read would block. Their data is left
+    // in the socket while their receive queue is full, or while they have
+    // data to send, so that TCP flow control applies (see GenerateSelectSet).
+    std::set<NodeId> recv_pending;
+    std::vector<EpollSocketEvents::Event> events;
+    int64_t nNextInactivityCheck = 0;
+
+    auto can_recv = [](CNode *pnode) {
+        if (pnode->fPauseRecv) {
+            return false;
+        }
+        LOCK(pnode->cs_vSend);
+        return pnode->vSendMsg.empty();
+    };
+
+    while (!interruptNet) {
+        bool fRecvReady = false;
+        const bool fSendThrottled =
+            WITH_LOCK(io.cs_send_throttled, return !io.send_throttled.empty());
+        {
+            LOCK(io.cs_nodes);
+            for (auto it = recv_pending.begin(); it != recv_pending.end();) {
+                auto node_it = io.nodes.find(*it);
+                if (node_it == io.nodes.end()) {
+                    it = recv_pending.erase(it);
+                    continue;
+                }
+                fRecvReady |= can_recv(node_it->second);
+                ++it;
+            }
+        }
+
+        int timeout_ms = SELECT_TIMEOUT_MILLISECONDS;
+        if (fRecvReady) {
+            timeout_ms = 0;
+        } else if (fSendThrottled) {
+            timeout_ms = SEND_THROTTLED_RETRY_MILLISECONDS;
+        }
+        if (!io.events.Wait(events, timeout_ms)) {
+            LogPrintf("socket epoll error %s\n",
+                      NetworkErrorString(WSAGetLastError()));
+            interruptNet.sleep_for(
+                std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS));
+        }
+
+        if (interruptNet) {
+            return;
+        }
+
+        std::set<NodeId> send_ready;
+        for (const EpollSocketEvents::Event &event : events) {
+            if (event.recv || event.error) {
+                recv_pending.insert(event.id);
+            }
+            if (event.send) {
+                send_ready.insert(event.id);
+            }
+        }
+        // There is no send event for the peers which stopped sending because
+        // of their upload rate limit, as their socket remained writable.
+        if (fSendThrottled) {
+            LOCK(io.cs_send_throttled);
+            send_ready.insert(io.send_throttled.begin(),
+                              io.send_throttled.end());
+        }
+
+        const int64_t nNow = GetSystemTimeInSeconds();
+        const bool fInactivityCheck = nNow >= nNextInactivityCheck;
+        if (fInactivityCheck) {
+            nNextInactivityCheck = nNow + 1;
+        }
+
+        std::vector<CNode *> vNodesCopy;
+        {
+            LOCK(io.cs_nodes);
+            if (fInactivityCheck) {
+                for (const auto &entry : io.nodes) {
+                    vNodesCopy.push_back(entry.second);
+                }
+            } else {
+                std::set<NodeId> active = recv_pending;
+                active.insert(send_ready.begin(), send_ready.end());
+                for (NodeId id : active) {
+                    auto it = io.nodes.find(id);
+                    if (it != io.nodes.end()) {
+                        vNodesCopy.push_back(it->second);
+                    }
+                }
+            }
+            for (CNode *pnode : vNodesCopy) {
+                pnode->AddRef();
+            }
+        }
+
+        for (CNode *pnode : vNodesCopy) {
+            const NodeId id = pnode->GetId();
+
+            //
+            // Send
+            //
+            if (send_ready.count(id)) {
+                LOCK(pnode->cs_vSend);
+                size_t nBytes = SocketSendData(pnode);
+                if (nBytes) {
+                    RecordBytesSent(nBytes);
+                }
+            }
+
+            //
+            // Receive
+            //
+            if (recv_pending.count(id) && can_recv(pnode) &&
+                !SocketRecvData(pnode)) {
+                recv_pending.erase(id);
+            }
+
+            if (fInactivityCheck) {
+                InactivityCheck(pnode);
+            }
+        }
+
+        for (CNode *pnode : vNodesCopy) {
+            pnode->Release();
+        }
+    }
+}
+
 void CConnman::WakeMessageHandler() {
     {
         LOCK(mutexMsgProc);
@@ -1989,6 +2504,19 @@ void CConnman::ThreadOpenConnections(const std::vector<std::string> connect) {
         int nOutboundFullRelay = 0;
         int nOutboundBlockRelay = 0;
         std::set<std::vector<uint8_t>> setConnected;
+        {
+            // The connections being established are accounted for before the
+            // nodes, so that they are not missed while they are moved there.
+            LOCK(cs_pending_connections);
+            for (const PendingConnection &conn : m_pending_connections) {
+                setConnected.insert(conn.addr.GetGroup(addrman.m_asmap));
+                if (conn.block_relay_only) {
+                    nOutboundBlockRelay++;
+                } else if (!conn.fFeeler) {
+                    nOutboundFullRelay++;
+                }
+            }
+        }
         {
             LOCK(cs_vNodes);
             for (const CNode *pnode : vNodes) {
@@ -2124,10 +2652,10 @@ void CConnman::ThreadOpenConnections(const std::vector<std::string> connect) {
                 nOutboundBlockRelay < m_max_outbound_block_relay && !fFeeler &&
                 nOutboundFullRelay >= m_max_outbound_full_relay;
 
-            OpenNetworkConnection(
+            StartOutboundConnection(
                 addrConnect,
                 int(setConnected.size()) >= std::min(nMaxConnections - 1, 2),
-                &grant, nullptr, false, fFeeler, false, block_relay_only);
+                grant, fFeeler, block_relay_only);
         }
     }
 }
@@ -2219,6 +2747,67 @@ void CConnman::ThreadOpenAddedConnections() {
     }
 }
 
+void CConnman::StartOutboundConnection(const CAddress &addrConnect,
+                                       bool fCountFailure,
+                                       CSemaphoreGrant &grant, bool fFeeler,
+                                       bool block_relay_only) {
+    if (interruptNet || !fNetworkActive) {
+        return;
+    }
+    bool banned_or_discouraged =
+        m_banman && (m_banman->IsDiscouraged(addrConnect) ||
+                     m_banman->IsBanned(addrConnect));
+    if (IsLocal(addrConnect) || FindNode(static_cast<CNetAddr>(addrConnect)) ||
+        banned_or_discouraged || FindNode(addrConnect.ToStringIPPort())) {
+        return;
+    }
+    {
+        LOCK(cs_pending_connections);
+        for (const PendingConnection &conn : m_pending_connections) {
+            if (static_cast<CNetAddr>(conn.addr) ==
+                static_cast<CNetAddr>(addrConnect)) {
+                return;
+            }
+        }
+    }
+
+    LogPrint(BCLog::NET, "trying connection %s lastseen=%.1fhrs\n",
+             addrConnect.ToString(),
+             (double)(GetAdjustedTime() - addrConnect.nTime) / 3600.0);
+
+    CService target = addrConnect;
+    std::unique_ptr<Socks5Handshake> socks5;
+    proxyType proxy;
+    if (GetProxy(addrConnect.GetNetwork(), proxy)) {
+        target = proxy.proxy;
+        socks5 = std::make_unique<Socks5Handshake>(
+            proxy, addrConnect.ToStringIP(), addrConnect.GetPort());
+    }
+    SOCKET hSocket = CreateSocket(target);
+    if (hSocket == INVALID_SOCKET) {
+        return;
+    }
+    if (!StartConnectSocket(target, hSocket, socks5 != nullptr)) {
+        CloseSocket(hSocket);
+        if (!socks5) {
+            addrman.Attempt(addrConnect, fCountFailure);
+        }
+        return;
+    }
+
+    LOCK(cs_pending_connections);
+    PendingConnection &conn = m_pending_connections.emplace_back();
+    conn.addr = addrConnect;
+    conn.target = target;
+    conn.hSocket = hSocket;
+    conn.socks5 = std::move(socks5);
+    conn.nDeadline = GetTimeMillis() + nConnectTimeout;
+    grant.MoveTo(conn.grant);
+    conn.fCountFailure = fCountFailure;
+    conn.fFeeler = fFeeler;
+    conn.block_relay_only = block_relay_only;
+}
+
 // If successful, this moves the passed grant to the constructed node.
 void CConnman::OpenNetworkConnection(const CAddress &addrConnect,
                                      bool fCountFailure,
@@ -2268,6 +2857,7 @@ void CConnman::OpenNetworkConnection(const CAddress &addrConnect,
     }
 
     m_msgproc->InitializeNode(*config, pnode);
+    RegisterNode(pnode);
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
@@ -2288,7 +2878,7 @@ void CConnman::ThreadMessageHandler() {
         bool fMoreWork = false;
 
         for (CNode *pnode : vNodesCopy) {
-            if (pnode->fDisconnect) {
+            if (pnode->fDisconnect || pnode->m_msg_in_worker) {
                 continue;
             }
 
@@ -2300,6 +2890,11 @@ void CConnman::ThreadMessageHandler() {
                 return;
             }
 
+            // The last message may have been dispatched to a message worker.
+            if (pnode->m_msg_in_worker) {
+                continue;
+            }
+
             // Send messages
             {
                 LOCK(pnode->cs_sendProcessing);
@@ -2330,6 +2925,46 @@ void CConnman::ThreadMessageHandler() {
     }
 }
 
+void CConnman::DispatchToMessageWorker(CNode *pnode,
+                                       std::function<void()> func) {
+    assert(HasMessageWorkers());
+    pnode->AddRef();
+    pnode->m_msg_in_worker = true;
+    {
+        LOCK(m_message_worker_mutex);
+        m_message_worker_queue.emplace_back(pnode, std::move(func));
+    }
+    m_message_worker_cond.notify_one();
+}
+
+void CConnman::ThreadMessageWorker() {
+    while (true) {
+        std::pair<CNode *, std::function<void()>> work;
+        {
+            WAIT_LOCK(m_message_worker_mutex, lock);
+            m_message_worker_cond.wait(
+                lock,
+                [this]() EXCLUSIVE_LOCKS_REQUIRED(m_message_worker_mutex) {
+                    return flagInterruptMsgProc ||
+                           !m_message_worker_queue.empty();
+                });
+            if (flagInterruptMsgProc) {
+                return;
+            }
+            work = std::move(m_message_worker_queue.front());
+            m_message_worker_queue.pop_front();
+        }
+
+        CNode *pnode = work.first;
+        work.second();
+        pnode->m_msg_in_worker = false;
+        pnode->Release();
+
+        // The node may have more messages to process.
+        WakeMessageHandler();
+    }
+}
+
 bool CConnman::BindListenPort(const CService &addrBind, bilingual_str &strError,
                               NetPermissionFlags permissions) {
     int nOne = 1;
@@ -2602,6 +3237,30 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions) {
         fMsgProcWake = false;
     }
 
+    if (m_socket_events_mode == SocketEventsMode::EPOLL) {
+        for (int i = 0; i < m_socket_threads; i++) {
+            auto io = std::make_unique<SocketIOThread>();
+            if (!io->events.IsValid()) {
+                LogPrintf("Failed to create epoll instance (%s), falling back "
+                          "to a single socket thread\n",
+                          NetworkErrorString(WSAGetLastError()));
+                m_socket_io_threads.clear();
+                break;
+            }
+            io->name = strprintf("netio.%d", i);
+            m_socket_io_threads.push_back(std::move(io));
+        }
+    }
+
+    // Send and receive from sockets of the peers in epoll mode
+    for (auto &io : m_socket_io_threads) {
+        io->thread = std::thread(&TraceThread<std::function<void()>>,
+                                 io->name.c_str(),
+                                 std::function<void()>(std::bind(
+                                     &CConnman::ThreadSocketIO, this,
+                                     std::ref(*io))));
+    }
+
     // Send and receive from sockets, accept connections
     threadSocketHandler = std::thread(
         &TraceThread<std::function<void()>>, "net",
@@ -2641,6 +3300,14 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions) {
                                       connOptions.m_specified_outgoing)));
     }
 
+    // Process messages which do not require cs_main
+    for (int i = 0; i < m_message_workers; i++) {
+        m_message_worker_threads.emplace_back(
+            &TraceThread<std::function<void()>>, "msgworker",
+            std::function<void()>(
+                std::bind(&CConnman::ThreadMessageWorker, this)));
+    }
+
     // Process messages
     threadMessageHandler =
         std::thread(&TraceThread<std::function<void()>>, "msghand",
@@ -2655,6 +3322,13 @@ bool CConnman::Start(CScheduler &scheduler, const Options &connOptions) {
         },
         DUMP_PEERS_INTERVAL);
 
+    scheduler.scheduleEvery(
+        [this]() {
+            this->SampleTelemetry();
+            return true;
+        },
+        PEER_TELEMETRY_INTERVAL);
+
     return true;
 }
 
@@ -2677,6 +3351,11 @@ void CConnman::Interrupt() {
         flagInterruptMsgProc = true;
     }
     condMsgProc.notify_all();
+    {
+        // Make sure the message workers waiting for work see the interruption.
+        LOCK(m_message_worker_mutex);
+    }
+    m_message_worker_cond.notify_all();
 
     interruptNet();
     InterruptSocks5(true);
@@ -2698,6 +3377,21 @@ void CConnman::StopThreads() {
     if (threadMessageHandler.joinable()) {
         threadMessageHandler.join();
     }
+    for (std::thread &thread : m_message_worker_threads) {
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+    m_message_worker_threads.clear();
+    {
+        // Drop the work which was not started before the interruption.
+        LOCK(m_message_worker_mutex);
+        for (auto &work : m_message_worker_queue) {
+            work.first->m_msg_in_worker = false;
+            work.first->Release();
+        }
+        m_message_worker_queue.clear();
+    }
     if (threadOpenConnections.joinable()) {
         threadOpenConnections.join();
     }
@@ -2710,6 +3404,11 @@ void CConnman::StopThreads() {
     if (threadSocketHandler.joinable()) {
         threadSocketHandler.join();
     }
+    for (auto &io : m_socket_io_threads) {
+        if (io->thread.joinable()) {
+            io->thread.join();
+        }
+    }
 }
 
 void CConnman::StopNodes() {
@@ -2718,11 +3417,28 @@ void CConnman::StopNodes() {
         fAddressesInitialized = false;
     }
 
+    // Abandon the connections being established
+    {
+        LOCK(cs_pending_connections);
+        for (PendingConnection &conn : m_pending_connections) {
+            CloseSocket(conn.hSocket);
+        }
+        m_pending_connections.clear();
+    }
+
     // Close sockets
     LOCK(cs_vNodes);
     for (CNode *pnode : vNodes) {
         pnode->CloseSocketDisconnect();
     }
+    for (auto &io : m_socket_io_threads) {
+        LOCK(io->cs_nodes);
+        for (const auto &entry : io->nodes) {
+            entry.second->Release();
+        }
+        io->nodes.clear();
+    }
+    m_socket_io_threads.clear();
     for (ListenSocket &hListenSocket : vhListenSocket) {
         if (hListenSocket.socket != INVALID_SOCKET) {
             if (!CloseSocket(hListenSocket.socket)) {
@@ -2829,6 +3545,25 @@ void CConnman::GetNodeStats(std::vector<CNodeStats> &vstats) {
     }
 }
 
+void CConnman::GetNodeTelemetry(std::vector<CNodeTelemetry> &vtelemetry,
+                                size_t count) {
+    vtelemetry.clear();
+    LOCK(cs_vNodes);
+    vtelemetry.reserve(vNodes.size());
+    for (CNode *pnode : vNodes) {
+        vtelemetry.push_back({pnode->GetId(), pnode->GetAddrName(),
+                              pnode->m_telemetry.GetSamples(count)});
+    }
+}
+
+void CConnman::SampleTelemetry() {
+    const int64_t now = GetTime();
+    LOCK(cs_vNodes);
+    for (CNode *pnode : vNodes) {
+        pnode->SampleTelemetry(now);
+    }
+}
+
 bool CConnman::DisconnectNode(const std::string &strNode) {
     LOCK(cs_vNodes);
     if (CNode *pnode = FindNode(strNode)) {
@@ -2870,6 +3605,14 @@ void CConnman::RecordBytesRecv(uint64_t bytes) {
     nTotalBytesRecv += bytes;
 }
 
+uint64_t CConnman::GetTotalRecvCalls() const {
+    return nTotalRecvCalls;
+}
+
+uint64_t CConnman::GetTotalSendCalls() const {
+    return nTotalSendCalls;
+}
+
 void CConnman::RecordBytesSent(uint64_t bytes) {
     LOCK(cs_totalBytesSent);
     nTotalBytesSent += bytes;
@@ -3031,15 +3774,66 @@ bool CConnman::NodeFullyConnected(const CNode *pnode) {
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
 }
 
-void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
+void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg,
+                           std::optional<TrafficClass> traffic_class) {
     size_t nMessageSize = msg.data.size();
     LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",
              SanitizeString(msg.m_type), nMessageSize, pnode->GetId());
+    const TrafficClass c = traffic_class.value_or(GetTrafficClass(msg.m_type));
 
     // make sure we use the appropriate network transport format
     std::vector<uint8_t> serializedHeader;
+    if (nMessageSize <= MAX_COALESCED_PAYLOAD_SIZE) {
+        serializedHeader.reserve(CMessageHeader::HEADER_SIZE + nMessageSize);
+        pnode->m_serializer->prepareForTransport(*config, msg,
+                                                 serializedHeader);
+        serializedHeader.insert(serializedHeader.end(), msg.data.begin(),
+                                msg.data.end());
+        EnqueueMessage(pnode, msg.m_type,
+                       CSendBuffer(std::move(serializedHeader), c),
+                       CSendBuffer());
+        return;
+    }
+
     pnode->m_serializer->prepareForTransport(*config, msg, serializedHeader);
-    size_t nTotalSize = nMessageSize + serializedHeader.size();
+    EnqueueMessage(pnode, msg.m_type,
+                   CSendBuffer(std::move(serializedHeader), c),
+                   CSendBuffer(std::move(msg.data), c));
+}
+
+void CConnman::PushSharedMessage(
+    CNode *pnode, const std::string &msg_type, const uint256 &hash,
+    int nVersion, const std::function<CSerializedNetMsg()> &make,
+    std::optional<TrafficClass> traffic_class) {
+    // All the peers use the same transport, so the header can be shared too.
+    NetMessageCache::Buffer buffer =
+        m_message_cache.Get(msg_type, hash, nVersion);
+    if (!buffer) {
+        CSerializedNetMsg msg = make();
+        assert(msg.m_type == msg_type);
+
+        std::vector<uint8_t> serialized;
+        serialized.reserve(CMessageHeader::HEADER_SIZE + msg.data.size());
+        pnode->m_serializer->prepareForTransport(*config, msg, serialized);
+        serialized.insert(serialized.end(), msg.data.begin(), msg.data.end());
+        buffer = std::make_shared<const std::vector<uint8_t>>(
+            std::move(serialized));
+        m_message_cache.Add(msg_type, hash, nVersion, buffer);
+    }
+
+    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",
+             SanitizeString(msg_type),
+             buffer->size() - CMessageHeader::HEADER_SIZE, pnode->GetId());
+    EnqueueMessage(pnode, msg_type,
+                   CSendBuffer(std::move(buffer),
+                               traffic_class.value_or(
+                                   GetTrafficClass(msg_type))),
+                   CSendBuffer());
+}
+
+void CConnman::EnqueueMessage(CNode *pnode, const std::string &msg_type,
+                              CSendBuffer &&header, CSendBuffer &&payload) {
+    size_t nTotalSize = header.size() + payload.size();
 
     size_t nBytesSent = 0;
     {
@@ -3047,15 +3841,17 @@ void CConnman::PushMessage(CNode *pnode, CSerializedNetMsg &&msg) {
         bool optimisticSend(pnode->vSendMsg.empty());
 
         // log total amount of bytes per message type
-        pnode->mapSendBytesPerMsgCmd[msg.m_type] += nTotalSize;
+        pnode->mapSendBytesPerMsgCmd[msg_type] += nTotalSize;
         pnode->nSendSize += nTotalSize;
 
         if (pnode->nSendSize > nSendBufferMaxSize) {
             pnode->fPauseSend = true;
         }
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
-        if (nMessageSize) {
-            pnode->vSendMsg.push_back(std::move(msg.data));
+        if (header.size()) {
+            pnode->vSendMsg.push_back(std::move(header));
+        }
+        if (payload.size()) {
+            pnode->vSendMsg.push_back(std::move(payload));
         }
 
         // If write queue empty, attempt "optimistic write"
@@ -10,6 +10,7 @@
 #include <addrdb.h>
 #include <addrman.h>
 #include <amount.h>
+#include <bandwidthshaper.h>
 #include <bloom.h>
 #include <chainparams.h>
 #include <compat.h>
@@ -18,8 +19,13 @@
 #include <limitedmap.h>
 #include <net_permissions.h>
 #include <netaddress.h>
+#include <netbase.h>
+#include <netmessagecache.h>
+#include <peertelemetry.h>
 #include <protocol.h>
 #include <random.h>
+#include <socketevents.h>
+#include <span.h>
 #include <streams.h>
 #include <sync.h>
 #include <threadinterrupt.h>
@@ -30,7 +36,11 @@
 #include <condition_variable>
 #include <cstdint>
 #include <deque>
+#include <list>
+#include <map>
 #include <memory>
+#include <optional>
+#include <set>
 #include <thread>
 
 #ifndef WIN32
@@ -106,6 +116,21 @@ static const int64_t DEFAULT_PEER_CONNECT_TIMEOUT = 60;
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
 static const size_t DEFAULT_MAXSENDBUFFER = 1 * 1000;
+/** Default number of threads servicing the peer sockets in epoll mode */
+static const int DEFAULT_SOCKET_THREADS = 1;
+/** Maximum number of threads servicing the peer sockets in epoll mode */
+static const int MAX_SOCKET_THREADS = 64;
+/** Default number of threads processing messages which do not need cs_main */
+static const int DEFAULT_MESSAGE_WORKERS = 2;
+/** Maximum number of threads processing messages which do not need cs_main */
+static const int MAX_MESSAGE_WORKERS = 64;
+/**
+ * Message payloads with at least this many bytes left to receive are received
+ * in place rather than copied from an intermediate buffer.
+ */
+static const uint32_t DIRECT_RECV_MIN_SIZE = 64 * 1024;
+/** Maximum number of payload bytes received in place by a single recv() */
+static const uint32_t DIRECT_RECV_MAX_SIZE = 256 * 1024;
 
 typedef int64_t NodeId;
 
@@ -122,6 +147,7 @@ struct AddedNodeInfo {
 };
 
 struct CNodeStats;
+struct CNodeTelemetry;
 class CClientUIInterface;
 
 struct CSerializedNetMsg {
@@ -136,6 +162,31 @@ struct CSerializedNetMsg {
     std::string m_type;
 };
 
+/**
+ * A buffer queued for sending to a peer. It is either owned by the peer's
+ * send queue, or shared with the send queues of other peers. The traffic
+ * class of the buffer determines the bandwidth limit it is subject to.
+ */
+class CSendBuffer {
+public:
+    CSendBuffer() = default;
+    CSendBuffer(std::vector<uint8_t> &&data, TrafficClass traffic_class)
+        : m_data(std::move(data)), m_class(traffic_class) {}
+    CSendBuffer(NetMessageCache::Buffer shared, TrafficClass traffic_class)
+        : m_shared(std::move(shared)), m_class(traffic_class) {}
+
+    const uint8_t *data() const {
+        return m_shared ? m_shared->data() : m_data.data();
+    }
+    size_t size() const { return m_shared ? m_shared->size() : m_data.size(); }
+    TrafficClass GetTrafficClass() const { return m_class; }
+
+private:
+    std::vector<uint8_t> m_data;
+    NetMessageCache::Buffer m_shared;
+    TrafficClass m_class{TrafficClass::OTHER};
+};
+
 namespace {
 struct CConnmanTest;
 }
@@ -165,6 +216,9 @@ public:
         unsigned int nReceiveFloodSize = 0;
         uint64_t nMaxOutboundTimeframe = 0;
         uint64_t nMaxOutboundLimit = 0;
+        //! Upload rate limits in bytes per second, 0 for unlimited.
+        std::map<TrafficClass, uint64_t> m_upload_rates;
+        uint64_t m_peer_upload_rate = 0;
         int64_t m_peer_connect_timeout = DEFAULT_PEER_CONNECT_TIMEOUT;
         std::vector<std::string> vSeedNodes;
         std::vector<NetWhitelistPermissions> vWhitelistedRange;
@@ -174,6 +228,9 @@ public:
         std::vector<std::string> m_specified_outgoing;
         std::vector<std::string> m_added_nodes;
         std::vector<bool> m_asmap;
+        SocketEventsMode m_socket_events_mode = GetDefaultSocketEventsMode();
+        int m_socket_threads = DEFAULT_SOCKET_THREADS;
+        int m_message_workers = DEFAULT_MESSAGE_WORKERS;
     };
 
     void Init(const Options &connOptions) {
@@ -200,11 +257,18 @@ public:
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
         m_peer_connect_timeout = connOptions.m_peer_connect_timeout;
+        m_socket_events_mode = connOptions.m_socket_events_mode;
+        m_socket_threads = connOptions.m_socket_threads;
+        m_message_workers = connOptions.m_message_workers;
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
             nMaxOutboundLimit = connOptions.nMaxOutboundLimit;
         }
+        for (const auto &entry : connOptions.m_upload_rates) {
+            m_shaper.SetRate(entry.first, entry.second);
+        }
+        m_peer_upload_rate = connOptions.m_peer_upload_rate;
         vWhitelistedRange = connOptions.vWhitelistedRange;
         {
             LOCK(cs_vAddedNodes);
@@ -238,7 +302,24 @@ public:
 
     bool ForNode(NodeId id, std::function<bool(CNode *pnode)> func);
 
-    void PushMessage(CNode *pnode, CSerializedNetMsg &&msg);
+    /**
+     * Send a message. Its traffic class is derived from its type unless
+     * specified.
+     */
+    void PushMessage(CNode *pnode, CSerializedNetMsg &&msg,
+                     std::optional<TrafficClass> traffic_class = std::nullopt);
+
+    /**
+     * Send a message carrying an object which is likely to be sent to many
+     * peers, such as a block or a relayed transaction. The message is looked
+     * up in the serialized message cache by type, object hash and version,
+     * and is only built by calling make if it is not there yet. The
+     * serialized message is then shared by the send queues of all the peers.
+     */
+    void PushSharedMessage(
+        CNode *pnode, const std::string &msg_type, const uint256 &hash,
+        int nVersion, const std::function<CSerializedNetMsg()> &make,
+        std::optional<TrafficClass> traffic_class = std::nullopt);
 
     template <typename Callable> void ForEachNode(Callable &&func) {
         LOCK(cs_vNodes);
@@ -306,6 +387,9 @@ public:
 
     size_t GetNodeCount(NumConnections num);
     void GetNodeStats(std::vector<CNodeStats> &vstats);
+    /** Return up to count of the most recent telemetry samples of each node */
+    void GetNodeTelemetry(std::vector<CNodeTelemetry> &vtelemetry,
+                          size_t count);
     bool DisconnectNode(const std::string &node);
     bool DisconnectNode(const CSubNet &subnet);
     bool DisconnectNode(const CNetAddr &addr);
@@ -342,6 +426,8 @@ public:
 
     uint64_t GetTotalBytesRecv();
     uint64_t GetTotalBytesSent();
+    uint64_t GetTotalRecvCalls() const;
+    uint64_t GetTotalSendCalls() const;
 
     void SetBestHeight(int height);
     int GetBestHeight() const;
@@ -353,6 +439,13 @@ public:
 
     void WakeMessageHandler();
 
+    bool HasMessageWorkers() const { return !m_message_worker_threads.empty(); }
+    /**
+     * Run func on a message worker thread on behalf of pnode. The message
+     * handler thread doesn't process the node until func returns.
+     */
+    void DispatchToMessageWorker(CNode *pnode, std::function<void()> func);
+
     /**
      * Attempts to obfuscate tx time through exponentially distributed emitting.
      * Works assuming that a single interval is used.
@@ -388,7 +481,46 @@ private:
     void AddOneShot(const std::string &strDest);
     void ProcessOneShot();
     void ThreadOpenConnections(std::vector<std::string> connect);
+
+    /**
+     * An outbound connection being established by the socket handler thread,
+     * so that slow or unresponsive peers do not hold up the other attempts:
+     * first the TCP connection, to the peer or to its proxy, then the SOCKS5
+     * handshake if it goes through a proxy. It holds the outbound slot of the
+     * attempt.
+     */
+    struct PendingConnection {
+        CAddress addr;
+        //! Where the TCP connection goes, either the peer or its proxy.
+        CService target;
+        SOCKET hSocket{INVALID_SOCKET};
+        std::unique_ptr<Socks5Handshake> socks5;
+        bool connected{false};
+        //! When the current step is given up, in milliseconds.
+        int64_t nDeadline{0};
+        CSemaphoreGrant grant;
+        bool fCountFailure{false};
+        bool fFeeler{false};
+        bool block_relay_only{false};
+    };
+
+    /**
+     * Start a connection attempt to an address selected from addrman, to be
+     * completed by the socket handler thread. If it gets started, this moves
+     * the passed grant to it.
+     */
+    void StartOutboundConnection(const CAddress &addrConnect,
+                                 bool fCountFailure, CSemaphoreGrant &grant,
+                                 bool fFeeler, bool block_relay_only);
+    /**
+     * Make progress on the pending connections whose socket is ready, give up
+     * the ones which timed out and add the established ones as nodes.
+     */
+    void PendingConnectionsHandler(const std::set<SOCKET> &recv_set,
+                                   const std::set<SOCKET> &send_set,
+                                   const std::set<SOCKET> &error_set);
     void ThreadMessageHandler();
+    void ThreadMessageWorker();
     void AcceptConnection(const ListenSocket &hListenSocket);
     void DisconnectNodes();
     void NotifyNumConnectionsChanged();
@@ -400,6 +532,36 @@ private:
                       std::set<SOCKET> &error_set);
     void SocketHandler();
     void ThreadSocketHandler();
+
+    /**
+     * In epoll mode, the sockets of the peers are serviced by
+     * m_socket_threads I/O threads rather than by ThreadSocketHandler, which
+     * only accepts new connections and disconnects peers. Each peer is
+     * assigned to an I/O thread by id and registered once in its epoll set,
+     * so that each wait only costs in proportion to the active sockets.
+     */
+    struct SocketIOThread {
+        EpollSocketEvents events;
+        Mutex cs_nodes;
+        //! The peers serviced by this thread, which hold a reference to them.
+        std::map<NodeId, CNode *> nodes GUARDED_BY(cs_nodes);
+        //! The peers which have data to send but are over their upload rate.
+        //! This is not guarded by cs_nodes, which is taken before cs_vSend.
+        Mutex cs_send_throttled;
+        std::set<NodeId> send_throttled GUARDED_BY(cs_send_throttled);
+        std::string name;
+        std::thread thread;
+    };
+
+    bool UseSocketIOThreads() const { return !m_socket_io_threads.empty(); }
+    void RegisterNode(CNode *pnode);
+    void UnregisterNode(CNode *pnode);
+    void ThreadSocketIO(SocketIOThread &io);
+    /**
+     * Receive data from a peer socket and hand off the complete messages to
+     * the message handler. Returns true if more data may be pending.
+     */
+    bool SocketRecvData(CNode *pnode);
     void ThreadDNSAddressSeed();
 
     uint64_t CalculateKeyedNetGroup(const CAddress &ad) const;
@@ -413,6 +575,9 @@ private:
     CNode *ConnectNode(CAddress addrConnect, const char *pszDest,
                        bool fCountFailure, bool manual_connection,
                        bool block_relay_only);
+    /** Create the node of an established outbound connection */
+    CNode *CreateOutboundNode(SOCKET hSocket, const CAddress &addrConnect,
+                              const char *pszDest, bool block_relay_only);
     void AddWhitelistPermissionFlags(NetPermissionFlags &flags,
                                      const CNetAddr &addr) const;
 
@@ -420,7 +585,21 @@ private:
 
     NodeId GetNewNodeId();
 
-    size_t SocketSendData(CNode *pnode) const;
+    size_t SocketSendData(CNode *pnode);
+    /**
+     * Return how many bytes of the send queue of a peer, from the buffer at
+     * position nFirst, the upload rate limits allow to send right now.
+     */
+    size_t GetSendAllowance(CNode *pnode, size_t nFirst, int64_t nTimeMicros)
+        EXCLUSIVE_LOCKS_REQUIRED(pnode->cs_vSend);
+    void SetSendThrottled(CNode *pnode, bool throttled);
+    void SampleTelemetry();
+    /**
+     * Queue the buffers of a message for sending, and try to send them right
+     * away if the send queue was empty. Empty buffers are skipped.
+     */
+    void EnqueueMessage(CNode *pnode, const std::string &msg_type,
+                        CSendBuffer &&header, CSendBuffer &&payload);
     void DumpAddresses();
 
     // Network stats
@@ -437,6 +616,9 @@ private:
     RecursiveMutex cs_totalBytesSent;
     uint64_t nTotalBytesRecv GUARDED_BY(cs_totalBytesRecv){0};
     uint64_t nTotalBytesSent GUARDED_BY(cs_totalBytesSent){0};
+    // Number of recv() and send() calls, to measure their efficiency
+    std::atomic<uint64_t> nTotalRecvCalls{0};
+    std::atomic<uint64_t> nTotalSendCalls{0};
 
     // outbound limit & stats
     uint64_t nMaxOutboundTotalBytesSentInCycle GUARDED_BY(cs_totalBytesSent);
@@ -447,6 +629,10 @@ private:
     // P2P timeout in seconds
     int64_t m_peer_connect_timeout;
 
+    SocketEventsMode m_socket_events_mode{GetDefaultSocketEventsMode()};
+    int m_socket_threads{DEFAULT_SOCKET_THREADS};
+    std::vector<std::unique_ptr<SocketIOThread>> m_socket_io_threads;
+
     // Whitelisted ranges. Any node connecting from these is automatically
     // whitelisted (as well as those connecting to whitelisted binds).
     std::vector<NetWhitelistPermissions> vWhitelistedRange;
@@ -454,6 +640,12 @@ private:
     unsigned int nSendBufferMaxSize{0};
     unsigned int nReceiveFloodSize{0};
 
+    NetMessageCache m_message_cache;
+
+    //! Upload rate limits of each traffic class, and of each peer.
+    BandwidthShaper m_shaper;
+    uint64_t m_peer_upload_rate{0};
+
     std::vector<ListenSocket> vhListenSocket;
     std::atomic<bool> fNetworkActive{true};
     bool fAddressesInitialized{false};
@@ -465,6 +657,11 @@ private:
     std::vector<CNode *> vNodes GUARDED_BY(cs_vNodes);
     std::list<CNode *> vNodesDisconnected;
     mutable RecursiveMutex cs_vNodes;
+    //! Taken before cs_vNodes, so that established connections are moved to
+    //! vNodes atomically.
+    Mutex cs_pending_connections;
+    std::list<PendingConnection>
+        m_pending_connections GUARDED_BY(cs_pending_connections);
     std::atomic<NodeId> nLastNodeId{0};
     unsigned int nPrevNodeCount{0};
 
@@ -512,6 +709,14 @@ private:
     Mutex mutexMsgProc;
     std::atomic<bool> flagInterruptMsgProc{false};
 
+    int m_message_workers{DEFAULT_MESSAGE_WORKERS};
+    //! Work dispatched to the message workers, along with the node it is for.
+    std::deque<std::pair<CNode *, std::function<void()>>>
+        m_message_worker_queue GUARDED_BY(m_message_worker_mutex);
+    std::condition_variable m_message_worker_cond;
+    Mutex m_message_worker_mutex;
+    std::vector<std::thread> m_message_worker_threads;
+
     CThreadInterrupt interruptNet;
 
     std::thread threadDNSAddressSeed;
@@ -652,6 +857,13 @@ struct CNodeStats {
     uint32_t m_mapped_as;
 };
 
+/** The recent activity of a node, see CConnman::GetNodeTelemetry */
+struct CNodeTelemetry {
+    NodeId nodeid;
+    std::string addrName;
+    std::vector<PeerTelemetrySample> samples;
+};
+
 /**
  * Transport protocol agnostic message container.
  * Ideally it should only contain receive time, payload,
@@ -691,6 +903,14 @@ public:
     // read and deserialize data
     virtual int Read(const Config &config, const char *data,
                      uint32_t bytes) = 0;
+    /**
+     * Return a buffer the next bytes of the message being received can be
+     * written to directly, or an empty span if they must go through an
+     * intermediate buffer. Bytes written to this buffer are then passed to
+     * Read() as usual, which does not copy them again. The buffer is only
+     * valid until the next call to Read().
+     */
+    virtual Span<char> GetReadBuffer() = 0;
     // decomposes a message from the context
     virtual CNetMessage GetMessage(const Config &config, int64_t time) = 0;
     virtual ~TransportDeserializer() {}
@@ -757,6 +977,8 @@ public:
         return ret;
     }
 
+    Span<char> GetReadBuffer() override;
+
     CNetMessage GetMessage(const Config &config, int64_t time) override;
 };
 
@@ -796,7 +1018,9 @@ public:
     // Offset inside the first vSendMsg already sent.
     size_t nSendOffset{0};
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
-    std::deque<std::vector<uint8_t>> vSendMsg GUARDED_BY(cs_vSend);
+    std::deque<CSendBuffer> vSendMsg GUARDED_BY(cs_vSend);
+    //! Upload rate limit of this peer, unlimited by default.
+    TokenBucket m_upload_bucket GUARDED_BY(cs_vSend);
     RecursiveMutex cs_vSend;
     RecursiveMutex cs_hSocket;
     RecursiveMutex cs_vRecv;
@@ -854,6 +1078,17 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv{false};
     std::atomic_bool fPauseSend{false};
+    //! Set while the upload rate limits prevent sending queued data.
+    std::atomic_bool fSendThrottled{false};
+    /**
+     * Set while a message of this node is processed by a message worker. The
+     * message handler thread leaves the node alone in the meantime, so that
+     * its messages are still processed one at a time and in order.
+     */
+    std::atomic_bool m_msg_in_worker{false};
+
+    //! Time series of the activity of this node.
+    PeerTelemetry m_telemetry;
 
 protected:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
@@ -894,10 +1129,6 @@ public:
         mutable RecursiveMutex cs_tx_inventory;
         CRollingBloomFilter filterInventoryKnown GUARDED_BY(cs_tx_inventory){
             50000, 0.000001};
-        // Set of transaction ids we still have to announce.
-        // They are sorted by the mempool before relay, so the order is not
-        // important.
-        std::set<TxId> setInventoryTxToSend;
         // Used for BIP35 mempool sending
         bool fSendMempool GUARDED_BY(cs_tx_inventory){false};
         // Last time a "MEMPOOL" request was serviced.
@@ -934,8 +1165,6 @@ public:
     // Whether a ping is requested.
     std::atomic<bool> fPingQueued{false};
 
-    std::set<TxId> orphan_work_set;
-
     CNode(NodeId id, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn,
           SOCKET hSocketIn, const CAddress &addrIn, uint64_t nKeyedNetGroupIn,
           uint64_t nLocalHostNonceIn, const CAddress &addrBindIn,
@@ -1037,14 +1266,12 @@ public:
         }
     }
 
+    /**
+     * Queue a block to announce. Transactions are announced to all the peers
+     * at once (see RelayTransaction).
+     */
     void PushInventory(const CInv &inv) {
-        if (inv.type == MSG_TX && m_tx_relay != nullptr) {
-            const TxId txid(inv.hash);
-            LOCK(m_tx_relay->cs_tx_inventory);
-            if (!m_tx_relay->filterInventoryKnown.contains(txid)) {
-                m_tx_relay->setInventoryTxToSend.insert(txid);
-            }
-        } else if (inv.type == MSG_BLOCK) {
+        if (inv.type == MSG_BLOCK) {
             const BlockHash hash(inv.hash);
             LOCK(cs_inventory);
             vInventoryBlockToSend.push_back(hash);
@@ -1059,6 +1286,8 @@ public:
     void CloseSocketDisconnect();
 
     void copyStats(CNodeStats &stats, const std::vector<bool> &m_asmap);
+    /** Take a sample of the activity of this node, see PeerTelemetry */
+    void SampleTelemetry(int64_t time);
 
     ServiceFlags GetLocalServices() const { return nLocalServices; }
 
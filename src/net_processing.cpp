@@ -9,6 +9,7 @@
 #include <avalanche/processor.h>
 #include <banman.h>
 #include <blockdb.h>
+#include <blockdownload.h>
 #include <blockencodings.h>
 #include <blockfilter.h>
 #include <blockvalidity.h>
@@ -29,7 +30,10 @@
 #include <reverse_iterator.h>
 #include <scheduler.h>
 #include <tinyformat.h>
+#include <txannouncement.h>
 #include <txmempool.h>
+#include <txorphanage.h>
+#include <txreconciliation.h>
 #include <util/check.h> // For NDEBUG compile time check
 #include <util/strencodings.h>
 #include <util/system.h>
@@ -38,10 +42,6 @@
 #include <memory>
 #include <typeinfo>
 
-/** Expiration time for orphan transactions in seconds */
-static constexpr int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
-/** Minimum time between orphan transactions expire time checks in seconds */
-static constexpr int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
 /** How long to cache transactions in mapRelay for normal relay */
 static constexpr std::chrono::seconds RELAY_TX_CACHE_TIME{15 * 60};
 /**
@@ -117,21 +117,14 @@ static_assert(INBOUND_PEER_TX_DELAY >= MAX_GETDATA_RANDOM_DELAY,
  */
 static const unsigned int MAX_GETDATA_SZ = 1000;
 
-/// How many non standard orphan do we consider from a node before ignoring it.
-static constexpr uint32_t MAX_NON_STANDARD_ORPHAN_PER_NODE = 5;
-
-struct COrphanTx {
-    // When modifying, adapt the copy of this definition in tests/DoS_tests.
-    CTransactionRef tx;
-    NodeId fromPeer;
-    int64_t nTimeExpire;
-    size_t list_pos;
-};
-
-RecursiveMutex g_cs_orphans;
-std::map<TxId, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
+/**
+ * Maximum number of orphans reconsidered on behalf of a peer each time its
+ * messages are processed, so that resolving a flood of orphans cannot stall
+ * message handling.
+ */
+static constexpr size_t MAX_ORPHAN_RECONSIDERATIONS_PER_BATCH = 8;
 
-void EraseOrphansFor(NodeId peer);
+TxOrphanage g_orphanage;
 
 /**
  * Average delay between local address broadcasts.
@@ -206,6 +199,12 @@ std::map<BlockHash, std::pair<NodeId, bool>> mapBlockSource GUARDED_BY(cs_main);
 std::unique_ptr<CRollingBloomFilter> recentRejects GUARDED_BY(cs_main);
 uint256 hashRecentRejectsChainTip GUARDED_BY(cs_main);
 
+/**
+ * Transactions to reconcile with the peers which support it, or nullptr if
+ * reconciliation is disabled.
+ */
+std::unique_ptr<TxReconciliationTracker> g_txreconciliation;
+
 /**
  * Blocks that are in flight, and that are in the queue to be downloaded.
  */
@@ -246,19 +245,6 @@ MapRelay mapRelay GUARDED_BY(cs_main);
 std::deque<std::pair<int64_t, MapRelay::iterator>>
     vRelayExpiration GUARDED_BY(cs_main);
 
-struct IteratorComparator {
-    template <typename I> bool operator()(const I &a, const I &b) const {
-        return &(*a) < &(*b);
-    }
-};
-std::map<COutPoint,
-         std::set<std::map<TxId, COrphanTx>::iterator, IteratorComparator>>
-    mapOrphanTransactionsByPrev GUARDED_BY(g_cs_orphans);
-
-//! For random eviction
-std::vector<std::map<TxId, COrphanTx>::iterator>
-    g_orphan_list GUARDED_BY(g_cs_orphans);
-
 static size_t vExtraTxnForCompactIt GUARDED_BY(g_cs_orphans) = 0;
 static std::vector<std::pair<TxHash, CTransactionRef>>
     vExtraTxnForCompact GUARDED_BY(g_cs_orphans);
@@ -533,9 +519,12 @@ static void PushNodeVersion(const Config &config, CNode &pnode,
 
 // Returns a bool indicating whether we requested this block.
 // Also used if a block was /not/ received and timed out or started with another
-// peer.
-static bool MarkBlockAsReceived(const BlockHash &hash)
+// peer, in which case from is -1.
+static bool MarkBlockAsReceived(const BlockHash &hash, NodeId from = -1)
     EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    // The block may also have been requested from this peer as a duplicate.
+    const bool requested = g_block_download.BlockReceived(
+        from, hash, GetTime<std::chrono::microseconds>());
     std::map<BlockHash,
              std::pair<NodeId, std::list<QueuedBlock>::iterator>>::iterator
         itInFlight = mapBlocksInFlight.find(hash);
@@ -562,7 +551,7 @@ static bool MarkBlockAsReceived(const BlockHash &hash)
         return true;
     }
 
-    return false;
+    return requested;
 }
 
 // returns false, still setting pit, if the block was already in flight from the
@@ -612,6 +601,8 @@ MarkBlockAsInFlight(const Config &config, NodeId nodeid, const BlockHash &hash,
     itInFlight = mapBlocksInFlight
                      .insert(std::make_pair(hash, std::make_pair(nodeid, it)))
                      .first;
+    g_block_download.BlockRequested(nodeid, hash,
+                                    GetTime<std::chrono::microseconds>());
 
     if (pit) {
         *pit = &itInFlight->second.second;
@@ -747,11 +738,13 @@ static bool PeerHasHeader(CNodeState *state, const CBlockIndex *pindex)
 
 /**
  * Update pindexLastCommonBlock and add not-in-flight missing successors to
- * vBlocks, until it has at most count entries.
+ * vBlocks, until it has at most count entries. If the first missing block is
+ * already in flight from another peer, it is returned in pindexWaitingFor.
  */
 static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count,
                                      std::vector<const CBlockIndex *> &vBlocks,
                                      NodeId &nodeStaller,
+                                     const CBlockIndex *&pindexWaitingFor,
                                      const Consensus::Params &consensusParams)
     EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     if (count == 0) {
@@ -846,6 +839,10 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count,
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+                if (vBlocks.empty() && waitingfor != nodeid) {
+                    // The validation is waiting for it.
+                    pindexWaitingFor = pindex;
+                }
             }
         }
     }
@@ -953,6 +950,9 @@ void PeerLogicValidation::InitializeNode(const Config &config, CNode *pnode) {
             std::forward_as_tuple(addr, std::move(addrName), pnode->fInbound,
                                   pnode->m_manual_connection));
     }
+    if (pnode->m_tx_relay != nullptr) {
+        g_tx_announcements.RegisterPeer(nodeid);
+    }
     if (!pnode->fInbound) {
         PushNodeVersion(config, *pnode, *connman, GetTime());
     }
@@ -976,7 +976,15 @@ void PeerLogicValidation::FinalizeNode(const Config &config, NodeId nodeid,
     for (const QueuedBlock &entry : state->vBlocksInFlight) {
         mapBlocksInFlight.erase(entry.hash);
     }
-    EraseOrphansFor(nodeid);
+    g_block_download.ForgetPeer(nodeid);
+    g_tx_announcements.ForgetPeer(nodeid);
+    {
+        LOCK(g_cs_orphans);
+        g_orphanage.EraseForPeer(nodeid);
+    }
+    if (g_txreconciliation) {
+        g_txreconciliation->ForgetPeer(nodeid);
+    }
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
     assert(nPeersWithValidatedDownloads >= 0);
@@ -1013,12 +1021,14 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
         }
     }
+    stats.m_txreconciliation =
+        g_txreconciliation && g_txreconciliation->IsPeerRegistered(nodeid);
     return true;
 }
 
 //////////////////////////////////////////////////////////////////////////////
 //
-// mapOrphanTransactions
+// Orphan transactions
 //
 
 static void AddToCompactExtraTransactions(const CTransactionRef &tx)
@@ -1038,129 +1048,27 @@ static void AddToCompactExtraTransactions(const CTransactionRef &tx)
     vExtraTxnForCompactIt = (vExtraTxnForCompactIt + 1) % max_extra_txn;
 }
 
-bool AddOrphanTx(const CTransactionRef &tx, NodeId peer)
-    EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans) {
-    const TxId &txid = tx->GetId();
-    if (mapOrphanTransactions.count(txid)) {
-        return false;
-    }
-
-    // Ignore big transactions, to avoid a send-big-orphans memory exhaustion
-    // attack. If a peer has a legitimate large transaction with a missing
-    // parent then we assume it will rebroadcast it later, after the parent
-    // transaction(s) have been mined or received.
-    // 100 orphans, each of which is at most 100,000 bytes big is at most 10
-    // megabytes of orphans and somewhat more byprev index (in the worst case):
-    unsigned int sz = tx->GetTotalSize();
-    if (sz > MAX_STANDARD_TX_SIZE) {
-        LogPrint(BCLog::MEMPOOL,
-                 "ignoring large orphan tx (size: %u, hash: %s)\n", sz,
-                 txid.ToString());
-        return false;
-    }
-
-    auto ret = mapOrphanTransactions.emplace(
-        txid, COrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME,
-                        g_orphan_list.size()});
-    assert(ret.second);
-    g_orphan_list.push_back(ret.first);
-    for (const CTxIn &txin : tx->vin) {
-        mapOrphanTransactionsByPrev[txin.prevout].insert(ret.first);
-    }
-
-    AddToCompactExtraTransactions(tx);
-
-    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u)\n",
-             txid.ToString(), mapOrphanTransactions.size(),
-             mapOrphanTransactionsByPrev.size());
-    return true;
-}
-
-static int EraseOrphanTx(const TxId id) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans) {
-    const auto it = mapOrphanTransactions.find(id);
-    if (it == mapOrphanTransactions.end()) {
-        return 0;
-    }
-    for (const CTxIn &txin : it->second.tx->vin) {
-        const auto itPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
-        if (itPrev == mapOrphanTransactionsByPrev.end()) {
-            continue;
-        }
-        itPrev->second.erase(it);
-        if (itPrev->second.empty()) {
-            mapOrphanTransactionsByPrev.erase(itPrev);
-        }
-    }
-
-    size_t old_pos = it->second.list_pos;
-    assert(g_orphan_list[old_pos] == it);
-    if (old_pos + 1 != g_orphan_list.size()) {
-        // Unless we're deleting the last entry in g_orphan_list, move the last
-        // entry to the position we're deleting.
-        auto it_last = g_orphan_list.back();
-        g_orphan_list[old_pos] = it_last;
-        it_last->second.list_pos = old_pos;
-    }
-    g_orphan_list.pop_back();
-
-    mapOrphanTransactions.erase(it);
-    return 1;
-}
-
-void EraseOrphansFor(NodeId peer) {
-    LOCK(g_cs_orphans);
-    int nErased = 0;
-    auto iter = mapOrphanTransactions.begin();
-    while (iter != mapOrphanTransactions.end()) {
-        // Increment to avoid iterator becoming invalid.
-        const auto maybeErase = iter++;
-        if (maybeErase->second.fromPeer == peer) {
-            nErased += EraseOrphanTx(maybeErase->second.tx->GetId());
-        }
-    }
-    if (nErased > 0) {
-        LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer=%d\n", nErased,
-                 peer);
-    }
-}
-
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans) {
-    LOCK(g_cs_orphans);
+/**
+ * Find the inputs of a transaction that are neither in the UTXO set nor created
+ * by a mempool transaction, i.e. the outpoints an orphan is waiting on.
+ */
+static std::vector<COutPoint> GetMissingInputs(const CTransaction &tx)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    CCoinsViewCache &coins_cache = ::ChainstateActive().CoinsTip();
+    CCoinsViewMemPool view(&coins_cache, g_mempool);
 
-    unsigned int nEvicted = 0;
-    static int64_t nNextSweep;
-    int64_t nNow = GetTime();
-    if (nNextSweep <= nNow) {
-        // Sweep out expired orphan pool entries:
-        int nErased = 0;
-        int64_t nMinExpTime =
-            nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
-        auto iter = mapOrphanTransactions.begin();
-        while (iter != mapOrphanTransactions.end()) {
-            const auto maybeErase = iter++;
-            if (maybeErase->second.nTimeExpire <= nNow) {
-                nErased += EraseOrphanTx(maybeErase->second.tx->GetId());
-            } else {
-                nMinExpTime =
-                    std::min(maybeErase->second.nTimeExpire, nMinExpTime);
-            }
-        }
-        // Sweep again 5 minutes after the next entry that expires in order to
-        // batch the linear scan.
-        nNextSweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
-        if (nErased > 0) {
-            LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n",
-                     nErased);
+    std::vector<COutPoint> missing;
+    for (const CTxIn &txin : tx.vin) {
+        // Don't let invalid transactions grow the coins cache, just like
+        // AcceptToMemoryPool.
+        const bool cached = coins_cache.HaveCoinInCache(txin.prevout);
+        if (!view.HaveCoin(txin.prevout)) {
+            missing.push_back(txin.prevout);
+        } else if (!cached) {
+            coins_cache.Uncache(txin.prevout);
         }
     }
-    FastRandomContext rng;
-    while (mapOrphanTransactions.size() > nMaxOrphans) {
-        // Evict a random orphan:
-        size_t randompos = rng.randrange(g_orphan_list.size());
-        EraseOrphanTx(g_orphan_list[randompos]->first);
-        ++nEvicted;
-    }
-    return nEvicted;
+    return missing;
 }
 
 /**
@@ -1349,6 +1257,10 @@ PeerLogicValidation::PeerLogicValidation(CConnman *connmanIn, BanMan *banman,
       m_stale_tip_check_time(0) {
     // Initialize global variables that cannot be constructed at startup.
     recentRejects.reset(new CRollingBloomFilter(120000, 0.000001));
+    if (gArgs.GetBoolArg("-txreconciliation",
+                         DEFAULT_TXRECONCILIATION_ENABLE)) {
+        g_txreconciliation = std::make_unique<TxReconciliationTracker>();
+    }
 
     const Consensus::Params &consensusParams = Params().GetConsensus();
     // Stale tip checking and peer eviction are on two different timers, but we
@@ -1367,45 +1279,15 @@ PeerLogicValidation::PeerLogicValidation(CConnman *connmanIn, BanMan *banman,
 }
 
 /**
- * Evict orphan txn pool entries (EraseOrphanTx) based on a newly connected
- * block. Also save the time of the last tip update.
+ * Evict orphan txn pool entries based on a newly connected block, and queue
+ * the orphans whose parents it confirmed. Also save the time of the last tip
+ * update.
  */
 void PeerLogicValidation::BlockConnected(
     const std::shared_ptr<const CBlock> &pblock, const CBlockIndex *pindex,
     const std::vector<CTransactionRef> &vtxConflicted) {
     LOCK(g_cs_orphans);
-
-    std::vector<TxId> vOrphanErase;
-
-    for (const CTransactionRef &ptx : pblock->vtx) {
-        const CTransaction &tx = *ptx;
-
-        // Which orphan pool entries must we evict?
-        for (const auto &txin : tx.vin) {
-            auto itByPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
-            if (itByPrev == mapOrphanTransactionsByPrev.end()) {
-                continue;
-            }
-
-            for (auto mi = itByPrev->second.begin();
-                 mi != itByPrev->second.end(); ++mi) {
-                const CTransaction &orphanTx = *(*mi)->second.tx;
-                const TxId &orphanId = orphanTx.GetId();
-                vOrphanErase.push_back(orphanId);
-            }
-        }
-    }
-
-    // Erase orphan transactions included or precluded by this block
-    if (vOrphanErase.size()) {
-        int nErased = 0;
-        for (const auto &orphanId : vOrphanErase) {
-            nErased += EraseOrphanTx(orphanId);
-        }
-        LogPrint(BCLog::MEMPOOL,
-                 "Erased %d orphan tx included or conflicted by block\n",
-                 nErased);
-    }
+    g_orphanage.EraseForBlock(*pblock);
 
     g_last_tip_update = GetTime();
 }
@@ -1450,7 +1332,6 @@ void PeerLogicValidation::NewPoWValidBlock(
                           &hashBlock](CNode *pnode) {
         AssertLockHeld(cs_main);
 
-        // TODO: Avoid the repeated-serialization here
         if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect) {
             return;
         }
@@ -1463,8 +1344,11 @@ void PeerLogicValidation::NewPoWValidBlock(
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n",
                      "PeerLogicValidation::NewPoWValidBlock",
                      hashBlock.ToString(), pnode->GetId());
-            connman->PushMessage(
-                pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            connman->PushSharedMessage(
+                pnode, NetMsgType::CMPCTBLOCK, hashBlock,
+                msgMaker.GetVersion(), [&] {
+                    return msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock);
+                });
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1570,7 +1454,7 @@ static bool AlreadyHave(const CInv &inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
 
             {
                 LOCK(g_cs_orphans);
-                if (mapOrphanTransactions.count(TxId{inv.hash})) {
+                if (g_orphanage.HaveTx(TxId{inv.hash})) {
                     return true;
                 }
             }
@@ -1595,9 +1479,8 @@ static bool AlreadyHave(const CInv &inv) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     return true;
 }
 
-void RelayTransaction(const TxId &txid, const CConnman &connman) {
-    CInv inv(MSG_TX, txid);
-    connman.ForEachNode([&inv](CNode *pnode) { pnode->PushInventory(inv); });
+void RelayTransaction(const TxId &txid) {
+    g_tx_announcements.Add(txid);
 }
 
 static void RelayAddress(const CAddress &addr, bool fReachable,
@@ -1685,138 +1568,198 @@ static void ProcessGetBlockData(const Config &config, CNode &pfrom,
         }
     }
 
-    LOCK(cs_main);
-    const CBlockIndex *pindex = LookupBlockIndex(hash);
-    if (pindex) {
-        send = BlockRequestAllowed(pindex, consensusParams);
-        if (!send) {
-            LogPrint(BCLog::NET,
-                     "%s: ignoring request from peer=%i for old "
-                     "block that isn't in the main chain\n",
-                     __func__, pfrom.GetId());
+    const CBlockIndex *pindex = nullptr;
+    bool fSendCompactBlock = false;
+    // Historical blocks are subject to their own upload rate limit, so that
+    // serving them does not get in the way of relaying new data.
+    TrafficClass block_class = TrafficClass::RECENT_BLOCKS;
+    {
+        LOCK(cs_main);
+        pindex = LookupBlockIndex(hash);
+        if (pindex) {
+            send = BlockRequestAllowed(pindex, consensusParams);
+            if (!send) {
+                LogPrint(BCLog::NET,
+                         "%s: ignoring request from peer=%i for old "
+                         "block that isn't in the main chain\n",
+                         __func__, pfrom.GetId());
+            }
         }
-    }
-    const CNetMsgMaker msgMaker(pfrom.GetSendVersion());
-    // Disconnect node in case we have reached the outbound limit for serving
-    // historical blocks.
-    // Never disconnect whitelisted nodes.
-    if (send && connman.OutboundTargetReached(true) &&
-        (((pindexBestHeader != nullptr) &&
-          (pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() >
-           HISTORICAL_BLOCK_AGE)) ||
-         inv.type == MSG_FILTERED_BLOCK) &&
-        !pfrom.HasPermission(PF_NOBAN)) {
-        LogPrint(BCLog::NET,
-                 "historical block serving limit reached, disconnect peer=%d\n",
-                 pfrom.GetId());
+        if (send && pindexBestHeader != nullptr &&
+            pindexBestHeader->GetBlockTime() - pindex->GetBlockTime() >
+                HISTORICAL_BLOCK_AGE) {
+            block_class = TrafficClass::HISTORICAL_BLOCKS;
+        }
+        // Disconnect node in case we have reached the outbound limit for
+        // serving historical blocks.
+        // Never disconnect whitelisted nodes.
+        if (send && connman.OutboundTargetReached(true) &&
+            (block_class == TrafficClass::HISTORICAL_BLOCKS ||
+             inv.type == MSG_FILTERED_BLOCK) &&
+            !pfrom.HasPermission(PF_NOBAN)) {
+            LogPrint(
+                BCLog::NET,
+                "historical block serving limit reached, disconnect peer=%d\n",
+                pfrom.GetId());
 
-        // disconnect node
-        pfrom.fDisconnect = true;
-        send = false;
-    }
-    // Avoid leaking prune-height by never sending blocks below the
-    // NODE_NETWORK_LIMITED threshold.
-    // Add two blocks buffer extension for possible races
-    if (send && !pfrom.HasPermission(PF_NOBAN) &&
-        ((((pfrom.GetLocalServices() & NODE_NETWORK_LIMITED) ==
-           NODE_NETWORK_LIMITED) &&
-          ((pfrom.GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) &&
-          (::ChainActive().Tip()->nHeight - pindex->nHeight >
-           (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2)))) {
-        LogPrint(BCLog::NET,
-                 "Ignore block request below NODE_NETWORK_LIMITED "
-                 "threshold from peer=%d\n",
-                 pfrom.GetId());
+            // disconnect node
+            pfrom.fDisconnect = true;
+            send = false;
+        }
+        // Avoid leaking prune-height by never sending blocks below the
+        // NODE_NETWORK_LIMITED threshold.
+        // Add two blocks buffer extension for possible races
+        if (send && !pfrom.HasPermission(PF_NOBAN) &&
+            ((((pfrom.GetLocalServices() & NODE_NETWORK_LIMITED) ==
+               NODE_NETWORK_LIMITED) &&
+              ((pfrom.GetLocalServices() & NODE_NETWORK) != NODE_NETWORK) &&
+              (::ChainActive().Tip()->nHeight - pindex->nHeight >
+               (int)NODE_NETWORK_LIMITED_MIN_BLOCKS + 2)))) {
+            LogPrint(BCLog::NET,
+                     "Ignore block request below NODE_NETWORK_LIMITED "
+                     "threshold from peer=%d\n",
+                     pfrom.GetId());
 
-        // disconnect node and prevent it from stalling (would otherwise wait
-        // for the missing block)
-        pfrom.fDisconnect = true;
-        send = false;
+            // disconnect node and prevent it from stalling (would otherwise
+            // wait for the missing block)
+            pfrom.fDisconnect = true;
+            send = false;
+        }
+        // Pruned nodes may have deleted the block, so check whether it's
+        // available before trying to send.
+        send = send && pindex->nStatus.hasData();
+        if (send && inv.type == MSG_CMPCT_BLOCK) {
+            // If a peer is asking for old blocks, we're almost guaranteed they
+            // won't have a useful mempool to match against a compact block,
+            // and we don't feel like constructing the object for them, so
+            // instead we respond with the full, non-compact block.
+            fSendCompactBlock =
+                CanDirectFetch(consensusParams) &&
+                pindex->nHeight >=
+                    ::ChainActive().Height() - MAX_CMPCTBLOCK_DEPTH;
+        }
+    } // release cs_main before reading the block from disk
+
+    if (!send) {
+        return;
     }
-    // Pruned nodes may have deleted the block, so check whether it's available
-    // before trying to send.
-    if (send && pindex->nStatus.hasData()) {
-        std::shared_ptr<const CBlock> pblock;
-        if (a_recent_block &&
-            a_recent_block->GetHash() == pindex->GetBlockHash()) {
-            pblock = a_recent_block;
-        } else {
-            // Send block from disk
-            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-            if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams)) {
+
+    std::shared_ptr<const CBlock> pblock;
+    if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
+        pblock = a_recent_block;
+    } else {
+        // Send block from disk
+        std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams)) {
+            // The block may have been pruned since cs_main was released.
+            if (WITH_LOCK(cs_main, return pindex->nStatus.hasData())) {
                 assert(!"cannot load block from disk");
             }
-            pblock = pblockRead;
+            LogPrint(BCLog::NET,
+                     "Block was pruned before it could be read, disconnect "
+                     "peer=%d\n",
+                     pfrom.GetId());
+            pfrom.fDisconnect = true;
+            return;
         }
-        if (inv.type == MSG_BLOCK) {
-            connman.PushMessage(&pfrom,
-                                msgMaker.Make(NetMsgType::BLOCK, *pblock));
-        } else if (inv.type == MSG_FILTERED_BLOCK) {
-            bool sendMerkleBlock = false;
-            CMerkleBlock merkleBlock;
-            if (pfrom.m_tx_relay != nullptr) {
-                LOCK(pfrom.m_tx_relay->cs_filter);
-                if (pfrom.m_tx_relay->pfilter) {
-                    sendMerkleBlock = true;
-                    merkleBlock =
-                        CMerkleBlock(*pblock, *pfrom.m_tx_relay->pfilter);
-                }
-            }
-            if (sendMerkleBlock) {
-                connman.PushMessage(
-                    &pfrom,
-                    msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock));
-                // CMerkleBlock just contains hashes, so also push any
-                // transactions in the block the client did not see. This avoids
-                // hurting performance by pointlessly requiring a round-trip.
-                // Note that there is currently no way for a node to request any
-                // single transactions we didn't send here - they must either
-                // disconnect and retry or request the full block. Thus, the
-                // protocol spec specified allows for us to provide duplicate
-                // txn here, however we MUST always provide at least what the
-                // remote peer needs.
-                typedef std::pair<size_t, uint256> PairType;
-                for (PairType &pair : merkleBlock.vMatchedTxn) {
-                    connman.PushMessage(
-                        &pfrom, msgMaker.Make(NetMsgType::TX,
-                                              *pblock->vtx[pair.first]));
-                }
+        pblock = pblockRead;
+    }
+
+    const CNetMsgMaker msgMaker(pfrom.GetSendVersion());
+    // Blocks are usually requested by many peers at about the same time, so
+    // they are serialized once and shared.
+    auto pushBlock = [&]() {
+        connman.PushSharedMessage(
+            &pfrom, NetMsgType::BLOCK, hash, msgMaker.GetVersion(),
+            [&] { return msgMaker.Make(NetMsgType::BLOCK, *pblock); },
+            block_class);
+    };
+    if (inv.type == MSG_BLOCK) {
+        pushBlock();
+    } else if (inv.type == MSG_FILTERED_BLOCK) {
+        bool sendMerkleBlock = false;
+        CMerkleBlock merkleBlock;
+        if (pfrom.m_tx_relay != nullptr) {
+            LOCK(pfrom.m_tx_relay->cs_filter);
+            if (pfrom.m_tx_relay->pfilter) {
+                sendMerkleBlock = true;
+                merkleBlock = CMerkleBlock(*pblock, *pfrom.m_tx_relay->pfilter);
             }
-            // else
-            // no response
-        } else if (inv.type == MSG_CMPCT_BLOCK) {
-            // If a peer is asking for old blocks, we're almost guaranteed they
-            // won't have a useful mempool to match against a compact block, and
-            // we don't feel like constructing the object for them, so instead
-            // we respond with the full, non-compact block.
-            int nSendFlags = 0;
-            if (CanDirectFetch(consensusParams) &&
-                pindex->nHeight >=
-                    ::ChainActive().Height() - MAX_CMPCTBLOCK_DEPTH) {
-                CBlockHeaderAndShortTxIDs cmpctblock(*pblock);
-                connman.PushMessage(
-                    &pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK,
-                                          cmpctblock));
-            } else {
+        }
+        if (sendMerkleBlock) {
+            connman.PushMessage(
+                &pfrom, msgMaker.Make(NetMsgType::MERKLEBLOCK, merkleBlock),
+                block_class);
+            // CMerkleBlock just contains hashes, so also push any
+            // transactions in the block the client did not see. This avoids
+            // hurting performance by pointlessly requiring a round-trip.
+            // Note that there is currently no way for a node to request any
+            // single transactions we didn't send here - they must either
+            // disconnect and retry or request the full block. Thus, the
+            // protocol spec specified allows for us to provide duplicate
+            // txn here, however we MUST always provide at least what the
+            // remote peer needs.
+            typedef std::pair<size_t, uint256> PairType;
+            for (PairType &pair : merkleBlock.vMatchedTxn) {
                 connman.PushMessage(
                     &pfrom,
-                    msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *pblock));
+                    msgMaker.Make(NetMsgType::TX, *pblock->vtx[pair.first]),
+                    block_class);
             }
         }
+        // else
+        // no response
+    } else if (inv.type == MSG_CMPCT_BLOCK) {
+        int nSendFlags = 0;
+        if (fSendCompactBlock) {
+            connman.PushSharedMessage(
+                &pfrom, NetMsgType::CMPCTBLOCK, hash, msgMaker.GetVersion(),
+                [&] {
+                    CBlockHeaderAndShortTxIDs cmpctblock(*pblock);
+                    return msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK,
+                                         cmpctblock);
+                });
+        } else {
+            pushBlock();
+        }
+    }
 
-        // Trigger the peer node to send a getblocks request for the next batch
-        // of inventory.
-        if (hash == pfrom.hashContinue) {
-            // Bypass PushInventory, this must send even if redundant, and we
-            // want it right after the last block so they don't wait for other
-            // stuff first.
-            std::vector<CInv> vInv;
-            vInv.push_back(
-                CInv(MSG_BLOCK, ::ChainActive().Tip()->GetBlockHash()));
+    // Trigger the peer node to send a getblocks request for the next batch
+    // of inventory.
+    if (hash == pfrom.hashContinue) {
+        // Bypass PushInventory, this must send even if redundant, and we
+        // want it right after the last block so they don't wait for other
+        // stuff first.
+        std::vector<CInv> vInv;
+        vInv.push_back(CInv(
+            MSG_BLOCK,
+            WITH_LOCK(cs_main, return ::ChainActive().Tip()->GetBlockHash())));
+        connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::INV, vInv));
+        pfrom.hashContinue = BlockHash();
+    }
+}
+
+/**
+ * Announce the transactions a reconciliation found the peer is missing, if
+ * they are still in our mempool.
+ */
+static void AnnounceReconciledTxs(CNode &pfrom, const std::vector<TxId> &txids,
+                                  CConnman &connman) {
+    const CNetMsgMaker msgMaker(pfrom.GetSendVersion());
+    std::vector<CInv> vInv;
+    for (const TxId &txid : txids) {
+        if (!g_mempool.exists(txid)) {
+            continue;
+        }
+        vInv.push_back(CInv(MSG_TX, txid));
+        if (vInv.size() == MAX_INV_SZ) {
             connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::INV, vInv));
-            pfrom.hashContinue = BlockHash();
+            vInv.clear();
         }
     }
+    if (!vInv.empty()) {
+        connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::INV, vInv));
+    }
 }
 
 static void ProcessGetData(const Config &config, CNode &pfrom,
@@ -1859,9 +1802,12 @@ static void ProcessGetData(const Config &config, CNode &pfrom,
             auto mi = mapRelay.find(inv.hash);
             int nSendFlags = 0;
             if (mi != mapRelay.end()) {
-                connman.PushMessage(
-                    &pfrom,
-                    msgMaker.Make(nSendFlags, NetMsgType::TX, *mi->second));
+                connman.PushSharedMessage(
+                    &pfrom, NetMsgType::TX, inv.hash, msgMaker.GetVersion(),
+                    [&] {
+                        return msgMaker.Make(nSendFlags, NetMsgType::TX,
+                                             *mi->second);
+                    });
                 push = true;
             } else {
                 auto txinfo = g_mempool.info(TxId(inv.hash));
@@ -1872,9 +1818,12 @@ static void ProcessGetData(const Config &config, CNode &pfrom,
                 if (txinfo.tx &&
                     ((mempool_req.count() && txinfo.m_time <= mempool_req) ||
                      (txinfo.m_time <= longlived_mempool_time))) {
-                    connman.PushMessage(
-                        &pfrom,
-                        msgMaker.Make(nSendFlags, NetMsgType::TX, *txinfo.tx));
+                    connman.PushSharedMessage(
+                        &pfrom, NetMsgType::TX, inv.hash, msgMaker.GetVersion(),
+                        [&] {
+                            return msgMaker.Make(nSendFlags, NetMsgType::TX,
+                                                 *txinfo.tx);
+                        });
                     push = true;
                 }
             }
@@ -1889,7 +1838,9 @@ static void ProcessGetData(const Config &config, CNode &pfrom,
         if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK ||
             inv.type == MSG_CMPCT_BLOCK) {
             it++;
+            const int64_t nServeStart = GetTimeMicros();
             ProcessGetBlockData(config, pfrom, inv, connman, interruptMsgProc);
+            pfrom.m_telemetry.RecordBlockServed(GetTimeMicros() - nServeStart);
         }
     }
 
@@ -1954,7 +1905,13 @@ static bool ProcessHeadersMessage(const Config &config, CNode &pfrom,
         return true;
     }
 
+    // Hash the headers and check their proof of work before taking cs_main.
+    std::vector<BlockHash> hashes;
+    const bool pow_checked =
+        CheckBlockHeaders(headers, hashes, chainparams.GetConsensus());
+
     bool received_new_header = false;
+    bool requested_more_headers = false;
     const CBlockIndex *pindexLast = nullptr;
     {
         LOCK(cs_main);
@@ -1996,25 +1953,42 @@ static bool ProcessHeadersMessage(const Config &config, CNode &pfrom,
             return true;
         }
 
-        BlockHash hashLastBlock;
-        for (const CBlockHeader &header : headers) {
-            if (!hashLastBlock.IsNull() &&
-                header.hashPrevBlock != hashLastBlock) {
+        for (size_t i = 1; i < nCount; i++) {
+            if (headers[i].hashPrevBlock != hashes[i - 1]) {
                 Misbehaving(pfrom, 20, "disconnected-header");
                 return error("non-continuous headers sequence");
             }
-            hashLastBlock = header.GetHash();
         }
+        const BlockHash &hashLastBlock = hashes.back();
 
         // If we don't have the last header, then they'll have given us
         // something new (if these headers are valid).
         if (!LookupBlockIndex(hashLastBlock)) {
             received_new_header = true;
         }
+
+        // Headers message had its maximum size; the peer may have more
+        // headers. Ask for them right away, so they are downloaded while
+        // these ones are validated.
+        const CBlockIndex *pindexPrev =
+            LookupBlockIndex(headers[0].hashPrevBlock);
+        if (nCount == MAX_HEADERS_RESULTS && pow_checked && pindexPrev) {
+            CBlockLocator locator = ::ChainActive().GetLocator(pindexPrev);
+            locator.vHave.insert(locator.vHave.begin(), hashLastBlock);
+            LogPrint(
+                BCLog::NET,
+                "more getheaders (%d) to end to peer=%d (startheight:%d)\n",
+                pindexPrev->nHeight + nCount, pfrom.GetId(),
+                pfrom.nStartingHeight);
+            connman.PushMessage(&pfrom, msgMaker.Make(NetMsgType::GETHEADERS,
+                                                      locator, uint256()));
+            requested_more_headers = true;
+        }
     }
 
     BlockValidationState state;
-    if (!chainman.ProcessNewBlockHeaders(config, headers, state, &pindexLast)) {
+    if (!chainman.ProcessNewBlockHeaders(config, headers, state, &pindexLast,
+                                         pow_checked ? &hashes : nullptr)) {
         if (state.IsInvalid()) {
             MaybePunishNodeForBlock(pfrom.GetId(), state, via_compact_block,
                                     "invalid header received");
@@ -2044,7 +2018,7 @@ static bool ProcessHeadersMessage(const Config &config, CNode &pfrom,
             nodestate->m_last_block_announcement = GetTime();
         }
 
-        if (nCount == MAX_HEADERS_RESULTS) {
+        if (nCount == MAX_HEADERS_RESULTS && !requested_more_headers) {
             // Headers message had its maximum size; the peer may have more
             // headers.
             // TODO: optimize: if pindexLast is an ancestor of
@@ -2116,9 +2090,24 @@ static bool ProcessHeadersMessage(const Config &config, CNode &pfrom,
                         // In any case, we want to download using a compact
                         // block, not a regular one.
                         vGetData[0] = CInv(MSG_CMPCT_BLOCK, vGetData[0].hash);
+                        // Or better, a graphene block, which falls back to
+                        // a compact block.
+                        if ((pfrom.GetLocalServices() & NODE_GRAPHENE) &&
+                            (pfrom.nServices & NODE_GRAPHENE)) {
+                            GrapheneBlockRequest req;
+                            req.blockhash = BlockHash(vGetData[0].hash);
+                            req.mempool_size = g_mempool.size();
+                            connman.PushMessage(
+                                &pfrom,
+                                msgMaker.Make(NetMsgType::GETGRBLK, req));
+                            vGetData.clear();
+                        }
+                    }
+                    if (!vGetData.empty()) {
+                        connman.PushMessage(
+                            &pfrom,
+                            msgMaker.Make(NetMsgType::GETDATA, vGetData));
                     }
-                    connman.PushMessage(
-                        &pfrom, msgMaker.Make(NetMsgType::GETDATA, vGetData));
                 }
             }
         }
@@ -2172,59 +2161,46 @@ static bool ProcessHeadersMessage(const Config &config, CNode &pfrom,
     return true;
 }
 
+/**
+ * Reconsider the orphans of a peer whose parents have all been seen, until one
+ * is accepted or rejected, or the batch limit is reached.
+ */
 void static ProcessOrphanTx(const Config &config, CConnman &connman,
-                            std::set<TxId> &orphan_work_set)
+                            NodeId peer)
     EXCLUSIVE_LOCKS_REQUIRED(cs_main, g_cs_orphans) {
     AssertLockHeld(cs_main);
     AssertLockHeld(g_cs_orphans);
-    std::unordered_map<NodeId, uint32_t> rejectCountPerNode;
-    bool done = false;
-    while (!done && !orphan_work_set.empty()) {
-        const TxId orphanTxId = *orphan_work_set.begin();
-        orphan_work_set.erase(orphan_work_set.begin());
-
-        auto orphan_it = mapOrphanTransactions.find(orphanTxId);
-        if (orphan_it == mapOrphanTransactions.end()) {
-            continue;
+    for (size_t i = 0; i < MAX_ORPHAN_RECONSIDERATIONS_PER_BATCH; i++) {
+        const CTransactionRef porphanTx = g_orphanage.GetTxToReconsider(peer);
+        if (!porphanTx) {
+            break;
         }
 
-        const CTransactionRef porphanTx = orphan_it->second.tx;
         const CTransaction &orphanTx = *porphanTx;
-        NodeId fromPeer = orphan_it->second.fromPeer;
+        const TxId &orphanTxId = orphanTx.GetId();
         // Use a new TxValidationState because orphans come from different peers
         // (and we call MaybePunishNodeForTx based on the source peer from the
         // orphan map, not based on the peer that relayed the previous
         // transaction).
         TxValidationState orphan_state;
 
-        auto it = rejectCountPerNode.find(fromPeer);
-        if (it != rejectCountPerNode.end() &&
-            it->second > MAX_NON_STANDARD_ORPHAN_PER_NODE) {
-            continue;
-        }
-
         if (AcceptToMemoryPool(config, g_mempool, orphan_state, porphanTx,
                                false /* bypass_limits */,
                                Amount::zero() /* nAbsurdFee */)) {
             LogPrint(BCLog::MEMPOOL, "   accepted orphan tx %s\n",
                      orphanTxId.ToString());
-            RelayTransaction(orphanTxId, connman);
-            for (size_t i = 0; i < orphanTx.vout.size(); i++) {
-                auto it_by_prev =
-                    mapOrphanTransactionsByPrev.find(COutPoint(orphanTxId, i));
-                if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
-                    for (const auto &elem : it_by_prev->second) {
-                        orphan_work_set.insert(elem->first);
-                    }
-                }
-            }
-            EraseOrphanTx(orphanTxId);
-            done = true;
-        } else if (orphan_state.GetResult() !=
-                   TxValidationResult::TX_MISSING_INPUTS) {
+            RelayTransaction(orphanTxId);
+            g_orphanage.AddChildrenToWorkSet(orphanTx);
+            g_orphanage.EraseTx(orphanTxId);
+            g_mempool.check(&::ChainstateActive().CoinsTip());
+            break;
+        }
+
+        if (orphan_state.GetResult() !=
+            TxValidationResult::TX_MISSING_INPUTS) {
             if (orphan_state.IsInvalid()) {
                 // Punish peer that gave us an invalid orphan tx
-                MaybePunishNodeForTx(fromPeer, orphan_state);
+                MaybePunishNodeForTx(peer, orphan_state);
                 LogPrint(BCLog::MEMPOOL, "   invalid orphan tx %s\n",
                          orphanTxId.ToString());
             }
@@ -2236,10 +2212,20 @@ void static ProcessOrphanTx(const Config &config, CConnman &connman,
             assert(recentRejects);
             recentRejects->insert(orphanTxId);
 
-            EraseOrphanTx(orphanTxId);
-            done = true;
+            g_orphanage.EraseTx(orphanTxId);
+            g_mempool.check(&::ChainstateActive().CoinsTip());
+            break;
+        }
+
+        // A parent went away before the orphan could be reconsidered, e.g. it
+        // was evicted from the mempool or one of its inputs got spent: wait
+        // for the missing outpoints again.
+        const std::vector<COutPoint> missing = GetMissingInputs(orphanTx);
+        if (missing.empty()) {
+            g_orphanage.EraseTx(orphanTxId);
+        } else {
+            g_orphanage.SetMissingInputs(orphanTxId, missing);
         }
-        g_mempool.check(&::ChainstateActive().CoinsTip());
     }
 }
 
@@ -2590,6 +2576,19 @@ bool ProcessMessage(const Config &config, CNode &pfrom,
             PushNodeVersion(config, pfrom, connman, GetAdjustedTime());
         }
 
+        // Offer to reconcile transactions rather than flood them if we both
+        // support it. This must happen before verack.
+        if (g_txreconciliation && pfrom.m_tx_relay != nullptr && fRelay &&
+            (pfrom.GetLocalServices() & NODE_TXRECONCILIATION) &&
+            (nServices & NODE_TXRECONCILIATION)) {
+            const uint64_t salt =
+                g_txreconciliation->PreRegisterPeer(pfrom.GetId());
+            connman.PushMessage(
+                &pfrom, CNetMsgMaker(INIT_PROTO_VERSION)
+                            .Make(NetMsgType::SENDTXRCNCL,
+                                  TXRECONCILIATION_VERSION, salt));
+        }
+
         connman.PushMessage(
             &pfrom, CNetMsgMaker(INIT_PROTO_VERSION).Make(NetMsgType::VERACK));
 
@@ -2697,6 +2696,23 @@ bool ProcessMessage(const Config &config, CNode &pfrom,
     // At this point, the outgoing message serialization version can't change.
     const CNetMsgMaker msgMaker(pfrom.GetSendVersion());
 
+    if (msg_type == NetMsgType::SENDTXRCNCL) {
+        uint32_t version;
+        uint64_t remote_salt;
+        vRecv >> version >> remote_salt;
+        // The offer is only valid before verack.
+        if (!g_txreconciliation || pfrom.fSuccessfullyConnected) {
+            return true;
+        }
+        if (g_txreconciliation->RegisterPeer(
+                pfrom.GetId(), pfrom.fInbound,
+                std::min(version, TXRECONCILIATION_VERSION), remote_salt)) {
+            LogPrint(BCLog::NET, "reconciling transactions with peer=%d\n",
+                     pfrom.GetId());
+        }
+        return true;
+    }
+
     if (msg_type == NetMsgType::VERACK) {
         pfrom.SetRecvVersion(std::min(pfrom.nVersion.load(), PROTOCOL_VERSION));
 
@@ -2834,6 +2850,53 @@ bool ProcessMessage(const Config &config, CNode &pfrom,
         return true;
     }
 
+    if (msg_type == NetMsgType::REQTXRCNCL) {
+        uint16_t remote_size;
+        uint16_t q;
+        vRecv >> remote_size >> q;
+        std::vector<uint8_t> sketch;
+        if (g_txreconciliation &&
+            g_txreconciliation->HandleReconciliationRequest(
+                pfrom.GetId(), remote_size, q, sketch)) {
+            connman.PushMessage(&pfrom,
+                                msgMaker.Make(NetMsgType::SKETCH, sketch));
+        }
+        return true;
+    }
+
+    if (msg_type == NetMsgType::SKETCH) {
+        std::vector<uint8_t> sketch;
+        vRecv >> sketch;
+        TxReconciliationTracker::Result result;
+        if (!g_txreconciliation ||
+            !g_txreconciliation->HandleSketch(pfrom.GetId(), sketch, result)) {
+            return true;
+        }
+        LogPrint(BCLog::NET,
+                 "reconciliation with peer=%d %s: announcing %u, "
+                 "requesting %u\n",
+                 pfrom.GetId(), result.success ? "succeeded" : "failed",
+                 result.announce.size(), result.missing.size());
+        AnnounceReconciledTxs(pfrom, result.announce, connman);
+        connman.PushMessage(&pfrom,
+                            msgMaker.Make(NetMsgType::RECONCILDIFF,
+                                          result.success, result.missing));
+        return true;
+    }
+
+    if (msg_type == NetMsgType::RECONCILDIFF) {
+        bool success;
+        std::vector<uint32_t> missing;
+        vRecv >> success >> missing;
+        std::vector<TxId> announce;
+        if (g_txreconciliation &&
+            g_txreconciliation->HandleReconciliationDiff(
+                pfrom.GetId(), success, missing, announce)) {
+            AnnounceReconciledTxs(pfrom, announce, connman);
+        }
+        return true;
+    }
+
     if (msg_type == NetMsgType::INV) {
         std::vector<CInv> vInv;
         vRecv >> vInv;
@@ -3068,6 +3131,63 @@ bool ProcessMessage(const Config &config, CNode &pfrom,
         return true;
     }
 
+    if (msg_type == NetMsgType::GETGRBLK) {
+        if (!(pfrom.GetLocalServices() & NODE_GRAPHENE)) {
+            LogPrint(BCLog::NET,
+                     "getgrblk sent despite not advertising graphene, "
+                     "disconnecting peer=%d\n",
+                     pfrom.GetId());
+            pfrom.fDisconnect = true;
+            return true;
+        }
+
+        GrapheneBlockRequest req;
+        vRecv >> req;
+
+        std::shared_ptr<const CBlock> pblock;
+        {
+            LOCK(cs_most_recent_block);
+            if (most_recent_block_hash == req.blockhash) {
+                pblock = most_recent_block;
+            }
+        }
+
+        if (!pblock) {
+            LOCK(cs_main);
+            const CBlockIndex *pindex = LookupBlockIndex(req.blockhash);
+            if (!pindex || !pindex->nStatus.hasData()) {
+                LogPrint(BCLog::NET,
+                         "Peer %d sent us a getgrblk for a block we don't "
+                         "have\n",
+                         pfrom.GetId());
+                return true;
+            }
+            if (pindex->nHeight <
+                ::ChainActive().Height() - MAX_CMPCTBLOCK_DEPTH) {
+                // The peer is unlikely to have the transactions of an old
+                // block, let the getdata logic send it in full.
+                pfrom.vRecvGetData.push_back(
+                    CInv(MSG_CMPCT_BLOCK, req.blockhash));
+                return true;
+            }
+            std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
+            bool ret = ReadBlockFromDisk(*pblockRead, pindex,
+                                         chainparams.GetConsensus());
+            assert(ret);
+            pblock = pblockRead;
+        }
+
+        if (!CGrapheneBlock::CanEncode(*pblock)) {
+            LOCK(cs_main);
+            pfrom.vRecvGetData.push_back(CInv(MSG_CMPCT_BLOCK, req.blockhash));
+            return true;
+        }
+        connman.PushMessage(
+            &pfrom, msgMaker.Make(NetMsgType::GRBLK,
+                                  CGrapheneBlock(*pblock, req.mempool_size)));
+        return true;
+    }
+
     if (msg_type == NetMsgType::GETHEADERS) {
         CBlockLocator locator;
         BlockHash hashStop;
@@ -3182,16 +3302,8 @@ bool ProcessMessage(const Config &config, CNode &pfrom,
                                false /* bypass_limits */,
                                Amount::zero() /* nAbsurdFee */)) {
             g_mempool.check(&::ChainstateActive().CoinsTip());
-            RelayTransaction(tx.GetId(), connman);
-            for (size_t i = 0; i < tx.vout.size(); i++) {
-                auto it_by_prev =
-                    mapOrphanTransactionsByPrev.find(COutPoint(txid, i));
-                if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
-                    for (const auto &elem : it_by_prev->second) {
-                        pfrom.orphan_work_set.insert(elem->first);
-                    }
-                }
-            }
+            RelayTransaction(tx.GetId());
+            g_orphanage.AddChildrenToWorkSet(tx);
 
             pfrom.nLastTXTime = GetTime();
 
@@ -3201,9 +3313,10 @@ bool ProcessMessage(const Config &config, CNode &pfrom,
                      pfrom.GetId(), tx.GetId().ToString(), g_mempool.size(),
                      g_mempool.DynamicMemoryUsage() / 1000);
 
-            // Recursively process any orphan transactions that depended on this
-            // one
-            ProcessOrphanTx(config, connman, pfrom.orphan_work_set);
+            // Reconsider the orphans of this peer that depended on this one,
+            // the orphans of other peers are reconsidered when processing
+            // their messages.
+            ProcessOrphanTx(config, connman, pfrom.GetId());
         } else if (state.GetResult() == TxValidationResult::TX_MISSING_INPUTS) {
             // It may be the case that the orphans parents have all been
             // rejected.
@@ -3225,14 +3338,17 @@ bool ProcessMessage(const Config &config, CNode &pfrom,
                         RequestTx(State(pfrom.GetId()), _txid, current_time);
                     }
                 }
-                AddOrphanTx(ptx, pfrom.GetId());
+                if (g_orphanage.AddTx(ptx, pfrom.GetId(),
+                                      GetMissingInputs(tx))) {
+                    AddToCompactExtraTransactions(ptx);
+                }
 
-                // DoS prevention: do not allow mapOrphanTransactions to grow
-                // unbounded (see CVE-2012-3789)
+                // DoS prevention: do not allow g_orphanage to grow unbounded
+                // (see CVE-2012-3789)
                 unsigned int nMaxOrphanTx = (unsigned int)std::max(
                     int64_t(0), gArgs.GetArg("-maxorphantx",
                                              DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+                unsigned int nEvicted = g_orphanage.LimitOrphans(nMaxOrphanTx);
                 if (nEvicted > 0) {
                     LogPrint(BCLog::MEMPOOL,
                              "mapOrphan overflow, removed %u tx\n", nEvicted);
@@ -3269,7 +3385,7 @@ bool ProcessMessage(const Config &config, CNode &pfrom,
                 } else {
                     LogPrintf("Force relaying tx %s from whitelisted peer=%d\n",
                               tx.GetId().ToString(), pfrom.GetId());
-                    RelayTransaction(tx.GetId(), connman);
+                    RelayTransaction(tx.GetId());
                 }
             }
         }
@@ -3574,6 +3690,89 @@ bool ProcessMessage(const Config &config, CNode &pfrom,
         return true;
     }
 
+    if (msg_type == NetMsgType::GRBLK) {
+        // Ignore grblk received while importing
+        if (fImporting || fReindex) {
+            LogPrint(BCLog::NET,
+                     "Unexpected grblk message received from peer %d\n",
+                     pfrom.GetId());
+            return true;
+        }
+
+        CGrapheneBlock grblock;
+        vRecv >> grblock;
+
+        // As for compact blocks, a successful decoding jumps to the BLOCKTXN
+        // handling code with a dummy BLOCKTXN message.
+        bool fProcessBLOCKTXN = false;
+        CDataStream blockTxnMsg(SER_NETWORK, PROTOCOL_VERSION);
+        {
+            LOCK2(cs_main, g_cs_orphans);
+
+            // Graphene blocks are only sent on request, for blocks which are
+            // already in flight.
+            const BlockHash hash = grblock.header.GetHash();
+            auto it = mapBlocksInFlight.find(hash);
+            if (it == mapBlocksInFlight.end() ||
+                it->second.first != pfrom.GetId() ||
+                it->second.second->partialBlock) {
+                LogPrint(BCLog::NET,
+                         "Peer %d sent us a grblk we weren't expecting\n",
+                         pfrom.GetId());
+                return true;
+            }
+
+            std::unique_ptr<PartiallyDownloadedBlock> &partialBlock =
+                it->second.second->partialBlock;
+            partialBlock.reset(
+                new PartiallyDownloadedBlock(config, &g_mempool));
+            ReadStatus status =
+                partialBlock->InitData(grblock, vExtraTxnForCompact);
+            if (status == READ_STATUS_INVALID) {
+                // Reset in-flight state in case of whitelist
+                MarkBlockAsReceived(hash);
+                Misbehaving(pfrom, 100, "invalid-grblk");
+                LogPrintf("Peer %d sent us invalid graphene block\n",
+                          pfrom.GetId());
+                return true;
+            } else if (status == READ_STATUS_FAILED) {
+                // The IBLT could not be decoded, ask for a compact block
+                // instead.
+                partialBlock.reset();
+                connman.PushMessage(
+                    &pfrom,
+                    msgMaker.Make(NetMsgType::GETDATA,
+                                  std::vector<CInv>{
+                                      CInv(MSG_CMPCT_BLOCK, hash)}));
+                return true;
+            }
+
+            BlockTransactionsRequest req;
+            for (size_t i = 0; i < grblock.tx_count; i++) {
+                if (!partialBlock->IsTxAvailable(i)) {
+                    req.indices.push_back(i);
+                }
+            }
+            if (req.indices.empty()) {
+                BlockTransactions txn;
+                txn.blockhash = hash;
+                blockTxnMsg << txn;
+                fProcessBLOCKTXN = true;
+            } else {
+                req.blockhash = hash;
+                connman.PushMessage(
+                    &pfrom, msgMaker.Make(NetMsgType::GETBLOCKTXN, req));
+            }
+        } // cs_main
+
+        if (fProcessBLOCKTXN) {
+            return ProcessMessage(config, pfrom, NetMsgType::BLOCKTXN,
+                                  blockTxnMsg, nTimeReceived, chainman, connman,
+                                  banman, interruptMsgProc);
+        }
+        return true;
+    }
+
     if (msg_type == NetMsgType::BLOCKTXN) {
         // Ignore blocktxn received while importing
         if (fImporting || fReindex) {
@@ -3641,7 +3840,7 @@ bool ProcessMessage(const Config &config, CNode &pfrom,
                 // updated, etc.
 
                 // it is now an empty pointer
-                MarkBlockAsReceived(resp.blockhash);
+                MarkBlockAsReceived(resp.blockhash, pfrom.GetId());
                 fBlockRead = true;
                 // mapBlockSource is used for potentially punishing peers and
                 // updating which peers send us compact blocks, so the race
@@ -3730,7 +3929,7 @@ bool ProcessMessage(const Config &config, CNode &pfrom,
             LOCK(cs_main);
             // Also always process if we requested the block explicitly, as we
             // may need it even though it is not a candidate for a new best tip.
-            forceProcessing |= MarkBlockAsReceived(hash);
+            forceProcessing |= MarkBlockAsReceived(hash, pfrom.GetId());
             // mapBlockSource is only used for punishing peers and setting
             // which peers send us compact blocks, so the race between here and
             // cs_main in ProcessNewBlock is fine.
@@ -4192,6 +4391,20 @@ bool ProcessMessage(const Config &config, CNode &pfrom,
     return true;
 }
 
+/**
+ * Whether a message can be processed by a message worker, concurrently with
+ * the messages of other peers. Such messages must not hold cs_main for long,
+ * and must not touch the state of other peers which is only protected by
+ * being accessed from the message handler thread (eg. relaying addresses).
+ */
+static bool CanProcessInMessageWorker(const std::string &msg_type) {
+    return msg_type == NetMsgType::PING || msg_type == NetMsgType::GETDATA ||
+           msg_type == NetMsgType::GETCFILTERS ||
+           msg_type == NetMsgType::GETCFHEADERS ||
+           msg_type == NetMsgType::GETCFCHECKPT ||
+           msg_type == NetMsgType::AVAPOLL;
+}
+
 bool PeerLogicValidation::CheckIfBanned(CNode &pnode) {
     AssertLockHeld(cs_main);
     CNodeState &state = *State(pnode.GetId());
@@ -4240,9 +4453,10 @@ bool PeerLogicValidation::ProcessMessages(const Config &config, CNode *pfrom,
         ProcessGetData(config, *pfrom, *connman, interruptMsgProc);
     }
 
-    if (!pfrom->orphan_work_set.empty()) {
+    if (WITH_LOCK(g_cs_orphans,
+                  return g_orphanage.HaveTxToReconsider(pfrom->GetId()))) {
         LOCK2(cs_main, g_cs_orphans);
-        ProcessOrphanTx(config, *connman, pfrom->orphan_work_set);
+        ProcessOrphanTx(config, *connman, pfrom->GetId());
     }
 
     if (pfrom->fDisconnect) {
@@ -4254,7 +4468,8 @@ bool PeerLogicValidation::ProcessMessages(const Config &config, CNode *pfrom,
     if (!pfrom->vRecvGetData.empty()) {
         return true;
     }
-    if (!pfrom->orphan_work_set.empty()) {
+    if (WITH_LOCK(g_cs_orphans,
+                  return g_orphanage.HaveTxToReconsider(pfrom->GetId()))) {
         return true;
     }
 
@@ -4309,7 +4524,6 @@ bool PeerLogicValidation::ProcessMessages(const Config &config, CNode *pfrom,
     unsigned int nMessageSize = msg.m_message_size;
 
     // Checksum
-    CDataStream &vRecv = msg.m_recv;
     if (!msg.m_valid_checksum) {
         LogPrint(BCLog::NET, "%s(%s, %u bytes): CHECKSUM ERROR peer=%d\n",
                  __func__, SanitizeString(msg_type), nMessageSize,
@@ -4321,16 +4535,39 @@ bool PeerLogicValidation::ProcessMessages(const Config &config, CNode *pfrom,
         return fMoreWork;
     }
 
+    if (connman->HasMessageWorkers() && CanProcessInMessageWorker(msg_type)) {
+        auto pmsg = std::make_shared<CNetMessage>(std::move(msg));
+        connman->DispatchToMessageWorker(
+            pfrom, [this, &config, pfrom, pmsg, &interruptMsgProc]() {
+                ProcessReceivedMessage(config, *pfrom, *pmsg,
+                                       interruptMsgProc);
+            });
+        // The message handler will be woken up once the message is processed.
+        return false;
+    }
+
+    fMoreWork |= ProcessReceivedMessage(config, *pfrom, msg, interruptMsgProc);
+    return fMoreWork;
+}
+
+bool PeerLogicValidation::ProcessReceivedMessage(
+    const Config &config, CNode &pfrom, CNetMessage &msg,
+    const std::atomic<bool> &interruptMsgProc) {
+    const std::string &msg_type = msg.m_command;
+    unsigned int nMessageSize = msg.m_message_size;
+
     // Process message
     bool fRet = false;
+    bool fMoreWork = false;
+    const int64_t nProcessStart = GetTimeMicros();
     try {
-        fRet = ProcessMessage(config, *pfrom, msg_type, vRecv, msg.m_time,
+        fRet = ProcessMessage(config, pfrom, msg_type, msg.m_recv, msg.m_time,
                               m_chainman, *connman, m_banman, interruptMsgProc);
         if (interruptMsgProc) {
             return false;
         }
 
-        if (!pfrom->vRecvGetData.empty()) {
+        if (!pfrom.vRecvGetData.empty()) {
             fMoreWork = true;
         }
     } catch (const std::exception &e) {
@@ -4342,13 +4579,16 @@ bool PeerLogicValidation::ProcessMessages(const Config &config, CNode *pfrom,
                  __func__, SanitizeString(msg_type), nMessageSize);
     }
 
+    pfrom.m_telemetry.RecordProcessing(msg_type,
+                                       GetTimeMicros() - nProcessStart);
+
     if (!fRet) {
         LogPrint(BCLog::NET, "%s(%s, %u bytes) FAILED peer=%d\n", __func__,
-                 SanitizeString(msg_type), nMessageSize, pfrom->GetId());
+                 SanitizeString(msg_type), nMessageSize, pfrom.GetId());
     }
 
     LOCK(cs_main);
-    CheckIfBanned(*pfrom);
+    CheckIfBanned(pfrom);
 
     return fMoreWork;
 }
@@ -4551,23 +4791,6 @@ void PeerLogicValidation::CheckForStaleTipAndEvictPeers(
     m_stale_tip_check_time = time_in_seconds + STALE_CHECK_INTERVAL;
 }
 
-namespace {
-class CompareInvMempoolOrder {
-    CTxMemPool *mp;
-
-public:
-    explicit CompareInvMempoolOrder(CTxMemPool *_mempool) { mp = _mempool; }
-
-    bool operator()(std::set<TxId>::iterator a, std::set<TxId>::iterator b) {
-        /**
-         * As std::make_heap produces a max-heap, we want the entries with the
-         * fewest ancestors/highest fee to sort later.
-         */
-        return mp->CompareDepthAndScore(*b, *a);
-    }
-};
-} // namespace
-
 bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
                                        std::atomic<bool> &interruptMsgProc) {
     const Consensus::Params &consensusParams =
@@ -4793,29 +5016,27 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
 
                 int nSendFlags = 0;
 
-                bool fGotBlockFromCache = false;
-                {
-                    LOCK(cs_most_recent_block);
-                    if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
-                        CBlockHeaderAndShortTxIDs cmpctblock(
-                            *most_recent_block);
-                        connman->PushMessage(
-                            pto,
-                            msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK,
-                                          cmpctblock));
-                        fGotBlockFromCache = true;
-                    }
-                }
-                if (!fGotBlockFromCache) {
-                    CBlock block;
-                    bool ret =
-                        ReadBlockFromDisk(block, pBestIndex, consensusParams);
-                    assert(ret);
-                    CBlockHeaderAndShortTxIDs cmpctblock(block);
-                    connman->PushMessage(
-                        pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK,
-                                           cmpctblock));
-                }
+                const BlockHash &hash = pBestIndex->GetBlockHash();
+                connman->PushSharedMessage(
+                    pto, NetMsgType::CMPCTBLOCK, hash, msgMaker.GetVersion(),
+                    [&] {
+                        {
+                            LOCK(cs_most_recent_block);
+                            if (most_recent_block_hash == hash) {
+                                return msgMaker.Make(
+                                    nSendFlags, NetMsgType::CMPCTBLOCK,
+                                    CBlockHeaderAndShortTxIDs(
+                                        *most_recent_block));
+                            }
+                        }
+                        CBlock block;
+                        bool ret = ReadBlockFromDisk(block, pBestIndex,
+                                                     consensusParams);
+                        assert(ret);
+                        return msgMaker.Make(nSendFlags,
+                                             NetMsgType::CMPCTBLOCK,
+                                             CBlockHeaderAndShortTxIDs(block));
+                    });
                 state.pindexBestHeaderSent = pBestIndex;
             } else if (state.fPreferHeaders) {
                 if (vHeaders.size() > 1) {
@@ -4910,7 +5131,7 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
             if (fSendTrickle) {
                 LOCK(pto->m_tx_relay->cs_filter);
                 if (!pto->m_tx_relay->fRelayTxes) {
-                    pto->m_tx_relay->setInventoryTxToSend.clear();
+                    g_tx_announcements.SkipAll(pto->GetId());
                 }
             }
 
@@ -4929,7 +5150,6 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
                 for (const auto &txinfo : vtxinfo) {
                     const TxId &txid = txinfo.tx->GetId();
                     CInv inv(MSG_TX, txid);
-                    pto->m_tx_relay->setInventoryTxToSend.erase(txid);
                     // Don't send transactions that peers will not put into
                     // their mempool
                     if (txinfo.fee < filterrate.GetFee(txinfo.vsize)) {
@@ -4940,6 +5160,8 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
                             *txinfo.tx)) {
                         continue;
                     }
+                    // This also prevents the transaction from being announced
+                    // again below.
                     pto->m_tx_relay->filterInventoryKnown.insert(txid);
                     vInv.push_back(inv);
                     if (vInv.size() == MAX_INV_SZ) {
@@ -4954,65 +5176,60 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
 
             // Determine transactions to relay
             if (fSendTrickle) {
-                // Produce a vector with all candidates for sending
-                std::vector<std::set<TxId>::iterator> vInvTx;
-                vInvTx.reserve(pto->m_tx_relay->setInventoryTxToSend.size());
-                for (std::set<TxId>::iterator it =
-                         pto->m_tx_relay->setInventoryTxToSend.begin();
-                     it != pto->m_tx_relay->setInventoryTxToSend.end(); it++) {
-                    vInvTx.push_back(it);
-                }
                 CFeeRate filterrate;
                 {
                     LOCK(pto->m_tx_relay->cs_feeFilter);
                     filterrate = CFeeRate(pto->m_tx_relay->minFeeFilter);
                 }
-                // Topologically and fee-rate sort the inventory we send for
-                // privacy and priority reasons. A heap is used so that not all
-                // items need sorting if only a few are being sent.
-                CompareInvMempoolOrder compareInvMempoolOrder(&g_mempool);
-                std::make_heap(vInvTx.begin(), vInvTx.end(),
-                               compareInvMempoolOrder);
-                // No reason to drain out at many times the network's capacity,
+                // The transactions are topologically and fee-rate sorted once
+                // for all the peers, for privacy and priority reasons. No
+                // reason to drain out at many times the network's capacity,
                 // especially since we have many peers and some will draw much
                 // shorter delays.
-                unsigned int nRelayedTransactions = 0;
+                const size_t nMaxRelayedTransactions =
+                    INVENTORY_BROADCAST_MAX_PER_MB * config.GetMaxBlockSize() /
+                    1000000;
                 LOCK(pto->m_tx_relay->cs_filter);
-                while (!vInvTx.empty() &&
-                       nRelayedTransactions < INVENTORY_BROADCAST_MAX_PER_MB *
-                                                  config.GetMaxBlockSize() /
-                                                  1000000) {
-                    // Fetch the top element from the heap
-                    std::pop_heap(vInvTx.begin(), vInvTx.end(),
-                                  compareInvMempoolOrder);
-                    std::set<TxId>::iterator it = vInvTx.back();
-                    vInvTx.pop_back();
-                    const TxId txid = *it;
-                    // Remove it from the to-be-sent set
-                    pto->m_tx_relay->setInventoryTxToSend.erase(it);
-                    // Check if not in the filter already
-                    if (pto->m_tx_relay->filterInventoryKnown.contains(txid)) {
-                        continue;
-                    }
-                    // Not in the mempool anymore? don't bother sending it.
-                    auto txinfo = g_mempool.info(txid);
-                    if (!txinfo.tx) {
-                        continue;
-                    }
-                    // Peer told you to not send transactions at that feerate?
-                    // Don't bother sending it.
-                    if (txinfo.fee < filterrate.GetFee(txinfo.vsize)) {
-                        continue;
-                    }
-                    if (pto->m_tx_relay->pfilter &&
-                        !pto->m_tx_relay->pfilter->IsRelevantAndUpdate(
-                            *txinfo.tx)) {
-                        continue;
-                    }
-                    // Send
-                    vInv.push_back(CInv(MSG_TX, txid));
-                    nRelayedTransactions++;
-                    {
+                g_tx_announcements.Read(
+                    pto->GetId(), g_mempool, current_time,
+                    nMaxRelayedTransactions,
+                    [&](const TxAnnouncement &announcement) {
+                        AssertLockHeld(cs_main);
+                        AssertLockHeld(pto->m_tx_relay->cs_tx_inventory);
+                        AssertLockHeld(pto->m_tx_relay->cs_filter);
+                        const TxMempoolInfo &txinfo = announcement.info;
+                        const TxId &txid = txinfo.tx->GetId();
+                        // Check if not in the filter already
+                        if (pto->m_tx_relay->filterInventoryKnown.contains(
+                                txid)) {
+                            return false;
+                        }
+                        // Not in the mempool anymore? don't bother sending
+                        // it.
+                        if (!g_mempool.exists(txid)) {
+                            return false;
+                        }
+                        // Peer told you to not send transactions at that
+                        // feerate? Don't bother sending it.
+                        if (txinfo.fee < filterrate.GetFee(txinfo.vsize)) {
+                            return false;
+                        }
+                        if (pto->m_tx_relay->pfilter &&
+                            !pto->m_tx_relay->pfilter->IsRelevantAndUpdate(
+                                *txinfo.tx)) {
+                            return false;
+                        }
+                        // Send, unless the transaction is left for the next
+                        // reconciliation with the peer.
+                        bool relayed = false;
+                        if (!g_txreconciliation ||
+                            g_txreconciliation->ShouldFlood(pto->GetId(),
+                                                            txid) ||
+                            !g_txreconciliation->AddToSet(pto->GetId(),
+                                                          txid)) {
+                            vInv.push_back(CInv(MSG_TX, txid));
+                            relayed = true;
+                        }
                         // Expire old relay messages
                         while (!vRelayExpiration.empty() &&
                                vRelayExpiration.front().first < nNow) {
@@ -5021,7 +5238,7 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
                         }
 
                         auto ret = mapRelay.insert(
-                            std::make_pair(txid, std::move(txinfo.tx)));
+                            std::make_pair(txid, txinfo.tx));
                         if (ret.second) {
                             vRelayExpiration.push_back(
                                 std::make_pair(nNow +
@@ -5030,14 +5247,24 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
                                                        .count(),
                                                ret.first));
                         }
-                    }
-                    if (vInv.size() == MAX_INV_SZ) {
-                        connman->PushMessage(
-                            pto, msgMaker.Make(NetMsgType::INV, vInv));
-                        vInv.clear();
-                    }
-                    pto->m_tx_relay->filterInventoryKnown.insert(txid);
-                }
+                        if (vInv.size() == MAX_INV_SZ) {
+                            connman->PushMessage(
+                                pto, msgMaker.Make(NetMsgType::INV, vInv));
+                            vInv.clear();
+                        }
+                        pto->m_tx_relay->filterInventoryKnown.insert(txid);
+                        return relayed;
+                    });
+            }
+
+            // Request a reconciliation of the transactions we did not flood
+            uint16_t local_size;
+            uint16_t q;
+            if (g_txreconciliation &&
+                g_txreconciliation->InitiateReconciliation(
+                    pto->GetId(), current_time, local_size, q)) {
+                connman->PushMessage(
+                    pto, msgMaker.Make(NetMsgType::REQTXRCNCL, local_size, q));
             }
         }
     }
@@ -5133,16 +5360,18 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
     // Message: getdata (blocks)
     //
     std::vector<CInv> vGetData;
+    // The number of blocks in flight from each peer adapts to its throughput.
+    const int block_window = g_block_download.GetWindow(pto->GetId());
     if (!pto->fClient &&
         ((fFetch && !pto->m_limited_node) ||
          !::ChainstateActive().IsInitialBlockDownload()) &&
-        state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        state.nBlocksInFlight < block_window) {
         std::vector<const CBlockIndex *> vToDownload;
         NodeId staller = -1;
-        FindNextBlocksToDownload(pto->GetId(),
-                                 MAX_BLOCKS_IN_TRANSIT_PER_PEER -
-                                     state.nBlocksInFlight,
-                                 vToDownload, staller, consensusParams);
+        const CBlockIndex *pindexWaitingFor = nullptr;
+        FindNextBlocksToDownload(
+            pto->GetId(), block_window - state.nBlocksInFlight, vToDownload,
+            staller, pindexWaitingFor, consensusParams);
         for (const CBlockIndex *pindex : vToDownload) {
             vGetData.push_back(CInv(MSG_BLOCK, pindex->GetBlockHash()));
             MarkBlockAsInFlight(config, pto->GetId(), pindex->GetBlockHash(),
@@ -5151,6 +5380,21 @@ bool PeerLogicValidation::SendMessages(const Config &config, CNode *pto,
                      pindex->GetBlockHash().ToString(), pindex->nHeight,
                      pto->GetId());
         }
+        // Rather than waiting for the stall timeout, also request the block
+        // holding back validation from this peer if the peer it was requested
+        // from is taking too long. The first copy to arrive is processed.
+        if (pindexWaitingFor &&
+            g_block_download.ShouldRequestDuplicate(
+                pto->GetId(), pindexWaitingFor->GetBlockHash(),
+                current_time)) {
+            vGetData.push_back(
+                CInv(MSG_BLOCK, pindexWaitingFor->GetBlockHash()));
+            g_block_download.BlockRequested(
+                pto->GetId(), pindexWaitingFor->GetBlockHash(), current_time);
+            LogPrint(BCLog::NET, "Requesting duplicate block %s (%d) peer=%d\n",
+                     pindexWaitingFor->GetBlockHash().ToString(),
+                     pindexWaitingFor->nHeight, pto->GetId());
+        }
         if (state.nBlocksInFlight == 0 && staller != -1) {
             if (State(staller)->nStallingSince == 0) {
                 State(staller)->nStallingSince = nNow;
@@ -5279,8 +5523,8 @@ public:
     CNetProcessingCleanup() {}
     ~CNetProcessingCleanup() {
         // orphan transactions
-        mapOrphanTransactions.clear();
-        mapOrphanTransactionsByPrev.clear();
+        LOCK(g_cs_orphans);
+        g_orphanage.Clear();
     }
 };
 static CNetProcessingCleanup instance_of_cnetprocessingcleanup;
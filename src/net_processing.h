@@ -9,10 +9,10 @@
 #include <consensus/params.h>
 #include <net.h>
 #include <sync.h>
+#include <txorphanage.h>
 #include <validationinterface.h>
 
 extern RecursiveMutex cs_main;
-extern RecursiveMutex g_cs_orphans;
 
 class ChainstateManager;
 class Config;
@@ -38,6 +38,15 @@ private:
 
     bool CheckIfBanned(CNode &pnode) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
+    /**
+     * Process a message which passed the header checks, on either the message
+     * handler thread or a message worker. Returns true if there is more work
+     * to be done for the peer.
+     */
+    bool ProcessReceivedMessage(const Config &config, CNode &pfrom,
+                                CNetMessage &msg,
+                                const std::atomic<bool> &interruptMsgProc);
+
 public:
     PeerLogicValidation(CConnman *connman, BanMan *banman,
                         CScheduler &scheduler, ChainstateManager &chainman);
@@ -122,6 +131,7 @@ struct CNodeStateStats {
     int nSyncHeight = -1;
     int nCommonHeight = -1;
     std::vector<int> vHeightInFlight;
+    bool m_txreconciliation = false;
 };
 
 /** Get statistics from node state */
@@ -131,7 +141,7 @@ void Misbehaving(NodeId nodeid, int howmuch, const std::string &reason = "")
     EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
 /** Relay transaction to every node */
-void RelayTransaction(const TxId &txid, const CConnman &connman);
+void RelayTransaction(const TxId &txid);
 
 bool ProcessMessage(const Config &config, CNode &pfrom,
                     const std::string &msg_type, CDataStream &vRecv,
@@ -11,6 +11,7 @@
 #include <util/string.h>
 #include <util/system.h>
 
+#include <algorithm>
 #include <atomic>
 
 #ifndef WIN32
@@ -32,9 +33,6 @@ static proxyType nameProxy GUARDED_BY(cs_proxyInfos);
 int nConnectTimeout = DEFAULT_CONNECT_TIMEOUT;
 bool fNameLookup = DEFAULT_NAME_LOOKUP;
 
-// Need ample time for negotiation for very slow proxies such as Tor
-// (milliseconds)
-static const int SOCKS5_RECV_TIMEOUT = 20 * 1000;
 static std::atomic<bool> interruptSocks5Recv(false);
 
 enum Network ParseNetwork(const std::string &net_in) {
@@ -406,12 +404,6 @@ static IntrRecvError InterruptibleRecv(uint8_t *data, size_t len, int timeout,
     return len == 0 ? IntrRecvError::OK : IntrRecvError::Timeout;
 }
 
-/** Credentials for proxy authentication */
-struct ProxyCredentials {
-    std::string username;
-    std::string password;
-};
-
 /** Convert SOCKS5 reply to an error message */
 static std::string Socks5ErrorString(uint8_t err) {
     switch (err) {
@@ -436,171 +428,267 @@ static std::string Socks5ErrorString(uint8_t err) {
     }
 }
 
-/**
- * Connect to a specified destination service through an already connected
- * SOCKS5 proxy.
- *
- * @param strDest The destination fully-qualified domain name.
- * @param port The destination port.
- * @param auth The credentials with which to authenticate with the specified
- *             SOCKS5 proxy.
- * @param hSocket The SOCKS5 proxy socket.
- *
- * @returns Whether or not the operation succeeded.
- *
- * @note The specified SOCKS5 proxy socket must already be connected to the
- *       SOCKS5 proxy.
- *
- * @see <a href="https://www.ietf.org/rfc/rfc1928.txt">RFC1928: SOCKS Protocol
- *      Version 5</a>
- */
-static bool Socks5(const std::string &strDest, int port,
-                   const ProxyCredentials *auth, const SOCKET &hSocket) {
-    IntrRecvError recvr;
+Socks5Handshake::Socks5Handshake(const proxyType &proxy,
+                                 const std::string &strDest, int port)
+    : m_dest(strDest), m_port(port) {
     LogPrint(BCLog::NET, "SOCKS5 connecting %s\n", strDest);
     if (strDest.size() > 255) {
-        return error("Hostname too long");
+        error("Hostname too long");
+        Fail();
+        return;
     }
+    if (proxy.randomize_credentials) {
+        static std::atomic_int counter(0);
+        m_auth = true;
+        m_username = m_password = strprintf("%i", counter++);
+    }
+
     // Construct the version identifier/method selection message
-    std::vector<uint8_t> vSocks5Init;
     // We want the SOCK5 protocol
-    vSocks5Init.push_back(SOCKSVersion::SOCKS5);
-    if (auth) {
+    m_send.push_back(SOCKSVersion::SOCKS5);
+    if (m_auth) {
         // 2 method identifiers follow...
-        vSocks5Init.push_back(0x02);
-        vSocks5Init.push_back(SOCKS5Method::NOAUTH);
-        vSocks5Init.push_back(SOCKS5Method::USER_PASS);
+        m_send.push_back(0x02);
+        m_send.push_back(SOCKS5Method::NOAUTH);
+        m_send.push_back(SOCKS5Method::USER_PASS);
     } else {
         // 1 method identifier follows...
-        vSocks5Init.push_back(0x01);
-        vSocks5Init.push_back(SOCKS5Method::NOAUTH);
-    }
-    ssize_t ret = send(hSocket, (const char *)vSocks5Init.data(),
-                       vSocks5Init.size(), MSG_NOSIGNAL);
-    if (ret != (ssize_t)vSocks5Init.size()) {
-        return error("Error sending to proxy");
-    }
-    uint8_t pchRet1[2];
-    if ((recvr = InterruptibleRecv(pchRet1, 2, SOCKS5_RECV_TIMEOUT, hSocket)) !=
-        IntrRecvError::OK) {
-        LogPrintf("Socks5() connect to %s:%d failed: InterruptibleRecv() "
-                  "timeout or other failure\n",
-                  strDest, port);
-        return false;
-    }
-    if (pchRet1[0] != SOCKSVersion::SOCKS5) {
-        return error("Proxy failed to initialize");
+        m_send.push_back(0x01);
+        m_send.push_back(SOCKS5Method::NOAUTH);
     }
-    if (pchRet1[1] == SOCKS5Method::USER_PASS && auth) {
-        // Perform username/password authentication (as described in RFC1929)
-        std::vector<uint8_t> vAuth;
-        // Current (and only) version of user/pass subnegotiation
-        vAuth.push_back(0x01);
-        if (auth->username.size() > 255 || auth->password.size() > 255) {
-            return error("Proxy username or password too long");
-        }
-        vAuth.push_back(auth->username.size());
-        vAuth.insert(vAuth.end(), auth->username.begin(), auth->username.end());
-        vAuth.push_back(auth->password.size());
-        vAuth.insert(vAuth.end(), auth->password.begin(), auth->password.end());
-        ret = send(hSocket, (const char *)vAuth.data(), vAuth.size(),
-                   MSG_NOSIGNAL);
-        if (ret != (ssize_t)vAuth.size()) {
-            return error("Error sending authentication to proxy");
-        }
-        LogPrint(BCLog::PROXY, "SOCKS5 sending proxy authentication %s:%s\n",
-                 auth->username, auth->password);
-        uint8_t pchRetA[2];
-        if ((recvr = InterruptibleRecv(pchRetA, 2, SOCKS5_RECV_TIMEOUT,
-                                       hSocket)) != IntrRecvError::OK) {
-            return error("Error reading proxy authentication response");
-        }
-        if (pchRetA[0] != 0x01 || pchRetA[1] != 0x00) {
-            return error("Proxy authentication unsuccessful");
-        }
-    } else if (pchRet1[1] == SOCKS5Method::NOAUTH) {
-        // Perform no authentication
-    } else {
-        return error("Proxy requested wrong authentication method %02x",
-                     pchRet1[1]);
+}
+
+void Socks5Handshake::Fail() {
+    m_status = Status::FAILED;
+    m_stage = Stage::DONE;
+    m_send.clear();
+    m_recv.clear();
+    m_need = 0;
+}
+
+void Socks5Handshake::QueueAuth() {
+    // Perform username/password authentication (as described in RFC1929)
+    if (m_username.size() > 255 || m_password.size() > 255) {
+        error("Proxy username or password too long");
+        Fail();
+        return;
     }
-    std::vector<uint8_t> vSocks5;
+    // Current (and only) version of user/pass subnegotiation
+    m_send.push_back(0x01);
+    m_send.push_back(m_username.size());
+    m_send.insert(m_send.end(), m_username.begin(), m_username.end());
+    m_send.push_back(m_password.size());
+    m_send.insert(m_send.end(), m_password.begin(), m_password.end());
+    LogPrint(BCLog::PROXY, "SOCKS5 sending proxy authentication %s:%s\n",
+             m_username, m_password);
+    m_stage = Stage::AUTH;
+    m_need = 2;
+}
+
+void Socks5Handshake::QueueConnect() {
     // VER protocol version
-    vSocks5.push_back(SOCKSVersion::SOCKS5);
+    m_send.push_back(SOCKSVersion::SOCKS5);
     // CMD CONNECT
-    vSocks5.push_back(SOCKS5Command::CONNECT);
+    m_send.push_back(SOCKS5Command::CONNECT);
     // RSV Reserved must be 0
-    vSocks5.push_back(0x00);
+    m_send.push_back(0x00);
     // ATYP DOMAINNAME
-    vSocks5.push_back(SOCKS5Atyp::DOMAINNAME);
-    // Length<=255 is checked at beginning of function
-    vSocks5.push_back(strDest.size());
-    vSocks5.insert(vSocks5.end(), strDest.begin(), strDest.end());
-    vSocks5.push_back((port >> 8) & 0xFF);
-    vSocks5.push_back((port >> 0) & 0xFF);
-    ret = send(hSocket, (const char *)vSocks5.data(), vSocks5.size(),
-               MSG_NOSIGNAL);
-    if (ret != (ssize_t)vSocks5.size()) {
-        return error("Error sending to proxy");
-    }
-    uint8_t pchRet2[4];
-    if ((recvr = InterruptibleRecv(pchRet2, 4, SOCKS5_RECV_TIMEOUT, hSocket)) !=
-        IntrRecvError::OK) {
-        if (recvr == IntrRecvError::Timeout) {
-            /**
-             * If a timeout happens here, this effectively means we timed out
-             * while connecting to the remote node. This is very common for Tor,
-             * so do not print an error message.
-             */
-            return false;
-        } else {
-            return error("Error while reading proxy response");
-        }
-    }
-    if (pchRet2[0] != SOCKSVersion::SOCKS5) {
-        return error("Proxy failed to accept request");
-    }
-    if (pchRet2[1] != SOCKS5Reply::SUCCEEDED) {
-        // Failures to connect to a peer that are not proxy errors
-        LogPrintf("Socks5() connect to %s:%d failed: %s\n", strDest, port,
-                  Socks5ErrorString(pchRet2[1]));
-        return false;
-    }
-    // Reserved field must be 0
-    if (pchRet2[2] != 0x00) {
-        return error("Error: malformed proxy response");
-    }
-    uint8_t pchRet3[256];
-    switch (pchRet2[3]) {
-        case SOCKS5Atyp::IPV4:
-            recvr = InterruptibleRecv(pchRet3, 4, SOCKS5_RECV_TIMEOUT, hSocket);
+    m_send.push_back(SOCKS5Atyp::DOMAINNAME);
+    // Length<=255 is checked in the constructor
+    m_send.push_back(m_dest.size());
+    m_send.insert(m_send.end(), m_dest.begin(), m_dest.end());
+    m_send.push_back((m_port >> 8) & 0xFF);
+    m_send.push_back((m_port >> 0) & 0xFF);
+    m_stage = Stage::CONNECT;
+    // The reply header, up to the first byte of the bound address.
+    m_need = 5;
+}
+
+void Socks5Handshake::ProcessReply() {
+    switch (m_stage) {
+        case Stage::METHOD:
+            if (m_recv[0] != SOCKSVersion::SOCKS5) {
+                error("Proxy failed to initialize");
+                Fail();
+            } else if (m_recv[1] == SOCKS5Method::USER_PASS && m_auth) {
+                QueueAuth();
+            } else if (m_recv[1] == SOCKS5Method::NOAUTH) {
+                // Perform no authentication
+                QueueConnect();
+            } else {
+                error("Proxy requested wrong authentication method %02x",
+                      m_recv[1]);
+                Fail();
+            }
             break;
-        case SOCKS5Atyp::IPV6:
-            recvr =
-                InterruptibleRecv(pchRet3, 16, SOCKS5_RECV_TIMEOUT, hSocket);
+        case Stage::AUTH:
+            if (m_recv[0] != 0x01 || m_recv[1] != 0x00) {
+                error("Proxy authentication unsuccessful");
+                Fail();
+            } else {
+                QueueConnect();
+            }
             break;
-        case SOCKS5Atyp::DOMAINNAME: {
-            recvr = InterruptibleRecv(pchRet3, 1, SOCKS5_RECV_TIMEOUT, hSocket);
-            if (recvr != IntrRecvError::OK) {
-                return error("Error reading from proxy");
+        case Stage::CONNECT:
+            if (m_recv[0] != SOCKSVersion::SOCKS5) {
+                error("Proxy failed to accept request");
+                Fail();
+                return;
+            }
+            if (m_recv[1] != SOCKS5Reply::SUCCEEDED) {
+                // Failures to connect to a peer that are not proxy errors
+                LogPrintf("Socks5() connect to %s:%d failed: %s\n", m_dest,
+                          m_port, Socks5ErrorString(m_recv[1]));
+                Fail();
+                return;
+            }
+            // Reserved field must be 0
+            if (m_recv[2] != 0x00) {
+                error("Error: malformed proxy response");
+                Fail();
+                return;
             }
-            int nRecv = pchRet3[0];
-            recvr =
-                InterruptibleRecv(pchRet3, nRecv, SOCKS5_RECV_TIMEOUT, hSocket);
+            // The bound address is followed by a 2 bytes port.
+            switch (m_recv[3]) {
+                case SOCKS5Atyp::IPV4:
+                    m_need = 4 + 4 + 2;
+                    break;
+                case SOCKS5Atyp::IPV6:
+                    m_need = 4 + 16 + 2;
+                    break;
+                case SOCKS5Atyp::DOMAINNAME:
+                    m_need = 5 + m_recv[4] + 2;
+                    break;
+                default:
+                    error("Error: malformed proxy response");
+                    Fail();
+                    return;
+            }
+            m_stage = Stage::BOUND_ADDRESS;
+            // Do not clear the reply, its end is still to be received.
+            return;
+        case Stage::BOUND_ADDRESS:
+            LogPrint(BCLog::NET, "SOCKS5 connected %s\n", m_dest);
+            m_status = Status::SUCCEEDED;
+            m_stage = Stage::DONE;
+            m_need = 0;
+            break;
+        case Stage::DONE:
             break;
-        }
-        default:
-            return error("Error: malformed proxy response");
     }
-    if (recvr != IntrRecvError::OK) {
-        return error("Error reading from proxy");
+    m_recv.clear();
+}
+
+void Socks5Handshake::DataSent(size_t nBytes) {
+    m_send.erase(m_send.begin(), m_send.begin() + nBytes);
+}
+
+void Socks5Handshake::DataReceived(const uint8_t *data, size_t len) {
+    assert(len <= BytesNeeded());
+    m_recv.insert(m_recv.end(), data, data + len);
+    while (m_status == Status::IN_PROGRESS && BytesNeeded() == 0) {
+        ProcessReply();
     }
-    if ((recvr = InterruptibleRecv(pchRet3, 2, SOCKS5_RECV_TIMEOUT, hSocket)) !=
-        IntrRecvError::OK) {
-        return error("Error reading from proxy");
+}
+
+Socks5Handshake::Status Socks5Handshake::Advance(const SOCKET &hSocket) {
+    // Replies are never longer than this.
+    uint8_t buf[512];
+    while (m_status == Status::IN_PROGRESS) {
+        if (!m_send.empty()) {
+            ssize_t ret = send(hSocket, (const char *)m_send.data(),
+                               m_send.size(), MSG_NOSIGNAL);
+            if (ret < 0) {
+                int nErr = WSAGetLastError();
+                if (nErr == WSAEWOULDBLOCK || nErr == WSAEINPROGRESS) {
+                    break;
+                }
+                error("Error sending to proxy");
+                Fail();
+                break;
+            }
+            DataSent(ret);
+            if (!m_send.empty()) {
+                break;
+            }
+        }
+
+        ssize_t ret = recv(hSocket, (char *)buf,
+                           std::min(BytesNeeded(), sizeof(buf)), 0);
+        if (ret > 0) {
+            DataReceived(buf, ret);
+            continue;
+        }
+        if (ret < 0) {
+            int nErr = WSAGetLastError();
+            if (nErr == WSAEWOULDBLOCK || nErr == WSAEINPROGRESS ||
+                nErr == WSAEINVAL) {
+                break;
+            }
+        }
+        if (IsConnecting()) {
+            // This is very common for Tor when the destination is not
+            // reachable, so do not print an error message.
+            LogPrint(BCLog::NET, "SOCKS5 connection to %s:%d closed\n",
+                     m_dest, m_port);
+        } else {
+            error("Error reading from proxy");
+        }
+        Fail();
     }
-    LogPrint(BCLog::NET, "SOCKS5 connected %s\n", strDest);
-    return true;
+    return m_status;
+}
+
+/**
+ * Connect to a specified destination service through an already connected
+ * SOCKS5 proxy, waiting for the replies of the proxy.
+ *
+ * @param strDest The destination fully-qualified domain name.
+ * @param port The destination port.
+ * @param proxy The SOCKS5 proxy, whose settings tell which credentials to
+ *              authenticate with.
+ * @param hSocket The SOCKS5 proxy socket.
+ *
+ * @returns Whether or not the operation succeeded.
+ *
+ * @note The specified SOCKS5 proxy socket must already be connected to the
+ *       SOCKS5 proxy.
+ */
+static bool Socks5(const std::string &strDest, int port,
+                   const proxyType &proxy, const SOCKET &hSocket) {
+    Socks5Handshake handshake(proxy, strDest, port);
+    std::vector<uint8_t> buf;
+    while (handshake.GetStatus() == Socks5Handshake::Status::IN_PROGRESS) {
+        const std::vector<uint8_t> &send_buf = handshake.GetSendBuffer();
+        if (!send_buf.empty()) {
+            ssize_t ret = send(hSocket, (const char *)send_buf.data(),
+                               send_buf.size(), MSG_NOSIGNAL);
+            if (ret != (ssize_t)send_buf.size()) {
+                return error("Error sending to proxy");
+            }
+            handshake.DataSent(ret);
+        }
+
+        buf.resize(handshake.BytesNeeded());
+        IntrRecvError recvr = InterruptibleRecv(buf.data(), buf.size(),
+                                                SOCKS5_RECV_TIMEOUT, hSocket);
+        if (recvr != IntrRecvError::OK) {
+            if (recvr == IntrRecvError::Timeout && handshake.IsConnecting()) {
+                /**
+                 * If a timeout happens here, this effectively means we timed
+                 * out while connecting to the remote node. This is very common
+                 * for Tor, so do not print an error message.
+                 */
+                return false;
+            }
+            LogPrintf("Socks5() connect to %s:%d failed: InterruptibleRecv() "
+                      "timeout or other failure\n",
+                      strDest, port);
+            return false;
+        }
+        handshake.DataReceived(buf.data(), buf.size());
+    }
+    return handshake.GetStatus() == Socks5Handshake::Status::SUCCEEDED;
 }
 
 /**
@@ -668,20 +756,8 @@ static void LogConnectFailure(bool manual_connection, const char *fmt,
     }
 }
 
-/**
- * Try to connect to the specified service on the specified socket.
- *
- * @param addrConnect The service to which to connect.
- * @param hSocket The socket on which to connect.
- * @param nTimeout Wait this many milliseconds for the connection to be
- *                 established.
- * @param manual_connection Whether or not the connection was manually requested
- *                          (e.g. through the addnode RPC)
- *
- * @returns Whether or not a connection was successfully made.
- */
-bool ConnectSocketDirectly(const CService &addrConnect, const SOCKET &hSocket,
-                           int nTimeout, bool manual_connection) {
+bool StartConnectSocket(const CService &addrConnect, const SOCKET &hSocket,
+                        bool manual_connection) {
     // Create a sockaddr from the specified service.
     struct sockaddr_storage sockaddr;
     socklen_t len = sizeof(sockaddr);
@@ -703,72 +779,92 @@ bool ConnectSocketDirectly(const CService &addrConnect, const SOCKET &hSocket,
         if (nErr == WSAEINPROGRESS || nErr == WSAEWOULDBLOCK ||
             nErr == WSAEINVAL) {
             // Connection didn't actually fail, but is being established
-            // asynchronously. Thus, use async I/O api (select/poll)
-            // synchronously to check for successful connection with a timeout.
-#ifdef USE_POLL
-            struct pollfd pollfd = {};
-            pollfd.fd = hSocket;
-            pollfd.events = POLLIN | POLLOUT;
-            int nRet = poll(&pollfd, 1, nTimeout);
-#else
-            struct timeval timeout = MillisToTimeval(nTimeout);
-            fd_set fdset;
-            FD_ZERO(&fdset);
-            FD_SET(hSocket, &fdset);
-            int nRet = select(hSocket + 1, nullptr, &fdset, nullptr, &timeout);
-#endif
-            // Upon successful completion, both select and poll return the total
-            // number of file descriptors that have been selected. A value of 0
-            // indicates that the call timed out and no file descriptors have
-            // been selected.
-            if (nRet == 0) {
-                LogPrint(BCLog::NET, "connection to %s timeout\n",
-                         addrConnect.ToString());
-                return false;
-            }
-            if (nRet == SOCKET_ERROR) {
-                LogPrintf("select() for %s failed: %s\n",
-                          addrConnect.ToString(),
-                          NetworkErrorString(WSAGetLastError()));
-                return false;
-            }
-
-            // Even if the select/poll was successful, the connect might not
-            // have been successful. The reason for this failure is hidden away
-            // in the SO_ERROR for the socket in modern systems. We read it into
-            // nRet here.
-            socklen_t nRetSize = sizeof(nRet);
-            if (getsockopt(hSocket, SOL_SOCKET, SO_ERROR,
-                           (sockopt_arg_type)&nRet,
-                           &nRetSize) == SOCKET_ERROR) {
-                LogPrintf("getsockopt() for %s failed: %s\n",
-                          addrConnect.ToString(),
-                          NetworkErrorString(WSAGetLastError()));
-                return false;
-            }
-            if (nRet != 0) {
-                LogConnectFailure(manual_connection,
-                                  "connect() to %s failed after select(): %s",
-                                  addrConnect.ToString(),
-                                  NetworkErrorString(nRet));
-                return false;
-            }
+            // asynchronously.
+            return true;
         }
 #ifdef WIN32
-        else if (WSAGetLastError() != WSAEISCONN)
-#else
-        else
-#endif
-        {
-            LogConnectFailure(manual_connection, "connect() to %s failed: %s",
-                              addrConnect.ToString(),
-                              NetworkErrorString(WSAGetLastError()));
-            return false;
+        if (nErr == WSAEISCONN) {
+            return true;
         }
+#endif
+        LogConnectFailure(manual_connection, "connect() to %s failed: %s",
+                          addrConnect.ToString(), NetworkErrorString(nErr));
+        return false;
     }
     return true;
 }
 
+bool FinishConnectSocket(const CService &addrConnect, const SOCKET &hSocket,
+                         bool manual_connection) {
+    // Even if the socket is writable, the connect might not have been
+    // successful. The reason for this failure is hidden away in the SO_ERROR
+    // for the socket in modern systems. We read it into nRet here.
+    int nRet = 0;
+    socklen_t nRetSize = sizeof(nRet);
+    if (getsockopt(hSocket, SOL_SOCKET, SO_ERROR, (sockopt_arg_type)&nRet,
+                   &nRetSize) == SOCKET_ERROR) {
+        LogPrintf("getsockopt() for %s failed: %s\n", addrConnect.ToString(),
+                  NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+    if (nRet != 0) {
+        LogConnectFailure(manual_connection,
+                          "connect() to %s failed after select(): %s",
+                          addrConnect.ToString(), NetworkErrorString(nRet));
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Try to connect to the specified service on the specified socket.
+ *
+ * @param addrConnect The service to which to connect.
+ * @param hSocket The socket on which to connect.
+ * @param nTimeout Wait this many milliseconds for the connection to be
+ *                 established.
+ * @param manual_connection Whether or not the connection was manually requested
+ *                          (e.g. through the addnode RPC)
+ *
+ * @returns Whether or not a connection was successfully made.
+ */
+bool ConnectSocketDirectly(const CService &addrConnect, const SOCKET &hSocket,
+                           int nTimeout, bool manual_connection) {
+    if (!StartConnectSocket(addrConnect, hSocket, manual_connection)) {
+        return false;
+    }
+
+    // Use async I/O api (select/poll) synchronously to check for successful
+    // connection with a timeout.
+#ifdef USE_POLL
+    struct pollfd pollfd = {};
+    pollfd.fd = hSocket;
+    pollfd.events = POLLIN | POLLOUT;
+    int nRet = poll(&pollfd, 1, nTimeout);
+#else
+    struct timeval timeout = MillisToTimeval(nTimeout);
+    fd_set fdset;
+    FD_ZERO(&fdset);
+    FD_SET(hSocket, &fdset);
+    int nRet = select(hSocket + 1, nullptr, &fdset, nullptr, &timeout);
+#endif
+    // Upon successful completion, both select and poll return the total
+    // number of file descriptors that have been selected. A value of 0
+    // indicates that the call timed out and no file descriptors have been
+    // selected.
+    if (nRet == 0) {
+        LogPrint(BCLog::NET, "connection to %s timeout\n",
+                 addrConnect.ToString());
+        return false;
+    }
+    if (nRet == SOCKET_ERROR) {
+        LogPrintf("select() for %s failed: %s\n", addrConnect.ToString(),
+                  NetworkErrorString(WSAGetLastError()));
+        return false;
+    }
+    return FinishConnectSocket(addrConnect, hSocket, manual_connection);
+}
+
 bool SetProxy(enum Network net, const proxyType &addrProxy) {
     assert(net >= 0 && net < NET_MAX);
     if (!addrProxy.IsValid()) {
@@ -862,18 +958,7 @@ bool ConnectThroughProxy(const proxyType &proxy, const std::string &strDest,
         return false;
     }
     // do socks negotiation
-    if (proxy.randomize_credentials) {
-        ProxyCredentials random_auth;
-        static std::atomic_int counter(0);
-        random_auth.username = random_auth.password =
-            strprintf("%i", counter++);
-        if (!Socks5(strDest, (unsigned short)port, &random_auth, hSocket)) {
-            return false;
-        }
-    } else if (!Socks5(strDest, (unsigned short)port, 0, hSocket)) {
-        return false;
-    }
-    return true;
+    return Socks5(strDest, (unsigned short)port, proxy, hSocket);
 }
 
 /**
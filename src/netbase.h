@@ -24,6 +24,9 @@ extern bool fNameLookup;
 static const int DEFAULT_CONNECT_TIMEOUT = 5000;
 //! -dns default
 static const int DEFAULT_NAME_LOOKUP = true;
+//! Time to wait for each reply of a SOCKS5 proxy, in milliseconds. This needs
+//! to be ample for very slow proxies such as Tor.
+static const int SOCKS5_RECV_TIMEOUT = 20 * 1000;
 
 class proxyType {
 public:
@@ -59,9 +62,77 @@ SOCKET CreateSocket(const CService &addrConnect);
 bool ConnectSocketDirectly(const CService &addrConnect,
                            const SOCKET &hSocketRet, int nTimeout,
                            bool manual_connection);
+/**
+ * Start connecting a non-blocking socket to the specified service, without
+ * waiting for the connection to be established. The socket becomes writable
+ * once the attempt completes, then FinishConnectSocket() tells whether it
+ * succeeded. Returns false if the attempt failed right away.
+ */
+bool StartConnectSocket(const CService &addrConnect, const SOCKET &hSocket,
+                        bool manual_connection);
+/** Check the outcome of a connection attempt started by StartConnectSocket */
+bool FinishConnectSocket(const CService &addrConnect, const SOCKET &hSocket,
+                         bool manual_connection);
 bool ConnectThroughProxy(const proxyType &proxy, const std::string &strDest,
                          int port, const SOCKET &hSocketRet, int nTimeout,
                          bool &outProxyConnectionFailed);
+
+/**
+ * The client side of a SOCKS5 handshake, asking the proxy to connect to a
+ * destination (see RFC1928). It does no blocking I/O, so that many handshakes
+ * can be driven by an event loop with Advance(). Callers may instead send
+ * GetSendBuffer() and feed the replies of the proxy to DataReceived()
+ * themselves, reading at most BytesNeeded() bytes so that no data past the
+ * handshake is consumed.
+ */
+class Socks5Handshake {
+public:
+    enum class Status { IN_PROGRESS, SUCCEEDED, FAILED };
+
+    Socks5Handshake(const proxyType &proxy, const std::string &strDest,
+                    int port);
+
+    Status GetStatus() const { return m_status; }
+    //! Whether the proxy is connecting to the destination, in which case a
+    //! timeout is a failure to reach the destination rather than the proxy.
+    bool IsConnecting() const { return m_stage == Stage::CONNECT; }
+
+    const std::vector<uint8_t> &GetSendBuffer() const { return m_send; }
+    void DataSent(size_t nBytes);
+    size_t BytesNeeded() const { return m_need - m_recv.size(); }
+    void DataReceived(const uint8_t *data, size_t len);
+
+    /**
+     * Send and receive on a non-blocking socket connected to the proxy, until
+     * it would block or the handshake is over.
+     */
+    Status Advance(const SOCKET &hSocket);
+    //! Whether Advance() is waiting for the socket to be writable rather than
+    //! readable.
+    bool WantsSend() const { return !m_send.empty(); }
+
+private:
+    enum class Stage { METHOD, AUTH, CONNECT, BOUND_ADDRESS, DONE };
+
+    void Fail();
+    void QueueAuth();
+    void QueueConnect();
+    void ProcessReply();
+
+    const std::string m_dest;
+    const int m_port;
+    bool m_auth{false};
+    std::string m_username;
+    std::string m_password;
+
+    Status m_status{Status::IN_PROGRESS};
+    Stage m_stage{Stage::METHOD};
+    std::vector<uint8_t> m_send;
+    std::vector<uint8_t> m_recv;
+    //! The size of the reply being received.
+    size_t m_need{2};
+};
+
 /** Return readable error string for a network error code */
 std::string NetworkErrorString(int err);
 /** Close socket and set hSocket to INVALID_SOCKET */
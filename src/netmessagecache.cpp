@@ -0,0 +1,65 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <netmessagecache.h>
+
+NetMessageCache::Buffer NetMessageCache::Get(const std::string &msg_type,
+                                             const uint256 &hash,
+                                             int version) {
+    LOCK(m_mutex);
+    const auto it = m_index.find(Key(msg_type, hash, version));
+    if (it == m_index.end()) {
+        return nullptr;
+    }
+
+    // Mark the message as the most recently used.
+    m_lru.splice(m_lru.end(), m_lru, it->second);
+    return it->second->second;
+}
+
+void NetMessageCache::Add(const std::string &msg_type, const uint256 &hash,
+                          int version, Buffer buffer) {
+    if (!buffer || buffer->size() > m_max_size) {
+        return;
+    }
+
+    LOCK(m_mutex);
+    Key key(msg_type, hash, version);
+    const auto it = m_index.find(key);
+    if (it != m_index.end()) {
+        Erase(it);
+    }
+
+    m_size += buffer->size();
+    m_lru.emplace_back(key, std::move(buffer));
+    m_index.emplace(std::move(key), std::prev(m_lru.end()));
+
+    while (m_size > m_max_size) {
+        Erase(m_index.find(m_lru.front().first));
+    }
+}
+
+void NetMessageCache::Erase(std::map<Key, LruList::iterator>::iterator it) {
+    AssertLockHeld(m_mutex);
+    m_size -= it->second->second->size();
+    m_lru.erase(it->second);
+    m_index.erase(it);
+}
+
+size_t NetMessageCache::Count() const {
+    LOCK(m_mutex);
+    return m_index.size();
+}
+
+size_t NetMessageCache::Size() const {
+    LOCK(m_mutex);
+    return m_size;
+}
+
+void NetMessageCache::Clear() {
+    LOCK(m_mutex);
+    m_lru.clear();
+    m_index.clear();
+    m_size = 0;
+}
@@ -0,0 +1,80 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NETMESSAGECACHE_H
+#define BITCOIN_NETMESSAGECACHE_H
+
+#include <sync.h>
+#include <uint256.h>
+
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <tuple>
+#include <vector>
+
+/**
+ * Default size of the serialized message cache, in bytes. This is enough to
+ * hold a maximum-size block along with the transactions being relayed.
+ */
+static const size_t DEFAULT_NET_MESSAGE_CACHE_SIZE = 64 * 1024 * 1024;
+
+/**
+ * A cache of messages serialized for the wire, header included, for objects
+ * sent to many peers such as blocks and relayed transactions.
+ *
+ * Messages are keyed by their type, the hash of the object they carry and the
+ * serialization version, so that an object is serialized and checksummed
+ * only once no matter how many peers it is sent to. The buffers are immutable
+ * and reference counted: they can be queued for sending to any number of
+ * peers, and stay alive as long as a send queue holds them even once evicted
+ * from the cache.
+ *
+ * The least recently used messages are evicted when the total size of the
+ * cached messages exceeds the maximum size.
+ */
+class NetMessageCache {
+public:
+    using Buffer = std::shared_ptr<const std::vector<uint8_t>>;
+
+    explicit NetMessageCache(size_t max_size = DEFAULT_NET_MESSAGE_CACHE_SIZE)
+        : m_max_size(max_size) {}
+
+    /** Return the cached message, or nullptr if there is none */
+    Buffer Get(const std::string &msg_type, const uint256 &hash, int version);
+
+    /**
+     * Add a message to the cache, replacing any message with the same key.
+     * Messages larger than the maximum size of the cache are not cached.
+     */
+    void Add(const std::string &msg_type, const uint256 &hash, int version,
+             Buffer buffer);
+
+    /** Return the number of cached messages */
+    size_t Count() const;
+    /** Return the total size of the cached messages, in bytes */
+    size_t Size() const;
+
+    void Clear();
+
+private:
+    using Key = std::tuple<std::string, uint256, int>;
+    using LruList = std::list<std::pair<Key, Buffer>>;
+
+    const size_t m_max_size;
+
+    mutable Mutex m_mutex;
+    //! Least recently used message first.
+    LruList m_lru GUARDED_BY(m_mutex);
+    std::map<Key, LruList::iterator> m_index GUARDED_BY(m_mutex);
+    size_t m_size GUARDED_BY(m_mutex){0};
+
+    void Erase(std::map<Key, LruList::iterator>::iterator it)
+        EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+};
+
+#endif // BITCOIN_NETMESSAGECACHE_H
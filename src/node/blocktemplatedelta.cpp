@@ -0,0 +1,135 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/blocktemplatedelta.h>
+
+#include <hash.h>
+#include <miner.h>
+#include <txmempool.h>
+
+#include <algorithm>
+#include <unordered_map>
+
+static std::vector<TxId> GetTemplateTxIds(const CBlockTemplate &tmpl) {
+    const auto &vtx = tmpl.block.vtx;
+    std::vector<TxId> txids;
+    txids.reserve(vtx.empty() ? 0 : vtx.size() - 1);
+    for (size_t i = 1; i < vtx.size(); i++) {
+        txids.push_back(vtx[i]->GetId());
+    }
+    return txids;
+}
+
+uint256 ComputeTemplateId(const CBlockTemplate &tmpl) {
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << tmpl.block.hashPrevBlock;
+    for (size_t i = 1; i < tmpl.block.vtx.size(); i++) {
+        ss << tmpl.block.vtx[i]->GetId();
+    }
+    return ss.GetHash();
+}
+
+Amount GetTemplateFees(const CBlockTemplate &tmpl) {
+    // The coinbase entry carries the negated sum of all fees.
+    if (tmpl.entries.empty()) {
+        return Amount::zero();
+    }
+    return -1 * tmpl.entries[0].fees;
+}
+
+bool ComputeTemplateDelta(const std::vector<TxId> &prev,
+                          const std::vector<TxId> &next,
+                          std::vector<uint32_t> &removed,
+                          std::vector<uint32_t> &added) {
+    removed.clear();
+    added.clear();
+
+    std::unordered_map<TxId, uint32_t, SaltedTxIdHasher> prevIndex;
+    prevIndex.reserve(prev.size());
+    for (uint32_t i = 0; i < prev.size(); i++) {
+        prevIndex.emplace(prev[i], i);
+    }
+
+    std::vector<bool> kept(prev.size(), false);
+    int64_t lastKept = -1;
+    for (uint32_t i = 0; i < next.size(); i++) {
+        auto it = prevIndex.find(next[i]);
+        if (it == prevIndex.end()) {
+            added.push_back(i);
+            continue;
+        }
+
+        if (int64_t(it->second) <= lastKept) {
+            // The relative order changed.
+            return false;
+        }
+
+        lastKept = it->second;
+        kept[it->second] = true;
+    }
+
+    for (uint32_t i = 0; i < prev.size(); i++) {
+        if (!kept[i]) {
+            removed.push_back(i);
+        }
+    }
+
+    return true;
+}
+
+BlockTemplateDelta
+BlockTemplateDeltaTracker::Update(const std::string &clientId,
+                                  const std::optional<uint256> &knownTemplateId,
+                                  const CBlockTemplate &tmpl) {
+    BlockTemplateDelta delta;
+    delta.templateId = ComputeTemplateId(tmpl);
+    std::vector<TxId> txids = GetTemplateTxIds(tmpl);
+
+    LOCK(cs);
+    auto it = clients.find(clientId);
+    if (it != clients.end() && knownTemplateId &&
+        *knownTemplateId == it->second.templateId) {
+        delta.isDelta = ComputeTemplateDelta(it->second.txids, txids,
+                                             delta.removed, delta.added);
+    }
+
+    if (it == clients.end()) {
+        if (clients.size() >= maxClients && maxClients > 0) {
+            auto oldest = std::min_element(
+                clients.begin(), clients.end(), [](const auto &a, const auto &b) {
+                    return a.second.lastUsed < b.second.lastUsed;
+                });
+            clients.erase(oldest);
+        }
+        it = clients.emplace(clientId, ClientState()).first;
+    }
+
+    ClientState &state = it->second;
+    state.templateId = delta.templateId;
+    state.txids = std::move(txids);
+    state.fees = GetTemplateFees(tmpl);
+    state.lastUsed = nextSequence++;
+
+    if (!delta.isDelta) {
+        delta.removed.clear();
+        delta.added.clear();
+    }
+
+    return delta;
+}
+
+std::optional<Amount>
+BlockTemplateDeltaTracker::GetLastFees(const std::string &clientId) const {
+    LOCK(cs);
+    auto it = clients.find(clientId);
+    if (it == clients.end()) {
+        return std::nullopt;
+    }
+    return it->second.fees;
+}
+
+size_t BlockTemplateDeltaTracker::GetClientCount() const {
+    LOCK(cs);
+    return clients.size();
+}
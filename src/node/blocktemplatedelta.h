@@ -0,0 +1,99 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_NODE_BLOCKTEMPLATEDELTA_H
+#define BITCOIN_NODE_BLOCKTEMPLATEDELTA_H
+
+#include <amount.h>
+#include <primitives/txid.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <string>
+#include <vector>
+
+struct CBlockTemplate;
+
+/** Default number of getblocktemplate clients for which we keep state. */
+static constexpr size_t DEFAULT_MAX_TEMPLATE_DELTA_CLIENTS = 64;
+
+/**
+ * Difference between the last template sent to a client and a new template.
+ * Indices refer to the position of a transaction in the non-coinbase
+ * transaction list of the template, i.e. index i is block.vtx[i + 1].
+ */
+struct BlockTemplateDelta {
+    //! Identifier of the new template, to be echoed back by the client.
+    uint256 templateId;
+    //! If false, the client must be sent the complete transaction list.
+    bool isDelta{false};
+    //! Indices in the previous template of the transactions to drop.
+    std::vector<uint32_t> removed;
+    //! Indices in the new template of the transactions the client lacks.
+    std::vector<uint32_t> added;
+};
+
+/**
+ * Compute the template id for a template: a hash committing to the previous
+ * block and the ordered list of transactions.
+ */
+uint256 ComputeTemplateId(const CBlockTemplate &tmpl);
+
+/** Total fees collected by the non-coinbase transactions of a template. */
+Amount GetTemplateFees(const CBlockTemplate &tmpl);
+
+/**
+ * Compute the delta between two ordered transaction lists. Returns false if
+ * the transactions present in both lists do not appear in the same relative
+ * order, in which case the delta cannot be applied by insertion/removal.
+ */
+bool ComputeTemplateDelta(const std::vector<TxId> &prev,
+                          const std::vector<TxId> &next,
+                          std::vector<uint32_t> &removed,
+                          std::vector<uint32_t> &added);
+
+/**
+ * Remembers the last block template sent to each getblocktemplate client so
+ * that subsequent requests can be answered with only the transactions that
+ * changed. The number of tracked clients is bounded; the least recently
+ * served client is forgotten first.
+ */
+class BlockTemplateDeltaTracker {
+private:
+    struct ClientState {
+        uint256 templateId;
+        std::vector<TxId> txids;
+        Amount fees;
+        uint64_t lastUsed;
+    };
+
+    mutable Mutex cs;
+    const size_t maxClients;
+    uint64_t nextSequence GUARDED_BY(cs){0};
+    std::map<std::string, ClientState> clients GUARDED_BY(cs);
+
+public:
+    explicit BlockTemplateDeltaTracker(
+        size_t maxClientsIn = DEFAULT_MAX_TEMPLATE_DELTA_CLIENTS)
+        : maxClients(maxClientsIn) {}
+
+    /**
+     * Record that tmpl is about to be sent to clientId and compute what the
+     * client needs. A delta is only returned if knownTemplateId matches the
+     * template we last sent to that client.
+     */
+    BlockTemplateDelta Update(const std::string &clientId,
+                              const std::optional<uint256> &knownTemplateId,
+                              const CBlockTemplate &tmpl);
+
+    /** Fees of the template last sent to this client, if any. */
+    std::optional<Amount> GetLastFees(const std::string &clientId) const;
+
+    size_t GetClientCount() const;
+};
+
+#endif // BITCOIN_NODE_BLOCKTEMPLATEDELTA_H
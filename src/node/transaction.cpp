@@ -88,7 +88,7 @@ TransactionError BroadcastTransaction(NodeContext &node, const Config &config,
     }
 
     if (relay) {
-        RelayTransaction(txid, *node.connman);
+        RelayTransaction(txid);
     }
 
     return TransactionError::OK;
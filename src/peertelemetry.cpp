@@ -0,0 +1,66 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <peertelemetry.h>
+
+#include <algorithm>
+
+void PeerTelemetry::RecordProcessing(const std::string &msg_type,
+                                     int64_t usec) {
+    LOCK(m_mutex);
+    MsgTypeTelemetry &telemetry = m_current.msg_types[msg_type];
+    telemetry.processed++;
+    telemetry.processing_time_usec += usec;
+}
+
+void PeerTelemetry::RecordBlockServed(int64_t usec) {
+    LOCK(m_mutex);
+    m_current.blocks_served++;
+    m_current.block_serving_time_usec += usec;
+}
+
+void PeerTelemetry::Sample(
+    int64_t time, uint64_t bytes_recv, uint64_t bytes_sent,
+    const std::map<std::string, uint64_t> &bytes_recv_per_msg_type,
+    const std::map<std::string, uint64_t> &bytes_sent_per_msg_type,
+    size_t send_queue_size, size_t process_queue_size) {
+    LOCK(m_mutex);
+
+    m_current.time = time;
+    m_current.bytes_recv = bytes_recv - m_last_bytes_recv;
+    m_current.bytes_sent = bytes_sent - m_last_bytes_sent;
+    m_current.send_queue_size = send_queue_size;
+    m_current.process_queue_size = process_queue_size;
+    m_last_bytes_recv = bytes_recv;
+    m_last_bytes_sent = bytes_sent;
+
+    for (const auto &entry : bytes_recv_per_msg_type) {
+        uint64_t &last = m_last_bytes_recv_per_msg_type[entry.first];
+        if (entry.second != last) {
+            m_current.msg_types[entry.first].bytes_recv = entry.second - last;
+            last = entry.second;
+        }
+    }
+    for (const auto &entry : bytes_sent_per_msg_type) {
+        uint64_t &last = m_last_bytes_sent_per_msg_type[entry.first];
+        if (entry.second != last) {
+            m_current.msg_types[entry.first].bytes_sent = entry.second - last;
+            last = entry.second;
+        }
+    }
+
+    if (m_samples.size() == PEER_TELEMETRY_SAMPLES) {
+        m_samples.pop_front();
+    }
+    m_samples.push_back(std::move(m_current));
+    m_current = PeerTelemetrySample();
+}
+
+std::vector<PeerTelemetrySample>
+PeerTelemetry::GetSamples(size_t count) const {
+    LOCK(m_mutex);
+    count = std::min(count, m_samples.size());
+    return std::vector<PeerTelemetrySample>(m_samples.end() - count,
+                                            m_samples.end());
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PEERTELEMETRY_H
+#define BITCOIN_PEERTELEMETRY_H
+
+#include <sync.h>
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <string>
+#include <vector>
+
+/** Interval between two samples of the peer telemetry */
+static constexpr std::chrono::seconds PEER_TELEMETRY_INTERVAL{1};
+/** Number of samples kept for each peer */
+static constexpr size_t PEER_TELEMETRY_SAMPLES = 120;
+
+/** Activity of a peer for a message type during a sampling interval */
+struct MsgTypeTelemetry {
+    uint64_t bytes_recv{0};
+    uint64_t bytes_sent{0};
+    //! Number of messages processed, and time spent processing them.
+    uint64_t processed{0};
+    int64_t processing_time_usec{0};
+};
+
+/** Activity of a peer during a sampling interval */
+struct PeerTelemetrySample {
+    //! End of the interval, as a UNIX time in seconds.
+    int64_t time{0};
+    uint64_t bytes_recv{0};
+    uint64_t bytes_sent{0};
+    //! Bytes waiting to be sent and to be processed at the end of the
+    //! interval.
+    size_t send_queue_size{0};
+    size_t process_queue_size{0};
+    //! Number of blocks served, and time spent serving them.
+    uint64_t blocks_served{0};
+    int64_t block_serving_time_usec{0};
+    //! The message types with some activity during the interval.
+    std::map<std::string, MsgTypeTelemetry> msg_types;
+};
+
+/**
+ * A time series of the activity of a peer, kept in a ring buffer of the last
+ * PEER_TELEMETRY_SAMPLES samples.
+ *
+ * Message processing and block serving are recorded as they happen, while
+ * the traffic and queue sizes are derived from the cumulative counters of
+ * the peer when a sample is taken.
+ */
+class PeerTelemetry {
+public:
+    void RecordProcessing(const std::string &msg_type, int64_t usec);
+    void RecordBlockServed(int64_t usec);
+
+    /**
+     * Close the current interval at the given time. The byte counts are the
+     * cumulative totals of the peer, in total and per message type.
+     */
+    void Sample(int64_t time, uint64_t bytes_recv, uint64_t bytes_sent,
+                const std::map<std::string, uint64_t> &bytes_recv_per_msg_type,
+                const std::map<std::string, uint64_t> &bytes_sent_per_msg_type,
+                size_t send_queue_size, size_t process_queue_size);
+
+    /** Return up to count samples, oldest first */
+    std::vector<PeerTelemetrySample> GetSamples(size_t count) const;
+
+private:
+    mutable Mutex m_mutex;
+    PeerTelemetrySample m_current GUARDED_BY(m_mutex);
+    std::deque<PeerTelemetrySample> m_samples GUARDED_BY(m_mutex);
+
+    //! The cumulative counters as of the previous sample.
+    uint64_t m_last_bytes_recv GUARDED_BY(m_mutex){0};
+    uint64_t m_last_bytes_sent GUARDED_BY(m_mutex){0};
+    std::map<std::string, uint64_t>
+        m_last_bytes_recv_per_msg_type GUARDED_BY(m_mutex);
+    std::map<std::string, uint64_t>
+        m_last_bytes_sent_per_msg_type GUARDED_BY(m_mutex);
+};
+
+#endif // BITCOIN_PEERTELEMETRY_H
@@ -0,0 +1,315 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <pinsketch.h>
+
+#include <crypto/common.h>
+#include <random.h>
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+
+/**
+ * Arithmetic in GF(2^32), represented as polynomials over GF(2) modulo the
+ * irreducible x^32 + x^7 + x^3 + x^2 + 1.
+ */
+uint32_t Reduce(uint64_t x) {
+    // x^32 = x^7 + x^3 + x^2 + 1, folded twice as the first fold may
+    // overflow by up to 7 bits.
+    for (int i = 0; i < 2; i++) {
+        const uint64_t high = x >> 32;
+        x = (x & 0xffffffff) ^ high ^ (high << 2) ^ (high << 3) ^ (high << 7);
+    }
+    return uint32_t(x);
+}
+
+/**
+ * Multiplication by a fixed element, using a table of its products by all
+ * the 4-bit polynomials. This is worth it when multiplying by the same
+ * element several times, e.g. in polynomial reductions.
+ */
+class Multiplier {
+public:
+    explicit Multiplier(uint32_t a) {
+        m_table[0] = 0;
+        for (int i = 1; i < 16; i++) {
+            m_table[i] = (i & 1) ? m_table[i - 1] ^ a : m_table[i / 2] << 1;
+        }
+    }
+
+    uint32_t operator()(uint32_t b) const {
+        uint64_t result = 0;
+        for (int i = 28; i >= 0; i -= 4) {
+            result = (result << 4) ^ m_table[(b >> i) & 15];
+        }
+        return Reduce(result);
+    }
+
+private:
+    uint64_t m_table[16];
+};
+
+uint32_t Mul(uint32_t a, uint32_t b) {
+    return Multiplier(a)(b);
+}
+
+uint32_t Sqr(uint32_t a) {
+    return Mul(a, a);
+}
+
+uint32_t Inv(uint32_t a) {
+    assert(a != 0);
+    // a^(2^32 - 2) = a^-1
+    uint32_t result = 1;
+    for (int i = 31; i >= 0; i--) {
+        result = Sqr(result);
+        if ((0xfffffffeU >> i) & 1) {
+            result = Mul(result, a);
+        }
+    }
+    return result;
+}
+
+/**
+ * Polynomials over GF(2^32), with the coefficients of the lowest degree
+ * terms first and no leading zero coefficient.
+ */
+using Poly = std::vector<uint32_t>;
+
+void Trim(Poly &p) {
+    while (!p.empty() && p.back() == 0) {
+        p.pop_back();
+    }
+}
+
+void MakeMonic(Poly &p) {
+    assert(!p.empty());
+    const Multiplier mul(Inv(p.back()));
+    for (uint32_t &c : p) {
+        c = mul(c);
+    }
+}
+
+/** Divide a by the monic m, leaving the remainder in a */
+void DivMod(Poly &a, const Poly &m, Poly *quotient = nullptr) {
+    assert(!m.empty() && m.back() == 1);
+    const size_t d = m.size() - 1;
+    if (quotient) {
+        quotient->assign(a.size() > d ? a.size() - d : 0, 0);
+    }
+    for (size_t i = a.size(); i-- > d;) {
+        const uint32_t c = a[i];
+        if (c == 0) {
+            continue;
+        }
+        if (quotient) {
+            (*quotient)[i - d] = c;
+        }
+        const Multiplier mul(c);
+        for (size_t j = 0; j <= d; j++) {
+            a[i - d + j] ^= mul(m[j]);
+        }
+    }
+    a.resize(std::min(a.size(), d));
+    Trim(a);
+}
+
+/** Return a^2 mod m */
+Poly SqrMod(const Poly &a, const Poly &m) {
+    if (a.empty()) {
+        return a;
+    }
+    Poly result(2 * a.size() - 1, 0);
+    // Squaring is linear in characteristic 2.
+    for (size_t i = 0; i < a.size(); i++) {
+        result[2 * i] = Sqr(a[i]);
+    }
+    DivMod(result, m);
+    return result;
+}
+
+/** Return the monic greatest common divisor of a and b */
+Poly Gcd(Poly a, Poly b) {
+    Trim(a);
+    Trim(b);
+    while (!b.empty()) {
+        MakeMonic(b);
+        DivMod(a, b);
+        std::swap(a, b);
+    }
+    if (!a.empty()) {
+        MakeMonic(a);
+    }
+    return a;
+}
+
+/**
+ * Find the roots of a monic polynomial known to have distinct roots in
+ * GF(2^32), by splitting it with the gcd of the trace of random multiples of
+ * x (Berlekamp trace algorithm).
+ */
+bool FindRoots(const Poly &f, std::vector<uint32_t> &roots,
+               FastRandomContext &rng) {
+    const size_t degree = f.size() - 1;
+    if (degree == 0) {
+        return true;
+    }
+    if (degree == 1) {
+        roots.push_back(f[0]);
+        return true;
+    }
+
+    for (int attempt = 0; attempt < 64; attempt++) {
+        // Compute Tr(beta * x) mod f. Tr(beta * r) is either 0 or 1 for each
+        // root r, so the gcd with f holds about half of the roots.
+        Poly term{0, rng.rand32() | 1};
+        Poly trace = term;
+        for (int i = 1; i < 32; i++) {
+            term = SqrMod(term, f);
+            trace.resize(std::max(trace.size(), term.size()), 0);
+            for (size_t j = 0; j < term.size(); j++) {
+                trace[j] ^= term[j];
+            }
+        }
+
+        Poly factor = Gcd(f, trace);
+        if (factor.size() < 2 || factor.size() > degree) {
+            continue;
+        }
+        Poly remainder = f;
+        Poly other;
+        DivMod(remainder, factor, &other);
+        assert(remainder.empty());
+        return FindRoots(factor, roots, rng) && FindRoots(other, roots, rng);
+    }
+    return false;
+}
+
+} // namespace
+
+void PinSketch::Add(uint32_t element) {
+    assert(element != 0);
+    const Multiplier mul_square(Sqr(element));
+    uint32_t power = element;
+    for (uint32_t &syndrome : m_syndromes) {
+        syndrome ^= power;
+        power = mul_square(power);
+    }
+}
+
+void PinSketch::Merge(const PinSketch &other) {
+    assert(other.GetCapacity() == GetCapacity());
+    for (size_t i = 0; i < m_syndromes.size(); i++) {
+        m_syndromes[i] ^= other.m_syndromes[i];
+    }
+}
+
+bool PinSketch::Decode(std::vector<uint32_t> &elements) const {
+    elements.clear();
+    const size_t capacity = GetCapacity();
+
+    // Recover the even power sums: s(2k) = s(k)^2 in characteristic 2.
+    std::vector<uint32_t> sums(2 * capacity + 1, 0);
+    for (size_t i = 1; i <= 2 * capacity; i++) {
+        sums[i] = (i & 1) ? m_syndromes[i / 2] : Sqr(sums[i / 2]);
+    }
+
+    // Berlekamp-Massey: find the shortest linear recurrence generating the
+    // power sums, whose connection polynomial is the product of (1 + e x)
+    // over the elements e.
+    Poly conn{1};
+    Poly prev{1};
+    size_t length = 0;
+    size_t shift = 1;
+    uint32_t prev_discrepancy = 1;
+    for (size_t n = 0; n < 2 * capacity; n++) {
+        conn.resize(std::max(conn.size(), length + 1), 0);
+        uint32_t discrepancy = sums[n + 1];
+        for (size_t i = 1; i <= length; i++) {
+            discrepancy ^= Mul(conn[i], sums[n + 1 - i]);
+        }
+        if (discrepancy == 0) {
+            shift++;
+            continue;
+        }
+
+        const Multiplier mul_coef(Mul(discrepancy, Inv(prev_discrepancy)));
+        const Poly old = conn;
+        conn.resize(std::max(conn.size(), prev.size() + shift), 0);
+        for (size_t i = 0; i < prev.size(); i++) {
+            conn[i + shift] ^= mul_coef(prev[i]);
+        }
+        if (2 * length <= n) {
+            length = n + 1 - length;
+            prev = old;
+            prev_discrepancy = discrepancy;
+            shift = 1;
+        } else {
+            shift++;
+        }
+    }
+
+    if (length == 0) {
+        return true;
+    }
+    conn.resize(std::max(conn.size(), length + 1), 0);
+    Trim(conn);
+    // A degree below the length would mean that 0 is an element.
+    if (length > capacity || conn.size() != length + 1) {
+        return false;
+    }
+
+    // The elements are the roots of the reversed connection polynomial,
+    // which is monic as the constant term of the recurrence is 1.
+    Poly locator(conn.rbegin(), conn.rend());
+
+    // It must split into distinct roots, i.e. divide x^(2^32) - x.
+    Poly x{0, 1};
+    DivMod(x, locator);
+    Poly power = x;
+    for (int i = 0; i < 32; i++) {
+        power = SqrMod(power, locator);
+    }
+    if (power != x) {
+        return false;
+    }
+
+    FastRandomContext rng(true);
+    if (!FindRoots(locator, elements, rng) || elements.size() != length) {
+        elements.clear();
+        return false;
+    }
+
+    // Make sure that this is not a decoding error due to an overflow.
+    PinSketch check(capacity);
+    for (uint32_t element : elements) {
+        check.Add(element);
+    }
+    if (check.m_syndromes != m_syndromes) {
+        elements.clear();
+        return false;
+    }
+    return true;
+}
+
+std::vector<uint8_t> PinSketch::Serialize() const {
+    std::vector<uint8_t> data(4 * m_syndromes.size());
+    for (size_t i = 0; i < m_syndromes.size(); i++) {
+        WriteLE32(&data[4 * i], m_syndromes[i]);
+    }
+    return data;
+}
+
+bool PinSketch::Deserialize(Span<const uint8_t> data, PinSketch &sketch) {
+    if (data.size() % 4 != 0) {
+        return false;
+    }
+    sketch.m_syndromes.resize(data.size() / 4);
+    for (size_t i = 0; i < sketch.m_syndromes.size(); i++) {
+        sketch.m_syndromes[i] = ReadLE32(data.data() + 4 * i);
+    }
+    return true;
+}
@@ -0,0 +1,54 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_PINSKETCH_H
+#define BITCOIN_PINSKETCH_H
+
+#include <span.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+/**
+ * A set sketch over non-zero 32-bit elements, in the spirit of minisketch.
+ *
+ * A sketch of capacity c holds the c odd power sums of its elements in
+ * GF(2^32) (the PinSketch construction of the BCH syndromes), which takes 4
+ * bytes per unit of capacity. Adding an element twice removes it, so merging
+ * the sketches of two sets yields the sketch of their symmetric difference,
+ * which can be decoded as long as it has no more than c elements. This makes
+ * it possible to reconcile two sets by sending one sketch whose size depends
+ * on the size of their difference only.
+ */
+class PinSketch {
+public:
+    explicit PinSketch(size_t capacity) : m_syndromes(capacity, 0) {}
+
+    size_t GetCapacity() const { return m_syndromes.size(); }
+
+    /** Add an element, which must not be 0, or remove it if present */
+    void Add(uint32_t element);
+    /** Merge a sketch of the same capacity, see above */
+    void Merge(const PinSketch &other);
+
+    /**
+     * Decode the elements of the sketch. Returns false if there are more
+     * elements than the capacity c of the sketch, which is detected unless
+     * they happen to have the same sketch as c elements or less. This happens
+     * with a probability of about 1 / c!, so small capacities are unreliable.
+     */
+    bool Decode(std::vector<uint32_t> &elements) const;
+
+    /** Serialize as 4 little endian bytes per unit of capacity */
+    std::vector<uint8_t> Serialize() const;
+    /** Returns false if the size of data is not a multiple of 4 */
+    static bool Deserialize(Span<const uint8_t> data, PinSketch &sketch);
+
+private:
+    //! The sums of the 1st, 3rd, 5th... powers of the elements.
+    std::vector<uint32_t> m_syndromes;
+};
+
+#endif // BITCOIN_PINSKETCH_H
@@ -7,6 +7,11 @@
 #include <policy/fees.h>
 
 #include <feerate.h>
+#include <txmempool.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
 
 FeeFilterRounder::FeeFilterRounder(const CFeeRate &minIncrementalFee) {
     Amount minFeeLimit = std::max(SATOSHI, minIncrementalFee.GetFeePerK() / 2);
@@ -27,3 +32,149 @@ Amount FeeFilterRounder::round(const Amount currentMinFee) {
 
     return *it;
 }
+
+/** Decay of the history of confirmed transactions, applied every block */
+static constexpr double HISTORY_DECAY = 0.998;
+/** Share of transactions that must have confirmed for a fee rate to pass */
+static constexpr double SUCCESS_THRESHOLD = 0.85;
+/** Number of transactions needed to judge a group of buckets */
+static constexpr double SUFFICIENT_TXS = 2;
+
+FeeRateHistogram::FeeRateHistogram() {
+    // The first bucket holds the fee rates below MIN_FEERATE.
+    bucketFeeRates.push_back(Amount::zero());
+    for (double bucketBoundary = MIN_FEERATE / SATOSHI;
+         bucketBoundary <= double(MAX_FEERATE / SATOSHI);
+         bucketBoundary *= FEE_SPACING) {
+        bucketFeeRates.push_back(int64_t(bucketBoundary) * SATOSHI);
+    }
+
+    mempoolBuckets.resize(bucketFeeRates.size());
+    historyBuckets.resize(bucketFeeRates.size());
+}
+
+size_t FeeRateHistogram::GetBucketIndex(const CFeeRate &feeRate) const {
+    const Amount feePerK = feeRate.GetFeePerK();
+    if (feePerK < bucketFeeRates[1]) {
+        return 0;
+    }
+
+    size_t i = 1 + size_t(std::log(double(feePerK / SATOSHI) /
+                                   double(MIN_FEERATE / SATOSHI)) /
+                          std::log(FEE_SPACING));
+    i = std::min(i, GetBucketCount() - 1);
+    // Correct for the rounding of the bucket boundaries.
+    while (feePerK < bucketFeeRates[i]) {
+        i--;
+    }
+    while (i + 1 < GetBucketCount() && feePerK >= bucketFeeRates[i + 1]) {
+        i++;
+    }
+    return i;
+}
+
+void FeeRateHistogram::AddTx(const CTxMemPoolEntry &entry) {
+    MempoolBucket &bucket = mempoolBuckets[GetBucketIndex(
+        CFeeRate(entry.GetFee(), entry.GetTxSize()))];
+    bucket.count++;
+    bucket.size += entry.GetTxSize();
+    mempoolTotalSize += entry.GetTxSize();
+}
+
+void FeeRateHistogram::RemoveTx(const CTxMemPoolEntry &entry, bool failed) {
+    const size_t i =
+        GetBucketIndex(CFeeRate(entry.GetFee(), entry.GetTxSize()));
+    MempoolBucket &bucket = mempoolBuckets[i];
+    assert(bucket.count > 0 && bucket.size >= entry.GetTxSize());
+    bucket.count--;
+    bucket.size -= entry.GetTxSize();
+    mempoolTotalSize -= entry.GetTxSize();
+
+    if (failed) {
+        historyBuckets[i].failed++;
+    }
+}
+
+void FeeRateHistogram::ProcessBlock(
+    unsigned int nBlockHeight,
+    const std::vector<const CTxMemPoolEntry *> &entries) {
+    // Blocks connected again after a reorg have already been accounted for.
+    if (nBlockHeight <= nBestSeenHeight) {
+        return;
+    }
+    nBestSeenHeight = nBlockHeight;
+
+    for (HistoryBucket &bucket : historyBuckets) {
+        for (double &confirmed : bucket.confirmed) {
+            confirmed *= HISTORY_DECAY;
+        }
+        bucket.confirmedLate *= HISTORY_DECAY;
+        bucket.failed *= HISTORY_DECAY;
+    }
+
+    for (const CTxMemPoolEntry *entry : entries) {
+        HistoryBucket &bucket = historyBuckets[GetBucketIndex(
+            CFeeRate(entry->GetFee(), entry->GetTxSize()))];
+        const unsigned int nBlocksWaited =
+            nBlockHeight > entry->GetHeight()
+                ? nBlockHeight - entry->GetHeight()
+                : 1;
+        if (nBlocksWaited <= MAX_CONFIRMATION_TARGET) {
+            bucket.confirmed[nBlocksWaited - 1]++;
+        } else {
+            bucket.confirmedLate++;
+        }
+    }
+}
+
+void FeeRateHistogram::ClearMempool() {
+    std::fill(mempoolBuckets.begin(), mempoolBuckets.end(), MempoolBucket());
+    mempoolTotalSize = 0;
+}
+
+std::optional<size_t>
+FeeRateHistogram::GetBucketAtDepth(uint64_t depth) const {
+    uint64_t size = 0;
+    for (size_t i = GetBucketCount(); i-- > 0;) {
+        size += mempoolBuckets[i].size;
+        if (size > depth) {
+            return i;
+        }
+    }
+    return std::nullopt;
+}
+
+std::optional<CFeeRate>
+FeeRateHistogram::EstimateFee(unsigned int nBlocks) const {
+    nBlocks = std::clamp(nBlocks, 1u, MAX_CONFIRMATION_TARGET);
+
+    // Walk down from the highest fee rates, grouping buckets until there is
+    // enough data to judge them, and stop at the first group for which too
+    // few transactions confirmed in time.
+    std::optional<CFeeRate> estimate;
+    double confirmedInTime = 0;
+    double total = 0;
+    for (size_t i = GetBucketCount(); i-- > 0;) {
+        const HistoryBucket &bucket = historyBuckets[i];
+        for (unsigned int j = 0; j < MAX_CONFIRMATION_TARGET; ++j) {
+            if (j < nBlocks) {
+                confirmedInTime += bucket.confirmed[j];
+            }
+            total += bucket.confirmed[j];
+        }
+        total += bucket.confirmedLate + bucket.failed;
+
+        if (total < SUFFICIENT_TXS) {
+            continue;
+        }
+        if (confirmedInTime / total < SUCCESS_THRESHOLD) {
+            break;
+        }
+
+        estimate = GetBucketFeeRate(i);
+        confirmedInTime = 0;
+        total = 0;
+    }
+
+    return estimate;
+}
@@ -6,14 +6,17 @@
 #define BITCOIN_POLICY_FEES_H
 
 #include <amount.h>
+#include <feerate.h>
 #include <random.h>
 #include <uint256.h>
 
+#include <array>
 #include <map>
+#include <optional>
 #include <string>
 #include <vector>
 
-class CFeeRate;
+class CTxMemPoolEntry;
 
 // Minimum and Maximum values for tracking feerates
 static constexpr Amount MIN_FEERATE(10 * SATOSHI);
@@ -38,4 +41,92 @@ private:
     FastRandomContext insecure_rand;
 };
 
+/** Largest confirmation target for which fee rates are estimated */
+static constexpr unsigned int MAX_CONFIRMATION_TARGET = 25;
+
+/**
+ * Histogram of the fee rates of the transactions in the mempool and of the
+ * recently confirmed ones, used to estimate fees without scanning the mempool.
+ *
+ * Transactions are lumped into FEE_SPACING log-spaced buckets between
+ * MIN_FEERATE and MAX_FEERATE, by the fee rate they pay on their own
+ * (ignoring prioritisation). Each transaction entering or leaving the mempool
+ * updates its bucket in O(1).
+ *
+ * For each bucket, the history tracks how many blocks the confirmed
+ * transactions waited, and how many left the mempool unconfirmed. These
+ * counts decay with every block so recent blocks weigh more.
+ */
+class FeeRateHistogram {
+public:
+    FeeRateHistogram();
+
+    /** Number of fee rate buckets */
+    size_t GetBucketCount() const { return bucketFeeRates.size(); }
+    /** Index of the bucket a fee rate falls into */
+    size_t GetBucketIndex(const CFeeRate &feeRate) const;
+    /** Lowest fee rate in a bucket */
+    CFeeRate GetBucketFeeRate(size_t bucket) const {
+        return CFeeRate(bucketFeeRates[bucket]);
+    }
+
+    /** A transaction entered the mempool */
+    void AddTx(const CTxMemPoolEntry &entry);
+    /**
+     * A transaction left the mempool. If it was neither confirmed nor
+     * replaced, it counts as a transaction that failed to confirm.
+     */
+    void RemoveTx(const CTxMemPoolEntry &entry, bool failed);
+    /** Record the confirmation of entries, which are about to be removed */
+    void ProcessBlock(unsigned int nBlockHeight,
+                      const std::vector<const CTxMemPoolEntry *> &entries);
+    /** The mempool was cleared, keep the history */
+    void ClearMempool();
+
+    /** Number of transactions in the mempool for a bucket */
+    uint64_t GetMempoolCount(size_t bucket) const {
+        return mempoolBuckets[bucket].count;
+    }
+    /** Total size of the transactions in the mempool for a bucket */
+    uint64_t GetMempoolSize(size_t bucket) const {
+        return mempoolBuckets[bucket].size;
+    }
+    /** Total size of the transactions in the mempool */
+    uint64_t GetMempoolTotalSize() const { return mempoolTotalSize; }
+
+    /**
+     * Bucket containing the transactions found depth bytes deep into the
+     * mempool, counting from the highest fee rates, or nullopt if the mempool
+     * is not that large.
+     */
+    std::optional<size_t> GetBucketAtDepth(uint64_t depth) const;
+
+    /**
+     * Lowest fee rate at which most of the recently seen transactions were
+     * confirmed within nBlocks blocks, or nullopt if there is not enough data.
+     */
+    std::optional<CFeeRate> EstimateFee(unsigned int nBlocks) const;
+
+private:
+    struct MempoolBucket {
+        uint64_t count = 0;
+        uint64_t size = 0;
+    };
+
+    struct HistoryBucket {
+        //! Transactions confirmed after waiting for i + 1 blocks.
+        std::array<double, MAX_CONFIRMATION_TARGET> confirmed{};
+        //! Transactions confirmed after waiting for more blocks.
+        double confirmedLate = 0;
+        //! Transactions that left the mempool unconfirmed.
+        double failed = 0;
+    };
+
+    std::vector<Amount> bucketFeeRates;
+    std::vector<MempoolBucket> mempoolBuckets;
+    std::vector<HistoryBucket> historyBuckets;
+    uint64_t mempoolTotalSize = 0;
+    unsigned int nBestSeenHeight = 0;
+};
+
 #endif // BITCOIN_POLICY_FEES_H
@@ -49,13 +49,20 @@ const char *GETCFHEADERS = "getcfheaders";
 const char *CFHEADERS = "cfheaders";
 const char *GETCFCHECKPT = "getcfcheckpt";
 const char *CFCHECKPT = "cfcheckpt";
+const char *SENDTXRCNCL = "sendtxrcncl";
+const char *REQTXRCNCL = "reqtxrcncl";
+const char *SKETCH = "sketch";
+const char *RECONCILDIFF = "reconcildiff";
+const char *GETGRBLK = "getgrblk";
+const char *GRBLK = "grblk";
 const char *AVAPOLL = "avapoll";
 const char *AVARESPONSE = "avaresponse";
 
 bool IsBlockLike(const std::string &strCommand) {
     return strCommand == NetMsgType::BLOCK ||
            strCommand == NetMsgType::CMPCTBLOCK ||
-           strCommand == NetMsgType::BLOCKTXN;
+           strCommand == NetMsgType::BLOCKTXN ||
+           strCommand == NetMsgType::GRBLK;
 }
 }; // namespace NetMsgType
 
@@ -74,7 +81,9 @@ static const std::string allNetMessageTypes[] = {
     NetMsgType::SENDCMPCT,    NetMsgType::CMPCTBLOCK,  NetMsgType::GETBLOCKTXN,
     NetMsgType::BLOCKTXN,     NetMsgType::GETCFILTERS, NetMsgType::CFILTER,
     NetMsgType::GETCFHEADERS, NetMsgType::CFHEADERS,   NetMsgType::GETCFCHECKPT,
-    NetMsgType::CFCHECKPT,
+    NetMsgType::CFCHECKPT,    NetMsgType::SENDTXRCNCL, NetMsgType::REQTXRCNCL,
+    NetMsgType::SKETCH,       NetMsgType::RECONCILDIFF, NetMsgType::GETGRBLK,
+    NetMsgType::GRBLK,
 };
 static const std::vector<std::string>
     allNetMessageTypesVec(allNetMessageTypes,
@@ -278,6 +287,10 @@ static std::string serviceFlagToStr(const size_t bit) {
             return "NETWORK_LIMITED";
         case NODE_AVALANCHE:
             return "AVALANCHE";
+        case NODE_TXRECONCILIATION:
+            return "TXRECONCILIATION";
+        case NODE_GRAPHENE:
+            return "GRAPHENE";
         default:
             std::ostringstream stream;
             stream.imbue(std::locale::classic());
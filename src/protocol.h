@@ -288,6 +288,39 @@ extern const char *GETCFCHECKPT;
  * evenly spaced filter headers for blocks on the requested chain.
  */
 extern const char *CFCHECKPT;
+/**
+ * Indicates that a node is willing to reconcile transactions rather than
+ * flood them, along with the reconciliation protocol version and a salt for
+ * the short transaction ids. Sent before verack, to peers which advertise
+ * NODE_TXRECONCILIATION.
+ */
+extern const char *SENDTXRCNCL;
+/**
+ * Requests a transaction reconciliation, along with the number of
+ * transactions the sender would announce and the coefficient used to
+ * estimate the size of the difference.
+ */
+extern const char *REQTXRCNCL;
+/**
+ * Contains a sketch of the short ids of the transactions the sender would
+ * announce, in reply to a reqtxrcncl message.
+ */
+extern const char *SKETCH;
+/**
+ * Concludes a transaction reconciliation, with whether the difference could
+ * be decoded and the short ids of the transactions the sender is missing.
+ */
+extern const char *RECONCILDIFF;
+/**
+ * Requests a block as a grblk message, along with the number of transactions
+ * in the mempool of the sender. Only available with service bit
+ * NODE_GRAPHENE.
+ */
+extern const char *GETGRBLK;
+/**
+ * Contains a CGrapheneBlock, in reply to a getgrblk message.
+ */
+extern const char *GRBLK;
 /**
  * Contains an avalanche::Poll.
  * Peer should respond with "avaresponse" message.
@@ -356,6 +389,15 @@ enum ServiceFlags : uint64_t {
     // NODE_AVALANCHE means the node supports Bitcoin Cash's avalanche
     // preconsensus mechanism.
     NODE_AVALANCHE = (1 << 24),
+
+    // NODE_TXRECONCILIATION means the node is able to relay transactions by
+    // reconciling sets of short transaction ids with its peers, rather than
+    // announcing each transaction to each peer.
+    NODE_TXRECONCILIATION = (1 << 25),
+
+    // NODE_GRAPHENE means the node is able to send blocks encoded as a Bloom
+    // filter and an invertible Bloom lookup table of their transactions.
+    NODE_GRAPHENE = (1 << 26),
 };
 
 /**
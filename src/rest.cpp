@@ -14,13 +14,16 @@
 #include <primitives/block.h>
 #include <primitives/transaction.h>
 #include <rpc/blockchain.h>
+#include <rpc/mining.h>
 #include <rpc/protocol.h>
 #include <rpc/server.h>
 #include <streams.h>
 #include <sync.h>
 #include <txmempool.h>
+#include <util/moneystr.h>
 #include <util/ref.h>
 #include <util/strencodings.h>
+#include <util/string.h>
 #include <validation.h>
 #include <version.h>
 
@@ -94,7 +97,10 @@ static CTxMemPool *GetMemPool(const util::Ref &context, HTTPRequest *req) {
 }
 
 static RetFormat ParseDataFormat(std::string &param,
-                                 const std::string &strReq) {
+                                 const std::string &strReqWithQuery) {
+    // The query string is read with HTTPRequest::GetQueryParameter().
+    const std::string strReq =
+        strReqWithQuery.substr(0, strReqWithQuery.find('?'));
     const std::string::size_type pos = strReq.rfind('.');
     if (pos == std::string::npos) {
         param = strReq;
@@ -392,9 +398,68 @@ static bool rest_mempool_contents(Config &config, const util::Ref &context,
 
     switch (rf) {
         case RetFormat::JSON: {
-            UniValue mempoolObject = MempoolToJSON(*mempool, true);
+            MempoolFilter filter;
+            bool paginated = false;
+            if (auto cursor = req->GetQueryParameter("cursor")) {
+                filter.cursor = MempoolCursor::FromString(*cursor);
+                if (!filter.cursor) {
+                    return RESTERR(req, HTTP_BAD_REQUEST,
+                                   "Invalid cursor: " + *cursor);
+                }
+                paginated = true;
+            }
+            if (auto count = req->GetQueryParameter("count")) {
+                int64_t nCount;
+                if (!ParseInt64(*count, &nCount) || nCount <= 0) {
+                    return RESTERR(req, HTTP_BAD_REQUEST,
+                                   "Invalid count: " + *count);
+                }
+                filter.count = nCount;
+                paginated = true;
+            }
+            if (auto minFeeRate = req->GetQueryParameter("minfeerate")) {
+                Amount nFeeRate;
+                if (!ParseMoney(*minFeeRate, nFeeRate)) {
+                    return RESTERR(req, HTTP_BAD_REQUEST,
+                                   "Invalid minfeerate: " + *minFeeRate);
+                }
+                filter.minFeeRate = CFeeRate(nFeeRate);
+                paginated = true;
+            }
+            if (auto minTime = req->GetQueryParameter("mintime")) {
+                int64_t nTime;
+                if (!ParseInt64(*minTime, &nTime)) {
+                    return RESTERR(req, HTTP_BAD_REQUEST,
+                                   "Invalid mintime: " + *minTime);
+                }
+                filter.minTime = std::chrono::seconds{nTime};
+                paginated = true;
+            }
+            if (auto maxTime = req->GetQueryParameter("maxtime")) {
+                int64_t nTime;
+                if (!ParseInt64(*maxTime, &nTime)) {
+                    return RESTERR(req, HTTP_BAD_REQUEST,
+                                   "Invalid maxtime: " + *maxTime);
+                }
+                filter.maxTime = std::chrono::seconds{nTime};
+                paginated = true;
+            }
 
-            std::string strJSON = mempoolObject.write() + "\n";
+            // Write the entries one at a time rather than building a
+            // UniValue for the whole mempool.
+            std::string strJSON;
+            std::optional<MempoolCursor> next;
+            if (paginated) {
+                strJSON += "{\"transactions\":";
+            }
+            WriteMempoolJSON(*mempool, true, filter, strJSON, next);
+            if (paginated) {
+                if (next) {
+                    strJSON += ",\"nextcursor\":\"" + next->ToString() + "\"";
+                }
+                strJSON += "}";
+            }
+            strJSON += "\n";
             req->WriteHeader("Content-Type", "application/json");
             req->WriteReply(HTTP_OK, strJSON);
             return true;
@@ -698,6 +763,102 @@ static bool rest_getutxos(Config &config, const util::Ref &context,
     }
 }
 
+static bool rest_blocktemplate(Config &config, const util::Ref &context,
+                               HTTPRequest *req,
+                               const std::string &strURIPart) {
+    if (!CheckWarmup(req)) {
+        return false;
+    }
+
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf != RetFormat::BINARY && rf != RetFormat::HEX) {
+        return RESTERR(req, HTTP_NOT_FOUND,
+                       "output format not found (available: bin, hex)");
+    }
+
+    CDataStream ssTemplate(SER_NETWORK, PROTOCOL_VERSION);
+    try {
+        ssTemplate << GetBinaryBlockTemplate(config, context);
+    } catch (const UniValue &objError) {
+        return RESTERR(req, HTTP_SERVICE_UNAVAILABLE,
+                       find_value(objError, "message").get_str());
+    }
+
+    if (rf == RetFormat::BINARY) {
+        req->WriteHeader("Content-Type", "application/octet-stream");
+        req->WriteReply(HTTP_OK, ssTemplate.str());
+        return true;
+    }
+
+    std::string strHex = HexStr(ssTemplate.begin(), ssTemplate.end()) + "\n";
+    req->WriteHeader("Content-Type", "text/plain");
+    req->WriteReply(HTTP_OK, strHex);
+    return true;
+}
+
+static bool rest_submitblock(Config &config, const util::Ref &context,
+                             HTTPRequest *req, const std::string &strURIPart) {
+    if (!CheckWarmup(req)) {
+        return false;
+    }
+
+    if (req->GetRequestMethod() != HTTPRequest::POST) {
+        return RESTERR(req, HTTP_BAD_METHOD,
+                       "submitblock only accepts POST requests");
+    }
+
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+
+    std::vector<uint8_t> blockData;
+    switch (rf) {
+        case RetFormat::BINARY: {
+            const std::string body = req->ReadBody();
+            blockData.assign(body.begin(), body.end());
+            break;
+        }
+
+        case RetFormat::HEX: {
+            const std::string strHex = TrimString(req->ReadBody());
+            if (!IsHex(strHex)) {
+                return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hex data");
+            }
+            blockData = ParseHex(strHex);
+            break;
+        }
+
+        default: {
+            return RESTERR(req, HTTP_NOT_FOUND,
+                           "input format not found (available: bin, hex)");
+        }
+    }
+
+    std::shared_ptr<CBlock> blockptr = std::make_shared<CBlock>();
+    try {
+        CDataStream ssBlock(blockData, SER_NETWORK, PROTOCOL_VERSION);
+        ssBlock >> *blockptr;
+        if (!ssBlock.empty()) {
+            return RESTERR(req, HTTP_BAD_REQUEST, "Block decode failed");
+        }
+    } catch (const std::exception &) {
+        return RESTERR(req, HTTP_BAD_REQUEST, "Block decode failed");
+    }
+
+    UniValue result;
+    try {
+        result = SubmitBlock(config, context, blockptr);
+    } catch (const UniValue &objError) {
+        return RESTERR(req, HTTP_BAD_REQUEST,
+                       find_value(objError, "message").get_str());
+    }
+
+    // Mirror the BIP22 result: an empty body means the block was accepted.
+    req->WriteHeader("Content-Type", "text/plain");
+    req->WriteReply(HTTP_OK, result.isNull() ? "" : result.get_str() + "\n");
+    return true;
+}
+
 static bool rest_blockhash_by_height(Config &config, const util::Ref &context,
                                      HTTPRequest *req,
                                      const std::string &str_uri_part) {
@@ -764,6 +925,8 @@ static const struct {
     {"/rest/headers/", rest_headers},
     {"/rest/getutxos", rest_getutxos},
     {"/rest/blockhashbyheight/", rest_blockhash_by_height},
+    {"/rest/blocktemplate", rest_blocktemplate},
+    {"/rest/submitblock", rest_submitblock},
 };
 
 void StartREST(const util::Ref &context) {
@@ -21,6 +21,7 @@
 #include <node/coinstats.h>
 #include <node/context.h>
 #include <node/utxo_snapshot.h>
+#include <policy/fees.h>
 #include <policy/policy.h>
 #include <primitives/transaction.h>
 #include <rpc/server.h>
@@ -35,6 +36,7 @@
 #include <util/system.h>
 #include <validation.h>
 #include <validationinterface.h>
+#include <validationstats.h>
 #include <versionbitsinfo.h> // For VersionBitsDeploymentInfo
 #include <warnings.h>
 
@@ -576,18 +578,8 @@ static void entryToJSON(const CTxMemPool &pool, UniValue &info,
 
 UniValue MempoolToJSON(const CTxMemPool &pool, bool verbose) {
     if (verbose) {
-        LOCK(pool.cs);
-        UniValue o(UniValue::VOBJ);
-        for (const CTxMemPoolEntry &e : pool.mapTx) {
-            const uint256 &txid = e.GetTx().GetId();
-            UniValue info(UniValue::VOBJ);
-            entryToJSON(pool, info, e);
-            // Mempool has unique entries so there is no advantage in using
-            // UniValue::pushKV, which checks if the key already exists in O(N).
-            // UniValue::__pushKV is used instead which currently is O(1).
-            o.__pushKV(txid.ToString(), info);
-        }
-        return o;
+        std::optional<MempoolCursor> next;
+        return MempoolToJSON(pool, verbose, MempoolFilter(), next);
     } else {
         std::vector<uint256> vtxids;
         pool.queryHashes(vtxids);
@@ -601,6 +593,188 @@ UniValue MempoolToJSON(const CTxMemPool &pool, bool verbose) {
     }
 }
 
+std::string MempoolCursor::ToString() const {
+    return strprintf("%d-%s", count_seconds(time), txid.ToString());
+}
+
+std::optional<MempoolCursor>
+MempoolCursor::FromString(const std::string &str) {
+    const size_t pos = str.find('-');
+    if (pos == std::string::npos) {
+        return std::nullopt;
+    }
+
+    int64_t nTime;
+    const std::string txidStr = str.substr(pos + 1);
+    if (!ParseInt64(str.substr(0, pos), &nTime) || txidStr.size() != 64 ||
+        !IsHex(txidStr)) {
+        return std::nullopt;
+    }
+
+    MempoolCursor cursor;
+    cursor.time = std::chrono::seconds{nTime};
+    cursor.txid = TxId(uint256S(txidStr));
+    return cursor;
+}
+
+namespace {
+/** Compare mempool entries to a cursor, in the entry_time index order. */
+struct CompareEntryToCursor {
+    bool operator()(const CTxMemPoolEntry &e, const MempoolCursor &c) const {
+        if (e.GetTime() != c.time) {
+            return e.GetTime() < c.time;
+        }
+        return e.GetTx().GetId() < c.txid;
+    }
+    bool operator()(const MempoolCursor &c, const CTxMemPoolEntry &e) const {
+        if (c.time != e.GetTime()) {
+            return c.time < e.GetTime();
+        }
+        return c.txid < e.GetTx().GetId();
+    }
+};
+} // namespace
+
+/**
+ * Number of mempool entries that are looked at between two acquisitions of
+ * pool.cs when listing the mempool.
+ */
+static constexpr size_t MEMPOOL_LISTING_CHUNK_SIZE = 1000;
+
+/**
+ * Call fn for each mempool entry matching filter, in entry time order.
+ * Return the cursor to resume from if the listing stopped after filter.count
+ * entries.
+ */
+static std::optional<MempoolCursor>
+ForEachMempoolEntry(const CTxMemPool &pool, const MempoolFilter &filter,
+                    const std::function<void(const CTxMemPoolEntry &)> &fn) {
+    // Position of the last entry looked at, which may have been filtered out.
+    std::optional<MempoolCursor> last = filter.cursor;
+    if (last && last->time < filter.minTime) {
+        last.reset();
+    }
+
+    size_t listed = 0;
+    while (true) {
+        LOCK(pool.cs);
+        const auto &index = pool.mapTx.get<entry_time>();
+        // The null txid sorts before any other txid with the same time.
+        auto it = last ? index.upper_bound(*last, CompareEntryToCursor())
+                       : index.lower_bound(
+                             MempoolCursor{filter.minTime, TxId()},
+                             CompareEntryToCursor());
+        for (size_t n = 0; n < MEMPOOL_LISTING_CHUNK_SIZE; ++it, ++n) {
+            if (it == index.end() || it->GetTime() > filter.maxTime) {
+                return std::nullopt;
+            }
+
+            if (listed >= filter.count) {
+                return last;
+            }
+
+            last = MempoolCursor{it->GetTime(), it->GetTx().GetId()};
+            if (CFeeRate(it->GetModifiedFee(), it->GetTxSize()) <
+                filter.minFeeRate) {
+                continue;
+            }
+
+            fn(*it);
+            listed++;
+        }
+    }
+}
+
+UniValue MempoolToJSON(const CTxMemPool &pool, bool verbose,
+                       const MempoolFilter &filter,
+                       std::optional<MempoolCursor> &next) {
+    UniValue o(verbose ? UniValue::VOBJ : UniValue::VARR);
+    next = ForEachMempoolEntry(
+        pool, filter,
+        [&](const CTxMemPoolEntry &e) EXCLUSIVE_LOCKS_REQUIRED(pool.cs) {
+            const std::string txid = e.GetTx().GetId().ToString();
+            if (!verbose) {
+                o.push_back(txid);
+                return;
+            }
+
+            UniValue info(UniValue::VOBJ);
+            entryToJSON(pool, info, e);
+            // Mempool has unique entries so there is no advantage in using
+            // UniValue::pushKV, which checks if the key already exists in O(N).
+            // UniValue::__pushKV is used instead which currently is O(1).
+            o.__pushKV(txid, info);
+        });
+    return o;
+}
+
+void WriteMempoolJSON(const CTxMemPool &pool, bool verbose,
+                      const MempoolFilter &filter, std::string &out,
+                      std::optional<MempoolCursor> &next) {
+    bool first = true;
+    out += verbose ? "{" : "[";
+    next = ForEachMempoolEntry(
+        pool, filter,
+        [&](const CTxMemPoolEntry &e) EXCLUSIVE_LOCKS_REQUIRED(pool.cs) {
+            if (!first) {
+                out += ",";
+            }
+            first = false;
+
+            out += "\"" + e.GetTx().GetId().ToString() + "\"";
+            if (verbose) {
+                UniValue info(UniValue::VOBJ);
+                entryToJSON(pool, info, e);
+                out += ":" + info.write();
+            }
+        });
+    out += verbose ? "}" : "]";
+}
+
+/** Parse the options of getrawmempool into a MempoolFilter. */
+static MempoolFilter ParseMempoolFilter(const UniValue &options) {
+    RPCTypeCheckObj(options,
+                    {
+                        {"cursor", UniValueType(UniValue::VSTR)},
+                        {"count", UniValueType(UniValue::VNUM)},
+                        {"minfeerate", UniValueType()},
+                        {"mintime", UniValueType(UniValue::VNUM)},
+                        {"maxtime", UniValueType(UniValue::VNUM)},
+                    },
+                    true, true);
+
+    MempoolFilter filter;
+    if (!options["cursor"].isNull()) {
+        filter.cursor = MempoolCursor::FromString(options["cursor"].get_str());
+        if (!filter.cursor) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        }
+    }
+
+    if (!options["count"].isNull()) {
+        const int64_t count = options["count"].get_int64();
+        if (count <= 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER,
+                               "Invalid count, must be positive");
+        }
+        filter.count = count;
+    }
+
+    if (!options["minfeerate"].isNull()) {
+        filter.minFeeRate = CFeeRate(AmountFromValue(options["minfeerate"]));
+    }
+
+    if (!options["mintime"].isNull()) {
+        filter.minTime = std::chrono::seconds{options["mintime"].get_int64()};
+    }
+
+    if (!options["maxtime"].isNull()) {
+        filter.maxTime = std::chrono::seconds{options["maxtime"].get_int64()};
+    }
+
+    return filter;
+}
+
 static UniValue getrawmempool(const Config &config,
                               const JSONRPCRequest &request) {
     RPCHelpMan{
@@ -608,10 +782,42 @@ static UniValue getrawmempool(const Config &config,
         "Returns all transaction ids in memory pool as a json array of "
         "string transaction ids.\n"
         "\nHint: use getmempoolentry to fetch a specific transaction from the "
-        "mempool.\n",
+        "mempool.\n"
+        "\nWhen options are given, only the matching transactions are listed, "
+        "in entry time order. The listing can be paginated by passing the "
+        "returned cursor to the next call. The mempool lock is released "
+        "regularly while listing, so a listing is not a consistent snapshot "
+        "of the mempool.\n",
         {
             {"verbose", RPCArg::Type::BOOL, /* default */ "false",
              "True for a json object, false for array of transaction ids"},
+            {"options",
+             RPCArg::Type::OBJ,
+             "{}",
+             "Filters and pagination of the listing",
+             {
+                 {"cursor", RPCArg::Type::STR,
+                  RPCArg::Optional::OMITTED_NAMED_ARG,
+                  "List the transactions after this cursor, as returned by "
+                  "a previous call"},
+                 {"count", RPCArg::Type::NUM,
+                  RPCArg::Optional::OMITTED_NAMED_ARG,
+                  "Maximum number of transactions to list"},
+                 {"minfeerate", RPCArg::Type::AMOUNT,
+                  RPCArg::Optional::OMITTED_NAMED_ARG,
+                  "Only list the transactions with at least this modified fee "
+                  "rate, in " +
+                      CURRENCY_UNIT + "/kB"},
+                 {"mintime", RPCArg::Type::NUM,
+                  RPCArg::Optional::OMITTED_NAMED_ARG,
+                  "Only list the transactions that entered the mempool at "
+                  "or after this time, in seconds since epoch"},
+                 {"maxtime", RPCArg::Type::NUM,
+                  RPCArg::Optional::OMITTED_NAMED_ARG,
+                  "Only list the transactions that entered the mempool at "
+                  "or before this time, in seconds since epoch"},
+             },
+             "options"},
         },
         {
             RPCResult{"for verbose = false",
@@ -629,8 +835,23 @@ static UniValue getrawmempool(const Config &config,
                           {RPCResult::Type::OBJ_DYN, "transactionid", "",
                            MempoolEntryDescription()},
                       }},
+            RPCResult{"when options are given",
+                      RPCResult::Type::OBJ,
+                      "",
+                      "",
+                      {
+                          {RPCResult::Type::ELISION, "",
+                           "\"transactions\": the listed transactions, in "
+                           "the same format as without options"},
+                          {RPCResult::Type::STR, "nextcursor",
+                           /* optional */ true,
+                           "The cursor to list the next transactions from, "
+                           "if the count was reached"},
+                      }},
         },
         RPCExamples{HelpExampleCli("getrawmempool", "true") +
+                    HelpExampleCli("getrawmempool",
+                                   "true '{\"count\": 1000}'") +
                     HelpExampleRpc("getrawmempool", "true")},
     }
         .Check(request);
@@ -640,7 +861,20 @@ static UniValue getrawmempool(const Config &config,
         fVerbose = request.params[0].get_bool();
     }
 
-    return MempoolToJSON(EnsureMemPool(request.context), fVerbose);
+    const CTxMemPool &mempool = EnsureMemPool(request.context);
+    if (request.params[1].isNull()) {
+        return MempoolToJSON(mempool, fVerbose);
+    }
+
+    std::optional<MempoolCursor> next;
+    UniValue result(UniValue::VOBJ);
+    result.pushKV("transactions",
+                  MempoolToJSON(mempool, fVerbose,
+                                ParseMempoolFilter(request.params[1]), next));
+    if (next) {
+        result.pushKV("nextcursor", next->ToString());
+    }
+    return result;
 }
 
 static UniValue getmempoolancestors(const Config &config,
@@ -1765,6 +1999,225 @@ static UniValue getmempoolinfo(const Config &config,
     return MempoolInfoToJSON(EnsureMemPool(request.context));
 }
 
+static UniValue getmempoolfeehistogram(const Config &config,
+                                       const JSONRPCRequest &request) {
+    RPCHelpMan{
+        "getmempoolfeehistogram",
+        "Returns the histogram of the fee rates paid by the transactions in "
+        "the memory pool, from the highest fee rates down.\n"
+        "Transactions are grouped into log-spaced fee rate buckets, by the "
+        "fee rate they pay on their own.\n",
+        {},
+        RPCResult{
+            RPCResult::Type::OBJ,
+            "",
+            "",
+            {
+                {RPCResult::Type::NUM, "bytes", "Sum of all transaction sizes"},
+                {RPCResult::Type::OBJ_DYN,
+                 "percentiles",
+                 "",
+                 {
+                     {RPCResult::Type::STR_AMOUNT, "percentile",
+                      "The fee rate in " + CURRENCY_UNIT +
+                          "/kB of the transactions found at this percentage "
+                          "of the mempool size, counting from the highest "
+                          "fee rates"},
+                 }},
+                {RPCResult::Type::ARR,
+                 "buckets",
+                 "The non-empty buckets",
+                 {
+                     {RPCResult::Type::OBJ,
+                      "",
+                      "",
+                      {
+                          {RPCResult::Type::STR_AMOUNT, "feerate",
+                           "The lowest fee rate in the bucket, in " +
+                               CURRENCY_UNIT + "/kB"},
+                          {RPCResult::Type::NUM, "count",
+                           "The number of transactions in the bucket"},
+                          {RPCResult::Type::NUM, "bytes",
+                           "Sum of the sizes of the transactions in the "
+                           "bucket"},
+                          {RPCResult::Type::NUM, "depth",
+                           "Sum of the sizes of the transactions in this "
+                           "bucket and in the buckets with higher fee rates"},
+                      }},
+                 }},
+            }},
+        RPCExamples{HelpExampleCli("getmempoolfeehistogram", "") +
+                    HelpExampleRpc("getmempoolfeehistogram", "")},
+    }
+        .Check(request);
+
+    const CTxMemPool &mempool = EnsureMemPool(request.context);
+    LOCK(mempool.cs);
+    const FeeRateHistogram &histogram = mempool.GetFeeRateHistogram();
+    const uint64_t totalSize = histogram.GetMempoolTotalSize();
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("bytes", totalSize);
+
+    UniValue percentiles(UniValue::VOBJ);
+    for (const int percentile : {5, 10, 25, 50, 75, 90, 95}) {
+        std::optional<size_t> bucket =
+            histogram.GetBucketAtDepth(totalSize * percentile / 100);
+        if (bucket) {
+            percentiles.pushKV(
+                std::to_string(percentile),
+                ValueFromAmount(
+                    histogram.GetBucketFeeRate(*bucket).GetFeePerK()));
+        }
+    }
+    ret.pushKV("percentiles", percentiles);
+
+    UniValue buckets(UniValue::VARR);
+    uint64_t depth = 0;
+    for (size_t i = histogram.GetBucketCount(); i-- > 0;) {
+        if (histogram.GetMempoolCount(i) == 0) {
+            continue;
+        }
+
+        depth += histogram.GetMempoolSize(i);
+        UniValue bucket(UniValue::VOBJ);
+        const CFeeRate feeRate = histogram.GetBucketFeeRate(i);
+        bucket.pushKV("feerate", ValueFromAmount(feeRate.GetFeePerK()));
+        bucket.pushKV("count", histogram.GetMempoolCount(i));
+        bucket.pushKV("bytes", histogram.GetMempoolSize(i));
+        bucket.pushKV("depth", depth);
+        buckets.push_back(bucket);
+    }
+    ret.pushKV("buckets", buckets);
+
+    return ret;
+}
+
+static UniValue
+LatencySnapshotToJSON(const LatencyHistogram::Snapshot &snapshot) {
+    UniValue stats(UniValue::VOBJ);
+    stats.pushKV("count", snapshot.count);
+    stats.pushKV("total", snapshot.total);
+    stats.pushKV("max", snapshot.max);
+
+    UniValue percentiles(UniValue::VOBJ);
+    if (snapshot.count > 0) {
+        for (const int percentile : {50, 90, 99}) {
+            percentiles.pushKV(std::to_string(percentile),
+                               snapshot.GetPercentile(percentile));
+        }
+    }
+    stats.pushKV("percentiles", percentiles);
+
+    UniValue buckets(UniValue::VARR);
+    for (size_t i = 0; i < LatencyHistogram::NUM_BUCKETS; ++i) {
+        if (snapshot.buckets[i] == 0) {
+            continue;
+        }
+
+        UniValue bucket(UniValue::VOBJ);
+        bucket.pushKV("upto", LatencyHistogram::GetBucketLimit(i));
+        bucket.pushKV("count", snapshot.buckets[i]);
+        buckets.push_back(bucket);
+    }
+    stats.pushKV("buckets", buckets);
+
+    return stats;
+}
+
+static UniValue getvalidationstats(const Config &config,
+                                   const JSONRPCRequest &request) {
+    const RPCResult phaseResult{
+        RPCResult::Type::OBJ,
+        "phase",
+        "The latency of a validation phase",
+        {
+            {RPCResult::Type::NUM, "count", "The number of measurements"},
+            {RPCResult::Type::NUM, "total", "The total time, in microseconds"},
+            {RPCResult::Type::NUM, "max",
+             "The longest measurement, in microseconds"},
+            {RPCResult::Type::OBJ_DYN,
+             "percentiles",
+             "",
+             {
+                 {RPCResult::Type::NUM, "percentile",
+                  "Upper bound of the time taken by this percentage of the "
+                  "measurements, in microseconds"},
+             }},
+            {RPCResult::Type::ARR,
+             "buckets",
+             "The non-empty buckets",
+             {
+                 {RPCResult::Type::OBJ,
+                  "",
+                  "",
+                  {
+                      {RPCResult::Type::NUM, "upto",
+                       "The exclusive upper bound of the bucket, in "
+                       "microseconds"},
+                      {RPCResult::Type::NUM, "count",
+                       "The number of measurements in the bucket"},
+                  }},
+             }},
+        }};
+
+    RPCHelpMan{
+        "getvalidationstats",
+        "Returns latency histograms of the phases of transaction and block "
+        "validation since startup.\n"
+        "\"mempool\" covers the acceptance of transactions to the memory "
+        "pool, \"connectblock\" and \"connecttip\" the connection of blocks "
+        "to the chain. The prechecks include the coin lookup and the "
+        "standard script checks, and the block verification includes the "
+        "transaction connection.\n"
+        "Durations are bucketed by powers of two.\n",
+        {
+            {"reset", RPCArg::Type::BOOL, /* default */ "false",
+             "Reset the histograms after reading them"},
+        },
+        RPCResult{RPCResult::Type::OBJ,
+                  "",
+                  "",
+                  {
+                      {RPCResult::Type::OBJ_DYN, "mempool", "", {phaseResult}},
+                      {RPCResult::Type::OBJ_DYN,
+                       "connectblock",
+                       "",
+                       {phaseResult}},
+                      {RPCResult::Type::OBJ_DYN,
+                       "connecttip",
+                       "",
+                       {phaseResult}},
+                  }},
+        RPCExamples{HelpExampleCli("getvalidationstats", "") +
+                    HelpExampleRpc("getvalidationstats", "")},
+    }
+        .Check(request);
+
+    UniValue ret(UniValue::VOBJ);
+    for (const char *groupName : {"mempool", "connectblock", "connecttip"}) {
+        UniValue group(UniValue::VOBJ);
+        for (size_t i = 0; i < size_t(ValidationPhase::NUM_PHASES); ++i) {
+            const ValidationPhaseInfo &info =
+                GetValidationPhaseInfo(ValidationPhase(i));
+            if (std::string(info.group) != groupName) {
+                continue;
+            }
+
+            const LatencyHistogram::Snapshot snapshot =
+                GetValidationLatency(info.phase).GetSnapshot();
+            group.pushKV(info.name, LatencySnapshotToJSON(snapshot));
+        }
+        ret.pushKV(groupName, group);
+    }
+
+    if (!request.params[0].isNull() && request.params[0].get_bool()) {
+        ResetValidationLatencies();
+    }
+
+    return ret;
+}
+
 static UniValue preciousblock(const Config &config,
                               const JSONRPCRequest &request) {
     RPCHelpMan{
@@ -2938,10 +3391,12 @@ void RegisterBlockchainRPCCommands(CRPCTable &t) {
         { "blockchain",         "getmempoolancestors",    getmempoolancestors,    {"txid","verbose"} },
         { "blockchain",         "getmempooldescendants",  getmempooldescendants,  {"txid","verbose"} },
         { "blockchain",         "getmempoolentry",        getmempoolentry,        {"txid"} },
+        { "blockchain",         "getmempoolfeehistogram", getmempoolfeehistogram, {} },
         { "blockchain",         "getmempoolinfo",         getmempoolinfo,         {} },
-        { "blockchain",         "getrawmempool",          getrawmempool,          {"verbose"} },
+        { "blockchain",         "getrawmempool",          getrawmempool,          {"verbose", "options"} },
         { "blockchain",         "gettxout",               gettxout,               {"txid","n","include_mempool"} },
         { "blockchain",         "gettxoutsetinfo",        gettxoutsetinfo,        {} },
+        { "blockchain",         "getvalidationstats",     getvalidationstats,     {"reset"} },
         { "blockchain",         "pruneblockchain",        pruneblockchain,        {"height"} },
         { "blockchain",         "savemempool",            savemempool,            {} },
         { "blockchain",         "verifychain",            verifychain,            {"checklevel","nblocks"} },
@@ -5,10 +5,17 @@
 #ifndef BITCOIN_RPC_BLOCKCHAIN_H
 #define BITCOIN_RPC_BLOCKCHAIN_H
 
+#include <feerate.h>
+#include <primitives/txid.h>
 #include <sync.h>
 
 #include <univalue.h>
 
+#include <chrono>
+#include <limits>
+#include <optional>
+#include <string>
+
 class CBlock;
 class CBlockIndex;
 class ChainstateManager;
@@ -46,6 +53,50 @@ UniValue MempoolInfoToJSON(const CTxMemPool &pool);
 /** Mempool to JSON */
 UniValue MempoolToJSON(const CTxMemPool &pool, bool verbose = false);
 
+/**
+ * Position in a listing of the mempool entries, which are ordered by entry
+ * time then txid. A listing resumes after the cursor, even if the entry it
+ * points to has left the mempool in the meantime.
+ */
+struct MempoolCursor {
+    std::chrono::seconds time;
+    TxId txid;
+
+    std::string ToString() const;
+    static std::optional<MempoolCursor> FromString(const std::string &str);
+};
+
+/** Selection of the mempool entries to list */
+struct MempoolFilter {
+    //! Only list the entries after this position.
+    std::optional<MempoolCursor> cursor;
+    //! Maximum number of entries to list.
+    size_t count = std::numeric_limits<size_t>::max();
+    //! Only list the entries with at least this modified fee rate.
+    CFeeRate minFeeRate;
+    //! Only list the entries that entered the mempool in this time range.
+    std::chrono::seconds minTime = std::chrono::seconds::min();
+    std::chrono::seconds maxTime = std::chrono::seconds::max();
+};
+
+/**
+ * Mempool entries matching filter to JSON, in entry time order. pool.cs is
+ * released after every chunk of entries, so the listing is not a consistent
+ * snapshot of the mempool. If the listing stopped after filter.count entries,
+ * next is set to the cursor to resume from.
+ */
+UniValue MempoolToJSON(const CTxMemPool &pool, bool verbose,
+                       const MempoolFilter &filter,
+                       std::optional<MempoolCursor> &next);
+
+/**
+ * Same as MempoolToJSON, but appends the JSON text to out one entry at a time
+ * instead of building a UniValue for the whole listing.
+ */
+void WriteMempoolJSON(const CTxMemPool &pool, bool verbose,
+                      const MempoolFilter &filter, std::string &out,
+                      std::optional<MempoolCursor> &next);
+
 /** Block header to JSON */
 UniValue blockheaderToJSON(const CBlockIndex *tip,
                            const CBlockIndex *blockindex)
@@ -110,6 +110,7 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"joinpsbts", 0, "txs"},
     {"finalizepsbt", 1, "extract"},
     {"converttopsbt", 1, "permitsigdata"},
+    {"getvalidationstats", 0, "reset"},
     {"gettxout", 1, "n"},
     {"gettxout", 2, "include_mempool"},
     {"gettxoutproof", 0, "txids"},
@@ -129,6 +130,7 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"pruneblockchain", 0, "height"},
     {"keypoolrefill", 0, "newsize"},
     {"getrawmempool", 0, "verbose"},
+    {"getrawmempool", 1, "options"},
     {"estimatefee", 0, "nblocks"},
     {"prioritisetransaction", 1, "dummy"},
     {"prioritisetransaction", 2, "fee_delta"},
@@ -160,6 +162,8 @@ static const CRPCConvertParam vRPCConvertParams[] = {
     {"createwallet", 4, "avoid_reuse"},
     {"createwallet", 5, "descriptors"},
     {"getnodeaddresses", 0, "count"},
+    {"getpeertelemetry", 0, "nodeid"},
+    {"getpeertelemetry", 1, "count"},
     {"stop", 0, "wait"},
     // Avalanche
     {"addavalanchenode", 0, "nodeid"},
@@ -11,6 +11,7 @@
 #include <config.h>
 #include <consensus/activation.h>
 #include <consensus/consensus.h>
+#include <consensus/merkle.h>
 #include <consensus/params.h>
 #include <consensus/validation.h>
 #include <core_io.h>
@@ -18,14 +19,18 @@
 #include <miner.h>
 #include <minerfund.h>
 #include <net.h>
+#include <node/blocktemplatedelta.h>
 #include <node/context.h>
+#include <policy/fees.h>
 #include <policy/policy.h>
 #include <pow/pow.h>
 #include <rpc/blockchain.h>
+#include <rpc/mining.h>
 #include <rpc/server.h>
 #include <rpc/util.h>
 #include <script/descriptor.h>
 #include <script/script.h>
+#include <script/standard.h>
 #include <shutdown.h>
 #include <txmempool.h>
 #include <univalue.h>
@@ -35,8 +40,18 @@
 #include <validationinterface.h>
 #include <warnings.h>
 
+#include <chrono>
 #include <cstdint>
 
+/**
+ * How often a long-polling delta client checks whether the fees of a fresh
+ * template exceed the ones it was last sent by its fee threshold.
+ */
+static constexpr std::chrono::seconds DELTA_LONGPOLL_CHECK_INTERVAL{5};
+
+/** Last template sent to each getblocktemplate client using delta mode. */
+static BlockTemplateDeltaTracker g_template_delta_tracker;
+
 /**
  * Return average network hashes per second based on the last 'lookup' blocks,
  * or from the last difficulty change if 'lookup' is nonpositive. If 'height' is
@@ -585,6 +600,97 @@ static UniValue BIP22ValidationResult(const Config &config,
     return "valid?";
 }
 
+/**
+ * The block template served to miners, shared by getblocktemplate and the
+ * REST interface.
+ */
+static unsigned int nTransactionsUpdatedLast GUARDED_BY(cs_main);
+static CBlockIndex *pindexPrevTemplate GUARDED_BY(cs_main);
+static int64_t nStartTemplate GUARDED_BY(cs_main);
+static std::unique_ptr<CBlockTemplate> pblocktemplate GUARDED_BY(cs_main);
+
+/**
+ * Rebuild the shared block template if the tip changed, or if the mempool
+ * changed and the template is more than 5 seconds old.
+ * Returns false if a new template was needed but could not be created.
+ */
+static bool UpdateBlockTemplate(const Config &config,
+                                const CTxMemPool &mempool)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    if (pindexPrevTemplate == ::ChainActive().Tip() &&
+        (mempool.GetTransactionsUpdated() == nTransactionsUpdatedLast ||
+         GetTime() - nStartTemplate <= 5)) {
+        return true;
+    }
+
+    // Clear pindexPrevTemplate so future calls make a new block, despite any
+    // failures from here on
+    pindexPrevTemplate = nullptr;
+
+    // Store the pindexBest used before CreateNewBlock, to avoid races
+    nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
+    CBlockIndex *pindexPrevNew = ::ChainActive().Tip();
+    nStartTemplate = GetTime();
+
+    // Create new block
+    CScript scriptDummy = CScript() << OP_TRUE;
+    pblocktemplate =
+        BlockAssembler(config, mempool).CreateNewBlock(scriptDummy);
+    if (!pblocktemplate) {
+        return false;
+    }
+
+    // Need to update only after we know CreateNewBlock succeeded
+    pindexPrevTemplate = pindexPrevNew;
+    return true;
+}
+
+/** Throw if the node is in no state to hand out block templates. */
+static void EnsureReadyForMining(const NodeContext &node)
+    EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    if (!node.connman) {
+        throw JSONRPCError(
+            RPC_CLIENT_P2P_DISABLED,
+            "Error: Peer-to-peer functionality missing or disabled");
+    }
+
+    if (node.connman->GetNodeCount(CConnman::CONNECTIONS_ALL) == 0) {
+        throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED,
+                           "Bitcoin is not connected!");
+    }
+
+    if (::ChainstateActive().IsInitialBlockDownload()) {
+        throw JSONRPCError(RPC_CLIENT_IN_INITIAL_DOWNLOAD, PACKAGE_NAME
+                           " is in initial sync and waiting for blocks...");
+    }
+}
+
+static Amount GetCoinbaseValue(const CBlock &block) {
+    Amount coinbasevalue = Amount::zero();
+    for (const auto &o : block.vtx[0]->vout) {
+        coinbasevalue += o.nValue;
+    }
+    return coinbasevalue;
+}
+
+static Amount GetMinerFundMinValue(const Consensus::Params &consensusParams,
+                                   const CBlockIndex *pindexPrev,
+                                   const Amount coinbasevalue) {
+    if (!IsAxionEnabled(consensusParams, pindexPrev)) {
+        return Amount::zero();
+    }
+    return GetMinerFundAmount(coinbasevalue);
+}
+
+static std::vector<uint256> GetCoinbaseMerkleBranch(const CBlock &block) {
+    std::vector<uint256> leaves;
+    leaves.reserve(block.vtx.size());
+    for (const auto &tx : block.vtx) {
+        leaves.push_back(tx->GetId());
+    }
+    return ComputeMerkleBranch(std::move(leaves), 0);
+}
+
 static UniValue getblocktemplate(const Config &config,
                                  const JSONRPCRequest &request) {
     RPCHelpMan{
@@ -628,6 +734,20 @@ static UniValue getblocktemplate(const Config &config,
                           "'serverlist', 'workid'"},
                      },
                  },
+                 {"clientid", RPCArg::Type::STR,
+                  RPCArg::Optional::OMITTED_NAMED_ARG,
+                  "Enables the template delta mode. The node remembers the "
+                  "last template sent to this client and only returns the "
+                  "transactions which changed since then"},
+                 {"templateid", RPCArg::Type::STR_HEX,
+                  RPCArg::Optional::OMITTED_NAMED_ARG,
+                  "The templateid of the last template received by this "
+                  "client. A delta is only returned if it matches"},
+                 {"feethreshold", RPCArg::Type::NUM,
+                  RPCArg::Optional::OMITTED_NAMED_ARG,
+                  "With longpollid and clientid, also return as soon as a new "
+                  "template would collect at least this many more satoshis in "
+                  "fees than the last one sent to this client"},
              },
              "\"template_request\""},
         },
@@ -643,12 +763,16 @@ static UniValue getblocktemplate(const Config &config,
                 {RPCResult::Type::ARR,
                  "transactions",
                  "contents of non-coinbase transactions that should be "
-                 "included in the next block",
+                 "included in the next block. In delta mode, only the "
+                 "transactions added since the last template",
                  {
                      {RPCResult::Type::OBJ,
                       "",
                       "",
                       {
+                          {RPCResult::Type::NUM, "index", /* optional */ true,
+                           "delta mode only: 0-based position of this "
+                           "transaction in the new template"},
                           {RPCResult::Type::STR_HEX, "data",
                            "transaction data encoded in hexadecimal "
                            "(byte-for-byte)"},
@@ -735,6 +859,28 @@ static UniValue getblocktemplate(const Config &config,
                  "compressed target of next block"},
                 {RPCResult::Type::NUM, "height",
                  "The height of the next block"},
+                {RPCResult::Type::STR_HEX, "templateid", /* optional */ true,
+                 "delta mode only: identifier of this template"},
+                {RPCResult::Type::BOOL, "delta", /* optional */ true,
+                 "delta mode only: whether 'transactions' and 'removed' are "
+                 "relative to the template identified by the request's "
+                 "templateid. If false, 'transactions' is complete"},
+                {RPCResult::Type::ARR,
+                 "removed",
+                 /* optional */ true,
+                 "delta mode only: 0-based positions in the previous template "
+                 "of the transactions to remove, applied before inserting the "
+                 "new ones",
+                 {
+                     {RPCResult::Type::NUM, "", "position"},
+                 }},
+                {RPCResult::Type::ARR,
+                 "merklebranch",
+                 /* optional */ true,
+                 "delta mode only: merkle branch of the coinbase transaction",
+                 {
+                     {RPCResult::Type::STR_HEX, "", "hash"},
+                 }},
             }},
         RPCExamples{HelpExampleCli("getblocktemplate", "") +
                     HelpExampleRpc("getblocktemplate", "")},
@@ -747,6 +893,9 @@ static UniValue getblocktemplate(const Config &config,
     std::string strMode = "template";
     UniValue lpval = NullUniValue;
     std::set<std::string> setClientRules;
+    std::optional<std::string> deltaClientId;
+    std::optional<uint256> knownTemplateId;
+    std::optional<Amount> feeThreshold;
     if (!request.params[0].isNull()) {
         const UniValue &oparam = request.params[0].get_obj();
         const UniValue &modeval = find_value(oparam, "mode");
@@ -759,6 +908,24 @@ static UniValue getblocktemplate(const Config &config,
         }
         lpval = find_value(oparam, "longpollid");
 
+        const UniValue &clientidval = find_value(oparam, "clientid");
+        if (!clientidval.isNull()) {
+            deltaClientId = clientidval.get_str();
+            const UniValue &templateidval = find_value(oparam, "templateid");
+            if (!templateidval.isNull()) {
+                knownTemplateId = ParseHashV(templateidval, "templateid");
+            }
+            const UniValue &feethresholdval =
+                find_value(oparam, "feethreshold");
+            if (!feethresholdval.isNull()) {
+                feeThreshold = feethresholdval.get_int64() * SATOSHI;
+                if (*feeThreshold < Amount::zero()) {
+                    throw JSONRPCError(RPC_INVALID_PARAMETER,
+                                       "feethreshold must be non-negative");
+                }
+            }
+        }
+
         if (strMode == "proposal") {
             const UniValue &dataval = find_value(oparam, "data");
             if (!dataval.isStr()) {
@@ -802,24 +969,7 @@ static UniValue getblocktemplate(const Config &config,
         throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
     }
 
-    NodeContext &node = EnsureNodeContext(request.context);
-    if (!node.connman) {
-        throw JSONRPCError(
-            RPC_CLIENT_P2P_DISABLED,
-            "Error: Peer-to-peer functionality missing or disabled");
-    }
-
-    if (node.connman->GetNodeCount(CConnman::CONNECTIONS_ALL) == 0) {
-        throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED,
-                           "Bitcoin is not connected!");
-    }
-
-    if (::ChainstateActive().IsInitialBlockDownload()) {
-        throw JSONRPCError(RPC_CLIENT_IN_INITIAL_DOWNLOAD, PACKAGE_NAME
-                           " is in initial sync and waiting for blocks...");
-    }
-
-    static unsigned int nTransactionsUpdatedLast;
+    EnsureReadyForMining(EnsureNodeContext(request.context));
     const CTxMemPool &mempool = EnsureMemPool(request.context);
 
     if (!lpval.isNull()) {
@@ -842,11 +992,22 @@ static UniValue getblocktemplate(const Config &config,
             nTransactionsUpdatedLastLP = nTransactionsUpdatedLast;
         }
 
+        // In delta mode with a fee threshold, the client is woken up as soon
+        // as a fresh template would pay it enough more than the last one.
+        std::optional<Amount> lastFees;
+        if (deltaClientId && feeThreshold) {
+            lastFees = g_template_delta_tracker.GetLastFees(*deltaClientId);
+        }
+
         // Release lock while waiting
         LEAVE_CRITICAL_SECTION(cs_main);
         {
-            checktxtime =
-                std::chrono::steady_clock::now() + std::chrono::minutes(1);
+            checktxtime = std::chrono::steady_clock::now();
+            if (lastFees) {
+                checktxtime += DELTA_LONGPOLL_CHECK_INTERVAL;
+            } else {
+                checktxtime += std::chrono::minutes(1);
+            }
 
             WAIT_LOCK(g_best_block_mutex, lock);
             while (g_best_block == hashWatchedChain && IsRPCRunning()) {
@@ -854,11 +1015,37 @@ static UniValue getblocktemplate(const Config &config,
                     std::cv_status::timeout) {
                     // Timeout: Check transactions for update
                     // without holding the mempool look to avoid deadlocks
-                    if (mempool.GetTransactionsUpdated() !=
+                    if (!lastFees) {
+                        if (mempool.GetTransactionsUpdated() !=
+                            nTransactionsUpdatedLastLP) {
+                            break;
+                        }
+                        checktxtime += std::chrono::seconds(10);
+                        continue;
+                    }
+
+                    checktxtime += DELTA_LONGPOLL_CHECK_INTERVAL;
+                    if (mempool.GetTransactionsUpdated() ==
                         nTransactionsUpdatedLastLP) {
+                        continue;
+                    }
+
+                    // Build a fresh template without holding
+                    // g_best_block_mutex, as cs_main must be taken first. If
+                    // that fails, stop waiting and report the error below.
+                    bool feeGainReached;
+                    {
+                        REVERSE_LOCK(lock);
+                        LOCK(cs_main);
+                        feeGainReached =
+                            !UpdateBlockTemplate(config, mempool) ||
+                            GetTemplateFees(*pblocktemplate) >=
+                                *lastFees + *feeThreshold;
+                        nTransactionsUpdatedLastLP = nTransactionsUpdatedLast;
+                    }
+                    if (feeGainReached) {
                         break;
                     }
-                    checktxtime += std::chrono::seconds(10);
                 }
             }
         }
@@ -872,33 +1059,11 @@ static UniValue getblocktemplate(const Config &config,
     }
 
     // Update block
-    static CBlockIndex *pindexPrev;
-    static int64_t nStart;
-    static std::unique_ptr<CBlockTemplate> pblocktemplate;
-    if (pindexPrev != ::ChainActive().Tip() ||
-        (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast &&
-         GetTime() - nStart > 5)) {
-        // Clear pindexPrev so future calls make a new block, despite any
-        // failures from here on
-        pindexPrev = nullptr;
-
-        // Store the pindexBest used before CreateNewBlock, to avoid races
-        nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
-        CBlockIndex *pindexPrevNew = ::ChainActive().Tip();
-        nStart = GetTime();
-
-        // Create new block
-        CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate =
-            BlockAssembler(config, mempool).CreateNewBlock(scriptDummy);
-        if (!pblocktemplate) {
-            throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
-        }
-
-        // Need to update only after we know CreateNewBlock succeeded
-        pindexPrev = pindexPrevNew;
+    if (!UpdateBlockTemplate(config, mempool)) {
+        throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
     }
 
+    CBlockIndex *const pindexPrev = pindexPrevTemplate;
     CHECK_NONFATAL(pindexPrev);
     // pointer for convenience
     CBlock *pblock = &pblocktemplate->block;
@@ -910,38 +1075,44 @@ static UniValue getblocktemplate(const Config &config,
     UniValue aCaps(UniValue::VARR);
     aCaps.push_back("proposal");
 
-    Amount coinbasevalue = Amount::zero();
-
-    UniValue transactions(UniValue::VARR);
-    transactions.reserve(pblock->vtx.size());
-    int index_in_template = 0;
-    for (const auto &it : pblock->vtx) {
-        const CTransaction &tx = *it;
-        const TxId txId = tx.GetId();
-
-        if (tx.IsCoinBase()) {
-            index_in_template++;
+    std::optional<BlockTemplateDelta> delta;
+    if (deltaClientId) {
+        delta = g_template_delta_tracker.Update(*deltaClientId,
+                                                knownTemplateId, *pblocktemplate);
+    }
 
-            for (const auto &o : pblock->vtx[0]->vout) {
-                coinbasevalue += o.nValue;
-            }
+    const Amount coinbasevalue = GetCoinbaseValue(*pblock);
 
-            continue;
-        }
+    auto txToUniv = [&](size_t index_in_template) {
+        const CTransaction &tx = *pblock->vtx[index_in_template];
 
         UniValue entry(UniValue::VOBJ);
-        entry.reserve(5);
+        entry.reserve(6);
         entry.__pushKV("data", EncodeHexTx(tx));
-        entry.__pushKV("txid", txId.GetHex());
+        entry.__pushKV("txid", tx.GetId().GetHex());
         entry.__pushKV("hash", tx.GetHash().GetHex());
         entry.__pushKV("fee", pblocktemplate->entries[index_in_template].fees /
                                   SATOSHI);
         int64_t nTxSigOps =
             pblocktemplate->entries[index_in_template].sigOpCount;
         entry.__pushKV("sigops", nTxSigOps);
+        return entry;
+    };
 
-        transactions.push_back(entry);
-        index_in_template++;
+    UniValue transactions(UniValue::VARR);
+    if (delta && delta->isDelta) {
+        transactions.reserve(delta->added.size());
+        for (const uint32_t index : delta->added) {
+            UniValue entry = txToUniv(index + 1);
+            entry.__pushKV("index", int64_t(index));
+            transactions.push_back(entry);
+        }
+    } else {
+        transactions.reserve(pblock->vtx.size());
+        // Skip the coinbase.
+        for (size_t i = 1; i < pblock->vtx.size(); i++) {
+            transactions.push_back(txToUniv(i));
+        }
     }
 
     UniValue aux(UniValue::VOBJ);
@@ -953,11 +1124,9 @@ static UniValue getblocktemplate(const Config &config,
         minerFundList.push_back(EncodeCashAddr(fundDestination, chainparams));
     }
 
-    int64_t minerFundMinValue = 0;
-    if (IsAxionEnabled(consensusParams, pindexPrev)) {
-        minerFundMinValue =
-            int64_t(GetMinerFundAmount(coinbasevalue) / SATOSHI);
-    }
+    int64_t minerFundMinValue = int64_t(
+        GetMinerFundMinValue(consensusParams, pindexPrev, coinbasevalue) /
+        SATOSHI);
 
     UniValue minerFund(UniValue::VOBJ);
     minerFund.pushKV("addresses", minerFundList);
@@ -996,6 +1165,68 @@ static UniValue getblocktemplate(const Config &config,
     result.pushKV("bits", strprintf("%08x", pblock->nBits));
     result.pushKV("height", int64_t(pindexPrev->nHeight) + 1);
 
+    if (delta) {
+        result.pushKV("templateid", delta->templateId.GetHex());
+        result.pushKV("delta", delta->isDelta);
+
+        UniValue removed(UniValue::VARR);
+        removed.reserve(delta->removed.size());
+        for (const uint32_t index : delta->removed) {
+            removed.push_back(int64_t(index));
+        }
+        result.pushKV("removed", removed);
+
+        UniValue merklebranch(UniValue::VARR);
+        for (const uint256 &hash : GetCoinbaseMerkleBranch(*pblock)) {
+            merklebranch.push_back(hash.GetHex());
+        }
+        result.pushKV("merklebranch", merklebranch);
+    }
+
+    return result;
+}
+
+BinaryBlockTemplate GetBinaryBlockTemplate(const Config &config,
+                                           const util::Ref &context) {
+    LOCK(cs_main);
+    EnsureReadyForMining(EnsureNodeContext(context));
+    if (!UpdateBlockTemplate(config, EnsureMemPool(context))) {
+        throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
+    }
+
+    const CChainParams &chainparams = config.GetChainParams();
+    const Consensus::Params &consensusParams = chainparams.GetConsensus();
+    const CBlockIndex *pindexPrev = pindexPrevTemplate;
+    CBlock &block = pblocktemplate->block;
+
+    // Update nTime
+    UpdateTime(&block, chainparams, pindexPrev);
+    block.nNonce = 0;
+
+    BinaryBlockTemplate result;
+    result.header = block.GetBlockHeader();
+    result.header.hashMerkleRoot.SetNull();
+    result.height = pindexPrev->nHeight + 1;
+    result.minTime = pindexPrev->GetMedianTimePast() + 1;
+    result.coinbaseValue = GetCoinbaseValue(block);
+    result.sizeLimit = DEFAULT_MAX_BLOCK_SIZE;
+    result.sigOpLimit = GetMaxBlockSigChecksCount(DEFAULT_MAX_BLOCK_SIZE);
+    for (const CTxDestination &fundDestination :
+         GetMinerFundWhitelist(consensusParams, pindexPrev)) {
+        result.minerFundScripts.push_back(
+            GetScriptForDestination(fundDestination));
+    }
+    result.minerFundMinValue = GetMinerFundMinValue(
+        consensusParams, pindexPrev, result.coinbaseValue);
+    result.coinbaseMerkleBranch = GetCoinbaseMerkleBranch(block);
+
+    result.entries.reserve(block.vtx.size() - 1);
+    // Skip the coinbase.
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        result.entries.push_back({block.vtx[i], pblocktemplate->entries[i].fees,
+                                  pblocktemplate->entries[i].sigOpCount});
+    }
+
     return result;
 }
 
@@ -1041,11 +1272,16 @@ static UniValue submitblock(const Config &config,
         .Check(request);
 
     std::shared_ptr<CBlock> blockptr = std::make_shared<CBlock>();
-    CBlock &block = *blockptr;
-    if (!DecodeHexBlk(block, request.params[0].get_str())) {
+    if (!DecodeHexBlk(*blockptr, request.params[0].get_str())) {
         throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Block decode failed");
     }
 
+    return SubmitBlock(config, request.context, blockptr);
+}
+
+UniValue SubmitBlock(const Config &config, const util::Ref &context,
+                     const std::shared_ptr<CBlock> &blockptr) {
+    const CBlock &block = *blockptr;
     if (block.vtx.empty() || !block.vtx[0]->IsCoinBase()) {
         throw JSONRPCError(RPC_DESERIALIZATION_ERROR,
                            "Block does not start with a coinbase");
@@ -1068,10 +1304,9 @@ static UniValue submitblock(const Config &config,
     bool new_block;
     submitblock_StateCatcher sc(block.GetHash());
     RegisterValidationInterface(&sc);
-    bool accepted =
-        EnsureChainman(request.context)
-            .ProcessNewBlock(config, blockptr, /* fForceProcessing */ true,
-                             /* fNewBlock */ &new_block);
+    bool accepted = EnsureChainman(context).ProcessNewBlock(
+        config, blockptr, /* fForceProcessing */ true,
+        /* fNewBlock */ &new_block);
     // We are only interested in BlockChecked which will have been dispatched
     // in-thread, so no need to sync before unregistering.
     UnregisterValidationInterface(&sc);
@@ -1137,14 +1372,33 @@ static UniValue estimatefee(const Config &config,
         "estimatefee",
         "Estimates the approximate fee per kilobyte needed for a "
         "transaction\n",
-        {},
+        {
+            {"nblocks", RPCArg::Type::NUM, RPCArg::Optional::OMITTED,
+             "Estimate the fee needed for the transaction to be confirmed "
+             "within this many blocks (1 - " +
+                 std::to_string(MAX_CONFIRMATION_TARGET) +
+                 "), from the recently confirmed transactions and the "
+                 "current mempool"},
+        },
         RPCResult{RPCResult::Type::NUM, "", "estimated fee-per-kilobyte"},
-        RPCExamples{HelpExampleCli("estimatefee", "")},
+        RPCExamples{HelpExampleCli("estimatefee", "") +
+                    HelpExampleCli("estimatefee", "6")},
     }
         .Check(request);
 
     const CTxMemPool &mempool = EnsureMemPool(request.context);
-    return ValueFromAmount(mempool.estimateFee().GetFeePerK());
+    if (request.params[0].isNull()) {
+        return ValueFromAmount(mempool.estimateFee().GetFeePerK());
+    }
+
+    const int nBlocks = request.params[0].get_int();
+    if (nBlocks < 1 || nBlocks > int(MAX_CONFIRMATION_TARGET)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER,
+                           strprintf("Invalid nblocks, must be 1 - %u",
+                                     MAX_CONFIRMATION_TARGET));
+    }
+    return ValueFromAmount(
+        mempool.estimateFee(nBlocks, config.GetMaxBlockSize()).GetFeePerK());
 }
 
 void RegisterMiningRPCCommands(CRPCTable &t) {
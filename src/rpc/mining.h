@@ -0,0 +1,85 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_MINING_H
+#define BITCOIN_RPC_MINING_H
+
+#include <amount.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <script/script.h>
+#include <serialize.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <univalue.h>
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+class Config;
+namespace util {
+class Ref;
+} // namespace util
+
+extern RecursiveMutex cs_main;
+
+/** A transaction of a binary block template. */
+struct BinaryBlockTemplateEntry {
+    CTransactionRef tx;
+    Amount fee;
+    int64_t sigOpCount;
+
+    SERIALIZE_METHODS(BinaryBlockTemplateEntry, obj) {
+        READWRITE(obj.tx, obj.fee, obj.sigOpCount);
+    }
+};
+
+/**
+ * Compact binary encoding of a block template, carrying the same information
+ * as the getblocktemplate result without the JSON and hex overhead.
+ */
+struct BinaryBlockTemplate {
+    //! Version, previous block hash, time and bits of the block to mine. The
+    //! merkle root and nonce are left null.
+    CBlockHeader header;
+    int32_t height;
+    int64_t minTime;
+    Amount coinbaseValue;
+    uint64_t sizeLimit;
+    uint64_t sigOpLimit;
+    //! Valid scripts for the miner fund output, and the minimum it must pay.
+    std::vector<CScript> minerFundScripts;
+    Amount minerFundMinValue;
+    //! Merkle branch of the coinbase, which does not depend on its content.
+    std::vector<uint256> coinbaseMerkleBranch;
+    //! The non-coinbase transactions, in block order.
+    std::vector<BinaryBlockTemplateEntry> entries;
+
+    SERIALIZE_METHODS(BinaryBlockTemplate, obj) {
+        READWRITE(obj.header, obj.height, obj.minTime, obj.coinbaseValue,
+                  obj.sizeLimit, obj.sigOpLimit, obj.minerFundScripts,
+                  obj.minerFundMinValue, obj.coinbaseMerkleBranch,
+                  obj.entries);
+    }
+};
+
+/**
+ * Get the block template served by getblocktemplate in binary form.
+ * Throws a JSONRPCError if the node is not ready for mining.
+ */
+BinaryBlockTemplate GetBinaryBlockTemplate(const Config &config,
+                                           const util::Ref &context)
+    LOCKS_EXCLUDED(cs_main);
+
+/**
+ * Process a block found by a miner. Returns null if the block was accepted,
+ * or the BIP22 reject reason otherwise.
+ */
+UniValue SubmitBlock(const Config &config, const util::Ref &context,
+                     const std::shared_ptr<CBlock> &blockptr)
+    LOCKS_EXCLUDED(cs_main);
+
+#endif // BITCOIN_RPC_MINING_H
@@ -5,6 +5,7 @@
 #include <rpc/server.h>
 
 #include <banman.h>
+#include <blockdownload.h>
 #include <clientversion.h>
 #include <config.h>
 #include <core_io.h>
@@ -155,6 +156,9 @@ static UniValue getpeerinfo(const Config &config,
                           "The heights of blocks we're currently asking from "
                           "this peer"},
                      }},
+                    {RPCResult::Type::BOOL, "txreconciliation",
+                     "Whether transactions are reconciled with this peer "
+                     "rather than flooded"},
                     {RPCResult::Type::BOOL, "whitelisted",
                      "Whether the peer is whitelisted"},
                     {RPCResult::Type::NUM, "minfeefilter",
@@ -249,6 +253,7 @@ static UniValue getpeerinfo(const Config &config,
                 heights.push_back(height);
             }
             obj.pushKV("inflight", heights);
+            obj.pushKV("txreconciliation", statestats.m_txreconciliation);
         }
         obj.pushKV("whitelisted", stats.m_legacyWhitelisted);
         UniValue permissions(UniValue::VARR);
@@ -506,6 +511,14 @@ static UniValue getnettotals(const Config &config,
                 {RPCResult::Type::NUM, "totalbytesrecv",
                  "Total bytes received"},
                 {RPCResult::Type::NUM, "totalbytessent", "Total bytes sent"},
+                {RPCResult::Type::NUM, "totalrecvcalls",
+                 "Total number of socket receive calls"},
+                {RPCResult::Type::NUM, "totalsendcalls",
+                 "Total number of socket send calls"},
+                {RPCResult::Type::NUM, "bytesperrecvcall",
+                 "Average number of bytes received per receive call"},
+                {RPCResult::Type::NUM, "bytespersendcall",
+                 "Average number of bytes sent per send call"},
                 {RPCResult::Type::NUM_TIME, "timemillis",
                  "Current UNIX time in milliseconds"},
                 {RPCResult::Type::OBJ,
@@ -540,6 +553,14 @@ static UniValue getnettotals(const Config &config,
     UniValue obj(UniValue::VOBJ);
     obj.pushKV("totalbytesrecv", node.connman->GetTotalBytesRecv());
     obj.pushKV("totalbytessent", node.connman->GetTotalBytesSent());
+    const uint64_t recv_calls = node.connman->GetTotalRecvCalls();
+    const uint64_t send_calls = node.connman->GetTotalSendCalls();
+    obj.pushKV("totalrecvcalls", recv_calls);
+    obj.pushKV("totalsendcalls", send_calls);
+    obj.pushKV("bytesperrecvcall",
+               recv_calls ? node.connman->GetTotalBytesRecv() / recv_calls : 0);
+    obj.pushKV("bytespersendcall",
+               send_calls ? node.connman->GetTotalBytesSent() / send_calls : 0);
     obj.pushKV("timemillis", GetTimeMillis());
 
     UniValue outboundLimit(UniValue::VOBJ);
@@ -952,6 +973,222 @@ static UniValue getnodeaddresses(const Config &config,
     return ret;
 }
 
+static UniValue getpeertelemetry(const Config &config,
+                                 const JSONRPCRequest &request) {
+    RPCHelpMan{
+        "getpeertelemetry",
+        "Returns the recent activity of each connected peer, as a time series "
+        "sampled every " +
+            std::to_string(PEER_TELEMETRY_INTERVAL.count()) +
+            " second(s). The last " + std::to_string(PEER_TELEMETRY_SAMPLES) +
+            " samples are kept.\n",
+        {
+            {"nodeid", RPCArg::Type::NUM, /* default */ "all peers",
+             "Only return the activity of this peer."},
+            {"count", RPCArg::Type::NUM,
+             /* default */ std::to_string(PEER_TELEMETRY_SAMPLES),
+             "How many of the most recent samples to return."},
+        },
+        RPCResult{
+            RPCResult::Type::ARR,
+            "",
+            "",
+            {
+                {RPCResult::Type::OBJ,
+                 "",
+                 "",
+                 {
+                     {RPCResult::Type::NUM, "id", "Peer index"},
+                     {RPCResult::Type::STR, "addr",
+                      "(host:port) The IP address and port of the peer"},
+                     {RPCResult::Type::ARR,
+                      "samples",
+                      "The samples, oldest first",
+                      {
+                          {RPCResult::Type::OBJ,
+                           "",
+                           "",
+                           {
+                               {RPCResult::Type::NUM_TIME, "time",
+                                "The " + UNIX_EPOCH_TIME +
+                                    " of the end of the interval"},
+                               {RPCResult::Type::NUM, "bytesrecv",
+                                "The bytes received during the interval"},
+                               {RPCResult::Type::NUM, "bytessent",
+                                "The bytes sent during the interval"},
+                               {RPCResult::Type::NUM, "sendqueue",
+                                "The bytes waiting to be sent"},
+                               {RPCResult::Type::NUM, "processqueue",
+                                "The bytes waiting to be processed"},
+                               {RPCResult::Type::NUM, "blocksserved",
+                                "The number of blocks served"},
+                               {RPCResult::Type::NUM, "blockservingtime",
+                                "The time spent serving blocks, in "
+                                "microseconds"},
+                               {RPCResult::Type::OBJ_DYN,
+                                "msgtypes",
+                                "The message types with some activity",
+                                {
+                                    {RPCResult::Type::OBJ,
+                                     "msg",
+                                     "",
+                                     {
+                                         {RPCResult::Type::NUM, "bytesrecv",
+                                          "The bytes received"},
+                                         {RPCResult::Type::NUM, "bytessent",
+                                          "The bytes queued for sending"},
+                                         {RPCResult::Type::NUM, "processed",
+                                          "The number of messages processed"},
+                                         {RPCResult::Type::NUM,
+                                          "processingtime",
+                                          "The time spent processing them, "
+                                          "in microseconds"},
+                                     }},
+                                }},
+                           }},
+                      }},
+                 }},
+            }},
+        RPCExamples{HelpExampleCli("getpeertelemetry", "") +
+                    HelpExampleCli("getpeertelemetry", "0 10") +
+                    HelpExampleRpc("getpeertelemetry", "0, 10")},
+    }
+        .Check(request);
+
+    NodeContext &node = EnsureNodeContext(request.context);
+    if (!node.connman) {
+        throw JSONRPCError(
+            RPC_CLIENT_P2P_DISABLED,
+            "Error: Peer-to-peer functionality missing or disabled");
+    }
+
+    size_t count = PEER_TELEMETRY_SAMPLES;
+    if (!request.params[1].isNull()) {
+        const int n = request.params[1].get_int();
+        if (n < 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER,
+                               "Sample count out of range");
+        }
+        count = n;
+    }
+
+    std::vector<CNodeTelemetry> vtelemetry;
+    node.connman->GetNodeTelemetry(vtelemetry, count);
+
+    UniValue ret(UniValue::VARR);
+    for (const CNodeTelemetry &telemetry : vtelemetry) {
+        if (!request.params[0].isNull() &&
+            telemetry.nodeid != request.params[0].get_int64()) {
+            continue;
+        }
+
+        UniValue samples(UniValue::VARR);
+        for (const PeerTelemetrySample &sample : telemetry.samples) {
+            UniValue msg_types(UniValue::VOBJ);
+            for (const auto &entry : sample.msg_types) {
+                UniValue msg_type(UniValue::VOBJ);
+                msg_type.pushKV("bytesrecv", entry.second.bytes_recv);
+                msg_type.pushKV("bytessent", entry.second.bytes_sent);
+                msg_type.pushKV("processed", entry.second.processed);
+                msg_type.pushKV("processingtime",
+                                entry.second.processing_time_usec);
+                msg_types.pushKV(entry.first, msg_type);
+            }
+
+            UniValue obj(UniValue::VOBJ);
+            obj.pushKV("time", sample.time);
+            obj.pushKV("bytesrecv", sample.bytes_recv);
+            obj.pushKV("bytessent", sample.bytes_sent);
+            obj.pushKV("sendqueue", uint64_t(sample.send_queue_size));
+            obj.pushKV("processqueue", uint64_t(sample.process_queue_size));
+            obj.pushKV("blocksserved", sample.blocks_served);
+            obj.pushKV("blockservingtime", sample.block_serving_time_usec);
+            obj.pushKV("msgtypes", msg_types);
+            samples.push_back(obj);
+        }
+
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("id", telemetry.nodeid);
+        obj.pushKV("addr", telemetry.addrName);
+        obj.pushKV("samples", samples);
+        ret.push_back(obj);
+    }
+    return ret;
+}
+
+static UniValue getblockdownloadinfo(const Config &config,
+                                     const JSONRPCRequest &request) {
+    RPCHelpMan{
+        "getblockdownloadinfo",
+        "Returns the state of the block download scheduler, which sizes the "
+        "number of blocks in flight from each peer according to its "
+        "throughput and requests the blocks holding back validation from a "
+        "second peer when the first one is too slow.\n",
+        {},
+        RPCResult{
+            RPCResult::Type::OBJ,
+            "",
+            "",
+            {
+                {RPCResult::Type::NUM, "inflight",
+                 "The number of blocks in flight"},
+                {RPCResult::Type::NUM, "duplicated",
+                 "The number of blocks in flight from two peers"},
+                {RPCResult::Type::NUM, "duplicaterequests",
+                 "The number of blocks requested from a second peer"},
+                {RPCResult::Type::NUM, "duplicatewins",
+                 "The number of these blocks received from the second peer "
+                 "first"},
+                {RPCResult::Type::ARR,
+                 "peers",
+                 "The peers blocks were requested from",
+                 {
+                     {RPCResult::Type::OBJ,
+                      "",
+                      "",
+                      {
+                          {RPCResult::Type::NUM, "id", "Peer index"},
+                          {RPCResult::Type::NUM, "window",
+                           "How many blocks may be in flight from the peer"},
+                          {RPCResult::Type::NUM, "inflight",
+                           "The number of blocks in flight from the peer"},
+                          {RPCResult::Type::NUM, "blockinterval",
+                           "The average time the peer takes to deliver a "
+                           "block, in microseconds, 0 if unknown"},
+                          {RPCResult::Type::NUM, "blocksreceived",
+                           "The number of requested blocks received from the "
+                           "peer"},
+                      }},
+                 }},
+            }},
+        RPCExamples{HelpExampleCli("getblockdownloadinfo", "") +
+                    HelpExampleRpc("getblockdownloadinfo", "")},
+    }
+        .Check(request);
+
+    BlockDownloadScheduler::Stats stats;
+    g_block_download.GetStats(stats);
+
+    UniValue peers(UniValue::VARR);
+    for (const BlockDownloadScheduler::PeerStats &peer : stats.peers) {
+        UniValue obj(UniValue::VOBJ);
+        obj.pushKV("id", peer.id);
+        obj.pushKV("window", uint64_t(peer.window));
+        obj.pushKV("inflight", uint64_t(peer.in_flight));
+        obj.pushKV("blockinterval", int64_t(peer.block_interval.count()));
+        obj.pushKV("blocksreceived", peer.blocks_received);
+        peers.push_back(obj);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("inflight", uint64_t(stats.in_flight));
+    ret.pushKV("duplicated", uint64_t(stats.duplicated));
+    ret.pushKV("duplicaterequests", stats.duplicate_requests);
+    ret.pushKV("duplicatewins", stats.duplicate_wins);
+    ret.pushKV("peers", peers);
+    return ret;
+}
+
 void RegisterNetRPCCommands(CRPCTable &t) {
     // clang-format off
     static const CRPCCommand commands[] = {
@@ -960,6 +1197,8 @@ void RegisterNetRPCCommands(CRPCTable &t) {
         { "network",            "getconnectioncount",     getconnectioncount,     {} },
         { "network",            "ping",                   ping,                   {} },
         { "network",            "getpeerinfo",            getpeerinfo,            {} },
+        { "network",            "getpeertelemetry",       getpeertelemetry,       {"nodeid", "count"} },
+        { "network",            "getblockdownloadinfo",   getblockdownloadinfo,   {} },
         { "network",            "addnode",                addnode,                {"node","command"} },
         { "network",            "disconnectnode",         disconnectnode,         {"address", "nodeid"} },
         { "network",            "getaddednodeinfo",       getaddednodeinfo,       {"node"} },
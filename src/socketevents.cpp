@@ -0,0 +1,137 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <socketevents.h>
+
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
+#include <cassert>
+#include <cerrno>
+
+/** Maximum number of events returned by a single wait */
+static constexpr int MAX_EPOLL_EVENTS = 256;
+
+bool ParseSocketEventsMode(const std::string &str, SocketEventsMode &mode) {
+#ifdef USE_EPOLL
+    if (str == "epoll") {
+        mode = SocketEventsMode::EPOLL;
+        return true;
+    }
+#endif
+#ifdef USE_POLL
+    if (str == "poll") {
+        mode = SocketEventsMode::POLL;
+        return true;
+    }
+#else
+    if (str == "select") {
+        mode = SocketEventsMode::SELECT;
+        return true;
+    }
+#endif
+    return false;
+}
+
+std::string SocketEventsModeToString(SocketEventsMode mode) {
+    switch (mode) {
+        case SocketEventsMode::SELECT:
+            return "select";
+        case SocketEventsMode::POLL:
+            return "poll";
+        case SocketEventsMode::EPOLL:
+            return "epoll";
+    }
+    assert(false);
+}
+
+std::vector<std::string> GetSupportedSocketEventsModes() {
+    std::vector<std::string> modes;
+#ifdef USE_POLL
+    modes.push_back("poll");
+#else
+    modes.push_back("select");
+#endif
+#ifdef USE_EPOLL
+    modes.push_back("epoll");
+#endif
+    return modes;
+}
+
+SocketEventsMode GetDefaultSocketEventsMode() {
+#if defined(USE_EPOLL)
+    return SocketEventsMode::EPOLL;
+#elif defined(USE_POLL)
+    return SocketEventsMode::POLL;
+#else
+    return SocketEventsMode::SELECT;
+#endif
+}
+
+#ifdef USE_EPOLL
+EpollSocketEvents::EpollSocketEvents() : m_fd(epoll_create1(EPOLL_CLOEXEC)) {}
+
+EpollSocketEvents::~EpollSocketEvents() {
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+bool EpollSocketEvents::IsValid() const {
+    return m_fd >= 0;
+}
+
+bool EpollSocketEvents::Add(SOCKET socket, uint64_t id) {
+    struct epoll_event event {};
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.u64 = id;
+    return epoll_ctl(m_fd, EPOLL_CTL_ADD, socket, &event) == 0;
+}
+
+bool EpollSocketEvents::Remove(SOCKET socket) {
+    // A non-null event is required by kernels older than 2.6.9.
+    struct epoll_event event {};
+    return epoll_ctl(m_fd, EPOLL_CTL_DEL, socket, &event) == 0;
+}
+
+bool EpollSocketEvents::Wait(std::vector<Event> &events, int timeout_ms) {
+    events.clear();
+
+    struct epoll_event epoll_events[MAX_EPOLL_EVENTS];
+    int n = epoll_wait(m_fd, epoll_events, MAX_EPOLL_EVENTS, timeout_ms);
+    if (n < 0) {
+        return errno == EINTR;
+    }
+
+    events.reserve(n);
+    for (int i = 0; i < n; i++) {
+        const uint32_t flags = epoll_events[i].events;
+        events.push_back({epoll_events[i].data.u64, (flags & EPOLLIN) != 0,
+                          (flags & EPOLLOUT) != 0,
+                          (flags & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) != 0});
+    }
+    return true;
+}
+#else
+EpollSocketEvents::EpollSocketEvents() {}
+EpollSocketEvents::~EpollSocketEvents() {}
+
+bool EpollSocketEvents::IsValid() const {
+    return false;
+}
+
+bool EpollSocketEvents::Add(SOCKET socket, uint64_t id) {
+    return false;
+}
+
+bool EpollSocketEvents::Remove(SOCKET socket) {
+    return false;
+}
+
+bool EpollSocketEvents::Wait(std::vector<Event> &events, int timeout_ms) {
+    events.clear();
+    return false;
+}
+#endif
@@ -0,0 +1,75 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SOCKETEVENTS_H
+#define BITCOIN_SOCKETEVENTS_H
+
+#include <compat.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** The mechanisms available to wait for socket events */
+enum class SocketEventsMode {
+    SELECT,
+    POLL,
+    EPOLL,
+};
+
+/** Return the mode matching a -socketevents value, false if not supported */
+bool ParseSocketEventsMode(const std::string &str, SocketEventsMode &mode);
+std::string SocketEventsModeToString(SocketEventsMode mode);
+/** Return the -socketevents values supported on this platform */
+std::vector<std::string> GetSupportedSocketEventsModes();
+SocketEventsMode GetDefaultSocketEventsMode();
+
+/**
+ * A persistent, edge-triggered set of sockets to wait on (epoll).
+ *
+ * Unlike select() and poll(), the sockets are registered once and for all
+ * rather than at each wait, so that the cost of a wait is proportional to the
+ * number of sockets having events rather than to the number of sockets. Each
+ * socket is identified by an opaque id supplied at registration time.
+ *
+ * Being edge-triggered, an event is only reported when the state of a socket
+ * changes: the owner is expected to read from a socket until it would block
+ * (or remember that it did not) before waiting for further receive events,
+ * and likewise for sending.
+ *
+ * A socket is removed automatically when it is closed. On platforms without
+ * epoll, IsValid() is always false.
+ */
+class EpollSocketEvents {
+public:
+    struct Event {
+        uint64_t id;
+        bool recv;
+        bool send;
+        bool error;
+    };
+
+    EpollSocketEvents();
+    ~EpollSocketEvents();
+
+    EpollSocketEvents(const EpollSocketEvents &) = delete;
+    EpollSocketEvents &operator=(const EpollSocketEvents &) = delete;
+
+    bool IsValid() const;
+
+    /** Register a socket for receive, send and error events */
+    bool Add(SOCKET socket, uint64_t id);
+    bool Remove(SOCKET socket);
+
+    /**
+     * Wait up to timeout_ms milliseconds for events, and replace the content
+     * of events with them. Returns false on error.
+     */
+    bool Wait(std::vector<Event> &events, int timeout_ms);
+
+private:
+    int m_fd{-1};
+};
+
+#endif // BITCOIN_SOCKETEVENTS_H
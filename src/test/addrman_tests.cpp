@@ -14,6 +14,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include <string>
+#include <thread>
 
 class CAddrManTest : public CAddrMan {
 private:
@@ -32,30 +33,35 @@ public:
 
     //! Ensure that bucket placement is always the same for testing purposes.
     void MakeDeterministic() {
+        LOCK(m_rand_mutex);
+        ShardLock lock(*this, ALL_SHARDS);
         nKey.SetNull();
         insecure_rand = FastRandomContext(true);
     }
 
     CAddrInfo *Find(const CNetAddr &addr, int *pnId = nullptr) {
-        LOCK(cs);
+        ShardLock lock(*this, ALL_SHARDS);
         return CAddrMan::Find(addr, pnId);
     }
 
     CAddrInfo *Create(const CAddress &addr, const CNetAddr &addrSource,
                       int *pnId = nullptr) {
-        LOCK(cs);
+        ShardLock lock(*this, ALL_SHARDS);
         return CAddrMan::Create(addr, addrSource, pnId);
     }
 
     void Delete(int nId) {
-        LOCK(cs);
+        ShardLock lock(*this, ALL_SHARDS);
         CAddrMan::Delete(nId);
     }
 
     // Used to test deserialization
     std::pair<int, int> GetBucketAndEntry(const CAddress &addr) {
-        LOCK(cs);
-        int nId = mapAddr[addr];
+        ShardLock lock(*this, ALL_SHARDS);
+        int nId;
+        if (!CAddrMan::Find(addr, &nId)) {
+            return std::pair<int, int>(-1, -1);
+        }
         for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; ++bucket) {
             for (int entry = 0; entry < ADDRMAN_BUCKET_SIZE; ++entry) {
                 if (nId == vvNew[bucket][entry]) {
@@ -66,13 +72,36 @@ public:
         return std::pair<int, int>(-1, -1);
     }
 
+    //! Return the address at each position of the tables, and the number of
+    //! positions used in each of them.
+    std::vector<std::string> GetTables(int &nNewRefs, int &nTriedRefs) {
+        ShardLock lock(*this, ALL_SHARDS);
+        std::vector<std::string> tables;
+        nNewRefs = 0;
+        nTriedRefs = 0;
+        for (int bucket = 0; bucket < ADDRMAN_NEW_BUCKET_COUNT; ++bucket) {
+            for (int entry = 0; entry < ADDRMAN_BUCKET_SIZE; ++entry) {
+                const int nId = vvNew[bucket][entry];
+                tables.push_back(nId == -1 ? "" : GetInfo(nId).ToString());
+                nNewRefs += nId == -1 ? 0 : 1;
+            }
+        }
+        for (int bucket = 0; bucket < ADDRMAN_TRIED_BUCKET_COUNT; ++bucket) {
+            for (int entry = 0; entry < ADDRMAN_BUCKET_SIZE; ++entry) {
+                const int nId = vvTried[bucket][entry];
+                tables.push_back(nId == -1 ? "" : GetInfo(nId).ToString());
+                nTriedRefs += nId == -1 ? 0 : 1;
+            }
+        }
+        return tables;
+    }
+
     // Simulates connection failure so that we can test eviction of offline
     // nodes
     void SimConnFail(CService &addr) {
-        LOCK(cs);
         int64_t nLastSuccess = 1;
         // Set last good connection in the deep past.
-        Good_(addr, true, nLastSuccess);
+        Good(addr, true, nLastSuccess);
 
         bool count_failure = false;
         int64_t nLastTry = GetAdjustedTime() - 61;
@@ -82,8 +111,7 @@ public:
     void Clear() {
         CAddrMan::Clear();
         if (deterministic) {
-            nKey.SetNull();
-            insecure_rand = FastRandomContext(true);
+            MakeDeterministic();
         }
     }
 };
@@ -432,6 +460,57 @@ BOOST_AUTO_TEST_CASE(addrman_getaddr) {
     BOOST_CHECK_EQUAL(addrman.size(), 2006U);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_concurrent) {
+    CAddrManTest addrman;
+    CNetAddr source = ResolveIP("252.2.2.2");
+    std::vector<CAddress> vAddr;
+    for (int i = 0; i < 4 * 256; i++) {
+        CAddress addr = CAddress(
+            ResolveService(strprintf("250.%i.%i.1", i % 256, i / 256), 8333),
+            NODE_NONE);
+        addr.nTime = GetAdjustedTime();
+        vAddr.push_back(addr);
+    }
+
+    // Test: Addresses can be added from several threads while others are
+    // selected and marked good.
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&addrman, &vAddr, &source, t] {
+            for (int i = t * 256; i < (t + 1) * 256; i++) {
+                addrman.Add(vAddr[i], source);
+            }
+        });
+    }
+    threads.emplace_back([&addrman, &vAddr] {
+        for (int i = 0; i < 4 * 256; i++) {
+            addrman.Select();
+            if (i % 8 == 0) {
+                addrman.Good(vAddr[i]);
+            }
+        }
+    });
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    // Test: The entry count matches the entries which can be found.
+    size_t found = 0;
+    for (const CAddress &addr : vAddr) {
+        found += addrman.Find(addr) ? 1 : 0;
+    }
+    BOOST_CHECK(found > 0);
+    BOOST_CHECK_EQUAL(addrman.size(), found);
+    BOOST_CHECK(addrman.Select().IsValid());
+
+    // Test: The tables are consistent once serialized.
+    CDataStream ssPeers(SER_DISK, CLIENT_VERSION);
+    ssPeers << addrman;
+    CAddrManTest addrman2;
+    ssPeers >> addrman2;
+    BOOST_CHECK_EQUAL(addrman2.size(), addrman.size());
+}
+
 BOOST_AUTO_TEST_CASE(caddrinfo_get_tried_bucket_legacy) {
     CAddrManTest addrman;
 
@@ -788,6 +867,53 @@ BOOST_AUTO_TEST_CASE(addrman_serialization) {
                 bucketAndEntry_asmap1_deser_addr2.second);
 }
 
+BOOST_AUTO_TEST_CASE(addrman_serialization_positions) {
+    CAddrManTest addrman;
+    for (int i = 0; i < 2048; i++) {
+        CAddress addr = CAddress(
+            ResolveService(strprintf("250.%i.%i.1", i % 256, i / 256), 8333),
+            NODE_NONE);
+        addr.nTime = GetAdjustedTime();
+        addrman.Add(addr, ResolveIP(strprintf("251.%i.1.1", i % 64)));
+        if (i % 8 == 0) {
+            addrman.Good(addr);
+        }
+    }
+    int nNewRefs;
+    int nTriedRefs;
+    const std::vector<std::string> tables =
+        addrman.GetTables(nNewRefs, nTriedRefs);
+    BOOST_CHECK(nNewRefs > 0);
+    BOOST_CHECK(nTriedRefs > 0);
+
+    // Test: The entries are loaded at the same positions.
+    CDataStream stream(SER_DISK, CLIENT_VERSION);
+    stream << addrman;
+    CDataStream stream_v2(stream);
+    CAddrManTest addrman2;
+    stream >> addrman2;
+    int nNewRefs2;
+    int nTriedRefs2;
+    BOOST_CHECK(addrman2.GetTables(nNewRefs2, nTriedRefs2) == tables);
+    BOOST_CHECK_EQUAL(addrman2.size(), addrman.size());
+
+    // Test: The previous version of the format, without the positions which
+    // are appended to it, is still supported.
+    stream_v2[0] = 2;
+    stream_v2.resize(stream_v2.size() - 2 * sizeof(int) -
+                     nNewRefs * sizeof(int) - nTriedRefs * 2 * sizeof(int));
+    CAddrManTest addrman3;
+    stream_v2 >> addrman3;
+    BOOST_CHECK(stream_v2.empty());
+    BOOST_CHECK(addrman3.GetTables(nNewRefs2, nTriedRefs2) == tables);
+
+    // Test: Positions out of the buckets are rejected.
+    stream << addrman;
+    stream[stream.size() - 1] = 0x7f;
+    CAddrManTest addrman4;
+    BOOST_CHECK_THROW(stream >> addrman4, std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_CASE(addrman_selecttriedcollision) {
     CAddrManTest addrman;
 
@@ -0,0 +1,106 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bandwidthshaper.h>
+
+#include <protocol.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <limits>
+
+BOOST_FIXTURE_TEST_SUITE(bandwidthshaper_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(token_bucket) {
+    TokenBucket bucket;
+    BOOST_CHECK(!bucket.IsLimited());
+    BOOST_CHECK_EQUAL(bucket.GetAvailable(0),
+                      std::numeric_limits<uint64_t>::max());
+
+    // 1000 bytes per second, with bursts of up to 2000 bytes.
+    bucket.SetRate(1000, 2000);
+    BOOST_CHECK(bucket.IsLimited());
+    const int64_t start = 1000000000;
+    BOOST_CHECK_EQUAL(bucket.GetAvailable(start), 2000U);
+
+    bucket.Consume(1500, start);
+    BOOST_CHECK_EQUAL(bucket.GetAvailable(start), 500U);
+    // Half a second later, 500 bytes have been added.
+    BOOST_CHECK_EQUAL(bucket.GetAvailable(start + 500000), 1000U);
+    // The level is capped to the burst size.
+    BOOST_CHECK_EQUAL(bucket.GetAvailable(start + 10000000), 2000U);
+
+    // Overspending is paid back before anything can be sent again.
+    bucket.Consume(3000, start + 10000000);
+    BOOST_CHECK_EQUAL(bucket.GetAvailable(start + 10000000), 0U);
+    BOOST_CHECK_EQUAL(bucket.GetAvailable(start + 10500000), 0U);
+    BOOST_CHECK_EQUAL(bucket.GetAvailable(start + 11500000), 500U);
+
+    // Time going backwards does not add anything.
+    BOOST_CHECK_EQUAL(bucket.GetAvailable(start), 500U);
+}
+
+BOOST_AUTO_TEST_CASE(shaper_classes) {
+    BandwidthShaper shaper;
+    BOOST_CHECK(!shaper.IsActive());
+
+    shaper.SetRate(TrafficClass::HISTORICAL_BLOCKS, 10000);
+    BOOST_CHECK(shaper.IsActive());
+    BOOST_CHECK_EQUAL(shaper.GetRate(TrafficClass::HISTORICAL_BLOCKS), 10000U);
+    BOOST_CHECK_EQUAL(shaper.GetRate(TrafficClass::TRANSACTIONS), 0U);
+
+    const size_t historical =
+        static_cast<size_t>(TrafficClass::HISTORICAL_BLOCKS);
+    const size_t transactions = static_cast<size_t>(TrafficClass::TRANSACTIONS);
+    const int64_t start = 1000000000;
+
+    BandwidthShaper::ByteCounts available = shaper.GetAvailable(start);
+    BOOST_CHECK_EQUAL(available[historical], 10000U);
+    BOOST_CHECK_EQUAL(available[transactions],
+                      std::numeric_limits<uint64_t>::max());
+
+    // Sending historical blocks does not affect the other classes.
+    BandwidthShaper::ByteCounts sent{};
+    sent[historical] = 10000;
+    sent[transactions] = 100000;
+    shaper.Consume(sent, start);
+    available = shaper.GetAvailable(start);
+    BOOST_CHECK_EQUAL(available[historical], 0U);
+    BOOST_CHECK_EQUAL(available[transactions],
+                      std::numeric_limits<uint64_t>::max());
+    available = shaper.GetAvailable(start + 100000);
+    BOOST_CHECK_EQUAL(available[historical], 1000U);
+
+    shaper.SetRate(TrafficClass::HISTORICAL_BLOCKS, 0);
+    BOOST_CHECK(!shaper.IsActive());
+}
+
+BOOST_AUTO_TEST_CASE(traffic_classes) {
+    BOOST_CHECK(GetTrafficClass(NetMsgType::BLOCK) ==
+                TrafficClass::RECENT_BLOCKS);
+    BOOST_CHECK(GetTrafficClass(NetMsgType::CMPCTBLOCK) ==
+                TrafficClass::RECENT_BLOCKS);
+    BOOST_CHECK(GetTrafficClass(NetMsgType::TX) == TrafficClass::TRANSACTIONS);
+    BOOST_CHECK(GetTrafficClass(NetMsgType::INV) == TrafficClass::TRANSACTIONS);
+    BOOST_CHECK(GetTrafficClass(NetMsgType::ADDR) == TrafficClass::ADDR);
+    BOOST_CHECK(GetTrafficClass(NetMsgType::CFILTER) == TrafficClass::FILTERS);
+    BOOST_CHECK(GetTrafficClass(NetMsgType::AVAPOLL) ==
+                TrafficClass::AVALANCHE);
+    BOOST_CHECK(GetTrafficClass(NetMsgType::PING) == TrafficClass::OTHER);
+    BOOST_CHECK(GetTrafficClass(NetMsgType::HEADERS) == TrafficClass::OTHER);
+
+    for (size_t i = 0; i < NUM_TRAFFIC_CLASSES; i++) {
+        const TrafficClass c = static_cast<TrafficClass>(i);
+        TrafficClass parsed;
+        BOOST_CHECK(ParseTrafficClass(TrafficClassToString(c), parsed));
+        BOOST_CHECK(parsed == c);
+    }
+    TrafficClass parsed;
+    BOOST_CHECK(!ParseTrafficClass("blocks", parsed));
+    BOOST_CHECK(!ParseTrafficClass("", parsed));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
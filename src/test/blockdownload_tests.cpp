@@ -0,0 +1,124 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockdownload.h>
+
+#include <validation.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std::chrono_literals;
+
+BOOST_FIXTURE_TEST_SUITE(blockdownload_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(window) {
+    BlockDownloadScheduler scheduler;
+    const BlockHash hashes[] = {BlockHash(InsecureRand256()),
+                                BlockHash(InsecureRand256()),
+                                BlockHash(InsecureRand256())};
+    std::chrono::microseconds now{1000000000};
+
+    // Unknown peers get the default window.
+    BOOST_CHECK_EQUAL(scheduler.GetWindow(0), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+
+    // A fast peer: the second block is only counted from the time the first
+    // one was received.
+    scheduler.BlockRequested(0, hashes[0], now);
+    scheduler.BlockRequested(0, hashes[1], now);
+    BOOST_CHECK(scheduler.BlockReceived(0, hashes[0], now + 10ms));
+    BOOST_CHECK_EQUAL(scheduler.GetWindow(0),
+                      MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER);
+    BOOST_CHECK(scheduler.BlockReceived(0, hashes[1], now + 20ms));
+    BOOST_CHECK(!scheduler.BlockReceived(0, hashes[1], now + 30ms));
+
+    // A slow peer.
+    scheduler.BlockRequested(1, hashes[2], now);
+    BOOST_CHECK(scheduler.BlockReceived(1, hashes[2], now + 1s));
+    BOOST_CHECK_EQUAL(scheduler.GetWindow(1), 5U);
+
+    // The interval is a moving average.
+    scheduler.BlockRequested(1, hashes[2], now);
+    BOOST_CHECK(scheduler.BlockReceived(1, hashes[2], now + 5s));
+    BOOST_CHECK_EQUAL(scheduler.GetWindow(1), 2U);
+    scheduler.BlockRequested(1, hashes[2], now);
+    BOOST_CHECK(scheduler.BlockReceived(1, hashes[2], now + 10s));
+    BOOST_CHECK_EQUAL(scheduler.GetWindow(1), MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+
+    BlockDownloadScheduler::Stats stats;
+    scheduler.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.in_flight, 0U);
+    BOOST_CHECK_EQUAL(stats.peers.size(), 2U);
+    BOOST_CHECK_EQUAL(stats.peers[0].blocks_received, 2U);
+    BOOST_CHECK(stats.peers[0].block_interval == 10ms);
+    BOOST_CHECK_EQUAL(stats.peers[1].blocks_received, 3U);
+
+    // Forgotten peers start over.
+    scheduler.ForgetPeer(1);
+    BOOST_CHECK_EQUAL(scheduler.GetWindow(1), MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+}
+
+BOOST_AUTO_TEST_CASE(duplicate_requests) {
+    BlockDownloadScheduler scheduler;
+    const BlockHash hash(InsecureRand256());
+    const BlockHash other_hash(InsecureRand256());
+    std::chrono::microseconds now{1000000000};
+
+    // Peer 0 takes 2 seconds per block, peer 1 is faster.
+    scheduler.BlockRequested(0, other_hash, now);
+    scheduler.BlockReceived(0, other_hash, now + 2s);
+    scheduler.BlockRequested(1, other_hash, now);
+    scheduler.BlockReceived(1, other_hash, now + 100ms);
+    scheduler.BlockRequested(2, other_hash, now);
+    scheduler.BlockReceived(2, other_hash, now + 5s);
+
+    now += 10s;
+    BOOST_CHECK(!scheduler.ShouldRequestDuplicate(1, hash, now));
+    scheduler.BlockRequested(0, hash, now);
+    BOOST_CHECK(!scheduler.ShouldRequestDuplicate(0, hash, now + 10s));
+    // Peer 0 is given twice its usual time.
+    BOOST_CHECK(!scheduler.ShouldRequestDuplicate(1, hash, now + 3s));
+    BOOST_CHECK(scheduler.ShouldRequestDuplicate(1, hash, now + 4s));
+    BOOST_CHECK(scheduler.ShouldRequestDuplicate(3, hash, now + 4s));
+    // Peer 2 would not be faster.
+    BOOST_CHECK(!scheduler.ShouldRequestDuplicate(2, hash, now + 4s));
+    BOOST_CHECK(scheduler.ShouldRequestDuplicate(2, hash, now + 6s));
+
+    // The block is only requested from two peers.
+    scheduler.BlockRequested(1, hash, now + 4s);
+    BOOST_CHECK(!scheduler.ShouldRequestDuplicate(3, hash, now + 10s));
+
+    BlockDownloadScheduler::Stats stats;
+    scheduler.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.in_flight, 1U);
+    BOOST_CHECK_EQUAL(stats.duplicated, 1U);
+    BOOST_CHECK_EQUAL(stats.duplicate_requests, 1U);
+    BOOST_CHECK_EQUAL(stats.duplicate_wins, 0U);
+
+    // The duplicate wins, and the first request is cancelled.
+    BOOST_CHECK(scheduler.BlockReceived(1, hash, now + 4100ms));
+    BOOST_CHECK(!scheduler.BlockReceived(0, hash, now + 5s));
+    scheduler.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.in_flight, 0U);
+    BOOST_CHECK_EQUAL(stats.duplicate_wins, 1U);
+    BOOST_CHECK_EQUAL(stats.peers[0].in_flight, 0U);
+
+    // A block which is no longer expected is cancelled from every peer.
+    scheduler.BlockRequested(0, hash, now);
+    scheduler.BlockRequested(1, hash, now);
+    BOOST_CHECK(!scheduler.BlockReceived(-1, hash, now));
+    scheduler.GetStats(stats);
+    BOOST_CHECK_EQUAL(stats.in_flight, 0U);
+
+    // Disconnected peers are forgotten, a duplicate is needed again.
+    scheduler.BlockRequested(0, hash, now);
+    scheduler.BlockRequested(1, hash, now);
+    scheduler.ForgetPeer(1);
+    BOOST_CHECK(scheduler.ShouldRequestDuplicate(1, hash, now + 10s));
+    scheduler.ForgetPeer(0);
+    BOOST_CHECK(!scheduler.ShouldRequestDuplicate(1, hash, now + 10s));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
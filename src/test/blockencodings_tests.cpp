@@ -15,6 +15,8 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
+
 static std::vector<std::pair<TxHash, CTransactionRef>> extra_txn;
 
 BOOST_FIXTURE_TEST_SUITE(blockencodings_tests, RegTestingSetup)
@@ -397,6 +399,187 @@ BOOST_AUTO_TEST_CASE(EmptyBlockRoundTripTest) {
     }
 }
 
+BOOST_AUTO_TEST_CASE(LargeMempoolRoundTripTest) {
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42 * SATOSHI;
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(tx));
+    block.nVersion = 42;
+    block.hashPrevBlock = BlockHash(InsecureRand256());
+    block.nBits = 0x207fffff;
+
+    // Enough transactions that their short ids are computed in several
+    // batches, some of them in the mempool and the others in extra_txn, among
+    // many transactions which are not in the block.
+    std::vector<std::pair<TxHash, CTransactionRef>> extra;
+    LOCK2(cs_main, pool.cs);
+    for (size_t i = 0; i < 1000; i++) {
+        tx.vin[0].prevout = InsecureRandOutPoint();
+        const CTransactionRef ref = MakeTransactionRef(tx);
+        if (i % 5 != 0) {
+            pool.addUnchecked(entry.FromTx(ref));
+            continue;
+        }
+        block.vtx.push_back(ref);
+        if (i % 3 == 0) {
+            extra.emplace_back(ref->GetHash(), ref);
+        } else {
+            pool.addUnchecked(entry.FromTx(ref));
+        }
+    }
+
+    bool mutated;
+    block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    assert(!mutated);
+
+    GlobalConfig config;
+    const Consensus::Params &params = config.GetChainParams().GetConsensus();
+    while (!CheckProofOfWork(block.GetHash(), block.nBits, params)) {
+        ++block.nNonce;
+    }
+
+    CBlockHeaderAndShortTxIDs shortIDs(block);
+    PartiallyDownloadedBlock partialBlock(GetConfig(), &pool);
+    BOOST_CHECK(partialBlock.InitData(shortIDs, extra) == READ_STATUS_OK);
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        BOOST_CHECK(partialBlock.IsTxAvailable(i));
+    }
+
+    CBlock block2;
+    std::vector<CTransactionRef> vtx_missing;
+    BOOST_CHECK(partialBlock.FillBlock(block2, vtx_missing) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block.GetHash().ToString(), block2.GetHash().ToString());
+    BOOST_CHECK_EQUAL(block.hashMerkleRoot.ToString(),
+                      BlockMerkleRoot(block2, &mutated).ToString());
+    BOOST_CHECK(!mutated);
+}
+
+/**
+ * Build a block in canonical order with the given number of transactions
+ * besides the coinbase
+ */
+static CBlock BuildCanonicalBlock(size_t tx_count) {
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig.resize(10);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 42 * SATOSHI;
+
+    CBlock block;
+    block.vtx.push_back(MakeTransactionRef(tx));
+    block.nVersion = 42;
+    block.hashPrevBlock = BlockHash(InsecureRand256());
+    block.nBits = 0x207fffff;
+    for (size_t i = 0; i < tx_count; i++) {
+        tx.vin[0].prevout = InsecureRandOutPoint();
+        block.vtx.push_back(MakeTransactionRef(tx));
+    }
+    std::sort(block.vtx.begin() + 1, block.vtx.end(),
+              [](const CTransactionRef &a, const CTransactionRef &b) {
+                  return a->GetId() < b->GetId();
+              });
+
+    bool mutated;
+    block.hashMerkleRoot = BlockMerkleRoot(block, &mutated);
+    assert(!mutated);
+
+    GlobalConfig config;
+    const Consensus::Params &params = config.GetChainParams().GetConsensus();
+    while (!CheckProofOfWork(block.GetHash(), block.nBits, params)) {
+        ++block.nNonce;
+    }
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(GrapheneRoundTripTest) {
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    const CBlock block = BuildCanonicalBlock(300);
+    BOOST_CHECK(CGrapheneBlock::CanEncode(block));
+
+    // Most of the transactions of the block are in the mempool, along with
+    // many others, some of them are in extra_txn, and a few are missing.
+    std::vector<std::pair<TxHash, CTransactionRef>> extra;
+    std::vector<size_t> missing;
+    LOCK2(cs_main, pool.cs);
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        if (i % 100 == 0) {
+            missing.push_back(i);
+        } else if (i % 10 == 0) {
+            extra.emplace_back(block.vtx[i]->GetHash(), block.vtx[i]);
+        } else {
+            pool.addUnchecked(entry.FromTx(block.vtx[i]));
+        }
+    }
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    for (size_t i = 0; i < 3000; i++) {
+        tx.vin[0].prevout = InsecureRandOutPoint();
+        pool.addUnchecked(entry.FromTx(tx));
+    }
+
+    CGrapheneBlock grblock(block, pool.size());
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << grblock;
+    CGrapheneBlock grblock2;
+    stream >> grblock2;
+
+    PartiallyDownloadedBlock partialBlock(GetConfig(), &pool);
+    BOOST_CHECK(partialBlock.InitData(grblock2, extra) == READ_STATUS_OK);
+    std::vector<CTransactionRef> vtx_missing;
+    for (size_t i = 0; i < block.vtx.size(); i++) {
+        const bool is_missing =
+            std::find(missing.begin(), missing.end(), i) != missing.end();
+        BOOST_CHECK_EQUAL(partialBlock.IsTxAvailable(i), !is_missing);
+        if (is_missing) {
+            vtx_missing.push_back(block.vtx[i]);
+        }
+    }
+
+    CBlock block2;
+    BOOST_CHECK(partialBlock.FillBlock(block2, vtx_missing) == READ_STATUS_OK);
+    BOOST_CHECK_EQUAL(block.GetHash().ToString(), block2.GetHash().ToString());
+    bool mutated;
+    BOOST_CHECK_EQUAL(block.hashMerkleRoot.ToString(),
+                      BlockMerkleRoot(block2, &mutated).ToString());
+    BOOST_CHECK(!mutated);
+}
+
+BOOST_AUTO_TEST_CASE(GrapheneFailureTest) {
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    const CBlock block = BuildCanonicalBlock(300);
+
+    // Blocks which are not in canonical order cannot be encoded.
+    CBlock unordered = block;
+    std::swap(unordered.vtx[1], unordered.vtx[2]);
+    BOOST_CHECK(!CGrapheneBlock::CanEncode(unordered));
+
+    // Too many transactions are missing for the IBLT to list them.
+    LOCK2(cs_main, pool.cs);
+    for (size_t i = 1; i < block.vtx.size(); i += 2) {
+        pool.addUnchecked(entry.FromTx(block.vtx[i]));
+    }
+    const CGrapheneBlock grblock(block, pool.size());
+    PartiallyDownloadedBlock partialBlock(GetConfig(), &pool);
+    BOOST_CHECK(partialBlock.InitData(grblock, extra_txn) ==
+                READ_STATUS_FAILED);
+
+    // Bogus graphene blocks are rejected.
+    CGrapheneBlock empty(block, 0);
+    empty.iblt = CIBLT();
+    PartiallyDownloadedBlock partialBlock2(GetConfig(), &pool);
+    BOOST_CHECK(partialBlock2.InitData(empty, extra_txn) ==
+                READ_STATUS_INVALID);
+}
+
 BOOST_AUTO_TEST_CASE(TransactionsRequestSerializationTest) {
     BlockTransactionsRequest req1;
     req1.blockhash = BlockHash(InsecureRand256());
@@ -0,0 +1,110 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/blocktemplatedelta.h>
+
+#include <miner.h>
+#include <primitives/transaction.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blocktemplatedelta_tests, BasicTestingSetup)
+
+static CTransactionRef MakeTx(uint32_t lockTime) {
+    CMutableTransaction mtx;
+    mtx.nLockTime = lockTime;
+    return MakeTransactionRef(std::move(mtx));
+}
+
+static CBlockTemplate MakeTemplate(const std::vector<CTransactionRef> &txs,
+                                   Amount totalFees) {
+    CBlockTemplate tmpl;
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    tmpl.block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+    tmpl.entries.emplace_back(tmpl.block.vtx[0], -1 * totalFees, 0);
+    for (const auto &tx : txs) {
+        tmpl.block.vtx.push_back(tx);
+        tmpl.entries.emplace_back(tx, Amount::zero(), 0);
+    }
+    return tmpl;
+}
+
+BOOST_AUTO_TEST_CASE(compute_delta) {
+    std::vector<TxId> txids;
+    for (uint32_t i = 0; i < 6; i++) {
+        txids.push_back(MakeTx(i)->GetId());
+    }
+
+    std::vector<uint32_t> removed, added;
+
+    // Identical lists produce an empty delta.
+    BOOST_CHECK(ComputeTemplateDelta(txids, txids, removed, added));
+    BOOST_CHECK(removed.empty());
+    BOOST_CHECK(added.empty());
+
+    // prev = 0 1 2 3, next = 1 4 3 5
+    std::vector<TxId> prev{txids[0], txids[1], txids[2], txids[3]};
+    std::vector<TxId> next{txids[1], txids[4], txids[3], txids[5]};
+    BOOST_CHECK(ComputeTemplateDelta(prev, next, removed, added));
+    BOOST_CHECK(removed == std::vector<uint32_t>({0, 2}));
+    BOOST_CHECK(added == std::vector<uint32_t>({1, 3}));
+
+    // Reordering kept transactions cannot be expressed as a delta.
+    std::vector<TxId> reordered{txids[3], txids[1]};
+    BOOST_CHECK(!ComputeTemplateDelta(prev, reordered, removed, added));
+
+    // Everything removed.
+    BOOST_CHECK(ComputeTemplateDelta(prev, {}, removed, added));
+    BOOST_CHECK(removed == std::vector<uint32_t>({0, 1, 2, 3}));
+    BOOST_CHECK(added.empty());
+}
+
+BOOST_AUTO_TEST_CASE(delta_tracker) {
+    std::vector<CTransactionRef> txs;
+    for (uint32_t i = 0; i < 4; i++) {
+        txs.push_back(MakeTx(i));
+    }
+
+    const CBlockTemplate first =
+        MakeTemplate({txs[0], txs[1], txs[2]}, 300 * SATOSHI);
+    const CBlockTemplate second =
+        MakeTemplate({txs[0], txs[2], txs[3]}, 500 * SATOSHI);
+    BOOST_CHECK_EQUAL(GetTemplateFees(first), 300 * SATOSHI);
+    BOOST_CHECK(ComputeTemplateId(first) != ComputeTemplateId(second));
+
+    BlockTemplateDeltaTracker tracker(2);
+    BOOST_CHECK(!tracker.GetLastFees("a"));
+
+    // The first request always gets the full template.
+    BlockTemplateDelta delta = tracker.Update("a", std::nullopt, first);
+    BOOST_CHECK(!delta.isDelta);
+    BOOST_CHECK(delta.templateId == ComputeTemplateId(first));
+    BOOST_CHECK_EQUAL(*tracker.GetLastFees("a"), 300 * SATOSHI);
+
+    // A stale or unknown template id gets the full template.
+    delta = tracker.Update("a", uint256(), second);
+    BOOST_CHECK(!delta.isDelta);
+
+    // Back to the first template, relative to the second one.
+    delta = tracker.Update("a", ComputeTemplateId(second), first);
+    BOOST_CHECK(delta.isDelta);
+    BOOST_CHECK(delta.removed == std::vector<uint32_t>({2}));
+    BOOST_CHECK(delta.added == std::vector<uint32_t>({1}));
+
+    // Clients are tracked separately.
+    delta = tracker.Update("b", ComputeTemplateId(first), second);
+    BOOST_CHECK(!delta.isDelta);
+
+    // The least recently served client is evicted.
+    tracker.Update("c", std::nullopt, first);
+    BOOST_CHECK_EQUAL(tracker.GetClientCount(), 2);
+    BOOST_CHECK(!tracker.GetLastFees("a"));
+    BOOST_CHECK(tracker.GetLastFees("b"));
+    BOOST_CHECK(tracker.GetLastFees("c"));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
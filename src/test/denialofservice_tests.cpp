@@ -14,6 +14,7 @@
 #include <script/signingprovider.h>
 #include <script/standard.h>
 #include <serialize.h>
+#include <txorphanage.h>
 #include <util/system.h>
 #include <util/time.h>
 #include <validation.h>
@@ -41,19 +42,6 @@ struct CConnmanTest : public CConnman {
 };
 } // namespace
 
-// Tests these internal-to-net_processing.cpp methods:
-extern bool AddOrphanTx(const CTransactionRef &tx, NodeId peer);
-extern void EraseOrphansFor(NodeId peer);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
-
-struct COrphanTx {
-    CTransactionRef tx;
-    NodeId fromPeer;
-    int64_t nTimeExpire;
-};
-extern std::map<uint256, COrphanTx>
-    mapOrphanTransactions GUARDED_BY(g_cs_orphans);
-
 static CService ip(uint32_t i) {
     struct in_addr s;
     s.s_addr = i;
@@ -398,17 +386,30 @@ BOOST_AUTO_TEST_CASE(DoS_bantime) {
     peerLogic->FinalizeNode(config, dummyNode.GetId(), dummy);
 }
 
-static CTransactionRef RandomOrphan() {
-    std::map<uint256, COrphanTx>::iterator it;
-    LOCK2(cs_main, g_cs_orphans);
-    it = mapOrphanTransactions.lower_bound(InsecureRand256());
-    if (it == mapOrphanTransactions.end()) {
-        it = mapOrphanTransactions.begin();
+class TxOrphanageTest : public TxOrphanage {
+public:
+    CTransactionRef RandomOrphan() EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans) {
+        auto it = m_orphans.lower_bound(TxId(InsecureRand256()));
+        if (it == m_orphans.end()) {
+            it = m_orphans.begin();
+        }
+        return it->second.tx;
     }
-    return it->second.tx;
-}
+
+    bool AddTx(const CTransactionRef &tx, NodeId peer)
+        EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans) {
+        std::vector<COutPoint> missing;
+        for (const CTxIn &txin : tx->vin) {
+            missing.push_back(txin.prevout);
+        }
+        return TxOrphanage::AddTx(tx, peer, missing);
+    }
+};
 
 BOOST_AUTO_TEST_CASE(DoS_mapOrphans) {
+    TxOrphanageTest orphanage;
+    LOCK(g_cs_orphans);
+
     CKey key;
     key.MakeNewKey(true);
     FillableSigningProvider keystore;
@@ -425,12 +426,12 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans) {
         tx.vout[0].scriptPubKey =
             GetScriptForDestination(PKHash(key.GetPubKey()));
 
-        AddOrphanTx(MakeTransactionRef(tx), i);
+        orphanage.AddTx(MakeTransactionRef(tx), i);
     }
 
     // ... and 50 that depend on other orphans:
     for (int i = 0; i < 50; i++) {
-        CTransactionRef txPrev = RandomOrphan();
+        CTransactionRef txPrev = orphanage.RandomOrphan();
 
         CMutableTransaction tx;
         tx.vin.resize(1);
@@ -442,12 +443,12 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans) {
         BOOST_CHECK(SignSignature(keystore, *txPrev, tx, 0,
                                   SigHashType().withForkId()));
 
-        AddOrphanTx(MakeTransactionRef(tx), i);
+        orphanage.AddTx(MakeTransactionRef(tx), i);
     }
 
     // This really-big orphan should be ignored:
     for (int i = 0; i < 10; i++) {
-        CTransactionRef txPrev = RandomOrphan();
+        CTransactionRef txPrev = orphanage.RandomOrphan();
 
         CMutableTransaction tx;
         tx.vout.resize(1);
@@ -466,24 +467,23 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans) {
             tx.vin[j].scriptSig = tx.vin[0].scriptSig;
         }
 
-        BOOST_CHECK(!AddOrphanTx(MakeTransactionRef(tx), i));
+        BOOST_CHECK(!orphanage.AddTx(MakeTransactionRef(tx), i));
     }
 
-    LOCK2(cs_main, g_cs_orphans);
-    // Test EraseOrphansFor:
+    // Test EraseForPeer:
     for (NodeId i = 0; i < 3; i++) {
-        size_t sizeBefore = mapOrphanTransactions.size();
-        EraseOrphansFor(i);
-        BOOST_CHECK(mapOrphanTransactions.size() < sizeBefore);
-    }
-
-    // Test LimitOrphanTxSize() function:
-    LimitOrphanTxSize(40);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 40);
-    LimitOrphanTxSize(10);
-    BOOST_CHECK(mapOrphanTransactions.size() <= 10);
-    LimitOrphanTxSize(0);
-    BOOST_CHECK(mapOrphanTransactions.empty());
+        size_t sizeBefore = orphanage.Size();
+        orphanage.EraseForPeer(i);
+        BOOST_CHECK(orphanage.Size() < sizeBefore);
+    }
+
+    // Test LimitOrphans() function:
+    orphanage.LimitOrphans(40);
+    BOOST_CHECK(orphanage.Size() <= 40);
+    orphanage.LimitOrphans(10);
+    BOOST_CHECK(orphanage.Size() <= 10);
+    orphanage.LimitOrphans(0);
+    BOOST_CHECK_EQUAL(orphanage.Size(), 0);
 }
 
 BOOST_AUTO_TEST_SUITE_END()
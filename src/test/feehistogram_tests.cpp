@@ -0,0 +1,181 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <policy/fees.h>
+
+#include <feerate.h>
+#include <txmempool.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(feehistogram_tests, BasicTestingSetup)
+
+static CTransactionRef MakeTx(uint32_t n) {
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].scriptSig = CScript() << CScriptNum(n);
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    tx.vout[0].nValue = COIN;
+    return MakeTransactionRef(tx);
+}
+
+BOOST_AUTO_TEST_CASE(bucket_index) {
+    FeeRateHistogram histogram;
+    const size_t nBuckets = histogram.GetBucketCount();
+    BOOST_CHECK(nBuckets > 100);
+
+    BOOST_CHECK_EQUAL(histogram.GetBucketIndex(CFeeRate()), 0U);
+    BOOST_CHECK_EQUAL(histogram.GetBucketIndex(CFeeRate(MIN_FEERATE - SATOSHI)),
+                      0U);
+    BOOST_CHECK_EQUAL(histogram.GetBucketIndex(CFeeRate(MIN_FEERATE)), 1U);
+    BOOST_CHECK_EQUAL(histogram.GetBucketIndex(CFeeRate(100 * MAX_FEERATE)),
+                      nBuckets - 1);
+
+    for (size_t i = 1; i < nBuckets; ++i) {
+        const CFeeRate lowest = histogram.GetBucketFeeRate(i);
+        BOOST_CHECK(histogram.GetBucketFeeRate(i - 1) < lowest);
+        BOOST_CHECK_EQUAL(histogram.GetBucketIndex(lowest), i);
+        BOOST_CHECK_EQUAL(
+            histogram.GetBucketIndex(CFeeRate(lowest.GetFeePerK() - SATOSHI)),
+            i - 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(mempool_depth) {
+    FeeRateHistogram histogram;
+    TestMemPoolEntryHelper entry;
+
+    BOOST_CHECK(!histogram.GetBucketAtDepth(0));
+
+    // Two transactions at a high fee rate, one at a low fee rate.
+    const CTxMemPoolEntry high1 = entry.Fee(100000 * SATOSHI).FromTx(MakeTx(1));
+    const CTxMemPoolEntry high2 = entry.Fee(100000 * SATOSHI).FromTx(MakeTx(2));
+    const CTxMemPoolEntry low = entry.Fee(100 * SATOSHI).FromTx(MakeTx(3));
+    histogram.AddTx(high1);
+    histogram.AddTx(high2);
+    histogram.AddTx(low);
+
+    const size_t highBucket = histogram.GetBucketIndex(
+        CFeeRate(high1.GetFee(), high1.GetTxSize()));
+    const size_t lowBucket =
+        histogram.GetBucketIndex(CFeeRate(low.GetFee(), low.GetTxSize()));
+    BOOST_CHECK(lowBucket < highBucket);
+    BOOST_CHECK_EQUAL(histogram.GetMempoolCount(highBucket), 2U);
+    BOOST_CHECK_EQUAL(histogram.GetMempoolSize(highBucket),
+                      high1.GetTxSize() + high2.GetTxSize());
+    BOOST_CHECK_EQUAL(histogram.GetMempoolCount(lowBucket), 1U);
+    const uint64_t totalSize =
+        high1.GetTxSize() + high2.GetTxSize() + low.GetTxSize();
+    BOOST_CHECK_EQUAL(histogram.GetMempoolTotalSize(), totalSize);
+
+    const uint64_t highSize = histogram.GetMempoolSize(highBucket);
+    BOOST_CHECK_EQUAL(*histogram.GetBucketAtDepth(0), highBucket);
+    BOOST_CHECK_EQUAL(*histogram.GetBucketAtDepth(highSize - 1), highBucket);
+    BOOST_CHECK_EQUAL(*histogram.GetBucketAtDepth(highSize), lowBucket);
+    BOOST_CHECK(!histogram.GetBucketAtDepth(totalSize));
+
+    histogram.RemoveTx(high1, false);
+    BOOST_CHECK_EQUAL(histogram.GetMempoolCount(highBucket), 1U);
+    BOOST_CHECK_EQUAL(histogram.GetMempoolTotalSize(),
+                      totalSize - high1.GetTxSize());
+
+    histogram.ClearMempool();
+    BOOST_CHECK_EQUAL(histogram.GetMempoolTotalSize(), 0U);
+    BOOST_CHECK_EQUAL(histogram.GetMempoolCount(lowBucket), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(estimate_fee) {
+    FeeRateHistogram histogram;
+    TestMemPoolEntryHelper entry;
+
+    BOOST_CHECK(!histogram.EstimateFee(1));
+
+    // High fee transactions confirm in the next block, low fee transactions
+    // wait for 10 blocks.
+    std::vector<CTxMemPoolEntry> highs, lows;
+    uint32_t n = 0;
+    for (unsigned int height = 100; height < 120; ++height) {
+        CTxMemPoolEntry high =
+            entry.Fee(100000 * SATOSHI).Height(height - 1).FromTx(MakeTx(n++));
+        CTxMemPoolEntry low =
+            entry.Fee(100 * SATOSHI).Height(height - 10).FromTx(MakeTx(n++));
+        histogram.AddTx(high);
+        histogram.AddTx(low);
+        histogram.ProcessBlock(height, {&high, &low});
+        histogram.RemoveTx(high, false);
+        histogram.RemoveTx(low, false);
+        highs.push_back(high);
+        lows.push_back(low);
+    }
+
+    const CFeeRate highFeeRate =
+        histogram.GetBucketFeeRate(histogram.GetBucketIndex(
+            CFeeRate(highs[0].GetFee(), highs[0].GetTxSize())));
+    const CFeeRate lowFeeRate =
+        histogram.GetBucketFeeRate(histogram.GetBucketIndex(
+            CFeeRate(lows[0].GetFee(), lows[0].GetTxSize())));
+    for (unsigned int nBlocks = 1; nBlocks < 10; ++nBlocks) {
+        BOOST_CHECK(*histogram.EstimateFee(nBlocks) == highFeeRate);
+    }
+    for (unsigned int nBlocks = 10; nBlocks <= MAX_CONFIRMATION_TARGET;
+         ++nBlocks) {
+        BOOST_CHECK(*histogram.EstimateFee(nBlocks) == lowFeeRate);
+    }
+
+    // Blocks connected again are not accounted for twice.
+    CTxMemPoolEntry high =
+        entry.Fee(100000 * SATOSHI).Height(100).FromTx(MakeTx(n++));
+    histogram.ProcessBlock(110, {&high});
+    BOOST_CHECK(*histogram.EstimateFee(1) == highFeeRate);
+
+    // Low fee transactions failing to confirm only make the estimate for them
+    // worse.
+    for (int i = 0; i < 10; ++i) {
+        CTxMemPoolEntry low = entry.Fee(100 * SATOSHI).FromTx(MakeTx(n++));
+        histogram.AddTx(low);
+        histogram.RemoveTx(low, true);
+    }
+    BOOST_CHECK(*histogram.EstimateFee(MAX_CONFIRMATION_TARGET) ==
+                highFeeRate);
+}
+
+BOOST_AUTO_TEST_CASE(mempool_estimate_fee) {
+    CTxMemPool pool;
+    TestMemPoolEntryHelper entry;
+    LOCK2(cs_main, pool.cs);
+
+    // With no data, the estimate is the minimum fee.
+    BOOST_CHECK(pool.estimateFee(1, 1000) == pool.estimateFee());
+
+    // Fill more than one block worth of mempool.
+    std::vector<CTransactionRef> txs;
+    for (uint32_t n = 0; n < 10; ++n) {
+        txs.push_back(MakeTx(n));
+        pool.addUnchecked(entry.Fee(100000 * SATOSHI).FromTx(txs.back()));
+    }
+    const FeeRateHistogram &histogram = pool.GetFeeRateHistogram();
+    BOOST_CHECK_EQUAL(histogram.GetMempoolTotalSize(), pool.GetTotalTxSize());
+
+    const size_t bucket = histogram.GetBucketIndex(
+        CFeeRate(100000 * SATOSHI, txs[0]->GetTotalSize()));
+    const uint64_t halfSize = pool.GetTotalTxSize() / 2;
+    BOOST_CHECK(pool.estimateFee(1, halfSize) ==
+                histogram.GetBucketFeeRate(bucket + 1));
+    BOOST_CHECK(pool.estimateFee(3, halfSize) == pool.estimateFee());
+
+    // Confirming the transactions moves them to the history.
+    pool.removeForBlock(txs, 2);
+    BOOST_CHECK_EQUAL(histogram.GetMempoolTotalSize(), 0U);
+    BOOST_CHECK(*histogram.EstimateFee(1) ==
+                histogram.GetBucketFeeRate(bucket));
+    BOOST_CHECK(pool.estimateFee(1, 1000) ==
+                histogram.GetBucketFeeRate(bucket));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
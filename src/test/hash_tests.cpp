@@ -156,6 +156,24 @@ BOOST_AUTO_TEST_CASE(siphash) {
         BOOST_CHECK_EQUAL(SipHashUint256(k1, k2, x), sip256.Finalize());
         BOOST_CHECK_EQUAL(SipHashUint256Extra(k1, k2, x, n), sip288.Finalize());
     }
+
+    // Check consistency between SipHashUint256 and SipHashUint256Batch, for
+    // counts which are and are not multiples of the batch width.
+    for (size_t count = 0; count < 10; ++count) {
+        uint64_t k1 = ctx.rand64();
+        uint64_t k2 = ctx.rand64();
+        std::vector<uint256> vals(count);
+        std::vector<const uint256 *> ptrs(count);
+        for (size_t i = 0; i < count; ++i) {
+            vals[i] = InsecureRand256();
+            ptrs[i] = &vals[i];
+        }
+        std::vector<uint64_t> out(count);
+        SipHashUint256Batch(k1, k2, ptrs.data(), count, out.data());
+        for (size_t i = 0; i < count; ++i) {
+            BOOST_CHECK_EQUAL(out[i], SipHashUint256(k1, k2, vals[i]));
+        }
+    }
 }
 
 namespace {
@@ -0,0 +1,106 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <iblt.h>
+
+#include <random.h>
+#include <streams.h>
+#include <version.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <set>
+
+BOOST_FIXTURE_TEST_SUITE(iblt_tests, BasicTestingSetup)
+
+static std::vector<uint64_t> RandomKeys(FastRandomContext &rng, size_t count) {
+    std::set<uint64_t> keys;
+    while (keys.size() < count) {
+        keys.insert(rng.rand64());
+    }
+    return std::vector<uint64_t>(keys.begin(), keys.end());
+}
+
+BOOST_AUTO_TEST_CASE(decode) {
+    FastRandomContext rng(true);
+    for (size_t capacity : {1, 10, 100, 1000}) {
+        CIBLT iblt(capacity, rng.rand32());
+        BOOST_CHECK_EQUAL(iblt.GetCellCount() % CIBLT::HASH_COUNT, 0U);
+
+        // Many keys in common, and about capacity keys in only one of the
+        // sets.
+        for (uint64_t key : RandomKeys(rng, 5000)) {
+            iblt.Insert(key);
+            iblt.Erase(key);
+        }
+        const std::vector<uint64_t> inserted =
+            RandomKeys(rng, (capacity + 1) / 2);
+        const std::vector<uint64_t> erased = RandomKeys(rng, capacity / 2);
+        for (uint64_t key : inserted) {
+            iblt.Insert(key);
+        }
+        for (uint64_t key : erased) {
+            iblt.Erase(key);
+        }
+
+        std::vector<uint64_t> decoded_inserted;
+        std::vector<uint64_t> decoded_erased;
+        BOOST_CHECK(iblt.Decode(decoded_inserted, decoded_erased));
+        std::sort(decoded_inserted.begin(), decoded_inserted.end());
+        std::sort(decoded_erased.begin(), decoded_erased.end());
+        BOOST_CHECK(decoded_inserted == inserted);
+        BOOST_CHECK(decoded_erased == erased);
+    }
+
+    // An empty table decodes to nothing.
+    CIBLT empty(10, 0);
+    std::vector<uint64_t> inserted{1};
+    std::vector<uint64_t> erased{2};
+    BOOST_CHECK(empty.Decode(inserted, erased));
+    BOOST_CHECK(inserted.empty() && erased.empty());
+}
+
+BOOST_AUTO_TEST_CASE(overflow) {
+    FastRandomContext rng(true);
+    CIBLT iblt(10, rng.rand32());
+    for (uint64_t key : RandomKeys(rng, 200)) {
+        iblt.Insert(key);
+    }
+    std::vector<uint64_t> inserted;
+    std::vector<uint64_t> erased;
+    BOOST_CHECK(!iblt.Decode(inserted, erased));
+    BOOST_CHECK(inserted.empty() && erased.empty());
+}
+
+BOOST_AUTO_TEST_CASE(serialization) {
+    CIBLT iblt(5, 42);
+    iblt.Insert(7);
+    iblt.Erase(0x123456789abcdef);
+
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << iblt;
+    CIBLT deserialized;
+    BOOST_CHECK(!deserialized.IsValid());
+    stream >> deserialized;
+    BOOST_CHECK(deserialized.IsValid());
+    BOOST_CHECK_EQUAL(deserialized.GetCellCount(), iblt.GetCellCount());
+
+    std::vector<uint64_t> inserted;
+    std::vector<uint64_t> erased;
+    BOOST_CHECK(deserialized.Decode(inserted, erased));
+    BOOST_CHECK(inserted == std::vector<uint64_t>{7});
+    BOOST_CHECK(erased == std::vector<uint64_t>{0x123456789abcdef});
+
+    // The number of cells must be a multiple of the number of hashes.
+    CDataStream bad(SER_NETWORK, PROTOCOL_VERSION);
+    bad << uint32_t(0) << std::vector<std::pair<uint64_t, uint64_t>>(4);
+    bad >> deserialized;
+    BOOST_CHECK(!deserialized.IsValid());
+    BOOST_CHECK(!deserialized.Decode(inserted, erased));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
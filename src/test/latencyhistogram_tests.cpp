@@ -0,0 +1,105 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <util/latencyhistogram.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <limits>
+#include <thread>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(latencyhistogram_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(bucket_index) {
+    BOOST_CHECK_EQUAL(LatencyHistogram::GetBucketIndex(-1), 0);
+    BOOST_CHECK_EQUAL(LatencyHistogram::GetBucketIndex(0), 0);
+    BOOST_CHECK_EQUAL(LatencyHistogram::GetBucketIndex(1), 1);
+    BOOST_CHECK_EQUAL(LatencyHistogram::GetBucketIndex(2), 2);
+    BOOST_CHECK_EQUAL(LatencyHistogram::GetBucketIndex(3), 2);
+    BOOST_CHECK_EQUAL(LatencyHistogram::GetBucketIndex(4), 3);
+    BOOST_CHECK_EQUAL(LatencyHistogram::GetBucketIndex(1000), 10);
+    BOOST_CHECK_EQUAL(LatencyHistogram::GetBucketIndex(1024), 11);
+    BOOST_CHECK_EQUAL(
+        LatencyHistogram::GetBucketIndex(std::numeric_limits<int64_t>::max()),
+        LatencyHistogram::NUM_BUCKETS - 1);
+
+    // Every duration is below the limit of its bucket, and at or above the
+    // limit of the previous one.
+    for (int64_t micros = 0; micros < 5000; ++micros) {
+        const size_t bucket = LatencyHistogram::GetBucketIndex(micros);
+        BOOST_CHECK(micros < LatencyHistogram::GetBucketLimit(bucket));
+        if (bucket > 0) {
+            BOOST_CHECK(micros >= LatencyHistogram::GetBucketLimit(bucket - 1));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(record) {
+    LatencyHistogram histogram;
+    LatencyHistogram::Snapshot snapshot = histogram.GetSnapshot();
+    BOOST_CHECK_EQUAL(snapshot.count, 0);
+    BOOST_CHECK_EQUAL(snapshot.GetPercentile(50), 0);
+
+    // 90 fast measurements and 10 slow ones.
+    for (int i = 0; i < 90; ++i) {
+        histogram.Record(10);
+    }
+    for (int i = 0; i < 10; ++i) {
+        histogram.Record(3000 + i);
+    }
+    // Negative durations, from the clock going backwards, count as zero.
+    histogram.Record(-5);
+
+    snapshot = histogram.GetSnapshot();
+    BOOST_CHECK_EQUAL(snapshot.count, 101);
+    BOOST_CHECK_EQUAL(snapshot.total, 90 * 10 + 10 * 3000 + 45);
+    BOOST_CHECK_EQUAL(snapshot.max, 3009);
+    BOOST_CHECK_EQUAL(snapshot.buckets[0], 1);
+    BOOST_CHECK_EQUAL(snapshot.buckets[LatencyHistogram::GetBucketIndex(10)],
+                      90);
+    BOOST_CHECK_EQUAL(snapshot.buckets[LatencyHistogram::GetBucketIndex(3000)],
+                      10);
+
+    BOOST_CHECK_EQUAL(snapshot.GetPercentile(0), 1);
+    BOOST_CHECK_EQUAL(snapshot.GetPercentile(50), 16);
+    BOOST_CHECK_EQUAL(snapshot.GetPercentile(90), 16);
+    // The upper bound of the bucket is capped to the largest duration.
+    BOOST_CHECK_EQUAL(snapshot.GetPercentile(91), 3009);
+    BOOST_CHECK_EQUAL(snapshot.GetPercentile(100), 3009);
+
+    histogram.Reset();
+    snapshot = histogram.GetSnapshot();
+    BOOST_CHECK_EQUAL(snapshot.count, 0);
+    BOOST_CHECK_EQUAL(snapshot.total, 0);
+    BOOST_CHECK_EQUAL(snapshot.max, 0);
+}
+
+BOOST_AUTO_TEST_CASE(concurrent_record) {
+    LatencyHistogram histogram;
+    constexpr int NUM_THREADS = 4;
+    constexpr int NUM_RECORDS = 10000;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < NUM_THREADS; ++t) {
+        threads.emplace_back([&histogram, t]() {
+            for (int i = 0; i < NUM_RECORDS; ++i) {
+                histogram.Record(t * NUM_RECORDS + i);
+            }
+        });
+    }
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+
+    const LatencyHistogram::Snapshot snapshot = histogram.GetSnapshot();
+    const int64_t n = NUM_THREADS * NUM_RECORDS;
+    BOOST_CHECK_EQUAL(snapshot.count, n);
+    BOOST_CHECK_EQUAL(snapshot.total, n * (n - 1) / 2);
+    BOOST_CHECK_EQUAL(snapshot.max, n - 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
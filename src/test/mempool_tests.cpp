@@ -14,6 +14,7 @@
 #include <boost/test/unit_test.hpp>
 
 #include <algorithm>
+#include <limits>
 #include <vector>
 
 BOOST_FIXTURE_TEST_SUITE(mempool_tests, TestingSetup)
@@ -1140,4 +1141,101 @@ BOOST_AUTO_TEST_CASE(MempoolAncestryTests) {
     BOOST_CHECK_EQUAL(descendants, 4ULL);
 }
 
+BOOST_AUTO_TEST_CASE(MempoolAncestorLimitsTest) {
+    CTxMemPool pool;
+    LOCK2(cs_main, pool.cs);
+    TestMemPoolEntryHelper entry;
+    const uint64_t noLimit = std::numeric_limits<uint64_t>::max();
+
+    // Diamond shape, the ancestors of td are shared between its parents:
+    //
+    // [ta].0 <- [tb].0 <- [td]
+    //   |                  |
+    //   \---1 <- [tc].0 ---/
+    //
+    CTransactionRef ta = make_tx(/* output_values */ {10 * COIN, 10 * COIN});
+    CTransactionRef tb = make_tx(/* output_values */ {5 * COIN},
+                                 /* inputs */ {ta}, /* input_indices */ {0});
+    CTransactionRef tc = make_tx(/* output_values */ {5 * COIN},
+                                 /* inputs */ {ta}, /* input_indices */ {1});
+    CTransactionRef td =
+        make_tx(/* output_values */ {5 * COIN}, /* inputs */ {tb, tc});
+    pool.addUnchecked(entry.FromTx(ta));
+    pool.addUnchecked(entry.FromTx(tb));
+    pool.addUnchecked(entry.FromTx(tc));
+    const CTxMemPoolEntry entryD = entry.FromTx(td);
+
+    CTxMemPool::setEntries setAncestors;
+    std::string errString;
+
+    // td has 3 ancestors, even though the ancestor counts of its parents sum
+    // up to 4.
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(entryD, setAncestors, 4,
+                                               noLimit, noLimit, noLimit,
+                                               errString));
+    BOOST_CHECK_EQUAL(setAncestors.size(), 3UL);
+
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entryD, setAncestors, 3,
+                                                noLimit, noLimit, noLimit,
+                                                errString));
+    BOOST_CHECK_EQUAL(errString, "too many unconfirmed ancestors [limit: 3]");
+
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entryD, setAncestors, 2,
+                                                noLimit, noLimit, noLimit,
+                                                errString));
+    BOOST_CHECK_EQUAL(errString, "too many unconfirmed parents [limit: 2]");
+
+    // The ancestor limit is already exceeded by the package of a parent.
+    CTransactionRef te =
+        make_tx(/* output_values */ {5 * COIN}, /* inputs */ {tb});
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entry.FromTx(te),
+                                                setAncestors, 2, noLimit,
+                                                noLimit, noLimit, errString));
+    BOOST_CHECK_EQUAL(errString, "too many unconfirmed ancestors [limit: 2]");
+    BOOST_CHECK(setAncestors.empty());
+
+    // The ancestor size limit counts every ancestor once.
+    const uint64_t packageSize = ta->GetTotalSize() + tb->GetTotalSize() +
+                                 tc->GetTotalSize() + td->GetTotalSize();
+    setAncestors.clear();
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(entryD, setAncestors, noLimit,
+                                               packageSize, noLimit, noLimit,
+                                               errString));
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entryD, setAncestors,
+                                                noLimit, packageSize - 1,
+                                                noLimit, noLimit, errString));
+    BOOST_CHECK_EQUAL(errString,
+                      strprintf("exceeds ancestor size limit [limit: %u]",
+                                packageSize - 1));
+
+    // ta would get 4 descendants, which is only visible past the parents.
+    setAncestors.clear();
+    BOOST_CHECK(pool.CalculateMemPoolAncestors(entryD, setAncestors, noLimit,
+                                               noLimit, 4, noLimit,
+                                               errString));
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entryD, setAncestors,
+                                                noLimit, noLimit, 3, noLimit,
+                                                errString));
+    BOOST_CHECK_EQUAL(errString,
+                      strprintf("too many descendants for tx %s [limit: 3]",
+                                ta->GetId().ToString()));
+
+    // tb would get 2 descendants, which is caught at the parents.
+    setAncestors.clear();
+    BOOST_CHECK(!pool.CalculateMemPoolAncestors(entryD, setAncestors,
+                                                noLimit, noLimit, 1, noLimit,
+                                                errString));
+    BOOST_CHECK(
+        errString ==
+            strprintf("too many descendants for tx %s [limit: 1]",
+                      tb->GetId().ToString()) ||
+        errString == strprintf("too many descendants for tx %s [limit: 1]",
+                               tc->GetId().ToString()));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
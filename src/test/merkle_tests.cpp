@@ -143,7 +143,8 @@ static void MerkleComputation(const std::vector<uint256> &leaves,
 }
 
 static std::vector<uint256>
-ComputeMerkleBranch(const std::vector<uint256> &leaves, uint32_t position) {
+MerkleComputationBranch(const std::vector<uint256> &leaves,
+                        uint32_t position) {
     std::vector<uint256> ret;
     MerkleComputation(leaves, nullptr, nullptr, position, &ret);
     return ret;
@@ -156,7 +157,7 @@ static std::vector<uint256> BlockMerkleBranch(const CBlock &block,
     for (size_t s = 0; s < block.vtx.size(); s++) {
         leaves[s] = block.vtx[s]->GetHash();
     }
-    return ComputeMerkleBranch(leaves, position);
+    return MerkleComputationBranch(leaves, position);
 }
 
 // Older version of the merkle root computation code, for comparison.
@@ -300,6 +301,11 @@ BOOST_AUTO_TEST_CASE(merkle_test) {
                     std::vector<uint256> oldBranch =
                         BlockGetMerkleBranch(block, merkleTree, mtx);
                     BOOST_CHECK(oldBranch == newBranch);
+                    std::vector<uint256> leaves;
+                    for (const auto &tx : block.vtx) {
+                        leaves.push_back(tx->GetId());
+                    }
+                    BOOST_CHECK(ComputeMerkleBranch(leaves, mtx) == newBranch);
                     BOOST_CHECK(
                         ComputeMerkleRootFromBranch(block.vtx[mtx]->GetId(),
                                                     newBranch, mtx) == oldRoot);
@@ -17,6 +17,8 @@
 
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
+#include <cstring>
 #include <memory>
 #include <string>
 
@@ -26,6 +28,8 @@ public:
 
     //! Ensure that bucket placement is always the same for testing purposes.
     void MakeDeterministic() {
+        LOCK(m_rand_mutex);
+        ShardLock lock(*this, ALL_SHARDS);
         nKey.SetNull();
         insecure_rand = FastRandomContext(true);
     }
@@ -201,6 +205,71 @@ BOOST_AUTO_TEST_CASE(cnode_simple_test) {
     BOOST_CHECK(pnode2->fFeeler == false);
 }
 
+BOOST_AUTO_TEST_CASE(v1transportdeserializer_read_buffer) {
+    const Config &config = GetConfig();
+    V1TransportSerializer serializer;
+    V1TransportDeserializer deserializer(
+        config.GetChainParams().NetMagic(), SER_NETWORK, INIT_PROTO_VERSION);
+
+    // A message small enough to be received through an intermediate buffer.
+    CSerializedNetMsg small;
+    small.m_type = NetMsgType::PING;
+    small.data = std::vector<uint8_t>(8, 0x42);
+    std::vector<uint8_t> header;
+    serializer.prepareForTransport(config, small, header);
+    BOOST_CHECK_EQUAL(deserializer.GetReadBuffer().size(), 0);
+    BOOST_CHECK_EQUAL(deserializer.Read(config, (const char *)header.data(),
+                                        header.size()),
+                      int(header.size()));
+    BOOST_CHECK_EQUAL(deserializer.GetReadBuffer().size(), 0);
+    BOOST_CHECK_EQUAL(deserializer.Read(config,
+                                        (const char *)small.data.data(),
+                                        small.data.size()),
+                      int(small.data.size()));
+    BOOST_CHECK(deserializer.Complete());
+    BOOST_CHECK(deserializer.GetMessage(config, 0).m_valid_checksum);
+
+    // The payload of a large message is received in place, by chunks.
+    CSerializedNetMsg large;
+    large.m_type = NetMsgType::BLOCK;
+    large.data =
+        g_insecure_rand_ctx.randbytes(3 * DIRECT_RECV_MAX_SIZE / 2 + 12345);
+    serializer.prepareForTransport(config, large, header);
+    BOOST_CHECK_EQUAL(deserializer.Read(config, (const char *)header.data(),
+                                        header.size()),
+                      int(header.size()));
+
+    size_t received = 0;
+    while (large.data.size() - received >= DIRECT_RECV_MIN_SIZE) {
+        Span<char> buf = deserializer.GetReadBuffer();
+        BOOST_CHECK_EQUAL(size_t(buf.size()),
+                          std::min<size_t>(large.data.size() - received,
+                                           DIRECT_RECV_MAX_SIZE));
+        // Simulate a short read.
+        const size_t nBytes = buf.size() / 2 + 1;
+        memcpy(buf.data(), large.data.data() + received, nBytes);
+        BOOST_CHECK_EQUAL(deserializer.Read(config, buf.data(), nBytes),
+                          int(nBytes));
+        received += nBytes;
+    }
+
+    // The tail goes through the usual path.
+    BOOST_CHECK_EQUAL(deserializer.GetReadBuffer().size(), 0);
+    BOOST_CHECK_EQUAL(
+        deserializer.Read(config,
+                          (const char *)large.data.data() + received,
+                          large.data.size() - received),
+        int(large.data.size() - received));
+    BOOST_CHECK(deserializer.Complete());
+
+    CNetMessage msg = deserializer.GetMessage(config, 0);
+    BOOST_CHECK(msg.m_valid_checksum);
+    BOOST_CHECK_EQUAL(msg.m_command, NetMsgType::BLOCK);
+    BOOST_CHECK_EQUAL(msg.m_recv.size(), large.data.size());
+    BOOST_CHECK(std::equal(large.data.begin(), large.data.end(),
+                           (const uint8_t *)msg.m_recv.data()));
+}
+
 BOOST_AUTO_TEST_CASE(test_getSubVersionEB) {
     BOOST_CHECK_EQUAL(getSubVersionEB(13800000000), "13800.0");
     BOOST_CHECK_EQUAL(getSubVersionEB(3800000000), "3800.0");
@@ -499,4 +499,77 @@ BOOST_AUTO_TEST_CASE(
         std::string("5wyqrzbvrdsumnok.onion\0example.com\0", 35), ret));
 }
 
+static void CheckSent(Socks5Handshake &handshake,
+                      const std::vector<uint8_t> &expected) {
+    BOOST_CHECK(handshake.GetSendBuffer() == expected);
+    handshake.DataSent(handshake.GetSendBuffer().size());
+    BOOST_CHECK(!handshake.WantsSend());
+}
+
+static void Receive(Socks5Handshake &handshake,
+                    const std::vector<uint8_t> &data) {
+    handshake.DataReceived(data.data(), data.size());
+}
+
+BOOST_AUTO_TEST_CASE(socks5_handshake) {
+    const proxyType proxy(LookupNumeric("127.0.0.1", 9050));
+    const std::vector<uint8_t> connect_request{
+        0x05, 0x01, 0x00, 0x03, 0x07, 'a', '.', 'o', 'n', 'i', 'o', 'n',
+        0x20, 0x8D};
+
+    // No authentication, the reply is received in pieces.
+    Socks5Handshake handshake(proxy, "a.onion", 8333);
+    CheckSent(handshake, {0x05, 0x01, 0x00});
+    BOOST_CHECK_EQUAL(handshake.BytesNeeded(), 2U);
+    Receive(handshake, {0x05});
+    Receive(handshake, {0x00});
+    BOOST_CHECK(handshake.IsConnecting());
+    CheckSent(handshake, connect_request);
+    Receive(handshake, {0x05, 0x00, 0x00, 0x01});
+    BOOST_CHECK_EQUAL(handshake.BytesNeeded(), 1U);
+    Receive(handshake, {0x7F});
+    // The rest of the IPv4 bound address and the port.
+    BOOST_CHECK_EQUAL(handshake.BytesNeeded(), 5U);
+    BOOST_CHECK(handshake.GetStatus() ==
+                Socks5Handshake::Status::IN_PROGRESS);
+    Receive(handshake, {0x00, 0x00, 0x01, 0x20, 0x8D});
+    BOOST_CHECK(handshake.GetStatus() == Socks5Handshake::Status::SUCCEEDED);
+    BOOST_CHECK_EQUAL(handshake.BytesNeeded(), 0U);
+
+    // Randomized credentials, with a domain name as bound address.
+    Socks5Handshake auth(proxyType(proxy.proxy, true), "a.onion", 8333);
+    CheckSent(auth, {0x05, 0x02, 0x00, 0x02});
+    Receive(auth, {0x05, 0x02});
+    BOOST_CHECK(!auth.IsConnecting());
+    const std::vector<uint8_t> auth_request = auth.GetSendBuffer();
+    BOOST_CHECK_EQUAL(auth_request.at(0), 0x01);
+    BOOST_CHECK_EQUAL(auth_request.size(), 3 + 2 * auth_request.at(1));
+    auth.DataSent(auth_request.size());
+    Receive(auth, {0x01, 0x00});
+    CheckSent(auth, connect_request);
+    Receive(auth, {0x05, 0x00, 0x00, 0x03, 0x02});
+    BOOST_CHECK_EQUAL(auth.BytesNeeded(), 4U);
+    Receive(auth, {'a', 'b', 0x20, 0x8D});
+    BOOST_CHECK(auth.GetStatus() == Socks5Handshake::Status::SUCCEEDED);
+
+    // Failures
+    Socks5Handshake refused(proxy, "a.onion", 8333);
+    Receive(refused, {0x05, 0x00});
+    Receive(refused, {0x05, 0x05, 0x00, 0x01, 0x00});
+    BOOST_CHECK(refused.GetStatus() == Socks5Handshake::Status::FAILED);
+    BOOST_CHECK(!refused.WantsSend());
+
+    Socks5Handshake wrong_method(proxy, "a.onion", 8333);
+    Receive(wrong_method, {0x05, 0x02});
+    BOOST_CHECK(wrong_method.GetStatus() == Socks5Handshake::Status::FAILED);
+
+    Socks5Handshake auth_failed(proxyType(proxy.proxy, true), "a.onion", 8333);
+    Receive(auth_failed, {0x05, 0x02});
+    Receive(auth_failed, {0x01, 0x01});
+    BOOST_CHECK(auth_failed.GetStatus() == Socks5Handshake::Status::FAILED);
+
+    Socks5Handshake long_name(proxy, std::string(256, 'a'), 8333);
+    BOOST_CHECK(long_name.GetStatus() == Socks5Handshake::Status::FAILED);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
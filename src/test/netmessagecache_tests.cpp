@@ -0,0 +1,88 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <netmessagecache.h>
+
+#include <protocol.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <memory>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(netmessagecache_tests, BasicTestingSetup)
+
+static NetMessageCache::Buffer MakeBuffer(size_t size) {
+    return std::make_shared<const std::vector<uint8_t>>(size);
+}
+
+BOOST_AUTO_TEST_CASE(get_add) {
+    NetMessageCache cache(1000);
+    const uint256 hash = InsecureRand256();
+
+    BOOST_CHECK(cache.Get(NetMsgType::TX, hash, 1) == nullptr);
+
+    NetMessageCache::Buffer tx = MakeBuffer(100);
+    cache.Add(NetMsgType::TX, hash, 1, tx);
+    BOOST_CHECK(cache.Get(NetMsgType::TX, hash, 1) == tx);
+    BOOST_CHECK_EQUAL(cache.Count(), 1);
+    BOOST_CHECK_EQUAL(cache.Size(), 100);
+
+    // The type, hash and version are all part of the key.
+    BOOST_CHECK(cache.Get(NetMsgType::BLOCK, hash, 1) == nullptr);
+    BOOST_CHECK(cache.Get(NetMsgType::TX, InsecureRand256(), 1) == nullptr);
+    BOOST_CHECK(cache.Get(NetMsgType::TX, hash, 2) == nullptr);
+
+    // Adding a message with the same key replaces it.
+    NetMessageCache::Buffer tx2 = MakeBuffer(200);
+    cache.Add(NetMsgType::TX, hash, 1, tx2);
+    BOOST_CHECK(cache.Get(NetMsgType::TX, hash, 1) == tx2);
+    BOOST_CHECK_EQUAL(cache.Count(), 1);
+    BOOST_CHECK_EQUAL(cache.Size(), 200);
+
+    // Messages larger than the cache are not cached.
+    cache.Add(NetMsgType::BLOCK, hash, 1, MakeBuffer(1001));
+    BOOST_CHECK(cache.Get(NetMsgType::BLOCK, hash, 1) == nullptr);
+    BOOST_CHECK_EQUAL(cache.Count(), 1);
+
+    cache.Clear();
+    BOOST_CHECK(cache.Get(NetMsgType::TX, hash, 1) == nullptr);
+    BOOST_CHECK_EQUAL(cache.Count(), 0);
+    BOOST_CHECK_EQUAL(cache.Size(), 0);
+
+    // Buffers outlive the cache entries.
+    BOOST_CHECK_EQUAL(tx->size(), 100);
+    BOOST_CHECK_EQUAL(tx2->size(), 200);
+}
+
+BOOST_AUTO_TEST_CASE(lru_eviction) {
+    NetMessageCache cache(1000);
+    std::vector<uint256> hashes;
+    for (int i = 0; i < 4; i++) {
+        hashes.push_back(InsecureRand256());
+        cache.Add(NetMsgType::TX, hashes.back(), 1, MakeBuffer(250));
+    }
+    BOOST_CHECK_EQUAL(cache.Count(), 4);
+    BOOST_CHECK_EQUAL(cache.Size(), 1000);
+
+    // Use the oldest message, the second one becomes the least recently used.
+    BOOST_CHECK(cache.Get(NetMsgType::TX, hashes[0], 1) != nullptr);
+
+    cache.Add(NetMsgType::TX, InsecureRand256(), 1, MakeBuffer(250));
+    BOOST_CHECK_EQUAL(cache.Count(), 4);
+    BOOST_CHECK_EQUAL(cache.Size(), 1000);
+    BOOST_CHECK(cache.Get(NetMsgType::TX, hashes[0], 1) != nullptr);
+    BOOST_CHECK(cache.Get(NetMsgType::TX, hashes[1], 1) == nullptr);
+    BOOST_CHECK(cache.Get(NetMsgType::TX, hashes[2], 1) != nullptr);
+
+    // A large message evicts as many messages as needed.
+    cache.Add(NetMsgType::BLOCK, hashes[0], 1, MakeBuffer(900));
+    BOOST_CHECK_EQUAL(cache.Count(), 1);
+    BOOST_CHECK_EQUAL(cache.Size(), 900);
+    BOOST_CHECK(cache.Get(NetMsgType::BLOCK, hashes[0], 1) != nullptr);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
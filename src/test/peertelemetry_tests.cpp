@@ -0,0 +1,88 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <peertelemetry.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <map>
+#include <string>
+
+BOOST_FIXTURE_TEST_SUITE(peertelemetry_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(sample) {
+    PeerTelemetry telemetry;
+    BOOST_CHECK(telemetry.GetSamples(10).empty());
+
+    std::map<std::string, uint64_t> recv{{"ping", 0}, {"tx", 0}};
+    std::map<std::string, uint64_t> sent{{"pong", 0}, {"tx", 0}};
+
+    recv["ping"] = 32;
+    sent["pong"] = 32;
+    telemetry.RecordProcessing("ping", 10);
+    telemetry.RecordBlockServed(1000);
+    telemetry.RecordBlockServed(500);
+    telemetry.Sample(100, 40, 50, recv, sent, 7, 8);
+
+    // Only the activity since the previous sample is accounted for.
+    recv["tx"] = 250;
+    telemetry.RecordProcessing("tx", 20);
+    telemetry.RecordProcessing("tx", 30);
+    telemetry.Sample(101, 300, 60, recv, sent, 0, 0);
+
+    // An idle interval.
+    telemetry.Sample(102, 300, 60, recv, sent, 0, 0);
+
+    const auto samples = telemetry.GetSamples(10);
+    BOOST_CHECK_EQUAL(samples.size(), 3);
+
+    BOOST_CHECK_EQUAL(samples[0].time, 100);
+    BOOST_CHECK_EQUAL(samples[0].bytes_recv, 40);
+    BOOST_CHECK_EQUAL(samples[0].bytes_sent, 50);
+    BOOST_CHECK_EQUAL(samples[0].send_queue_size, 7);
+    BOOST_CHECK_EQUAL(samples[0].process_queue_size, 8);
+    BOOST_CHECK_EQUAL(samples[0].blocks_served, 2);
+    BOOST_CHECK_EQUAL(samples[0].block_serving_time_usec, 1500);
+    BOOST_CHECK_EQUAL(samples[0].msg_types.size(), 2);
+    BOOST_CHECK_EQUAL(samples[0].msg_types.at("ping").bytes_recv, 32);
+    BOOST_CHECK_EQUAL(samples[0].msg_types.at("ping").processed, 1);
+    BOOST_CHECK_EQUAL(samples[0].msg_types.at("ping").processing_time_usec,
+                      10);
+    BOOST_CHECK_EQUAL(samples[0].msg_types.at("pong").bytes_sent, 32);
+
+    BOOST_CHECK_EQUAL(samples[1].time, 101);
+    BOOST_CHECK_EQUAL(samples[1].bytes_recv, 260);
+    BOOST_CHECK_EQUAL(samples[1].bytes_sent, 10);
+    BOOST_CHECK_EQUAL(samples[1].blocks_served, 0);
+    BOOST_CHECK_EQUAL(samples[1].msg_types.size(), 1);
+    BOOST_CHECK_EQUAL(samples[1].msg_types.at("tx").bytes_recv, 250);
+    BOOST_CHECK_EQUAL(samples[1].msg_types.at("tx").processed, 2);
+    BOOST_CHECK_EQUAL(samples[1].msg_types.at("tx").processing_time_usec, 50);
+
+    BOOST_CHECK_EQUAL(samples[2].bytes_recv, 0);
+    BOOST_CHECK_EQUAL(samples[2].bytes_sent, 0);
+    BOOST_CHECK(samples[2].msg_types.empty());
+
+    // The most recent samples are returned.
+    const auto last = telemetry.GetSamples(1);
+    BOOST_CHECK_EQUAL(last.size(), 1);
+    BOOST_CHECK_EQUAL(last[0].time, 102);
+}
+
+BOOST_AUTO_TEST_CASE(ring_buffer) {
+    PeerTelemetry telemetry;
+    const std::map<std::string, uint64_t> empty;
+    for (size_t i = 0; i < PEER_TELEMETRY_SAMPLES + 10; i++) {
+        telemetry.Sample(i, 0, 0, empty, empty, 0, 0);
+    }
+
+    const auto samples = telemetry.GetSamples(PEER_TELEMETRY_SAMPLES + 10);
+    BOOST_CHECK_EQUAL(samples.size(), PEER_TELEMETRY_SAMPLES);
+    BOOST_CHECK_EQUAL(samples.front().time, 10);
+    BOOST_CHECK_EQUAL(samples.back().time, PEER_TELEMETRY_SAMPLES + 9);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
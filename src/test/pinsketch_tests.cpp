@@ -0,0 +1,123 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <pinsketch.h>
+
+#include <random.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+#include <set>
+
+BOOST_FIXTURE_TEST_SUITE(pinsketch_tests, BasicTestingSetup)
+
+static std::set<uint32_t> RandomElements(FastRandomContext &rng,
+                                         size_t count) {
+    std::set<uint32_t> elements;
+    while (elements.size() < count) {
+        const uint32_t element = rng.rand32();
+        if (element != 0) {
+            elements.insert(element);
+        }
+    }
+    return elements;
+}
+
+static void CheckDecode(const PinSketch &sketch,
+                        const std::set<uint32_t> &expected) {
+    std::vector<uint32_t> decoded;
+    BOOST_CHECK(sketch.Decode(decoded));
+    std::sort(decoded.begin(), decoded.end());
+    BOOST_CHECK(decoded ==
+                std::vector<uint32_t>(expected.begin(), expected.end()));
+}
+
+BOOST_AUTO_TEST_CASE(decode) {
+    FastRandomContext rng(true);
+    for (size_t capacity : {1, 2, 3, 10, 40}) {
+        for (size_t count = 0; count <= capacity; count++) {
+            const std::set<uint32_t> elements = RandomElements(rng, count);
+            PinSketch sketch(capacity);
+            for (uint32_t element : elements) {
+                sketch.Add(element);
+            }
+            CheckDecode(sketch, elements);
+        }
+
+        // Decoding more elements than the capacity fails, except with a
+        // probability of about 1 / capacity! which only matters for the
+        // smallest capacities.
+        if (capacity < 10) {
+            continue;
+        }
+        PinSketch sketch(capacity);
+        for (uint32_t element : RandomElements(rng, capacity + 1)) {
+            sketch.Add(element);
+        }
+        std::vector<uint32_t> decoded;
+        BOOST_CHECK(!sketch.Decode(decoded));
+        BOOST_CHECK(decoded.empty());
+    }
+
+    // Extreme elements.
+    PinSketch sketch(3);
+    sketch.Add(1);
+    sketch.Add(2);
+    sketch.Add(0xffffffff);
+    CheckDecode(sketch, {1, 2, 0xffffffff});
+}
+
+BOOST_AUTO_TEST_CASE(merge) {
+    FastRandomContext rng(true);
+    const std::set<uint32_t> common = RandomElements(rng, 200);
+    const std::set<uint32_t> extra = RandomElements(rng, 20);
+
+    PinSketch a(20);
+    PinSketch b(20);
+    for (uint32_t element : common) {
+        a.Add(element);
+        b.Add(element);
+    }
+    std::set<uint32_t> difference;
+    bool in_a = true;
+    for (uint32_t element : extra) {
+        if (common.count(element)) {
+            continue;
+        }
+        (in_a ? a : b).Add(element);
+        difference.insert(element);
+        in_a = !in_a;
+    }
+
+    // Adding an element twice removes it.
+    a.Add(42);
+    a.Add(42);
+
+    a.Merge(b);
+    CheckDecode(a, difference);
+}
+
+BOOST_AUTO_TEST_CASE(serialization) {
+    PinSketch sketch(5);
+    sketch.Add(7);
+    sketch.Add(0x12345678);
+    const std::vector<uint8_t> data = sketch.Serialize();
+    BOOST_CHECK_EQUAL(data.size(), 20U);
+    // The first syndrome is the sum of the elements.
+    BOOST_CHECK(std::vector<uint8_t>(data.begin(), data.begin() + 4) ==
+                std::vector<uint8_t>({0x7f, 0x56, 0x34, 0x12}));
+
+    PinSketch deserialized(0);
+    BOOST_CHECK(PinSketch::Deserialize(MakeSpan(data), deserialized));
+    BOOST_CHECK_EQUAL(deserialized.GetCapacity(), 5U);
+    CheckDecode(deserialized, {7, 0x12345678});
+
+    const std::vector<uint8_t> truncated(data.begin(), data.begin() + 6);
+    BOOST_CHECK(!PinSketch::Deserialize(MakeSpan(truncated), deserialized));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
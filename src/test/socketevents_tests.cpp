@@ -0,0 +1,85 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <socketevents.h>
+
+#include <netbase.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(socketevents_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(parse_modes) {
+    SocketEventsMode mode;
+    for (const std::string &str : GetSupportedSocketEventsModes()) {
+        BOOST_CHECK(ParseSocketEventsMode(str, mode));
+        BOOST_CHECK_EQUAL(SocketEventsModeToString(mode), str);
+    }
+
+    const std::string default_mode =
+        SocketEventsModeToString(GetDefaultSocketEventsMode());
+    BOOST_CHECK(ParseSocketEventsMode(default_mode, mode));
+    BOOST_CHECK(mode == GetDefaultSocketEventsMode());
+
+    BOOST_CHECK(!ParseSocketEventsMode("", mode));
+    BOOST_CHECK(!ParseSocketEventsMode("kqueue", mode));
+}
+
+#ifdef USE_EPOLL
+BOOST_AUTO_TEST_CASE(epoll_edge_triggered) {
+    int fds[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    SOCKET local = fds[0];
+    SOCKET remote = fds[1];
+    BOOST_REQUIRE(SetSocketNonBlocking(local, true));
+
+    EpollSocketEvents events;
+    BOOST_REQUIRE(events.IsValid());
+    BOOST_CHECK(events.Add(local, 42));
+    // Sockets can only be registered once.
+    BOOST_CHECK(!events.Add(local, 43));
+
+    // The socket is writable from the start.
+    std::vector<EpollSocketEvents::Event> ready;
+    BOOST_CHECK(events.Wait(ready, 1000));
+    BOOST_REQUIRE_EQUAL(ready.size(), 1U);
+    BOOST_CHECK_EQUAL(ready[0].id, 42U);
+    BOOST_CHECK(ready[0].send);
+    BOOST_CHECK(!ready[0].recv);
+    BOOST_CHECK(!ready[0].error);
+
+    // The state did not change, so there is no new event.
+    BOOST_CHECK(events.Wait(ready, 0));
+    BOOST_CHECK(ready.empty());
+
+    const char data[2] = {1, 2};
+    BOOST_REQUIRE_EQUAL(send(remote, data, sizeof(data), 0), 2);
+    BOOST_CHECK(events.Wait(ready, 1000));
+    BOOST_REQUIRE_EQUAL(ready.size(), 1U);
+    BOOST_CHECK(ready[0].recv);
+
+    // Partially reading the data does not trigger a new event.
+    char byte;
+    BOOST_CHECK_EQUAL(recv(local, &byte, 1, 0), 1);
+    BOOST_CHECK(events.Wait(ready, 0));
+    BOOST_CHECK(ready.empty());
+
+    // Closing the remote end is reported as an error.
+    CloseSocket(remote);
+    BOOST_CHECK(events.Wait(ready, 1000));
+    BOOST_REQUIRE_EQUAL(ready.size(), 1U);
+    BOOST_CHECK(ready[0].error);
+
+    BOOST_CHECK(events.Remove(local));
+    BOOST_CHECK(!events.Remove(local));
+    CloseSocket(local);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
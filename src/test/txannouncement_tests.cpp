@@ -0,0 +1,189 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txannouncement.h>
+
+#include <script/script.h>
+#include <validation.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace std::chrono_literals;
+
+BOOST_FIXTURE_TEST_SUITE(txannouncement_tests, BasicTestingSetup)
+
+static CTransactionRef MakeTx(const COutPoint &prevout) {
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = prevout;
+    tx.vin[0].scriptSig = CScript() << OP_11;
+    tx.vout.resize(1);
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    tx.vout[0].nValue = 10 * COIN;
+    return MakeTransactionRef(tx);
+}
+
+static CTransactionRef AddTx(CTxMemPool &pool, const COutPoint &prevout,
+                             Amount fee) {
+    CTransactionRef tx = MakeTx(prevout);
+    LOCK2(cs_main, pool.cs);
+    pool.addUnchecked(TestMemPoolEntryHelper().Fee(fee).FromTx(tx));
+    return tx;
+}
+
+static CTransactionRef AddTx(CTxMemPool &pool, Amount fee) {
+    return AddTx(pool, COutPoint(TxId(InsecureRand256()), 0), fee);
+}
+
+static std::vector<TxId> ReadAll(TxAnnouncementScheduler &scheduler,
+                                 NodeId peer, const CTxMemPool &pool,
+                                 std::chrono::microseconds now,
+                                 size_t max_count = 100) {
+    std::vector<TxId> txids;
+    scheduler.Read(peer, pool, now, max_count,
+                   [&txids](const TxAnnouncement &announcement) {
+                       txids.push_back(announcement.info.tx->GetId());
+                       return true;
+                   });
+    return txids;
+}
+
+BOOST_AUTO_TEST_CASE(mempool_order) {
+    TxAnnouncementScheduler scheduler;
+    CTxMemPool pool;
+    std::chrono::microseconds now{1000000000};
+    scheduler.RegisterPeer(0);
+
+    CTransactionRef parent = AddTx(pool, 1000 * SATOSHI);
+    CTransactionRef child =
+        AddTx(pool, COutPoint(parent->GetId(), 0), 100000 * SATOSHI);
+    CTransactionRef high = AddTx(pool, 50000 * SATOSHI);
+    CTransactionRef low = AddTx(pool, 500 * SATOSHI);
+    for (const CTransactionRef &tx : {child, low, parent, high, parent}) {
+        scheduler.Add(tx->GetId());
+    }
+    BOOST_CHECK_EQUAL(scheduler.GetQueueSize(), 0U);
+
+    // Parents first, then by feerate, and each transaction once.
+    std::vector<TxId> expected{high->GetId(), parent->GetId(), low->GetId(),
+                               child->GetId()};
+    std::vector<TxId> txids = ReadAll(scheduler, 0, pool, now);
+    BOOST_CHECK(txids == expected);
+    // Everything was read, so the batch is released.
+    BOOST_CHECK_EQUAL(scheduler.GetQueueSize(), 0U);
+    BOOST_CHECK(ReadAll(scheduler, 0, pool, now + 1s).empty());
+
+    // Transactions which left the mempool are not announced.
+    CTransactionRef removed = AddTx(pool, 1000 * SATOSHI);
+    scheduler.Add(removed->GetId());
+    {
+        LOCK(pool.cs);
+        pool.removeRecursive(*removed, MemPoolRemovalReason::CONFLICT);
+    }
+    BOOST_CHECK(ReadAll(scheduler, 0, pool, now + 2s).empty());
+}
+
+BOOST_AUTO_TEST_CASE(batches) {
+    TxAnnouncementScheduler scheduler;
+    CTxMemPool pool;
+    std::chrono::microseconds now{1000000000};
+    scheduler.RegisterPeer(0);
+    scheduler.RegisterPeer(1);
+
+    CTransactionRef low = AddTx(pool, 500 * SATOSHI);
+    scheduler.Add(low->GetId());
+    BOOST_CHECK(ReadAll(scheduler, 0, pool, now) ==
+                std::vector<TxId>{low->GetId()});
+    // Peer 1 hasn't read it yet.
+    BOOST_CHECK_EQUAL(scheduler.GetQueueSize(), 1U);
+
+    // No new batch is sorted until the interval has elapsed.
+    CTransactionRef high = AddTx(pool, 50000 * SATOSHI);
+    scheduler.Add(high->GetId());
+    BOOST_CHECK(ReadAll(scheduler, 0, pool, now + 50ms).empty());
+    BOOST_CHECK(ReadAll(scheduler, 0, pool, now + 100ms) ==
+                std::vector<TxId>{high->GetId()});
+
+    // Peer 1 gets both batches merged in mempool order.
+    std::vector<TxId> expected{high->GetId(), low->GetId()};
+    BOOST_CHECK(ReadAll(scheduler, 1, pool, now + 100ms) == expected);
+    BOOST_CHECK_EQUAL(scheduler.GetQueueSize(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(max_count) {
+    TxAnnouncementScheduler scheduler;
+    CTxMemPool pool;
+    std::chrono::microseconds now{1000000000};
+    scheduler.RegisterPeer(0);
+
+    std::vector<TxId> expected;
+    for (int i = 0; i < 5; i++) {
+        CTransactionRef tx = AddTx(pool, (5000 - 1000 * i) * SATOSHI);
+        scheduler.Add(tx->GetId());
+        expected.push_back(tx->GetId());
+    }
+
+    // Only the transactions which are announced count.
+    std::vector<TxId> txids;
+    size_t calls = 0;
+    scheduler.Read(0, pool, now, 2,
+                   [&txids, &calls](const TxAnnouncement &announcement) {
+                       if (calls++ == 0) {
+                           return false;
+                       }
+                       txids.push_back(announcement.info.tx->GetId());
+                       return true;
+                   });
+    BOOST_CHECK_EQUAL(calls, 3U);
+    BOOST_CHECK(txids == std::vector<TxId>(expected.begin() + 1,
+                                           expected.begin() + 3));
+    BOOST_CHECK_EQUAL(scheduler.GetQueueSize(), 5U);
+
+    // The next read resumes where the previous one stopped.
+    BOOST_CHECK(ReadAll(scheduler, 0, pool, now + 1s) ==
+                std::vector<TxId>(expected.begin() + 3, expected.end()));
+    BOOST_CHECK_EQUAL(scheduler.GetQueueSize(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(peers) {
+    TxAnnouncementScheduler scheduler;
+    CTxMemPool pool;
+    std::chrono::microseconds now{1000000000};
+
+    // Nothing is queued while there is no peer.
+    CTransactionRef tx1 = AddTx(pool, 1000 * SATOSHI);
+    scheduler.Add(tx1->GetId());
+    scheduler.RegisterPeer(0);
+    BOOST_CHECK(ReadAll(scheduler, 0, pool, now).empty());
+
+    // A peer registered later doesn't get the batches sorted before.
+    CTransactionRef tx2 = AddTx(pool, 1000 * SATOSHI);
+    scheduler.Add(tx2->GetId());
+    BOOST_CHECK(ReadAll(scheduler, 0, pool, now) ==
+                std::vector<TxId>{tx2->GetId()});
+    scheduler.RegisterPeer(1);
+    scheduler.RegisterPeer(2);
+    BOOST_CHECK(ReadAll(scheduler, 1, pool, now).empty());
+
+    // The batches are released as the peers skip them or go away.
+    CTransactionRef tx3 = AddTx(pool, 1000 * SATOSHI);
+    scheduler.Add(tx3->GetId());
+    BOOST_CHECK(ReadAll(scheduler, 0, pool, now + 1s) ==
+                std::vector<TxId>{tx3->GetId()});
+    BOOST_CHECK_EQUAL(scheduler.GetQueueSize(), 1U);
+    scheduler.SkipAll(1);
+    BOOST_CHECK_EQUAL(scheduler.GetQueueSize(), 1U);
+    BOOST_CHECK(ReadAll(scheduler, 1, pool, now + 1s).empty());
+    scheduler.ForgetPeer(2);
+    BOOST_CHECK_EQUAL(scheduler.GetQueueSize(), 0U);
+
+    // Unknown peers read nothing.
+    CTransactionRef tx4 = AddTx(pool, 1000 * SATOSHI);
+    scheduler.Add(tx4->GetId());
+    BOOST_CHECK(ReadAll(scheduler, 2, pool, now + 2s).empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
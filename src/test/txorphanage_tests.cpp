@@ -0,0 +1,201 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txorphanage.h>
+
+#include <primitives/block.h>
+#include <script/script.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+BOOST_FIXTURE_TEST_SUITE(txorphanage_tests, BasicTestingSetup)
+
+static CTransactionRef MakeTx(const std::vector<COutPoint> &prevouts,
+                              size_t nOutputs = 1, size_t padding = 0) {
+    CMutableTransaction tx;
+    for (const COutPoint &prevout : prevouts) {
+        tx.vin.emplace_back(prevout);
+    }
+    tx.vout.resize(nOutputs);
+    for (CTxOut &out : tx.vout) {
+        out.nValue = CENT;
+        out.scriptPubKey = CScript() << OP_TRUE;
+    }
+    if (padding > 0) {
+        tx.vout[0].scriptPubKey << std::vector<uint8_t>(padding);
+    }
+    return MakeTransactionRef(tx);
+}
+
+static COutPoint RandomOutPoint() {
+    return COutPoint(TxId(InsecureRand256()), 0);
+}
+
+BOOST_AUTO_TEST_CASE(wait_on_missing_outpoints) {
+    TxOrphanage orphanage;
+    LOCK(g_cs_orphans);
+
+    const CTransactionRef parent1 = MakeTx({RandomOutPoint()}, 2);
+    const CTransactionRef parent2 = MakeTx({RandomOutPoint()});
+    const COutPoint confirmed = RandomOutPoint();
+
+    // The orphan spends a confirmed outpoint and waits on two parents.
+    const CTransactionRef orphan = MakeTx({COutPoint(parent1->GetId(), 0),
+                                           COutPoint(parent2->GetId(), 0),
+                                           confirmed});
+    BOOST_CHECK(orphanage.AddTx(orphan, 1,
+                                {COutPoint(parent1->GetId(), 0),
+                                 COutPoint(parent2->GetId(), 0)}));
+    BOOST_CHECK(!orphanage.AddTx(orphan, 2, {}));
+    BOOST_CHECK(orphanage.HaveTx(orphan->GetId()));
+    BOOST_CHECK_EQUAL(orphanage.Size(), 1);
+    BOOST_CHECK_EQUAL(orphanage.GetMissingOutpointCount(), 2);
+    BOOST_CHECK(!orphanage.HaveTxToReconsider(1));
+
+    // Unrelated transactions don't affect the orphan, even if they spend the
+    // same confirmed outpoint.
+    orphanage.AddChildrenToWorkSet(*MakeTx({confirmed}));
+    BOOST_CHECK_EQUAL(orphanage.GetMissingOutpointCount(), 2);
+
+    // The orphan is not reconsidered until both parents have been seen.
+    orphanage.AddChildrenToWorkSet(*parent1);
+    BOOST_CHECK_EQUAL(orphanage.GetMissingOutpointCount(), 1);
+    BOOST_CHECK(!orphanage.HaveTxToReconsider(1));
+
+    orphanage.AddChildrenToWorkSet(*parent2);
+    BOOST_CHECK_EQUAL(orphanage.GetMissingOutpointCount(), 0);
+
+    // It is then reconsidered on behalf of the peer it came from.
+    BOOST_CHECK(!orphanage.HaveTxToReconsider(2));
+    BOOST_CHECK(orphanage.HaveTxToReconsider(1));
+    BOOST_CHECK(orphanage.GetTxToReconsider(2) == nullptr);
+    BOOST_CHECK(orphanage.GetTxToReconsider(1) == orphan);
+    BOOST_CHECK(!orphanage.HaveTxToReconsider(1));
+    BOOST_CHECK(orphanage.GetTxToReconsider(1) == nullptr);
+
+    // If a parent went away in the meantime, wait for it again.
+    orphanage.SetMissingInputs(orphan->GetId(),
+                               {COutPoint(parent2->GetId(), 0)});
+    BOOST_CHECK_EQUAL(orphanage.GetMissingOutpointCount(), 1);
+    orphanage.AddChildrenToWorkSet(*parent2);
+    BOOST_CHECK(orphanage.GetTxToReconsider(1) == orphan);
+
+    BOOST_CHECK_EQUAL(orphanage.EraseTx(orphan->GetId()), 1);
+    BOOST_CHECK_EQUAL(orphanage.EraseTx(orphan->GetId()), 0);
+    BOOST_CHECK_EQUAL(orphanage.Size(), 0);
+    BOOST_CHECK_EQUAL(orphanage.GetPeerBytes(1), 0);
+}
+
+BOOST_AUTO_TEST_CASE(bulk_resolution) {
+    TxOrphanage orphanage;
+    LOCK(g_cs_orphans);
+
+    // Many orphans from different peers spend the outputs of the same parent.
+    const size_t nOrphans = 20;
+    const CTransactionRef parent = MakeTx({RandomOutPoint()}, nOrphans);
+    std::vector<CTransactionRef> orphans;
+    for (size_t i = 0; i < nOrphans; i++) {
+        const COutPoint prevout(parent->GetId(), i);
+        orphans.push_back(MakeTx({prevout}));
+        BOOST_CHECK(orphanage.AddTx(orphans.back(), i % 2, {prevout}));
+    }
+
+    // An orphan that got erased is not reconsidered.
+    BOOST_CHECK_EQUAL(orphanage.EraseTx(orphans[0]->GetId()), 1);
+
+    // A single lookup per output of the parent resolves all of them.
+    orphanage.AddChildrenToWorkSet(*parent);
+    BOOST_CHECK_EQUAL(orphanage.GetMissingOutpointCount(), 0);
+
+    size_t nReconsidered = 0;
+    for (NodeId peer = 0; peer < 2; peer++) {
+        while (CTransactionRef tx = orphanage.GetTxToReconsider(peer)) {
+            BOOST_CHECK(tx != orphans[0]);
+            BOOST_CHECK_EQUAL(orphanage.EraseTx(tx->GetId()), 1);
+            nReconsidered++;
+        }
+    }
+    BOOST_CHECK_EQUAL(nReconsidered, nOrphans - 1);
+    BOOST_CHECK_EQUAL(orphanage.Size(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(peer_quota) {
+    const size_t quota = 3000;
+    TxOrphanage orphanage(quota);
+    LOCK(g_cs_orphans);
+
+    // Each orphan is a bit more than 1000 bytes.
+    std::vector<CTransactionRef> orphans;
+    for (int i = 0; i < 3; i++) {
+        const COutPoint prevout = RandomOutPoint();
+        orphans.push_back(MakeTx({prevout}, 1, 1000));
+        BOOST_CHECK(orphans.back()->GetTotalSize() > 1000);
+    }
+    const size_t size = orphans[0]->GetTotalSize();
+    BOOST_CHECK(2 * size <= quota && 3 * size > quota);
+
+    BOOST_CHECK(orphanage.AddTx(orphans[0], 1, {orphans[0]->vin[0].prevout}));
+    BOOST_CHECK(orphanage.AddTx(orphans[1], 1, {orphans[1]->vin[0].prevout}));
+    BOOST_CHECK_EQUAL(orphanage.GetPeerBytes(1), 2 * size);
+
+    // The peer is over its quota, but other peers are not affected.
+    BOOST_CHECK(!orphanage.AddTx(orphans[2], 1, {orphans[2]->vin[0].prevout}));
+    BOOST_CHECK_EQUAL(orphanage.GetPeerBytes(1), 2 * size);
+    BOOST_CHECK(orphanage.AddTx(orphans[2], 2, {orphans[2]->vin[0].prevout}));
+    BOOST_CHECK_EQUAL(orphanage.GetPeerBytes(2), size);
+
+    // Erasing an orphan frees some quota.
+    orphanage.EraseTx(orphans[0]->GetId());
+    BOOST_CHECK_EQUAL(orphanage.GetPeerBytes(1), size);
+    orphanage.EraseForPeer(2);
+    BOOST_CHECK_EQUAL(orphanage.GetPeerBytes(2), 0);
+    BOOST_CHECK(orphanage.AddTx(orphans[2], 1, {orphans[2]->vin[0].prevout}));
+    BOOST_CHECK_EQUAL(orphanage.GetPeerBytes(1), 2 * size);
+
+    orphanage.LimitOrphans(0);
+    BOOST_CHECK_EQUAL(orphanage.Size(), 0);
+    BOOST_CHECK_EQUAL(orphanage.GetPeerBytes(1), 0);
+}
+
+BOOST_AUTO_TEST_CASE(erase_for_block) {
+    TxOrphanage orphanage;
+    LOCK(g_cs_orphans);
+
+    const CTransactionRef parent = MakeTx({RandomOutPoint()}, 2);
+    const CTransactionRef spender = MakeTx({COutPoint(parent->GetId(), 1)});
+
+    // An orphan waiting on an output of the block.
+    const COutPoint waitOn(parent->GetId(), 0);
+    const CTransactionRef child = MakeTx({waitOn});
+    // An orphan included in the block.
+    const CTransactionRef included = MakeTx({RandomOutPoint()});
+    // An orphan waiting on an outpoint the block spends.
+    const COutPoint spent(parent->GetId(), 1);
+    const CTransactionRef conflicted = MakeTx({spent});
+    // An unrelated orphan.
+    const CTransactionRef unrelated = MakeTx({RandomOutPoint()});
+
+    BOOST_CHECK(orphanage.AddTx(child, 1, {waitOn}));
+    BOOST_CHECK(orphanage.AddTx(included, 1, {included->vin[0].prevout}));
+    BOOST_CHECK(orphanage.AddTx(conflicted, 2, {spent}));
+    BOOST_CHECK(orphanage.AddTx(unrelated, 2, {unrelated->vin[0].prevout}));
+
+    CBlock block;
+    block.vtx = {parent, spender, included};
+    orphanage.EraseForBlock(block);
+
+    BOOST_CHECK_EQUAL(orphanage.Size(), 2);
+    BOOST_CHECK(!orphanage.HaveTx(included->GetId()));
+    BOOST_CHECK(!orphanage.HaveTx(conflicted->GetId()));
+    BOOST_CHECK(orphanage.HaveTx(unrelated->GetId()));
+    BOOST_CHECK(!orphanage.HaveTxToReconsider(2));
+    BOOST_CHECK(orphanage.GetTxToReconsider(1) == child);
+    BOOST_CHECK_EQUAL(orphanage.GetMissingOutpointCount(), 1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
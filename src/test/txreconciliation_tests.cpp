@@ -0,0 +1,184 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txreconciliation.h>
+
+#include <random.h>
+
+#include <test/util/setup_common.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <algorithm>
+
+BOOST_FIXTURE_TEST_SUITE(txreconciliation_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(capacity_estimate) {
+    // Without a coefficient, only the size difference is accounted for.
+    BOOST_CHECK_EQUAL(EstimateSketchCapacity(10, 10, 0), 1U);
+    BOOST_CHECK_EQUAL(EstimateSketchCapacity(10, 30, 0), 21U);
+    BOOST_CHECK_EQUAL(EstimateSketchCapacity(30, 10, 0), 21U);
+    BOOST_CHECK_EQUAL(EstimateSketchCapacity(100, 100, RECON_Q_PRECISION),
+                      101U);
+    BOOST_CHECK_EQUAL(
+        EstimateSketchCapacity(100, 120, uint16_t(RECON_Q * RECON_Q_PRECISION)),
+        45U);
+}
+
+BOOST_AUTO_TEST_CASE(registration) {
+    TxReconciliationTracker tracker;
+    const TxId txid(InsecureRand256());
+
+    // Peers must send their salt after we sent ours.
+    BOOST_CHECK(!tracker.RegisterPeer(0, false, 1, 1));
+    tracker.PreRegisterPeer(0);
+    BOOST_CHECK(!tracker.IsPeerRegistered(0));
+    BOOST_CHECK(tracker.ShouldFlood(0, txid));
+    BOOST_CHECK(!tracker.AddToSet(0, txid));
+
+    // Unknown versions are rejected.
+    BOOST_CHECK(!tracker.RegisterPeer(0, false, 0, 1));
+    BOOST_CHECK(tracker.RegisterPeer(0, false, 1, 1));
+    BOOST_CHECK(tracker.IsPeerRegistered(0));
+    BOOST_CHECK(!tracker.RegisterPeer(0, false, 1, 1));
+
+    // Only one outbound peer: all its transactions get flooded.
+    BOOST_CHECK(tracker.ShouldFlood(0, txid));
+
+    tracker.ForgetPeer(0);
+    BOOST_CHECK(!tracker.IsPeerRegistered(0));
+}
+
+BOOST_AUTO_TEST_CASE(flooding) {
+    TxReconciliationTracker tracker;
+    for (NodeId peer = 0; peer < 20; peer++) {
+        tracker.PreRegisterPeer(peer);
+        BOOST_CHECK(tracker.RegisterPeer(peer, peer >= 10, 1, 1));
+    }
+
+    // Transactions are flooded to about one outbound peer and a tenth of the
+    // inbound ones.
+    size_t outbound = 0;
+    size_t inbound = 0;
+    for (int i = 0; i < 1000; i++) {
+        const TxId txid(InsecureRand256());
+        for (NodeId peer = 0; peer < 20; peer++) {
+            if (tracker.ShouldFlood(peer, txid)) {
+                (peer < 10 ? outbound : inbound)++;
+            }
+        }
+    }
+    BOOST_CHECK(outbound > 800 && outbound < 1200);
+    BOOST_CHECK(inbound > 800 && inbound < 1200);
+}
+
+/** Register a connection, on which the peers have ids 1 and 0 respectively */
+static void Connect(TxReconciliationTracker &initiator,
+                    TxReconciliationTracker &responder) {
+    const uint64_t initiator_salt = initiator.PreRegisterPeer(1);
+    const uint64_t responder_salt = responder.PreRegisterPeer(0);
+    BOOST_CHECK(initiator.RegisterPeer(1, false, 1, responder_salt));
+    BOOST_CHECK(responder.RegisterPeer(0, true, 1, initiator_salt));
+}
+
+BOOST_AUTO_TEST_CASE(reconciliation) {
+    TxReconciliationTracker initiator;
+    TxReconciliationTracker responder;
+    Connect(initiator, responder);
+
+    std::vector<TxId> common;
+    std::vector<TxId> initiator_only;
+    std::vector<TxId> responder_only;
+    for (int i = 0; i < 100; i++) {
+        common.push_back(TxId(InsecureRand256()));
+        BOOST_CHECK(initiator.AddToSet(1, common.back()));
+        BOOST_CHECK(responder.AddToSet(0, common.back()));
+    }
+    for (int i = 0; i < 5; i++) {
+        initiator_only.push_back(TxId(InsecureRand256()));
+        BOOST_CHECK(initiator.AddToSet(1, initiator_only.back()));
+        responder_only.push_back(TxId(InsecureRand256()));
+        BOOST_CHECK(responder.AddToSet(0, responder_only.back()));
+    }
+    // Adding a transaction twice is fine.
+    BOOST_CHECK(initiator.AddToSet(1, common.front()));
+    BOOST_CHECK_EQUAL(initiator.GetSetSize(1), 105U);
+
+    // Only the initiator sends requests, and one at a time.
+    uint16_t size;
+    uint16_t q;
+    const std::chrono::microseconds now{1000000000};
+    BOOST_CHECK(!responder.InitiateReconciliation(0, now, size, q));
+    BOOST_CHECK(initiator.InitiateReconciliation(1, now, size, q));
+    BOOST_CHECK_EQUAL(size, 105U);
+    BOOST_CHECK(!initiator.InitiateReconciliation(1, now, size, q));
+
+    std::vector<uint8_t> sketch;
+    BOOST_CHECK(!initiator.HandleReconciliationRequest(1, size, q, sketch));
+    BOOST_CHECK(responder.HandleReconciliationRequest(0, size, q, sketch));
+    BOOST_CHECK_EQUAL(sketch.size(), 4 * EstimateSketchCapacity(105, 105, q));
+    BOOST_CHECK_EQUAL(responder.GetSetSize(0), 0U);
+
+    TxReconciliationTracker::Result result;
+    BOOST_CHECK(!responder.HandleSketch(0, sketch, result));
+    BOOST_CHECK(initiator.HandleSketch(1, sketch, result));
+    BOOST_CHECK(result.success);
+    BOOST_CHECK_EQUAL(initiator.GetSetSize(1), 0U);
+    std::sort(result.announce.begin(), result.announce.end());
+    std::sort(initiator_only.begin(), initiator_only.end());
+    BOOST_CHECK(result.announce == initiator_only);
+    BOOST_CHECK_EQUAL(result.missing.size(), 5U);
+
+    std::vector<TxId> announce;
+    BOOST_CHECK(responder.HandleReconciliationDiff(0, result.success,
+                                                   result.missing, announce));
+    std::sort(announce.begin(), announce.end());
+    std::sort(responder_only.begin(), responder_only.end());
+    BOOST_CHECK(announce == responder_only);
+    BOOST_CHECK(!responder.HandleReconciliationDiff(0, result.success,
+                                                    result.missing, announce));
+
+    // The next request is sent after the interval.
+    BOOST_CHECK(!initiator.InitiateReconciliation(
+        1, now + RECON_REQUEST_INTERVAL / 2, size, q));
+    BOOST_CHECK(initiator.InitiateReconciliation(
+        1, now + RECON_REQUEST_INTERVAL, size, q));
+}
+
+BOOST_AUTO_TEST_CASE(reconciliation_failure) {
+    TxReconciliationTracker initiator;
+    TxReconciliationTracker responder;
+    Connect(initiator, responder);
+
+    // The difference is larger than the capacity of the sketch.
+    std::vector<TxId> responder_txs;
+    for (int i = 0; i < 20; i++) {
+        BOOST_CHECK(initiator.AddToSet(1, TxId(InsecureRand256())));
+        responder_txs.push_back(TxId(InsecureRand256()));
+        BOOST_CHECK(responder.AddToSet(0, responder_txs.back()));
+    }
+
+    uint16_t size;
+    uint16_t q;
+    BOOST_CHECK(initiator.InitiateReconciliation(
+        1, std::chrono::microseconds{1000000000}, size, q));
+    std::vector<uint8_t> sketch;
+    BOOST_CHECK(responder.HandleReconciliationRequest(0, size, q, sketch));
+
+    // Both sides announce their whole set instead.
+    TxReconciliationTracker::Result result;
+    BOOST_CHECK(initiator.HandleSketch(1, sketch, result));
+    BOOST_CHECK(!result.success);
+    BOOST_CHECK_EQUAL(result.announce.size(), 20U);
+    BOOST_CHECK(result.missing.empty());
+
+    std::vector<TxId> announce;
+    BOOST_CHECK(responder.HandleReconciliationDiff(0, result.success,
+                                                   result.missing, announce));
+    std::sort(announce.begin(), announce.end());
+    std::sort(responder_txs.begin(), responder_txs.end());
+    BOOST_CHECK(announce == responder_txs);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -195,6 +195,7 @@ TestingSetup::TestingSetup(const std::string &chainName,
     constexpr int script_check_threads = 2;
     for (int i = 0; i < script_check_threads; ++i) {
         threadGroup.create_thread([i]() { return ThreadScriptCheck(i); });
+        threadGroup.create_thread([i]() { return ThreadHeaderCheck(i); });
     }
 
     m_node.mempool = &::g_mempool;
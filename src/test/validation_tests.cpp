@@ -10,6 +10,7 @@
 #include <config.h>
 #include <consensus/consensus.h>
 #include <net.h>
+#include <pow/pow.h>
 #include <primitives/transaction.h>
 #include <streams.h>
 #include <util/system.h>
@@ -130,4 +131,39 @@ BOOST_AUTO_TEST_CASE(validation_load_external_block_file) {
     BOOST_CHECK_NO_THROW({ LoadExternalBlockFile(config, fp, 0); });
 }
 
+BOOST_AUTO_TEST_CASE(check_block_headers) {
+    const auto chainparams = CreateChainParams(CBaseChainParams::REGTEST);
+    const Consensus::Params &params = chainparams->GetConsensus();
+
+    std::vector<CBlockHeader> headers(300);
+    BlockHash prev = chainparams->GenesisBlock().GetHash();
+    for (CBlockHeader &header : headers) {
+        header.hashPrevBlock = prev;
+        header.nBits = chainparams->GenesisBlock().nBits;
+        while (!CheckProofOfWork(header.GetHash(), header.nBits, params)) {
+            header.nNonce++;
+        }
+        prev = header.GetHash();
+    }
+
+    std::vector<BlockHash> hashes;
+    BOOST_CHECK(CheckBlockHeaders(headers, hashes, params));
+    BOOST_CHECK_EQUAL(hashes.size(), headers.size());
+    for (size_t i = 0; i < headers.size(); i++) {
+        BOOST_CHECK(hashes[i] == headers[i].GetHash());
+    }
+
+    // A header with a much harder target fails, but all the hashes are still
+    // returned.
+    headers[123].nBits = 0x1d00ffff;
+    BOOST_CHECK(!CheckBlockHeaders(headers, hashes, params));
+    BOOST_CHECK_EQUAL(hashes.size(), headers.size());
+    for (size_t i = 0; i < headers.size(); i++) {
+        BOOST_CHECK(hashes[i] == headers[i].GetHash());
+    }
+
+    BOOST_CHECK(CheckBlockHeaders({}, hashes, params));
+    BOOST_CHECK(hashes.empty());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,166 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txannouncement.h>
+
+#include <algorithm>
+
+TxAnnouncementScheduler g_tx_announcements;
+
+bool TxAnnouncementScheduler::AnnounceBefore(const TxAnnouncement &a,
+                                             const TxAnnouncement &b) {
+    if (a.ancestor_count != b.ancestor_count) {
+        return a.ancestor_count < b.ancestor_count;
+    }
+    // Same as CompareTxMemPoolEntryByScore
+    double f1 = b.info.vsize * (a.info.fee / SATOSHI);
+    double f2 = a.info.vsize * (b.info.fee / SATOSHI);
+    if (f1 == f2) {
+        return b.info.tx->GetId() < a.info.tx->GetId();
+    }
+    return f1 > f2;
+}
+
+void TxAnnouncementScheduler::Add(const TxId &txid) {
+    if (m_peer_count == 0) {
+        return;
+    }
+    LOCK(m_pending_mutex);
+    m_pending.push_back(txid);
+}
+
+void TxAnnouncementScheduler::RegisterPeer(NodeId peer) {
+    LOCK(m_mutex);
+    if (m_peers.emplace(peer, PeerState{EndBatch(), {}}).second) {
+        m_peer_count++;
+    }
+}
+
+void TxAnnouncementScheduler::ForgetPeer(NodeId peer) {
+    LOCK(m_mutex);
+    if (m_peers.erase(peer)) {
+        m_peer_count--;
+        ReleaseBatches();
+    }
+}
+
+void TxAnnouncementScheduler::SkipAll(NodeId peer) {
+    LOCK(m_mutex);
+    auto it = m_peers.find(peer);
+    if (it == m_peers.end()) {
+        return;
+    }
+    it->second.next_batch = EndBatch();
+    it->second.partial.clear();
+    ReleaseBatches();
+}
+
+void TxAnnouncementScheduler::MakeBatch(const CTxMemPool &mempool,
+                                        std::chrono::microseconds now) {
+    std::vector<TxId> txids;
+    {
+        LOCK(m_pending_mutex);
+        txids.swap(m_pending);
+    }
+    if (txids.empty()) {
+        return;
+    }
+    m_next_batch_time = now + TX_ANNOUNCEMENT_BATCH_INTERVAL;
+
+    std::vector<TxAnnouncement> batch;
+    batch.reserve(txids.size());
+    for (auto &entry : mempool.infoForRelay(txids)) {
+        batch.push_back({std::move(entry.first), entry.second});
+    }
+    std::sort(batch.begin(), batch.end(), AnnounceBefore);
+    // A transaction relayed twice is found twice, next to each other.
+    batch.erase(std::unique(batch.begin(), batch.end(),
+                            [](const TxAnnouncement &a,
+                               const TxAnnouncement &b) {
+                                return a.info.tx == b.info.tx;
+                            }),
+                batch.end());
+    if (!batch.empty()) {
+        m_batches.push_back(std::move(batch));
+    }
+}
+
+void TxAnnouncementScheduler::ReleaseBatches() {
+    uint64_t first_needed = EndBatch();
+    for (const auto &entry : m_peers) {
+        const PeerState &state = entry.second;
+        first_needed = std::min(first_needed, state.partial.empty()
+                                                  ? state.next_batch
+                                                  : state.partial.begin()->first);
+    }
+    while (m_first_batch < first_needed) {
+        m_batches.pop_front();
+        m_first_batch++;
+    }
+}
+
+void TxAnnouncementScheduler::Read(
+    NodeId peer, const CTxMemPool &mempool, std::chrono::microseconds now,
+    size_t max_count, const std::function<bool(const TxAnnouncement &)> &fn) {
+    LOCK(m_mutex);
+    auto peer_it = m_peers.find(peer);
+    if (peer_it == m_peers.end()) {
+        return;
+    }
+    if (now >= m_next_batch_time) {
+        MakeBatch(mempool, now);
+    }
+    PeerState &state = peer_it->second;
+
+    // The position of the peer in each batch it has not read entirely. They
+    // are merged with a heap, which pops the transaction to announce first.
+    struct Cursor {
+        uint64_t batch;
+        size_t pos;
+    };
+    std::vector<Cursor> cursors;
+    for (const auto &entry : state.partial) {
+        cursors.push_back({entry.first, entry.second});
+    }
+    for (uint64_t batch = state.next_batch; batch < EndBatch(); batch++) {
+        cursors.push_back({batch, 0});
+    }
+    auto get = [this](const Cursor &cursor) -> const TxAnnouncement & {
+        return m_batches[cursor.batch - m_first_batch][cursor.pos];
+    };
+    auto later = [&get](const Cursor &a, const Cursor &b) {
+        return AnnounceBefore(get(b), get(a));
+    };
+    std::make_heap(cursors.begin(), cursors.end(), later);
+
+    size_t count = 0;
+    while (!cursors.empty() && count < max_count) {
+        std::pop_heap(cursors.begin(), cursors.end(), later);
+        Cursor &cursor = cursors.back();
+        if (fn(get(cursor))) {
+            count++;
+        }
+        if (++cursor.pos < m_batches[cursor.batch - m_first_batch].size()) {
+            std::push_heap(cursors.begin(), cursors.end(), later);
+        } else {
+            cursors.pop_back();
+        }
+    }
+
+    state.partial.clear();
+    for (const Cursor &cursor : cursors) {
+        state.partial.emplace(cursor.batch, cursor.pos);
+    }
+    state.next_batch = EndBatch();
+    ReleaseBatches();
+}
+
+size_t TxAnnouncementScheduler::GetQueueSize() const {
+    LOCK(m_mutex);
+    size_t size = 0;
+    for (const std::vector<TxAnnouncement> &batch : m_batches) {
+        size += batch.size();
+    }
+    return size;
+}
@@ -0,0 +1,120 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXANNOUNCEMENT_H
+#define BITCOIN_TXANNOUNCEMENT_H
+
+#include <net.h>
+#include <primitives/txid.h>
+#include <sync.h>
+#include <txmempool.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <vector>
+
+/** Shortest time between two sorts of the transactions to announce */
+static constexpr std::chrono::milliseconds TX_ANNOUNCEMENT_BATCH_INTERVAL{100};
+
+/** A transaction to announce, as it was in the mempool when it was queued */
+struct TxAnnouncement {
+    TxMempoolInfo info;
+    //! Number of in-mempool ancestors, including the transaction itself.
+    uint64_t ancestor_count;
+};
+
+/**
+ * Schedule the announcements of transactions to the peers.
+ *
+ * Rather than each peer keeping a set of the transactions to announce to it,
+ * and sorting it in mempool order whenever it is time to announce them, the
+ * transactions to relay are queued here once for all the peers. At most once
+ * per TX_ANNOUNCEMENT_BATCH_INTERVAL, the transactions queued since the last
+ * time are looked up in the mempool and sorted into a batch. Each peer then
+ * reads the batches it has not read yet, merged in mempool order (see
+ * CTxMemPool::CompareDepthAndScore), and filters them according to what it
+ * knows and wants, so that the cost of each announcement does not depend on
+ * how many transactions are waiting to be announced.
+ *
+ * A batch is released once all the registered peers have read it.
+ *
+ * This class is thread safe.
+ */
+class TxAnnouncementScheduler {
+public:
+    /** Queue a transaction to be announced to all the registered peers */
+    void Add(const TxId &txid);
+
+    /**
+     * Start tracking a peer. It is announced the transactions queued from now
+     * on, and the ones queued before which are not sorted into a batch yet.
+     */
+    void RegisterPeer(NodeId peer);
+    void ForgetPeer(NodeId peer);
+
+    /** Skip the transactions queued for a peer so far */
+    void SkipAll(NodeId peer);
+
+    /**
+     * Read the transactions queued for a peer in mempool order, passing each
+     * one to fn, until fn has returned true, meaning the transaction was
+     * announced, max_count times. The transactions fn was called for are not
+     * read again. fn is called with the scheduler locked, so it must not call
+     * back into it.
+     */
+    void Read(NodeId peer, const CTxMemPool &mempool,
+              std::chrono::microseconds now, size_t max_count,
+              const std::function<bool(const TxAnnouncement &)> &fn);
+
+    /** Return how many transactions are queued and not released */
+    size_t GetQueueSize() const;
+
+    /**
+     * Whether a should be announced before b: transactions with fewer
+     * ancestors come first, so that parents are announced before their
+     * children, then the ones with the highest feerate.
+     */
+    static bool AnnounceBefore(const TxAnnouncement &a,
+                               const TxAnnouncement &b);
+
+private:
+    struct PeerState {
+        //! The batches from this one on are not read at all.
+        uint64_t next_batch{0};
+        //! How many transactions have been read from the batches before
+        //! next_batch which are not read entirely.
+        std::map<uint64_t, size_t> partial;
+    };
+
+    /** Sort the transactions queued since the last batch into a new one */
+    void MakeBatch(const CTxMemPool &mempool, std::chrono::microseconds now)
+        EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    /** Release the batches every peer has read */
+    void ReleaseBatches() EXCLUSIVE_LOCKS_REQUIRED(m_mutex);
+    uint64_t EndBatch() const EXCLUSIVE_LOCKS_REQUIRED(m_mutex) {
+        return m_first_batch + m_batches.size();
+    }
+
+    //! Transactions are not queued while there is no peer to announce them.
+    std::atomic<size_t> m_peer_count{0};
+
+    //! Taken after m_mutex.
+    mutable Mutex m_pending_mutex;
+    std::vector<TxId> m_pending GUARDED_BY(m_pending_mutex);
+
+    mutable Mutex m_mutex;
+    std::deque<std::vector<TxAnnouncement>> m_batches GUARDED_BY(m_mutex);
+    //! The number of the first batch in m_batches.
+    uint64_t m_first_batch GUARDED_BY(m_mutex){0};
+    std::chrono::microseconds m_next_batch_time GUARDED_BY(m_mutex){0};
+    std::map<NodeId, PeerState> m_peers GUARDED_BY(m_mutex);
+};
+
+extern TxAnnouncementScheduler g_tx_announcements;
+
+#endif // BITCOIN_TXANNOUNCEMENT_H
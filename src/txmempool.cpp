@@ -180,6 +180,61 @@ void CTxMemPool::UpdateTransactionsFromBlock(
     }
 }
 
+bool CTxMemPool::CheckParentsPackageLimits(
+    const setEntries &parents, const CTxMemPoolEntry &entry,
+    uint64_t limitAncestorCount, uint64_t limitAncestorSize,
+    uint64_t limitDescendantCount, uint64_t limitDescendantSize,
+    std::string &errString, bool &fWithinAncestorLimits) const {
+    // The ancestors of entry are the union of the ancestor packages of its
+    // parents, so the largest of these packages is a lower bound for the
+    // entry's own package and their sum is an upper bound.
+    uint64_t maxCountWithAncestors = 0;
+    uint64_t maxSizeWithAncestors = 0;
+    uint64_t sumCountWithAncestors = 0;
+    uint64_t sumSizeWithAncestors = 0;
+    for (txiter parent : parents) {
+        // Each parent gains entry as a descendant.
+        if (parent->GetSizeWithDescendants() + entry.GetTxSize() >
+            limitDescendantSize) {
+            errString = strprintf(
+                "exceeds descendant size limit for tx %s [limit: %u]",
+                parent->GetTx().GetId().ToString(), limitDescendantSize);
+            return false;
+        }
+
+        if (parent->GetCountWithDescendants() + 1 > limitDescendantCount) {
+            errString = strprintf("too many descendants for tx %s [limit: %u]",
+                                  parent->GetTx().GetId().ToString(),
+                                  limitDescendantCount);
+            return false;
+        }
+
+        maxCountWithAncestors =
+            std::max(maxCountWithAncestors, parent->GetCountWithAncestors());
+        maxSizeWithAncestors =
+            std::max(maxSizeWithAncestors, parent->GetSizeWithAncestors());
+        sumCountWithAncestors += parent->GetCountWithAncestors();
+        sumSizeWithAncestors += parent->GetSizeWithAncestors();
+    }
+
+    if (maxCountWithAncestors + 1 > limitAncestorCount) {
+        errString = strprintf("too many unconfirmed ancestors [limit: %u]",
+                              limitAncestorCount);
+        return false;
+    }
+
+    if (maxSizeWithAncestors + entry.GetTxSize() > limitAncestorSize) {
+        errString = strprintf("exceeds ancestor size limit [limit: %u]",
+                              limitAncestorSize);
+        return false;
+    }
+
+    fWithinAncestorLimits =
+        sumCountWithAncestors + 1 <= limitAncestorCount &&
+        sumSizeWithAncestors + entry.GetTxSize() <= limitAncestorSize;
+    return true;
+}
+
 bool CTxMemPool::CalculateMemPoolAncestors(
     const CTxMemPoolEntry &entry, setEntries &setAncestors,
     uint64_t limitAncestorCount, uint64_t limitAncestorSize,
@@ -212,13 +267,32 @@ bool CTxMemPool::CalculateMemPoolAncestors(
         parentHashes = GetMemPoolParents(it);
     }
 
+    // Use the cached package statistics of the parents to reject entries
+    // that are over the limits before walking all of their ancestors, and to
+    // skip the ancestor limit checks when they cannot be hit.
+    bool fWithinAncestorLimits = false;
+    if (!CheckParentsPackageLimits(parentHashes, entry, limitAncestorCount,
+                                   limitAncestorSize, limitDescendantCount,
+                                   limitDescendantSize, errString,
+                                   fWithinAncestorLimits)) {
+        return false;
+    }
+
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
-    while (!parentHashes.empty()) {
-        txiter stageit = *parentHashes.begin();
+    // Ancestors are added to setAncestors as soon as they are discovered, and
+    // staged for a visit of their own parents.
+    std::vector<txiter> staged;
+    staged.reserve(parentHashes.size());
+    for (txiter parent : parentHashes) {
+        if (setAncestors.insert(parent).second) {
+            staged.push_back(parent);
+        }
+    }
 
-        setAncestors.insert(stageit);
-        parentHashes.erase(stageit);
+    while (!staged.empty()) {
+        txiter stageit = staged.back();
+        staged.pop_back();
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry.GetTxSize() >
@@ -236,7 +310,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(
             return false;
         }
 
-        if (totalSizeWithAncestors > limitAncestorSize) {
+        if (!fWithinAncestorLimits &&
+            totalSizeWithAncestors > limitAncestorSize) {
             errString = strprintf("exceeds ancestor size limit [limit: %u]",
                                   limitAncestorSize);
             return false;
@@ -245,11 +320,12 @@ bool CTxMemPool::CalculateMemPoolAncestors(
         const setEntries &setMemPoolParents = GetMemPoolParents(stageit);
         for (txiter phash : setMemPoolParents) {
             // If this is a new ancestor, add it.
-            if (setAncestors.count(phash) == 0) {
-                parentHashes.insert(phash);
+            if (!setAncestors.insert(phash).second) {
+                continue;
             }
-            if (parentHashes.size() + setAncestors.size() + 1 >
-                limitAncestorCount) {
+            staged.push_back(phash);
+            if (!fWithinAncestorLimits &&
+                setAncestors.size() + 1 > limitAncestorCount) {
                 errString =
                     strprintf("too many unconfirmed ancestors [limit: %u]",
                               limitAncestorCount);
@@ -456,6 +532,7 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry,
 
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
+    feeHistogram.AddTx(entry);
 
     vTxHashes.emplace_back(tx.GetHash(), newit);
     newit->vTxHashesIdx = vTxHashes.size() - 1;
@@ -486,6 +563,8 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason) {
     }
 
     totalTxSize -= it->GetTxSize();
+    feeHistogram.RemoveTx(*it, reason == MemPoolRemovalReason::EXPIRY ||
+                                   reason == MemPoolRemovalReason::SIZELIMIT);
     cachedInnerUsage -= it->DynamicMemoryUsage();
     cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) +
                         memusage::DynamicUsage(mapLinks[it].children);
@@ -646,6 +725,8 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef> &vtx,
             entries.push_back(&*i);
         }
     }
+    // Before the entries are removed, record their confirmation.
+    feeHistogram.ProcessBlock(nBlockHeight, entries);
 
     for (const CTransactionRef &tx :
          reverse_iterate(disconnectpool.GetQueuedTx().get<insertion_order>())) {
@@ -671,6 +752,7 @@ void CTxMemPool::_clear() {
     mapNextTx.clear();
     vTxHashes.clear();
     totalTxSize = 0;
+    feeHistogram.ClearMempool();
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
     blockSinceLastRollingFeeBump = false;
@@ -913,6 +995,20 @@ std::vector<TxMempoolInfo> CTxMemPool::infoAll() const {
     return ret;
 }
 
+std::vector<std::pair<TxMempoolInfo, uint64_t>>
+CTxMemPool::infoForRelay(const std::vector<TxId> &txids) const {
+    std::vector<std::pair<TxMempoolInfo, uint64_t>> ret;
+    ret.reserve(txids.size());
+    LOCK(cs);
+    for (const TxId &txid : txids) {
+        indexed_transaction_set::const_iterator it = mapTx.find(txid);
+        if (it != mapTx.end()) {
+            ret.emplace_back(GetInfo(it), it->GetCountWithAncestors());
+        }
+    }
+    return ret;
+}
+
 CTransactionRef CTxMemPool::get(const TxId &txid) const {
     LOCK(cs);
     indexed_transaction_set::const_iterator i = mapTx.find(txid);
@@ -945,6 +1041,29 @@ CFeeRate CTxMemPool::estimateFee() const {
     return std::max(::minRelayTxFee, GetMinFee(maxMempoolSize));
 }
 
+CFeeRate CTxMemPool::estimateFee(unsigned int nBlocks,
+                                 uint64_t nMaxBlockSize) const {
+    LOCK(cs);
+
+    CFeeRate feeRate = estimateFee();
+    std::optional<CFeeRate> historical = feeHistogram.EstimateFee(nBlocks);
+    if (historical) {
+        feeRate = std::max(feeRate, *historical);
+    }
+
+    // Outbid the transactions found nBlocks blocks deep into the mempool,
+    // which would otherwise be mined first.
+    std::optional<size_t> bucket =
+        feeHistogram.GetBucketAtDepth(nBlocks * nMaxBlockSize);
+    if (bucket) {
+        const size_t next =
+            std::min(*bucket + 1, feeHistogram.GetBucketCount() - 1);
+        feeRate = std::max(feeRate, feeHistogram.GetBucketFeeRate(next));
+    }
+
+    return feeRate;
+}
+
 void CTxMemPool::PrioritiseTransaction(const TxId &txid,
                                        const Amount nFeeDelta) {
     {
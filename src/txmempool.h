@@ -10,6 +10,7 @@
 #include <coins.h>
 #include <core_memusage.h>
 #include <indirectmap.h>
+#include <policy/fees.h>
 #include <primitives/transaction.h>
 #include <salteduint256hasher.h>
 #include <sync.h>
@@ -290,10 +291,18 @@ public:
     }
 };
 
+/** \class CompareTxMemPoolEntryByEntryTime
+ *
+ *  Sort an entry by its entry time, breaking ties by txid so that an entry's
+ *  position can be found again from its (time, txid) pair.
+ */
 class CompareTxMemPoolEntryByEntryTime {
 public:
     bool operator()(const CTxMemPoolEntry &a, const CTxMemPoolEntry &b) const {
-        return a.GetTime() < b.GetTime();
+        if (a.GetTime() != b.GetTime()) {
+            return a.GetTime() < b.GetTime();
+        }
+        return a.GetTx().GetId() < b.GetTx().GetId();
     }
 };
 
@@ -473,6 +482,8 @@ private:
 
     //! sum of all mempool tx's sizes.
     uint64_t totalTxSize;
+    //! fee rates of the mempool txs and of the recently confirmed ones.
+    FeeRateHistogram feeHistogram GUARDED_BY(cs);
     //! sum of dynamic memory usage of all the map elements (NOT the maps
     //! themselves)
     uint64_t cachedInnerUsage;
@@ -699,6 +710,24 @@ public:
         std::string &errString, bool fSearchForParents = true) const
         EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    /**
+     * Check the limits enforced by CalculateMemPoolAncestors() using only the
+     * cached package statistics of the direct parents of entry, in
+     * O(parents). Returns false if a limit is certainly exceeded.
+     * fWithinAncestorLimits is set to true if the ancestor limits certainly
+     * hold, in which case they do not need to be checked while walking the
+     * ancestors.
+     */
+    bool CheckParentsPackageLimits(const setEntries &parents,
+                                   const CTxMemPoolEntry &entry,
+                                   uint64_t limitAncestorCount,
+                                   uint64_t limitAncestorSize,
+                                   uint64_t limitDescendantCount,
+                                   uint64_t limitDescendantSize,
+                                   std::string &errString,
+                                   bool &fWithinAncestorLimits) const
+        EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     /**
      * Populate setDescendants with all in-mempool descendants of hash.
      * Assumes that setDescendants includes all in-mempool descendants of
@@ -769,8 +798,28 @@ public:
     CTransactionRef get(const TxId &txid) const;
     TxMempoolInfo info(const TxId &txid) const;
     std::vector<TxMempoolInfo> infoAll() const;
+    /**
+     * Return the information of the given transactions which are still in the
+     * mempool, along with their number of in-mempool ancestors which orders
+     * them for relay (see CompareDepthAndScore), under a single lock.
+     */
+    std::vector<std::pair<TxMempoolInfo, uint64_t>>
+    infoForRelay(const std::vector<TxId> &txids) const;
 
     CFeeRate estimateFee() const;
+    /**
+     * Estimate the fee rate needed for a transaction to be confirmed within
+     * nBlocks blocks of at most nMaxBlockSize bytes, from the recently
+     * confirmed transactions and from the transactions in the mempool that
+     * would be mined first. Never lower than estimateFee().
+     */
+    CFeeRate estimateFee(unsigned int nBlocks, uint64_t nMaxBlockSize) const;
+
+    const FeeRateHistogram &GetFeeRateHistogram() const
+        EXCLUSIVE_LOCKS_REQUIRED(cs) {
+        AssertLockHeld(cs);
+        return feeHistogram;
+    }
 
     size_t DynamicMemoryUsage() const;
 
@@ -0,0 +1,313 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txorphanage.h>
+
+#include <logging.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <util/time.h>
+
+#include <algorithm>
+#include <cassert>
+
+RecursiveMutex g_cs_orphans;
+
+bool TxOrphanage::AddTx(const CTransactionRef &tx, NodeId peer,
+                        const std::vector<COutPoint> &missing) {
+    AssertLockHeld(g_cs_orphans);
+
+    const TxId &txid = tx->GetId();
+    if (m_orphans.count(txid)) {
+        return false;
+    }
+
+    // Ignore big transactions, to avoid a send-big-orphans memory exhaustion
+    // attack. If a peer has a legitimate large transaction with a missing
+    // parent then we assume it will rebroadcast it later, after the parent
+    // transaction(s) have been mined or received.
+    // 100 orphans, each of which is at most 100,000 bytes big is at most 10
+    // megabytes of orphans and somewhat more of the outpoint index (in the
+    // worst case):
+    const size_t sz = tx->GetTotalSize();
+    if (sz > MAX_STANDARD_TX_SIZE) {
+        LogPrint(BCLog::MEMPOOL,
+                 "ignoring large orphan tx (size: %u, hash: %s)\n", sz,
+                 txid.ToString());
+        return false;
+    }
+
+    // A single peer cannot use up the whole orphanage.
+    size_t &peer_bytes = m_peer_bytes[peer];
+    if (peer_bytes + sz > m_max_peer_bytes) {
+        LogPrint(BCLog::MEMPOOL,
+                 "ignoring orphan tx %s, peer=%d exceeds its orphan quota "
+                 "(%u + %u > %u bytes)\n",
+                 txid.ToString(), peer, peer_bytes, sz, m_max_peer_bytes);
+        if (peer_bytes == 0) {
+            m_peer_bytes.erase(peer);
+        }
+        return false;
+    }
+    peer_bytes += sz;
+
+    auto ret = m_orphans.emplace(
+        txid, OrphanTx{tx, peer, GetTime() + ORPHAN_TX_EXPIRE_TIME,
+                       m_orphan_list.size(), {}});
+    assert(ret.second);
+    m_orphan_list.push_back(ret.first);
+    WaitOn(ret.first, missing);
+
+    LogPrint(BCLog::MEMPOOL, "stored orphan tx %s (mapsz %u outsz %u)\n",
+             txid.ToString(), m_orphans.size(), m_outpoint_to_orphan_it.size());
+    return true;
+}
+
+bool TxOrphanage::HaveTx(const TxId &txid) const {
+    AssertLockHeld(g_cs_orphans);
+    return m_orphans.count(txid);
+}
+
+void TxOrphanage::WaitOn(OrphanMap::iterator it,
+                         const std::vector<COutPoint> &missing) {
+    AssertLockHeld(g_cs_orphans);
+    assert(it->second.missing.empty());
+
+    it->second.missing = missing;
+    for (const COutPoint &outpoint : missing) {
+        m_outpoint_to_orphan_it[outpoint].insert(it);
+    }
+
+    if (missing.empty()) {
+        m_peer_work_set[it->second.fromPeer].insert(it->first);
+    }
+}
+
+void TxOrphanage::StopWaiting(OrphanMap::iterator it) {
+    AssertLockHeld(g_cs_orphans);
+
+    for (const COutPoint &outpoint : it->second.missing) {
+        const auto itPrev = m_outpoint_to_orphan_it.find(outpoint);
+        if (itPrev == m_outpoint_to_orphan_it.end()) {
+            continue;
+        }
+        itPrev->second.erase(it);
+        if (itPrev->second.empty()) {
+            m_outpoint_to_orphan_it.erase(itPrev);
+        }
+    }
+    it->second.missing.clear();
+}
+
+int TxOrphanage::EraseTx(const TxId &txid) {
+    AssertLockHeld(g_cs_orphans);
+
+    const auto it = m_orphans.find(txid);
+    if (it == m_orphans.end()) {
+        return 0;
+    }
+    StopWaiting(it);
+
+    size_t old_pos = it->second.list_pos;
+    assert(m_orphan_list[old_pos] == it);
+    if (old_pos + 1 != m_orphan_list.size()) {
+        // Unless we're deleting the last entry in m_orphan_list, move the last
+        // entry to the position we're deleting.
+        auto it_last = m_orphan_list.back();
+        m_orphan_list[old_pos] = it_last;
+        it_last->second.list_pos = old_pos;
+    }
+    m_orphan_list.pop_back();
+
+    const NodeId peer = it->second.fromPeer;
+    auto itBytes = m_peer_bytes.find(peer);
+    assert(itBytes != m_peer_bytes.end());
+    itBytes->second -= it->second.tx->GetTotalSize();
+    if (itBytes->second == 0) {
+        m_peer_bytes.erase(itBytes);
+    }
+
+    auto itWork = m_peer_work_set.find(peer);
+    if (itWork != m_peer_work_set.end()) {
+        itWork->second.erase(txid);
+        if (itWork->second.empty()) {
+            m_peer_work_set.erase(itWork);
+        }
+    }
+
+    m_orphans.erase(it);
+    return 1;
+}
+
+void TxOrphanage::EraseForPeer(NodeId peer) {
+    AssertLockHeld(g_cs_orphans);
+
+    int nErased = 0;
+    auto iter = m_orphans.begin();
+    while (iter != m_orphans.end()) {
+        // Increment to avoid iterator becoming invalid.
+        const auto maybeErase = iter++;
+        if (maybeErase->second.fromPeer == peer) {
+            nErased += EraseTx(maybeErase->first);
+        }
+    }
+    if (nErased > 0) {
+        LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx from peer=%d\n", nErased,
+                 peer);
+    }
+}
+
+void TxOrphanage::EraseForBlock(const CBlock &block) {
+    AssertLockHeld(g_cs_orphans);
+
+    std::vector<TxId> vOrphanErase;
+    for (const CTransactionRef &ptx : block.vtx) {
+        if (m_orphans.count(ptx->GetId())) {
+            vOrphanErase.push_back(ptx->GetId());
+        }
+
+        // The orphans waiting on an outpoint spent by this block can never be
+        // accepted.
+        for (const CTxIn &txin : ptx->vin) {
+            auto itByPrev = m_outpoint_to_orphan_it.find(txin.prevout);
+            if (itByPrev == m_outpoint_to_orphan_it.end()) {
+                continue;
+            }
+            for (const auto &mi : itByPrev->second) {
+                vOrphanErase.push_back(mi->first);
+            }
+        }
+    }
+
+    // Erase orphan transactions included or precluded by this block
+    if (vOrphanErase.size()) {
+        int nErased = 0;
+        for (const TxId &orphanId : vOrphanErase) {
+            nErased += EraseTx(orphanId);
+        }
+        LogPrint(BCLog::MEMPOOL,
+                 "Erased %d orphan tx included or conflicted by block\n",
+                 nErased);
+    }
+
+    for (const CTransactionRef &ptx : block.vtx) {
+        AddChildrenToWorkSet(*ptx);
+    }
+}
+
+unsigned int TxOrphanage::LimitOrphans(unsigned int max_orphans) {
+    AssertLockHeld(g_cs_orphans);
+
+    unsigned int nEvicted = 0;
+    int64_t nNow = GetTime();
+    if (m_next_sweep <= nNow) {
+        // Sweep out expired orphan pool entries:
+        int nErased = 0;
+        int64_t nMinExpTime =
+            nNow + ORPHAN_TX_EXPIRE_TIME - ORPHAN_TX_EXPIRE_INTERVAL;
+        auto iter = m_orphans.begin();
+        while (iter != m_orphans.end()) {
+            const auto maybeErase = iter++;
+            if (maybeErase->second.nTimeExpire <= nNow) {
+                nErased += EraseTx(maybeErase->first);
+            } else {
+                nMinExpTime =
+                    std::min(maybeErase->second.nTimeExpire, nMinExpTime);
+            }
+        }
+        // Sweep again 5 minutes after the next entry that expires in order to
+        // batch the linear scan.
+        m_next_sweep = nMinExpTime + ORPHAN_TX_EXPIRE_INTERVAL;
+        if (nErased > 0) {
+            LogPrint(BCLog::MEMPOOL, "Erased %d orphan tx due to expiration\n",
+                     nErased);
+        }
+    }
+    FastRandomContext rng;
+    while (m_orphans.size() > max_orphans) {
+        // Evict a random orphan:
+        size_t randompos = rng.randrange(m_orphan_list.size());
+        EraseTx(m_orphan_list[randompos]->first);
+        ++nEvicted;
+    }
+    return nEvicted;
+}
+
+void TxOrphanage::AddChildrenToWorkSet(const CTransaction &tx) {
+    AssertLockHeld(g_cs_orphans);
+
+    const TxId &txid = tx.GetId();
+    for (uint32_t i = 0; i < tx.vout.size(); i++) {
+        const COutPoint outpoint(txid, i);
+        const auto it_by_prev = m_outpoint_to_orphan_it.find(outpoint);
+        if (it_by_prev == m_outpoint_to_orphan_it.end()) {
+            continue;
+        }
+
+        for (const auto &elem : it_by_prev->second) {
+            std::vector<COutPoint> &missing = elem->second.missing;
+            missing.erase(std::remove(missing.begin(), missing.end(), outpoint),
+                          missing.end());
+            if (missing.empty()) {
+                m_peer_work_set[elem->second.fromPeer].insert(elem->first);
+            }
+        }
+        m_outpoint_to_orphan_it.erase(it_by_prev);
+    }
+}
+
+CTransactionRef TxOrphanage::GetTxToReconsider(NodeId peer) {
+    AssertLockHeld(g_cs_orphans);
+
+    auto itWork = m_peer_work_set.find(peer);
+    if (itWork == m_peer_work_set.end()) {
+        return nullptr;
+    }
+
+    // Entries are removed from the work set when the orphan is erased, so the
+    // orphan must exist.
+    const TxId txid = *itWork->second.begin();
+    itWork->second.erase(itWork->second.begin());
+    if (itWork->second.empty()) {
+        m_peer_work_set.erase(itWork);
+    }
+
+    const auto it = m_orphans.find(txid);
+    assert(it != m_orphans.end());
+    return it->second.tx;
+}
+
+bool TxOrphanage::HaveTxToReconsider(NodeId peer) const {
+    AssertLockHeld(g_cs_orphans);
+    return m_peer_work_set.count(peer);
+}
+
+void TxOrphanage::SetMissingInputs(const TxId &txid,
+                                   const std::vector<COutPoint> &missing) {
+    AssertLockHeld(g_cs_orphans);
+
+    const auto it = m_orphans.find(txid);
+    if (it == m_orphans.end()) {
+        return;
+    }
+    StopWaiting(it);
+    WaitOn(it, missing);
+}
+
+size_t TxOrphanage::GetPeerBytes(NodeId peer) const {
+    AssertLockHeld(g_cs_orphans);
+
+    const auto it = m_peer_bytes.find(peer);
+    return it == m_peer_bytes.end() ? 0 : it->second;
+}
+
+void TxOrphanage::Clear() {
+    AssertLockHeld(g_cs_orphans);
+
+    m_orphans.clear();
+    m_outpoint_to_orphan_it.clear();
+    m_orphan_list.clear();
+    m_peer_work_set.clear();
+    m_peer_bytes.clear();
+}
@@ -0,0 +1,169 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXORPHANAGE_H
+#define BITCOIN_TXORPHANAGE_H
+
+#include <net.h>
+#include <policy/policy.h>
+#include <primitives/transaction.h>
+#include <sync.h>
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <vector>
+
+class CBlock;
+
+/** Guards orphan transactions and extra txs for compact blocks */
+extern RecursiveMutex g_cs_orphans;
+
+/** Expiration time for orphan transactions in seconds */
+static constexpr int64_t ORPHAN_TX_EXPIRE_TIME = 20 * 60;
+/** Minimum time between orphan transactions expire time checks in seconds */
+static constexpr int64_t ORPHAN_TX_EXPIRE_INTERVAL = 5 * 60;
+/**
+ * Default for the total size of the orphan transactions a single peer can
+ * have in the orphanage, in bytes.
+ */
+static constexpr size_t DEFAULT_MAX_ORPHAN_BYTES_PER_PEER =
+    4 * MAX_STANDARD_TX_SIZE;
+
+/**
+ * A class to track orphan transactions, i.e. transactions whose parents are
+ * not known yet.
+ *
+ * Orphans are indexed by the outpoints they are still waiting on rather than
+ * by all their inputs, so that the arrival of a parent only touches the
+ * orphans spending its outputs, and an orphan is only reconsidered once all
+ * its missing outpoints have been seen. Orphans ready to be reconsidered are
+ * queued in a work set belonging to the peer that sent them, so that a peer
+ * flooding us with orphans only consumes its own share of message processing.
+ */
+class TxOrphanage {
+public:
+    explicit TxOrphanage(
+        size_t max_peer_bytes = DEFAULT_MAX_ORPHAN_BYTES_PER_PEER)
+        : m_max_peer_bytes(max_peer_bytes) {}
+
+    /**
+     * Add a new orphan transaction, waiting on the given missing outpoints.
+     * Returns false if the transaction is already known, too large or exceeds
+     * the quota of the peer.
+     */
+    bool AddTx(const CTransactionRef &tx, NodeId peer,
+               const std::vector<COutPoint> &missing)
+        EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** Check if we already have an orphan transaction */
+    bool HaveTx(const TxId &txid) const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** Erase an orphan by txid, returns the number of erased orphans */
+    int EraseTx(const TxId &txid) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** Erase all orphans announced by a peer (eg, after it disconnected) */
+    void EraseForPeer(NodeId peer) EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /**
+     * Erase the orphans included in or conflicting with a block, then make
+     * the outputs of the block available to the remaining orphans.
+     */
+    void EraseForBlock(const CBlock &block)
+        EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /**
+     * Erase expired orphans, then random orphans until there are no more than
+     * max_orphans. Returns the number of randomly evicted orphans.
+     */
+    unsigned int LimitOrphans(unsigned int max_orphans)
+        EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /**
+     * Make the outputs of a transaction available to the orphans waiting on
+     * them. The orphans no longer missing any outpoint are added to the work
+     * set of the peer they came from.
+     */
+    void AddChildrenToWorkSet(const CTransaction &tx)
+        EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /**
+     * Pop an orphan from the work set of a peer. Returns nullptr if there is
+     * no orphan to reconsider on behalf of this peer.
+     */
+    CTransactionRef GetTxToReconsider(NodeId peer)
+        EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    bool HaveTxToReconsider(NodeId peer) const
+        EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /**
+     * Wait again on the given outpoints, e.g. because a parent was evicted
+     * from the mempool before the orphan could be reconsidered.
+     */
+    void SetMissingInputs(const TxId &txid,
+                          const std::vector<COutPoint> &missing)
+        EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** Return how many orphans there are */
+    size_t Size() const EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans) {
+        return m_orphans.size();
+    }
+
+    /** Return the total size of the orphans announced by a peer */
+    size_t GetPeerBytes(NodeId peer) const
+        EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+    /** Return the number of outpoints the orphans are waiting on */
+    size_t GetMissingOutpointCount() const
+        EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans) {
+        return m_outpoint_to_orphan_it.size();
+    }
+
+    void Clear() EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+
+protected:
+    struct OrphanTx {
+        CTransactionRef tx;
+        NodeId fromPeer;
+        int64_t nTimeExpire;
+        size_t list_pos;
+        //! The outpoints this orphan is still waiting on.
+        std::vector<COutPoint> missing;
+    };
+
+    using OrphanMap = std::map<TxId, OrphanTx>;
+
+    struct IteratorComparator {
+        template <typename I> bool operator()(const I &a, const I &b) const {
+            return &(*a) < &(*b);
+        }
+    };
+
+    const size_t m_max_peer_bytes;
+
+    OrphanMap m_orphans GUARDED_BY(g_cs_orphans);
+
+    //! Index from the missing outpoints to the orphans waiting on them.
+    std::map<COutPoint, std::set<OrphanMap::iterator, IteratorComparator>>
+        m_outpoint_to_orphan_it GUARDED_BY(g_cs_orphans);
+
+    //! For random eviction
+    std::vector<OrphanMap::iterator> m_orphan_list GUARDED_BY(g_cs_orphans);
+
+    //! Orphans to reconsider, by the peer they came from.
+    std::map<NodeId, std::set<TxId>> m_peer_work_set GUARDED_BY(g_cs_orphans);
+
+    //! Total size of the orphans, by the peer they came from.
+    std::map<NodeId, size_t> m_peer_bytes GUARDED_BY(g_cs_orphans);
+
+    int64_t m_next_sweep GUARDED_BY(g_cs_orphans){0};
+
+    void WaitOn(OrphanMap::iterator it, const std::vector<COutPoint> &missing)
+        EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+    void StopWaiting(OrphanMap::iterator it)
+        EXCLUSIVE_LOCKS_REQUIRED(g_cs_orphans);
+};
+
+#endif // BITCOIN_TXORPHANAGE_H
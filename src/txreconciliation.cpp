@@ -0,0 +1,280 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txreconciliation.h>
+
+#include <crypto/siphash.h>
+#include <hash.h>
+#include <pinsketch.h>
+#include <random.h>
+
+#include <algorithm>
+#include <limits>
+#include <string>
+
+/** Tag of the hash from which the short id keys are derived */
+static const std::string RECON_SALT_TAG = "Tx Relay Salting";
+
+size_t EstimateSketchCapacity(size_t local_size, size_t remote_size,
+                              uint16_t q) {
+    const size_t difference = local_size > remote_size
+                                  ? local_size - remote_size
+                                  : remote_size - local_size;
+    const size_t min_size = std::min(local_size, remote_size);
+    return difference + min_size * q / RECON_Q_PRECISION + 1;
+}
+
+uint32_t
+TxReconciliationTracker::PeerState::ComputeShortId(const TxId &txid) const {
+    const uint32_t short_id = uint32_t(SipHashUint256(k0, k1, txid));
+    // Sketches cannot hold 0.
+    return short_id == 0 ? 1 : short_id;
+}
+
+TxReconciliationTracker::TxReconciliationTracker()
+    : m_flood_k0(GetRand(std::numeric_limits<uint64_t>::max())),
+      m_flood_k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+uint64_t TxReconciliationTracker::PreRegisterPeer(NodeId peer) {
+    const uint64_t salt = GetRand(std::numeric_limits<uint64_t>::max());
+    LOCK(m_mutex);
+    m_local_salts[peer] = salt;
+    return salt;
+}
+
+bool TxReconciliationTracker::RegisterPeer(NodeId peer, bool inbound,
+                                           uint32_t version,
+                                           uint64_t remote_salt) {
+    LOCK(m_mutex);
+    auto salt_it = m_local_salts.find(peer);
+    if (salt_it == m_local_salts.end() || version < 1 ||
+        m_states.count(peer)) {
+        return false;
+    }
+
+    // Both sides derive the same keys whatever the order of the salts.
+    const uint64_t local_salt = salt_it->second;
+    const uint256 keys = (CHashWriter(SER_GETHASH, 0)
+                          << RECON_SALT_TAG
+                          << std::min(local_salt, remote_salt)
+                          << std::max(local_salt, remote_salt))
+                             .GetHash();
+    PeerState &state = m_states[peer];
+    state.we_initiate = !inbound;
+    state.k0 = keys.GetUint64(0);
+    state.k1 = keys.GetUint64(1);
+    if (inbound) {
+        m_inbound_count++;
+    } else {
+        m_outbound_count++;
+    }
+    m_local_salts.erase(salt_it);
+    return true;
+}
+
+void TxReconciliationTracker::ForgetPeer(NodeId peer) {
+    LOCK(m_mutex);
+    m_local_salts.erase(peer);
+    auto it = m_states.find(peer);
+    if (it == m_states.end()) {
+        return;
+    }
+    if (it->second.we_initiate) {
+        m_outbound_count--;
+    } else {
+        m_inbound_count--;
+    }
+    m_states.erase(it);
+}
+
+bool TxReconciliationTracker::IsPeerRegistered(NodeId peer) const {
+    LOCK(m_mutex);
+    return m_states.count(peer) > 0;
+}
+
+bool TxReconciliationTracker::ShouldFlood(NodeId peer,
+                                          const TxId &txid) const {
+    LOCK(m_mutex);
+    auto it = m_states.find(peer);
+    if (it == m_states.end()) {
+        return true;
+    }
+
+    double probability = RECON_INBOUND_FANOUT_RATIO;
+    if (it->second.we_initiate) {
+        probability = RECON_OUTBOUND_FANOUT / m_outbound_count;
+    }
+    // Pick the peers at random, but consistently for a given transaction.
+    const uint64_t hash = CSipHasher(m_flood_k0, m_flood_k1)
+                              .Write(peer)
+                              .Write(txid.begin(), txid.size())
+                              .Finalize();
+    return (hash >> 11) * 0x1.0p-53 < probability;
+}
+
+bool TxReconciliationTracker::AddToSet(NodeId peer, const TxId &txid) {
+    LOCK(m_mutex);
+    auto it = m_states.find(peer);
+    if (it == m_states.end()) {
+        return false;
+    }
+    PeerState &state = it->second;
+    if (state.set.size() >= MAX_RECON_SET_SIZE) {
+        return false;
+    }
+    auto ret = state.set.emplace(state.ComputeShortId(txid), txid);
+    return ret.second || ret.first->second == txid;
+}
+
+size_t TxReconciliationTracker::GetSetSize(NodeId peer) const {
+    LOCK(m_mutex);
+    auto it = m_states.find(peer);
+    return it == m_states.end() ? 0 : it->second.set.size();
+}
+
+bool TxReconciliationTracker::InitiateReconciliation(
+    NodeId peer, std::chrono::microseconds now, uint16_t &local_size,
+    uint16_t &q) {
+    LOCK(m_mutex);
+    auto it = m_states.find(peer);
+    if (it == m_states.end()) {
+        return false;
+    }
+    PeerState &state = it->second;
+    if (!state.we_initiate || now < state.next_request) {
+        return false;
+    }
+    // Give up on a request the peer did not reply to after a while.
+    if (state.awaiting_reply &&
+        now < state.next_request + RECON_REQUEST_INTERVAL) {
+        return false;
+    }
+
+    state.awaiting_reply = true;
+    state.next_request = now + RECON_REQUEST_INTERVAL;
+    local_size = uint16_t(std::min<size_t>(state.set.size(), 0xffff));
+    q = uint16_t(RECON_Q * RECON_Q_PRECISION);
+    return true;
+}
+
+bool TxReconciliationTracker::HandleReconciliationRequest(
+    NodeId peer, uint16_t remote_size, uint16_t q,
+    std::vector<uint8_t> &sketch) {
+    LOCK(m_mutex);
+    auto it = m_states.find(peer);
+    if (it == m_states.end()) {
+        return false;
+    }
+    PeerState &state = it->second;
+    if (state.we_initiate) {
+        return false;
+    }
+    if (state.awaiting_reply) {
+        // The initiator gave up on the previous reconciliation, keep its
+        // transactions for this one.
+        state.set.insert(state.snapshot.begin(), state.snapshot.end());
+    }
+
+    sketch.clear();
+    const size_t capacity =
+        std::max(MIN_SKETCH_CAPACITY,
+                 EstimateSketchCapacity(state.set.size(), remote_size, q));
+    if (capacity <= MAX_SKETCH_CAPACITY) {
+        PinSketch local(capacity);
+        for (const auto &entry : state.set) {
+            local.Add(entry.first);
+        }
+        sketch = local.Serialize();
+    }
+
+    state.snapshot = std::move(state.set);
+    state.set.clear();
+    state.awaiting_reply = true;
+    return true;
+}
+
+bool TxReconciliationTracker::HandleSketch(NodeId peer,
+                                           const std::vector<uint8_t> &sketch,
+                                           Result &result) {
+    LOCK(m_mutex);
+    auto it = m_states.find(peer);
+    if (it == m_states.end()) {
+        return false;
+    }
+    PeerState &state = it->second;
+    if (!state.we_initiate || !state.awaiting_reply) {
+        return false;
+    }
+    state.awaiting_reply = false;
+
+    result.success = false;
+    result.announce.clear();
+    result.missing.clear();
+
+    PinSketch remote(0);
+    std::vector<uint32_t> difference;
+    if (!sketch.empty() && sketch.size() <= 4 * MAX_SKETCH_CAPACITY &&
+        PinSketch::Deserialize(MakeSpan(sketch), remote)) {
+        PinSketch local(remote.GetCapacity());
+        for (const auto &entry : state.set) {
+            local.Add(entry.first);
+        }
+        local.Merge(remote);
+        result.success = local.Decode(difference);
+    }
+
+    if (result.success) {
+        for (uint32_t short_id : difference) {
+            auto tx_it = state.set.find(short_id);
+            if (tx_it != state.set.end()) {
+                result.announce.push_back(tx_it->second);
+            } else {
+                result.missing.push_back(short_id);
+            }
+        }
+    } else {
+        for (const auto &entry : state.set) {
+            result.announce.push_back(entry.second);
+        }
+    }
+    state.set.clear();
+    return true;
+}
+
+bool TxReconciliationTracker::HandleReconciliationDiff(
+    NodeId peer, bool success, const std::vector<uint32_t> &missing,
+    std::vector<TxId> &announce) {
+    LOCK(m_mutex);
+    auto it = m_states.find(peer);
+    if (it == m_states.end()) {
+        return false;
+    }
+    PeerState &state = it->second;
+    if (state.we_initiate || !state.awaiting_reply) {
+        return false;
+    }
+    state.awaiting_reply = false;
+
+    announce.clear();
+    if (success) {
+        for (uint32_t short_id : missing) {
+            auto tx_it = state.snapshot.find(short_id);
+            if (tx_it == state.snapshot.end()) {
+                // The difference was decoded wrongly, fall back to
+                // announcing everything.
+                success = false;
+                announce.clear();
+                break;
+            }
+            announce.push_back(tx_it->second);
+        }
+    }
+    if (!success) {
+        for (const auto &entry : state.snapshot) {
+            announce.push_back(entry.second);
+        }
+    }
+    state.snapshot.clear();
+    return true;
+}
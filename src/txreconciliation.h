@@ -0,0 +1,174 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_TXRECONCILIATION_H
+#define BITCOIN_TXRECONCILIATION_H
+
+#include <net.h>
+#include <primitives/txid.h>
+#include <sync.h>
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <vector>
+
+/** Whether transaction reconciliation is enabled by default */
+static constexpr bool DEFAULT_TXRECONCILIATION_ENABLE = false;
+/** The version of the reconciliation protocol we support */
+static constexpr uint32_t TXRECONCILIATION_VERSION = 1;
+/** How often to reconcile with each outbound peer */
+static constexpr std::chrono::seconds RECON_REQUEST_INTERVAL{8};
+/**
+ * Expected number of outbound reconciling peers each transaction is still
+ * flooded to, so that it propagates quickly.
+ */
+static constexpr double RECON_OUTBOUND_FANOUT = 1;
+/** Fraction of the inbound reconciling peers each transaction is flooded to */
+static constexpr double RECON_INBOUND_FANOUT_RATIO = 0.1;
+/**
+ * Coefficient used to estimate the size of the difference between two sets
+ * from their sizes, see EstimateSketchCapacity.
+ */
+static constexpr double RECON_Q = 0.25;
+/** RECON_Q is sent as a 16 bit integer, scaled by this factor */
+static constexpr uint16_t RECON_Q_PRECISION = (2 << 14) - 1;
+/**
+ * Maximum capacity of a reconciliation sketch, beyond which transactions are
+ * announced by flooding. This bounds the time spent decoding a sketch.
+ */
+static constexpr size_t MAX_SKETCH_CAPACITY = 100;
+/**
+ * Minimum capacity of a reconciliation sketch, so that a sketch whose
+ * capacity is exceeded almost always fails to decode, see PinSketch::Decode.
+ */
+static constexpr size_t MIN_SKETCH_CAPACITY = 10;
+/** Maximum number of transactions awaiting reconciliation with a peer */
+static constexpr size_t MAX_RECON_SET_SIZE = 3000;
+
+/**
+ * Return the capacity a sketch should have to decode the difference between
+ * sets of the given sizes: their size difference plus a fraction q of the
+ * size of the smallest set, plus one.
+ */
+size_t EstimateSketchCapacity(size_t local_size, size_t remote_size,
+                              uint16_t q);
+
+/**
+ * Track the transactions to announce to each peer with which we reconcile
+ * rather than flood transactions, in the spirit of Erlay (BIP 330).
+ *
+ * Both sides of a connection exchange a salt before verack, from which short
+ * 32-bit ids are derived for the transactions. The side which initiated the
+ * connection periodically requests a reconciliation: the other side replies
+ * with a sketch of the short ids of the transactions it would have announced
+ * since the last reconciliation, whose capacity is estimated from the sizes
+ * of both sets. The initiator merges it with the sketch of its own set and
+ * decodes their difference, announces the transactions the other side is
+ * missing, and asks for the ones it is missing itself. If decoding fails,
+ * both sides announce their whole set instead.
+ *
+ * Transactions are still flooded to a few reconciling peers, picked at random
+ * for each transaction, so that they quickly reach all parts of the network.
+ *
+ * This class is thread safe.
+ */
+class TxReconciliationTracker {
+public:
+    /** The outcome of a reconciliation, on the initiator side */
+    struct Result {
+        bool success;
+        //! The transactions the peer is missing.
+        std::vector<TxId> announce;
+        //! The short ids of the transactions we are missing.
+        std::vector<uint32_t> missing;
+    };
+
+    TxReconciliationTracker();
+
+    /**
+     * Get ready to reconcile with a peer, before sending it the returned
+     * salt. The peer is not registered until its own salt is received.
+     */
+    uint64_t PreRegisterPeer(NodeId peer);
+    /**
+     * Start reconciling with a pre-registered peer once its salt has been
+     * received. We are the initiator if the connection is outbound. Returns
+     * false if the peer was not pre-registered or its version is unknown.
+     */
+    bool RegisterPeer(NodeId peer, bool inbound, uint32_t version,
+                      uint64_t remote_salt);
+    void ForgetPeer(NodeId peer);
+    bool IsPeerRegistered(NodeId peer) const;
+
+    /**
+     * Whether a transaction should be flooded to a registered peer, rather
+     * than added to its reconciliation set.
+     */
+    bool ShouldFlood(NodeId peer, const TxId &txid) const;
+    /**
+     * Add a transaction to the set of a registered peer. Returns false if it
+     * cannot be reconciled, e.g. because its short id collides or the set is
+     * full, in which case it should be flooded.
+     */
+    bool AddToSet(NodeId peer, const TxId &txid);
+    size_t GetSetSize(NodeId peer) const;
+
+    /**
+     * Return the size of our set and the q coefficient to send in a
+     * reconciliation request if it is time to reconcile with the peer, i.e.
+     * if we are the initiator and no request is pending.
+     */
+    bool InitiateReconciliation(NodeId peer, std::chrono::microseconds now,
+                                uint16_t &local_size, uint16_t &q);
+    /**
+     * Reply to a reconciliation request with the sketch of our set, which is
+     * empty if the difference is expected to be too large. Our set is kept
+     * aside until the initiator tells us what it is missing. Returns false if
+     * the request is unexpected, i.e. if we are the initiator.
+     */
+    bool HandleReconciliationRequest(NodeId peer, uint16_t remote_size,
+                                     uint16_t q, std::vector<uint8_t> &sketch);
+    /**
+     * Decode the difference between the sketch of the peer and our set.
+     * Returns false if the sketch is unexpected.
+     */
+    bool HandleSketch(NodeId peer, const std::vector<uint8_t> &sketch,
+                      Result &result);
+    /**
+     * Return the transactions which the initiator is missing, or our whole
+     * set if the reconciliation failed. Returns false if the message is
+     * unexpected.
+     */
+    bool HandleReconciliationDiff(NodeId peer, bool success,
+                                  const std::vector<uint32_t> &missing,
+                                  std::vector<TxId> &announce);
+
+private:
+    struct PeerState {
+        bool we_initiate;
+        //! The SipHash keys of the short ids.
+        uint64_t k0;
+        uint64_t k1;
+        //! The transactions to reconcile, by short id.
+        std::map<uint32_t, TxId> set;
+        //! Our set at the time we sent a sketch, for the responder.
+        std::map<uint32_t, TxId> snapshot;
+        bool awaiting_reply{false};
+        std::chrono::microseconds next_request{0};
+
+        uint32_t ComputeShortId(const TxId &txid) const;
+    };
+
+    mutable Mutex m_mutex;
+    std::map<NodeId, uint64_t> m_local_salts GUARDED_BY(m_mutex);
+    std::map<NodeId, PeerState> m_states GUARDED_BY(m_mutex);
+    size_t m_inbound_count GUARDED_BY(m_mutex){0};
+    size_t m_outbound_count GUARDED_BY(m_mutex){0};
+    //! Keys used to pick the peers a transaction is flooded to.
+    const uint64_t m_flood_k0;
+    const uint64_t m_flood_k1;
+};
+
+#endif // BITCOIN_TXRECONCILIATION_H
@@ -0,0 +1,71 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <util/latencyhistogram.h>
+
+#include <crypto/common.h>
+
+#include <algorithm>
+#include <cmath>
+
+int64_t LatencyHistogram::GetBucketLimit(size_t bucket) {
+    return int64_t(1) << std::min(bucket, NUM_BUCKETS - 1);
+}
+
+size_t LatencyHistogram::GetBucketIndex(int64_t micros) {
+    if (micros <= 0) {
+        return 0;
+    }
+    return std::min<size_t>(CountBits(micros), NUM_BUCKETS - 1);
+}
+
+void LatencyHistogram::Record(int64_t micros) {
+    // The clock is not monotonic, don't let it skew the totals.
+    micros = std::max<int64_t>(micros, 0);
+    m_buckets[GetBucketIndex(micros)].fetch_add(1, std::memory_order_relaxed);
+    m_total.fetch_add(micros, std::memory_order_relaxed);
+
+    int64_t max = m_max.load(std::memory_order_relaxed);
+    while (micros > max &&
+           !m_max.compare_exchange_weak(max, micros,
+                                        std::memory_order_relaxed)) {
+    }
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::GetSnapshot() const {
+    Snapshot snapshot;
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+        snapshot.buckets[i] = m_buckets[i].load(std::memory_order_relaxed);
+        // Use the bucket counts so the percentiles add up.
+        snapshot.count += snapshot.buckets[i];
+    }
+    snapshot.total = m_total.load(std::memory_order_relaxed);
+    snapshot.max = m_max.load(std::memory_order_relaxed);
+    return snapshot;
+}
+
+void LatencyHistogram::Reset() {
+    for (auto &bucket : m_buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    m_total.store(0, std::memory_order_relaxed);
+    m_max.store(0, std::memory_order_relaxed);
+}
+
+int64_t LatencyHistogram::Snapshot::GetPercentile(double percentile) const {
+    if (count == 0) {
+        return 0;
+    }
+
+    const uint64_t rank = std::max<uint64_t>(
+        1, std::ceil(count * std::clamp(percentile, 0.0, 100.0) / 100.0));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < NUM_BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen >= rank) {
+            return std::min(GetBucketLimit(i), max);
+        }
+    }
+    return max;
+}
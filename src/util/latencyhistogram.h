@@ -0,0 +1,54 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_UTIL_LATENCYHISTOGRAM_H
+#define BITCOIN_UTIL_LATENCYHISTOGRAM_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * A lock-free histogram of durations in microseconds.
+ *
+ * Durations are counted in power-of-two buckets: bucket 0 holds durations
+ * below 1us and bucket i > 0 holds durations in [2^(i-1), 2^i) us. The last
+ * bucket also holds every longer duration. Recording only performs a few
+ * relaxed atomic operations so it can be used on hot paths from any thread;
+ * a snapshot is therefore not guaranteed to be perfectly consistent while
+ * durations are being recorded concurrently.
+ */
+class LatencyHistogram {
+public:
+    static constexpr size_t NUM_BUCKETS = 32;
+
+    struct Snapshot {
+        std::array<uint64_t, NUM_BUCKETS> buckets{};
+        uint64_t count{0};
+        int64_t total{0};
+        int64_t max{0};
+
+        /**
+         * Upper bound of the bucket holding the given percentile (0-100) of
+         * the recorded durations, capped to the largest recorded duration.
+         */
+        int64_t GetPercentile(double percentile) const;
+    };
+
+    //! Exclusive upper bound of a bucket, in microseconds.
+    static int64_t GetBucketLimit(size_t bucket);
+    static size_t GetBucketIndex(int64_t micros);
+
+    void Record(int64_t micros);
+    Snapshot GetSnapshot() const;
+    void Reset();
+
+private:
+    std::array<std::atomic<uint64_t>, NUM_BUCKETS> m_buckets{};
+    std::atomic<int64_t> m_total{0};
+    std::atomic<int64_t> m_max{0};
+};
+
+#endif // BITCOIN_UTIL_LATENCYHISTOGRAM_H
@@ -48,6 +48,7 @@
 #include <util/system.h>
 #include <util/translation.h>
 #include <validationinterface.h>
+#include <validationstats.h>
 #include <warnings.h>
 
 #include <boost/algorithm/string/replace.hpp>
@@ -426,6 +427,7 @@ private:
 };
 
 bool MemPoolAccept::PreChecks(ATMPArgs &args, Workspace &ws) {
+    ValidationPhaseTimer timer(ValidationPhase::MEMPOOL_PRECHECKS);
     const CTransactionRef &ptx = ws.m_ptx;
     const CTransaction &tx = *ws.m_ptx;
     const TxId &txid = ws.m_ptx->GetId();
@@ -488,6 +490,8 @@ bool MemPoolAccept::PreChecks(ATMPArgs &args, Workspace &ws) {
     m_view.SetBackend(m_viewmempool);
 
     CCoinsViewCache &coins_cache = ::ChainstateActive().CoinsTip();
+    std::optional<ValidationPhaseTimer> coins_timer{
+        std::in_place, ValidationPhase::MEMPOOL_COINS};
     // Do all inputs exist?
     for (const CTxIn &txin : tx.vin) {
         if (!coins_cache.HaveCoinInCache(txin.prevout)) {
@@ -524,6 +528,7 @@ bool MemPoolAccept::PreChecks(ATMPArgs &args, Workspace &ws) {
 
     // Bring the best block into scope.
     m_view.GetBestBlock();
+    coins_timer.reset();
 
     // we have all inputs cached now, so switch back to dummy (to protect
     // against bugs where we pull more inputs from disk that miss being
@@ -591,10 +596,14 @@ bool MemPoolAccept::PreChecks(ATMPArgs &args, Workspace &ws) {
     const uint32_t scriptVerifyFlags =
         ws.m_next_block_script_verify_flags | STANDARD_SCRIPT_VERIFY_FLAGS;
     PrecomputedTransactionData txdata(tx);
-    if (!CheckInputs(tx, state, m_view, scriptVerifyFlags, true, false, txdata,
-                     ws.m_sig_checks_standard)) {
-        // State filled in by CheckInputs.
-        return false;
+    {
+        ValidationPhaseTimer scripts_timer(
+            ValidationPhase::MEMPOOL_STANDARD_SCRIPTS);
+        if (!CheckInputs(tx, state, m_view, scriptVerifyFlags, true, false,
+                         txdata, ws.m_sig_checks_standard)) {
+            // State filled in by CheckInputs.
+            return false;
+        }
     }
 
     entry.reset(new CTxMemPoolEntry(ptx, nFees, nAcceptTime,
@@ -628,6 +637,7 @@ bool MemPoolAccept::PreChecks(ATMPArgs &args, Workspace &ws) {
 
 bool MemPoolAccept::ConsensusScriptChecks(ATMPArgs &args, Workspace &ws,
                                           PrecomputedTransactionData &txdata) {
+    ValidationPhaseTimer timer(ValidationPhase::MEMPOOL_CONSENSUS_SCRIPTS);
     const CTransaction &tx = *ws.m_ptx;
     const TxId &txid = tx.GetId();
 
@@ -669,6 +679,7 @@ bool MemPoolAccept::ConsensusScriptChecks(ATMPArgs &args, Workspace &ws,
 }
 
 bool MemPoolAccept::Finalize(ATMPArgs &args, Workspace &ws) {
+    ValidationPhaseTimer timer(ValidationPhase::MEMPOOL_FINALIZE);
     const TxId &txid = ws.m_ptx->GetId();
     TxValidationState &state = args.m_state;
     const bool bypass_limits = args.m_bypass_limits;
@@ -699,6 +710,7 @@ bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef &ptx,
     // mempool "read lock" (held through
     // GetMainSignals().TransactionAddedToMempool())
     LOCK(m_pool.cs);
+    ValidationPhaseTimer timer(ValidationPhase::MEMPOOL_TOTAL);
 
     Workspace workspace(ptx, GetNextBlockScriptFlags(
                                  args.m_config.GetChainParams().GetConsensus(),
@@ -727,6 +739,7 @@ bool MemPoolAccept::AcceptSingleTransaction(const CTransactionRef &ptx,
         return false;
     }
 
+    ValidationPhaseTimer signals_timer(ValidationPhase::MEMPOOL_SIGNALS);
     GetMainSignals().TransactionAddedToMempool(ptx);
     return true;
 }
@@ -1475,6 +1488,64 @@ void ThreadScriptCheck(int worker_num) {
     scriptcheckqueue.Thread();
 }
 
+/**
+ * Closure representing the hashing and proof of work check of one block
+ * header. The hash is written to a slot owned by the caller.
+ */
+class CHeaderCheck {
+private:
+    const CBlockHeader *m_header;
+    BlockHash *m_hash;
+    const Consensus::Params *m_params;
+
+public:
+    CHeaderCheck() : m_header(nullptr), m_hash(nullptr), m_params(nullptr) {}
+    CHeaderCheck(const CBlockHeader &header, BlockHash &hash,
+                 const Consensus::Params &params)
+        : m_header(&header), m_hash(&hash), m_params(&params) {}
+
+    bool operator()() {
+        *m_hash = m_header->GetHash();
+        return CheckProofOfWork(*m_hash, m_header->nBits, *m_params);
+    }
+
+    void swap(CHeaderCheck &check) {
+        std::swap(m_header, check.m_header);
+        std::swap(m_hash, check.m_hash);
+        std::swap(m_params, check.m_params);
+    }
+};
+
+static CCheckQueue<CHeaderCheck> headercheckqueue(128);
+
+void ThreadHeaderCheck(int worker_num) {
+    util::ThreadRename(strprintf("headerch.%i", worker_num));
+    headercheckqueue.Thread();
+}
+
+bool CheckBlockHeaders(const std::vector<CBlockHeader> &headers,
+                       std::vector<BlockHash> &hashes,
+                       const Consensus::Params &params) {
+    hashes.resize(headers.size());
+    std::vector<CHeaderCheck> checks;
+    checks.reserve(headers.size());
+    for (size_t i = 0; i < headers.size(); i++) {
+        checks.emplace_back(headers[i], hashes[i], params);
+    }
+
+    CCheckQueueControl<CHeaderCheck> control(&headercheckqueue);
+    control.Add(checks);
+    if (control.Wait()) {
+        return true;
+    }
+
+    // The queue stops at the first failure, so some hashes may be missing.
+    for (size_t i = 0; i < headers.size(); i++) {
+        hashes[i] = headers[i].GetHash();
+    }
+    return false;
+}
+
 VersionBitsCache versionbitscache GUARDED_BY(cs_main);
 
 int32_t ComputeBlockVersion(const CBlockIndex *pindexPrev,
@@ -1680,6 +1751,8 @@ bool CChainState::ConnectBlock(const CBlock &block, BlockValidationState &state,
 
     int64_t nTime1 = GetTimeMicros();
     nTimeCheck += nTime1 - nTimeStart;
+    GetValidationLatency(ValidationPhase::CONNECTBLOCK_CHECK)
+        .Record(nTime1 - nTimeStart);
     LogPrint(BCLog::BENCH, "    - Sanity checks: %.2fms [%.2fs (%.2fms/blk)]\n",
              MILLI * (nTime1 - nTimeStart), nTimeCheck * MICRO,
              nTimeCheck * MILLI / nBlocksTotal);
@@ -1802,6 +1875,8 @@ bool CChainState::ConnectBlock(const CBlock &block, BlockValidationState &state,
 
     int64_t nTime2 = GetTimeMicros();
     nTimeForks += nTime2 - nTime1;
+    GetValidationLatency(ValidationPhase::CONNECTBLOCK_FORKS)
+        .Record(nTime2 - nTime1);
     LogPrint(BCLog::BENCH, "    - Fork checks: %.2fms [%.2fs (%.2fms/blk)]\n",
              MILLI * (nTime2 - nTime1), nTimeForks * MICRO,
              nTimeForks * MILLI / nBlocksTotal);
@@ -1941,6 +2016,8 @@ bool CChainState::ConnectBlock(const CBlock &block, BlockValidationState &state,
 
     int64_t nTime3 = GetTimeMicros();
     nTimeConnect += nTime3 - nTime2;
+    GetValidationLatency(ValidationPhase::CONNECTBLOCK_CONNECT)
+        .Record(nTime3 - nTime2);
     LogPrint(BCLog::BENCH,
              "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) "
              "[%.2fs (%.2fms/blk)]\n",
@@ -1996,6 +2073,8 @@ MinerFundSuccess:
 
     int64_t nTime4 = GetTimeMicros();
     nTimeVerify += nTime4 - nTime2;
+    GetValidationLatency(ValidationPhase::CONNECTBLOCK_VERIFY)
+        .Record(nTime4 - nTime2);
     LogPrint(
         BCLog::BENCH,
         "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs (%.2fms/blk)]\n",
@@ -2022,12 +2101,16 @@ MinerFundSuccess:
 
     int64_t nTime5 = GetTimeMicros();
     nTimeIndex += nTime5 - nTime4;
+    GetValidationLatency(ValidationPhase::CONNECTBLOCK_INDEX)
+        .Record(nTime5 - nTime4);
     LogPrint(BCLog::BENCH, "    - Index writing: %.2fms [%.2fs (%.2fms/blk)]\n",
              MILLI * (nTime5 - nTime4), nTimeIndex * MICRO,
              nTimeIndex * MILLI / nBlocksTotal);
 
     int64_t nTime6 = GetTimeMicros();
     nTimeCallbacks += nTime6 - nTime5;
+    GetValidationLatency(ValidationPhase::CONNECTBLOCK_CALLBACKS)
+        .Record(nTime6 - nTime5);
     LogPrint(BCLog::BENCH, "    - Callbacks: %.2fms [%.2fs (%.2fms/blk)]\n",
              MILLI * (nTime6 - nTime5), nTimeCallbacks * MICRO,
              nTimeCallbacks * MILLI / nBlocksTotal);
@@ -2504,6 +2587,8 @@ bool CChainState::ConnectTip(const Config &config, BlockValidationState &state,
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros();
     nTimeReadFromDisk += nTime2 - nTime1;
+    GetValidationLatency(ValidationPhase::CONNECTTIP_READ)
+        .Record(nTime2 - nTime1);
     int64_t nTime3;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n",
              (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
@@ -2534,6 +2619,8 @@ bool CChainState::ConnectTip(const Config &config, BlockValidationState &state,
 
         nTime3 = GetTimeMicros();
         nTimeConnectTotal += nTime3 - nTime2;
+        GetValidationLatency(ValidationPhase::CONNECTTIP_CONNECT)
+            .Record(nTime3 - nTime2);
         LogPrint(BCLog::BENCH,
                  "  - Connect total: %.2fms [%.2fs (%.2fms/blk)]\n",
                  (nTime3 - nTime2) * MILLI, nTimeConnectTotal * MICRO,
@@ -2544,6 +2631,8 @@ bool CChainState::ConnectTip(const Config &config, BlockValidationState &state,
 
     int64_t nTime4 = GetTimeMicros();
     nTimeFlush += nTime4 - nTime3;
+    GetValidationLatency(ValidationPhase::CONNECTTIP_FLUSH)
+        .Record(nTime4 - nTime3);
     LogPrint(BCLog::BENCH, "  - Flush: %.2fms [%.2fs (%.2fms/blk)]\n",
              (nTime4 - nTime3) * MILLI, nTimeFlush * MICRO,
              nTimeFlush * MILLI / nBlocksTotal);
@@ -2556,6 +2645,8 @@ bool CChainState::ConnectTip(const Config &config, BlockValidationState &state,
 
     int64_t nTime5 = GetTimeMicros();
     nTimeChainState += nTime5 - nTime4;
+    GetValidationLatency(ValidationPhase::CONNECTTIP_CHAINSTATE)
+        .Record(nTime5 - nTime4);
     LogPrint(BCLog::BENCH,
              "  - Writing chainstate: %.2fms [%.2fs (%.2fms/blk)]\n",
              (nTime5 - nTime4) * MILLI, nTimeChainState * MICRO,
@@ -2582,7 +2673,11 @@ bool CChainState::ConnectTip(const Config &config, BlockValidationState &state,
 
     int64_t nTime6 = GetTimeMicros();
     nTimePostConnect += nTime6 - nTime5;
+    GetValidationLatency(ValidationPhase::CONNECTTIP_POSTCONNECT)
+        .Record(nTime6 - nTime5);
     nTimeTotal += nTime6 - nTime1;
+    GetValidationLatency(ValidationPhase::CONNECTTIP_TOTAL)
+        .Record(nTime6 - nTime1);
     LogPrint(BCLog::BENCH,
              "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n",
              (nTime6 - nTime5) * MILLI, nTimePostConnect * MICRO,
@@ -3493,10 +3588,14 @@ const CBlockIndex *CChainState::GetFinalizedBlock() const {
 }
 
 CBlockIndex *BlockManager::AddToBlockIndex(const CBlockHeader &block) {
+    return AddToBlockIndex(block, block.GetHash());
+}
+
+CBlockIndex *BlockManager::AddToBlockIndex(const CBlockHeader &block,
+                                           const BlockHash &hash) {
     AssertLockHeld(cs_main);
 
     // Check for duplicate
-    BlockHash hash = block.GetHash();
     BlockMap::iterator it = m_block_index.find(hash);
     if (it != m_block_index.end()) {
         return it->second;
@@ -3997,11 +4096,20 @@ bool BlockManager::AcceptBlockHeader(const Config &config,
                                      const CBlockHeader &block,
                                      BlockValidationState &state,
                                      CBlockIndex **ppindex) {
+    return AcceptBlockHeader(config, block, block.GetHash(),
+                             BlockValidationOptions(config), state, ppindex);
+}
+
+bool BlockManager::AcceptBlockHeader(const Config &config,
+                                     const CBlockHeader &block,
+                                     const BlockHash &hash,
+                                     BlockValidationOptions validationOptions,
+                                     BlockValidationState &state,
+                                     CBlockIndex **ppindex) {
     AssertLockHeld(cs_main);
     const CChainParams &chainparams = config.GetChainParams();
 
     // Check for duplicate
-    BlockHash hash = block.GetHash();
     BlockMap::iterator miSelf = m_block_index.find(hash);
     CBlockIndex *pindex = nullptr;
     if (hash != chainparams.GetConsensus().hashGenesisBlock) {
@@ -4023,7 +4131,7 @@ bool BlockManager::AcceptBlockHeader(const Config &config,
         }
 
         if (!CheckBlockHeader(block, state, chainparams.GetConsensus(),
-                              BlockValidationOptions(config))) {
+                              validationOptions)) {
             return error("%s: Consensus::CheckBlockHeader: %s, %s", __func__,
                          hash.ToString(), state.ToString());
         }
@@ -4095,7 +4203,7 @@ bool BlockManager::AcceptBlockHeader(const Config &config,
     }
 
     if (pindex == nullptr) {
-        pindex = AddToBlockIndex(block);
+        pindex = AddToBlockIndex(block, hash);
     }
 
     if (ppindex) {
@@ -4108,26 +4216,46 @@ bool BlockManager::AcceptBlockHeader(const Config &config,
 // Exposed wrapper for AcceptBlockHeader
 bool ChainstateManager::ProcessNewBlockHeaders(
     const Config &config, const std::vector<CBlockHeader> &headers,
-    BlockValidationState &state, const CBlockIndex **ppindex) {
+    BlockValidationState &state, const CBlockIndex **ppindex,
+    const std::vector<BlockHash> *checked_hashes) {
     AssertLockNotHeld(cs_main);
+    const Consensus::Params &params = config.GetChainParams().GetConsensus();
+
+    // Do the context-free checks before taking cs_main. If any of them fails,
+    // check the proof of work again while accepting the headers, so the ones
+    // before the invalid header are still accepted.
+    std::vector<BlockHash> hashes;
+    bool pow_checked = true;
+    if (!checked_hashes) {
+        pow_checked = CheckBlockHeaders(headers, hashes, params);
+        checked_hashes = &hashes;
+    }
+    assert(checked_hashes->size() == headers.size());
+    const BlockValidationOptions validationOptions =
+        BlockValidationOptions(config).withCheckPoW(!pow_checked);
+
     {
         LOCK(cs_main);
-        for (const CBlockHeader &header : headers) {
+        bool accepted = true;
+        for (size_t i = 0; i < headers.size(); i++) {
             // Use a temp pindex instead of ppindex to avoid a const_cast
             CBlockIndex *pindex = nullptr;
-            bool accepted =
-                m_blockman.AcceptBlockHeader(config, header, state, &pindex);
-            ::ChainstateActive().CheckBlockIndex(
-                config.GetChainParams().GetConsensus());
-
+            accepted = m_blockman.AcceptBlockHeader(
+                config, headers[i], (*checked_hashes)[i], validationOptions,
+                state, &pindex);
             if (!accepted) {
-                return false;
+                break;
             }
 
             if (ppindex) {
                 *ppindex = pindex;
             }
         }
+        ::ChainstateActive().CheckBlockIndex(params);
+
+        if (!accepted) {
+            return false;
+        }
     }
 
     if (NotifyHeaderTip()) {
@@ -295,6 +295,11 @@ void UnloadBlockIndex();
  */
 void ThreadScriptCheck(int worker_num);
 
+/**
+ * Run an instance of the header checking thread.
+ */
+void ThreadHeaderCheck(int worker_num);
+
 /**
  * Retrieve a transaction (from memory pool, or from disk, if possible).
  */
@@ -567,6 +572,17 @@ bool CheckBlock(const CBlock &block, BlockValidationState &state,
                 const Consensus::Params &params,
                 BlockValidationOptions validationOptions);
 
+/**
+ * Hash a batch of block headers and check their proof of work, spread over the
+ * header checking threads.
+ *
+ * hashes is always filled with the hashes of the headers. Returns false if any
+ * of them has an invalid proof of work.
+ */
+bool CheckBlockHeaders(const std::vector<CBlockHeader> &headers,
+                       std::vector<BlockHash> &hashes,
+                       const Consensus::Params &params);
+
 /**
  * This is a variant of ContextualCheckTransaction which computes the contextual
  * check for a transaction based on the chain tip.
@@ -672,6 +688,9 @@ public:
 
     CBlockIndex *AddToBlockIndex(const CBlockHeader &block)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    CBlockIndex *AddToBlockIndex(const CBlockHeader &block,
+                                 const BlockHash &hash)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
     /** Create a new block index entry for a given block hash */
     CBlockIndex *InsertBlockIndex(const BlockHash &hash)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -684,6 +703,15 @@ public:
     bool AcceptBlockHeader(const Config &config, const CBlockHeader &block,
                            BlockValidationState &state, CBlockIndex **ppindex)
         EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    /**
+     * Same as above, for a header whose hash is already known. The proof of
+     * work is only checked if validationOptions asks for it.
+     */
+    bool AcceptBlockHeader(const Config &config, const CBlockHeader &block,
+                           const BlockHash &hash,
+                           BlockValidationOptions validationOptions,
+                           BlockValidationState &state, CBlockIndex **ppindex)
+        EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 };
 
 /**
@@ -1205,12 +1233,15 @@ public:
      * @param[out] ppindex       If set, the pointer will be set to point to the
      *                           last new block index object for the given
      * headers.
+     * @param[in]  checked_hashes If set, the hashes of the headers, as
+     *                           returned by a successful CheckBlockHeaders.
+     *                           Otherwise CheckBlockHeaders is called here.
      * @return True if block headers were accepted as valid.
      */
-    bool ProcessNewBlockHeaders(const Config &config,
-                                const std::vector<CBlockHeader> &block,
-                                BlockValidationState &state,
-                                const CBlockIndex **ppindex = nullptr)
+    bool ProcessNewBlockHeaders(
+        const Config &config, const std::vector<CBlockHeader> &block,
+        BlockValidationState &state, const CBlockIndex **ppindex = nullptr,
+        const std::vector<BlockHash> *checked_hashes = nullptr)
         LOCKS_EXCLUDED(cs_main);
 
     //! Mark one block file as pruned (modify associated database entries)
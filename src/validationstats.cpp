@@ -0,0 +1,57 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <validationstats.h>
+
+#include <array>
+#include <cassert>
+
+namespace {
+
+constexpr size_t NUM_PHASES = size_t(ValidationPhase::NUM_PHASES);
+
+const std::array<ValidationPhaseInfo, NUM_PHASES> PHASE_INFOS{{
+    {ValidationPhase::MEMPOOL_TOTAL, "mempool", "total"},
+    {ValidationPhase::MEMPOOL_PRECHECKS, "mempool", "prechecks"},
+    {ValidationPhase::MEMPOOL_COINS, "mempool", "coins"},
+    {ValidationPhase::MEMPOOL_STANDARD_SCRIPTS, "mempool", "standardscripts"},
+    {ValidationPhase::MEMPOOL_CONSENSUS_SCRIPTS, "mempool",
+     "consensusscripts"},
+    {ValidationPhase::MEMPOOL_FINALIZE, "mempool", "finalize"},
+    {ValidationPhase::MEMPOOL_SIGNALS, "mempool", "signals"},
+
+    {ValidationPhase::CONNECTBLOCK_CHECK, "connectblock", "check"},
+    {ValidationPhase::CONNECTBLOCK_FORKS, "connectblock", "forks"},
+    {ValidationPhase::CONNECTBLOCK_CONNECT, "connectblock", "connect"},
+    {ValidationPhase::CONNECTBLOCK_VERIFY, "connectblock", "verify"},
+    {ValidationPhase::CONNECTBLOCK_INDEX, "connectblock", "index"},
+    {ValidationPhase::CONNECTBLOCK_CALLBACKS, "connectblock", "callbacks"},
+
+    {ValidationPhase::CONNECTTIP_READ, "connecttip", "read"},
+    {ValidationPhase::CONNECTTIP_CONNECT, "connecttip", "connect"},
+    {ValidationPhase::CONNECTTIP_FLUSH, "connecttip", "flush"},
+    {ValidationPhase::CONNECTTIP_CHAINSTATE, "connecttip", "chainstate"},
+    {ValidationPhase::CONNECTTIP_POSTCONNECT, "connecttip", "postconnect"},
+    {ValidationPhase::CONNECTTIP_TOTAL, "connecttip", "total"},
+}};
+
+std::array<LatencyHistogram, NUM_PHASES> g_validation_latencies;
+
+} // namespace
+
+const ValidationPhaseInfo &GetValidationPhaseInfo(ValidationPhase phase) {
+    const ValidationPhaseInfo &info = PHASE_INFOS.at(size_t(phase));
+    assert(info.phase == phase);
+    return info;
+}
+
+LatencyHistogram &GetValidationLatency(ValidationPhase phase) {
+    return g_validation_latencies.at(size_t(phase));
+}
+
+void ResetValidationLatencies() {
+    for (LatencyHistogram &histogram : g_validation_latencies) {
+        histogram.Reset();
+    }
+}
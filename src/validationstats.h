@@ -0,0 +1,78 @@
+// Copyright (c) 2020 The Bitcoin developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_VALIDATIONSTATS_H
+#define BITCOIN_VALIDATIONSTATS_H
+
+#include <util/latencyhistogram.h>
+#include <util/time.h>
+
+#include <cstdint>
+
+/**
+ * Phases of transaction and block validation whose latency is tracked.
+ * Phases belong to a group (mempool, connectblock or connecttip) and may
+ * overlap: e.g. the mempool prechecks include the coin lookup and the
+ * standard script checks.
+ */
+enum class ValidationPhase {
+    //! AcceptToMemoryPool, from taking the lock to the signals.
+    MEMPOOL_TOTAL,
+    MEMPOOL_PRECHECKS,
+    MEMPOOL_COINS,
+    MEMPOOL_STANDARD_SCRIPTS,
+    MEMPOOL_CONSENSUS_SCRIPTS,
+    MEMPOOL_FINALIZE,
+    MEMPOOL_SIGNALS,
+
+    CONNECTBLOCK_CHECK,
+    CONNECTBLOCK_FORKS,
+    CONNECTBLOCK_CONNECT,
+    //! Includes CONNECTBLOCK_CONNECT and the parallel script checks.
+    CONNECTBLOCK_VERIFY,
+    CONNECTBLOCK_INDEX,
+    CONNECTBLOCK_CALLBACKS,
+
+    CONNECTTIP_READ,
+    CONNECTTIP_CONNECT,
+    CONNECTTIP_FLUSH,
+    CONNECTTIP_CHAINSTATE,
+    CONNECTTIP_POSTCONNECT,
+    CONNECTTIP_TOTAL,
+
+    //! Not a phase, must stay last.
+    NUM_PHASES,
+};
+
+struct ValidationPhaseInfo {
+    ValidationPhase phase;
+    const char *group;
+    const char *name;
+};
+
+const ValidationPhaseInfo &GetValidationPhaseInfo(ValidationPhase phase);
+LatencyHistogram &GetValidationLatency(ValidationPhase phase);
+void ResetValidationLatencies();
+
+/**
+ * Records the time elapsed between its construction and destruction, so that
+ * phases exiting early on failure are accounted for too.
+ */
+class ValidationPhaseTimer {
+public:
+    explicit ValidationPhaseTimer(ValidationPhase phase)
+        : m_phase(phase), m_start(GetTimeMicros()) {}
+    ~ValidationPhaseTimer() {
+        GetValidationLatency(m_phase).Record(GetTimeMicros() - m_start);
+    }
+
+    ValidationPhaseTimer(const ValidationPhaseTimer &) = delete;
+    ValidationPhaseTimer &operator=(const ValidationPhaseTimer &) = delete;
+
+private:
+    const ValidationPhase m_phase;
+    const int64_t m_start;
+};
+
+#endif // BITCOIN_VALIDATIONSTATS_H
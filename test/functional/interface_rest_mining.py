@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the binary block template and submitblock REST endpoints."""
+
+import http.client
+from io import BytesIO
+import struct
+import urllib.parse
+
+from test_framework.blocktools import create_coinbase
+from test_framework.messages import (
+    COIN,
+    COutPoint,
+    CBlock,
+    CBlockHeader,
+    CTransaction,
+    CTxIn,
+    CTxOut,
+    deser_compact_size,
+    deser_string,
+    deser_uint256_vector,
+    hash256,
+    ser_uint256,
+    ToHex,
+    uint256_from_str,
+)
+from test_framework.script import CScript, OP_TRUE
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.txtools import pad_tx
+from test_framework.util import assert_equal
+
+
+class BinaryBlockTemplate:
+    def deserialize(self, f):
+        self.header = CBlockHeader()
+        self.header.deserialize(f)
+        self.height, self.mintime, self.coinbasevalue = struct.unpack(
+            "<iqq", f.read(20))
+        self.sizelimit, self.sigoplimit = struct.unpack("<QQ", f.read(16))
+        self.minerfund_scripts = [deser_string(f)
+                                  for _ in range(deser_compact_size(f))]
+        self.minerfund_minvalue = struct.unpack("<q", f.read(8))[0]
+        self.merklebranch = deser_uint256_vector(f)
+        self.entries = []
+        for _ in range(deser_compact_size(f)):
+            tx = CTransaction()
+            tx.deserialize(f)
+            fee, sigops = struct.unpack("<qq", f.read(16))
+            self.entries.append((tx, fee, sigops))
+
+
+class RESTMiningTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [['-rest', '-acceptnonstdtxn=1'], []]
+        self.supports_cli = False
+
+    def rest_request(self, uri, http_method='GET', body=''):
+        url = urllib.parse.urlparse(self.nodes[0].url)
+        conn = http.client.HTTPConnection(url.hostname, url.port)
+        conn.request(http_method, '/rest' + uri, body)
+        resp = conn.getresponse()
+        return resp.status, resp.read()
+
+    def run_test(self):
+        node = self.nodes[0]
+        descriptor = node.getdescriptorinfo('raw(51)')['descriptor']
+        coinbase_txid = node.getblock(
+            node.generatetodescriptor(1, descriptor)[0])['tx'][0]
+        node.generatetodescriptor(100, descriptor)
+        self.sync_all()
+
+        tx = CTransaction()
+        tx.vin.append(CTxIn(COutPoint(int(coinbase_txid, 16), 0)))
+        tx.vout.append(CTxOut(50 * COIN - 1000, CScript([OP_TRUE])))
+        pad_tx(tx)
+        txid = node.sendrawtransaction(ToHex(tx))
+
+        self.log.info("Fetch the binary block template")
+        status, data = self.rest_request('/blocktemplate.bin')
+        assert_equal(status, 200)
+        tmpl = BinaryBlockTemplate()
+        tmpl.deserialize(BytesIO(data))
+
+        gbt = node.getblocktemplate()
+        assert_equal(tmpl.header.nVersion, gbt['version'])
+        assert_equal(tmpl.header.hashPrevBlock,
+                     int(gbt['previousblockhash'], 16))
+        assert_equal(tmpl.header.nBits, int(gbt['bits'], 16))
+        assert_equal(tmpl.height, gbt['height'])
+        assert_equal(tmpl.mintime, gbt['mintime'])
+        assert_equal(tmpl.coinbasevalue, gbt['coinbasevalue'])
+        assert_equal(tmpl.sizelimit, gbt['sizelimit'])
+        assert_equal(tmpl.sigoplimit, gbt['sigoplimit'])
+        minerfund = gbt['coinbasetxn']['minerfund']
+        assert_equal(len(tmpl.minerfund_scripts),
+                     len(minerfund['addresses']))
+        assert_equal(tmpl.minerfund_minvalue, minerfund['minimumvalue'])
+        assert_equal(len(tmpl.entries), 1)
+        entry_tx, fee, sigops = tmpl.entries[0]
+        entry_tx.rehash()
+        assert_equal(entry_tx.hash, txid)
+        assert_equal(fee, 1000)
+        assert_equal(fee, gbt['transactions'][0]['fee'])
+        assert_equal(sigops, gbt['transactions'][0]['sigops'])
+
+        status, hexdata = self.rest_request('/blocktemplate.hex')
+        assert_equal(status, 200)
+        assert_equal(bytes.fromhex(hexdata.decode().strip()), data)
+
+        status, _ = self.rest_request('/blocktemplate.json')
+        assert_equal(status, 404)
+
+        self.log.info("Build a block from the template and submit it")
+        block = CBlock()
+        block.nVersion = tmpl.header.nVersion
+        block.hashPrevBlock = tmpl.header.hashPrevBlock
+        block.nTime = tmpl.header.nTime
+        block.nBits = tmpl.header.nBits
+        coinbase = create_coinbase(tmpl.height)
+        coinbase.vout[0].nValue = tmpl.coinbasevalue
+        coinbase.rehash()
+        block.vtx = [coinbase] + [e[0] for e in tmpl.entries]
+
+        # The merkle root can be computed from the coinbase branch alone
+        root = ser_uint256(coinbase.sha256)
+        for h in tmpl.merklebranch:
+            root = hash256(root + ser_uint256(h))
+        block.hashMerkleRoot = block.calc_merkle_root()
+        assert_equal(uint256_from_str(root), block.hashMerkleRoot)
+        block.solve()
+
+        status, _ = self.rest_request(
+            '/submitblock.bin', 'GET', block.serialize())
+        assert_equal(status, 405)
+
+        status, result = self.rest_request(
+            '/submitblock.bin', 'POST', block.serialize())
+        assert_equal(status, 200)
+        assert_equal(result, b'')
+        assert_equal(node.getbestblockhash(), block.hash)
+        assert_equal(node.getrawmempool(), [])
+
+        status, result = self.rest_request(
+            '/submitblock.hex', 'POST', block.serialize().hex())
+        assert_equal(status, 200)
+        assert_equal(result, b'duplicate\n')
+
+        self.log.info("Invalid blocks are rejected")
+        status, _ = self.rest_request('/submitblock.bin', 'POST', b'\x00')
+        assert_equal(status, 400)
+        bad_block = CBlock(block)
+        bad_block.vtx = [tx]
+        bad_block.hashPrevBlock = int(node.getbestblockhash(), 16)
+        bad_block.hashMerkleRoot = bad_block.calc_merkle_root()
+        bad_block.solve()
+        status, result = self.rest_request(
+            '/submitblock.bin', 'POST', bad_block.serialize())
+        assert_equal(status, 400)
+        assert b'coinbase' in result
+
+
+if __name__ == '__main__':
+    RESTMiningTest().main()
@@ -0,0 +1,172 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the paginated and filtered mempool listings over RPC and REST."""
+
+from decimal import Decimal
+import http.client
+import json
+import urllib.parse
+
+from test_framework.messages import (
+    COIN,
+    COutPoint,
+    CTransaction,
+    CTxIn,
+    CTxOut,
+    ToHex,
+)
+from test_framework.script import CScript, OP_TRUE
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.txtools import pad_tx
+from test_framework.util import assert_equal, assert_raises_rpc_error
+
+NUM_SPENDS = 20
+
+
+class MempoolPaginationTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+        self.extra_args = [['-rest', '-acceptnonstdtxn=1']]
+        self.supports_cli = False
+
+    def rest_request(self, uri):
+        url = urllib.parse.urlparse(self.nodes[0].url)
+        conn = http.client.HTTPConnection(url.hostname, url.port)
+        conn.request('GET', '/rest' + uri)
+        resp = conn.getresponse()
+        return resp.status, resp.read()
+
+    def list_all(self, options):
+        """Follow the cursors until the whole listing has been fetched."""
+        node = self.nodes[0]
+        pages = []
+        while True:
+            result = node.getrawmempool(True, options)
+            pages.append(result['transactions'])
+            if 'nextcursor' not in result:
+                return pages
+            options = dict(options, cursor=result['nextcursor'])
+
+    def run_test(self):
+        node = self.nodes[0]
+        descriptor = node.getdescriptorinfo('raw(51)')['descriptor']
+        coinbase_txid = node.getblock(
+            node.generatetodescriptor(1, descriptor)[0])['tx'][0]
+        node.generatetodescriptor(100, descriptor)
+
+        self.log.info("Fill the mempool at two different times")
+        start_time = node.getblockheader(node.getbestblockhash())['time']
+        node.setmocktime(start_time)
+        split_tx = CTransaction()
+        split_tx.vin.append(CTxIn(COutPoint(int(coinbase_txid, 16), 0)))
+        for _ in range(NUM_SPENDS):
+            split_tx.vout.append(
+                CTxOut(50 * COIN // NUM_SPENDS - 1000, CScript([OP_TRUE])))
+        split_txid = node.sendrawtransaction(ToHex(split_tx))
+
+        for i in range(NUM_SPENDS):
+            if i == NUM_SPENDS // 2:
+                node.setmocktime(start_time + 100)
+            tx = CTransaction()
+            tx.vin.append(CTxIn(COutPoint(int(split_txid, 16), i)))
+            tx.vout.append(CTxOut(split_tx.vout[i].nValue - 1000 * (i + 1),
+                                  CScript([OP_TRUE])))
+            pad_tx(tx)
+            node.sendrawtransaction(ToHex(tx), 0)
+
+        mempool = node.getrawmempool(True)
+        assert_equal(len(mempool), NUM_SPENDS + 1)
+
+        self.log.info("Options without filters list the whole mempool")
+        result = node.getrawmempool(True, {})
+        assert_equal(result['transactions'], mempool)
+        assert 'nextcursor' not in result
+        result = node.getrawmempool(False, {})
+        assert_equal(sorted(result['transactions']), sorted(mempool))
+
+        self.log.info("Paginate the mempool in entry time order")
+        pages = self.list_all({'count': 6})
+        assert_equal([len(page) for page in pages], [6, 6, 6, 3])
+        listed = [txid for page in pages for txid in page]
+        assert_equal(len(set(listed)), len(listed))
+        assert_equal(sorted(listed), sorted(mempool))
+        assert_equal(listed, sorted(
+            mempool, key=lambda txid: (mempool[txid]['time'], txid)))
+        for page in pages:
+            for txid, entry in page.items():
+                assert_equal(entry, mempool[txid])
+
+        nonverbose = node.getrawmempool(False, {'count': 100})
+        assert_equal(nonverbose['transactions'], listed)
+
+        self.log.info("Filter by entry time")
+        early = node.getrawmempool(True, {'maxtime': start_time})
+        assert_equal(len(early['transactions']), NUM_SPENDS // 2 + 1)
+        late = node.getrawmempool(True, {'mintime': start_time + 1})
+        assert_equal(len(late['transactions']), NUM_SPENDS // 2)
+        assert all(entry['time'] == start_time + 100
+                   for entry in late['transactions'].values())
+        pages = self.list_all({'count': 4, 'mintime': start_time + 50})
+        assert_equal(sum(len(page) for page in pages), NUM_SPENDS // 2)
+        none = node.getrawmempool(
+            True, {'mintime': start_time + 1, 'maxtime': start_time + 99})
+        assert_equal(none['transactions'], {})
+
+        self.log.info("Filter by fee rate")
+        min_feerate = Decimal('0.001')
+        expected = sorted(
+            txid for txid, entry in mempool.items()
+            if entry['fees']['modified'] * 1000 / entry['size'] >= min_feerate)
+        assert 0 < len(expected) < len(mempool)
+        result = node.getrawmempool(True, {'minfeerate': min_feerate})
+        assert_equal(sorted(result['transactions']), expected)
+        pages = self.list_all({'count': 3, 'minfeerate': min_feerate})
+        assert_equal(sorted(txid for page in pages for txid in page),
+                     expected)
+
+        self.log.info("Invalid options are rejected")
+        assert_raises_rpc_error(-8, "Invalid cursor",
+                                node.getrawmempool, True, {'cursor': 'x'})
+        assert_raises_rpc_error(-8, "Invalid count",
+                                node.getrawmempool, True, {'count': 0})
+        assert_raises_rpc_error(-3, "Expected type number",
+                                node.getrawmempool, True, {'mintime': 'x'})
+
+        self.log.info("Paginate the mempool over REST")
+        status, data = self.rest_request('/mempool/contents.json')
+        assert_equal(status, 200)
+        assert_equal(json.loads(data, parse_float=Decimal), mempool)
+
+        listed_rest = []
+        cursor = None
+        while True:
+            uri = '/mempool/contents.json?count=5'
+            if cursor is not None:
+                uri += '&cursor=' + cursor
+            status, data = self.rest_request(uri)
+            assert_equal(status, 200)
+            result = json.loads(data, parse_float=Decimal)
+            listed_rest += result['transactions']
+            cursor = result.get('nextcursor')
+            if cursor is None:
+                break
+        assert_equal(listed_rest, listed)
+
+        status, data = self.rest_request(
+            '/mempool/contents.json?minfeerate=0.001&maxtime={}'.format(
+                start_time + 100))
+        assert_equal(status, 200)
+        result = json.loads(data, parse_float=Decimal)
+        assert_equal(sorted(result['transactions']), expected)
+        assert 'nextcursor' not in result
+
+        for query in ['cursor=x', 'count=0', 'minfeerate=x', 'mintime=x']:
+            status, _ = self.rest_request('/mempool/contents.json?' + query)
+            assert_equal(status, 400)
+
+
+if __name__ == '__main__':
+    MempoolPaginationTest().main()
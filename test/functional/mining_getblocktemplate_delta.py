@@ -0,0 +1,147 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the getblocktemplate delta mode."""
+
+import threading
+import time
+
+from test_framework.messages import (
+    COIN,
+    COutPoint,
+    CTransaction,
+    CTxIn,
+    CTxOut,
+    ToHex,
+)
+from test_framework.script import CScript, OP_TRUE
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.txtools import pad_tx
+from test_framework.util import assert_equal, get_rpc_proxy
+
+
+class LongpollThread(threading.Thread):
+
+    def __init__(self, node, request):
+        threading.Thread.__init__(self)
+        self.request = request
+        # create a new connection to the node, we can't use the same
+        # connection from two threads
+        self.node = get_rpc_proxy(
+            node.url, 1, timeout=600, coveragedir=node.coverage_dir)
+
+    def run(self):
+        self.result = self.node.getblocktemplate(self.request)
+
+
+class GetBlockTemplateDeltaTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [['-acceptnonstdtxn=1']] * self.num_nodes
+
+    def spend(self, txid, fee):
+        node = self.nodes[0]
+        tx = CTransaction()
+        tx.vin.append(CTxIn(COutPoint(int(txid, 16), 0)))
+        tx.vout.append(CTxOut(50 * COIN - fee, CScript([OP_TRUE])))
+        pad_tx(tx)
+        return node.sendrawtransaction(ToHex(tx), 0)
+
+    def run_test(self):
+        node = self.nodes[0]
+        descriptor = node.getdescriptorinfo('raw(51)')['descriptor']
+        blocks = node.generatetodescriptor(10, descriptor)
+        node.generatetodescriptor(100, descriptor)
+        coinbases = [node.getblock(h)['tx'][0] for h in blocks]
+        self.sync_all()
+
+        def gbt(**kwargs):
+            request = {'clientid': 'pool'}
+            request.update(kwargs)
+            return node.getblocktemplate(request)
+
+        self.log.info("The first request gets a full template")
+        tmpl = gbt()
+        assert_equal(tmpl['delta'], False)
+        assert_equal(tmpl['transactions'], [])
+        assert_equal(tmpl['removed'], [])
+        assert_equal(tmpl['merklebranch'], [])
+
+        # Without a clientid, nothing changes
+        assert 'templateid' not in node.getblocktemplate()
+
+        self.log.info("New transactions are sent as a delta")
+        txids = [self.spend(coinbases[i], 1000) for i in range(3)]
+        # Make sure the cached template is considered stale
+        mocktime = int(time.time()) + 10
+        node.setmocktime(mocktime)
+        tmpl2 = gbt(templateid=tmpl['templateid'])
+        assert_equal(tmpl2['delta'], True)
+        assert_equal(tmpl2['removed'], [])
+        assert_equal(sorted(tx['txid'] for tx in tmpl2['transactions']),
+                     sorted(txids))
+        assert_equal([tx['index'] for tx in tmpl2['transactions']],
+                     [0, 1, 2])
+        assert_equal(len(tmpl2['merklebranch']), 2)
+        template_txids = [tx['txid'] for tx in tmpl2['transactions']]
+
+        self.log.info("Transactions mined in a block are removed")
+        node.generatetodescriptor(1, descriptor)
+        new_txid = self.spend(coinbases[3], 1000)
+        tmpl3 = gbt(templateid=tmpl2['templateid'])
+        assert_equal(tmpl3['delta'], True)
+        assert_equal(tmpl3['removed'], [0, 1, 2])
+        assert_equal([(tx['index'], tx['txid'])
+                      for tx in tmpl3['transactions']], [(0, new_txid)])
+        # The coinbase branch of a 2 transactions block is the other one
+        assert_equal(tmpl3['merklebranch'], [new_txid])
+        assert template_txids[0] not in tmpl3['merklebranch']
+
+        self.log.info("An unknown templateid gets the full template")
+        tmpl4 = gbt(templateid='00' * 32)
+        assert_equal(tmpl4['delta'], False)
+        assert_equal(len(tmpl4['transactions']), 1)
+        assert 'index' not in tmpl4['transactions'][0]
+        assert_equal(tmpl4['templateid'], tmpl3['templateid'])
+
+        # Other clients are tracked separately
+        tmpl5 = gbt(clientid='other', templateid=tmpl3['templateid'])
+        assert_equal(tmpl5['delta'], False)
+
+        self.log.info("Long poll with a fee threshold")
+        node.setmocktime(0)
+        thr = LongpollThread(node, {
+            'clientid': 'pool',
+            'longpollid': tmpl4['longpollid'],
+            'feethreshold': 10 * COIN,
+        })
+        thr.start()
+        # A small fee gain does not wake up the long poll
+        self.spend(coinbases[4], 1000)
+        thr.join(12)
+        assert thr.is_alive()
+        # But a large one does
+        fee_txid = self.spend(coinbases[5], 20 * COIN)
+        thr.join(15)
+        assert not thr.is_alive()
+        assert_equal(thr.result['delta'], False)
+        assert fee_txid in [tx['txid'] for tx in thr.result['transactions']]
+
+        self.log.info("Long poll with a fee threshold still returns on new tip")
+        thr = LongpollThread(node, {
+            'clientid': 'pool',
+            'longpollid': thr.result['longpollid'],
+            'feethreshold': 10 * COIN,
+        })
+        thr.start()
+        thr.join(5)
+        assert thr.is_alive()
+        self.nodes[1].generatetodescriptor(1, descriptor)
+        thr.join(5)
+        assert not thr.is_alive()
+
+
+if __name__ == '__main__':
+    GetBlockTemplateDeltaTest().main()
@@ -0,0 +1,76 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the block download scheduler.
+
+Check that blocks in flight from a peer which does not deliver them are
+requested from another peer as well, so that the download does not have to
+wait for the stall timeout, and that getblockdownloadinfo reports it.
+"""
+
+from test_framework.messages import CBlockHeader, FromHex, msg_headers
+from test_framework.mininode import P2PInterface
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, connect_nodes, wait_until
+
+NUM_BLOCKS = 10
+
+
+class BlockDownloadTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.setup_clean_chain = False
+        self.num_nodes = 2
+
+    def setup_network(self):
+        # Node 0 doesn't know about the blocks of node 1 until a peer which
+        # never delivers them announces them.
+        self.setup_nodes()
+
+    def run_test(self):
+        node0, node1 = self.nodes
+        address = node1.get_deterministic_priv_key().address
+        blockhashes = node1.generatetoaddress(NUM_BLOCKS, address)
+
+        self.log.info("Announce blocks from a peer which withholds them")
+        info = node0.getblockdownloadinfo()
+        assert_equal(info['inflight'], 0)
+        assert_equal(info['peers'], [])
+
+        staller = node0.add_p2p_connection(P2PInterface())
+        headers = [FromHex(CBlockHeader(), node1.getblockheader(h, False))
+                   for h in blockhashes]
+        staller.send_message(msg_headers(headers))
+        wait_until(lambda: node0.getblockdownloadinfo()[
+                   'inflight'] == NUM_BLOCKS, timeout=10)
+        staller_id = node0.getpeerinfo()[0]['id']
+        info = node0.getblockdownloadinfo()
+        assert_equal(len(info['peers']), 1)
+        assert_equal(info['peers'][0]['id'], staller_id)
+        assert_equal(info['peers'][0]['inflight'], NUM_BLOCKS)
+        assert_equal(info['peers'][0]['blockinterval'], 0)
+        assert_equal(info['duplicaterequests'], 0)
+
+        self.log.info("Download them from a second peer")
+        connect_nodes(node0, node1)
+        # Node 1 announces its chain with its next block.
+        tip = node1.generatetoaddress(1, address)[0]
+        wait_until(lambda: node0.getbestblockhash() == tip, timeout=30)
+
+        info = node0.getblockdownloadinfo()
+        assert_equal(info['inflight'], 0)
+        assert_equal(info['duplicated'], 0)
+        assert_equal(info['duplicaterequests'], NUM_BLOCKS)
+        assert_equal(info['duplicatewins'], NUM_BLOCKS)
+        peer = [p for p in info['peers'] if p['id'] != staller_id][0]
+        assert_equal(peer['blocksreceived'], NUM_BLOCKS + 1)
+        assert peer['blockinterval'] > 0
+        # The staller is still connected, but has nothing in flight anymore.
+        staller_info = [p for p in info['peers'] if p['id'] == staller_id][0]
+        assert_equal(staller_info['inflight'], 0)
+        assert_equal(staller_info['blocksreceived'], 0)
+        assert staller.is_connected
+
+
+if __name__ == '__main__':
+    BlockDownloadTest().main()
@@ -0,0 +1,100 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test graphene block relay.
+
+Check that nodes started with -graphene download blocks from each other as
+graphene blocks, request the transactions they miss with getblocktxn, and
+still download blocks from other nodes as usual.
+"""
+
+from decimal import Decimal
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    connect_nodes,
+    disconnect_nodes,
+    wait_until,
+)
+
+FEE = Decimal('0.001')
+
+
+class GrapheneTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 3
+        # Nodes 0 and 1 support graphene, node 2 does not.
+        self.extra_args = [["-graphene"], ["-graphene"], []]
+
+    def create_tx(self, node, height):
+        """Spend the coinbase of the block at the given height, which must pay
+        to the key of the node"""
+        key = node.get_deterministic_priv_key()
+        prevtx = node.getblock(node.getblockhash(height), 2)['tx'][0]
+        rawtx = node.createrawtransaction(
+            inputs=[{'txid': prevtx['txid'], 'vout': 0}],
+            outputs=[{key.address: prevtx['vout'][0]['value'] - FEE}],
+        )
+        return node.signrawtransactionwithkey(
+            hexstring=rawtx,
+            privkeys=[key.key],
+            prevtxs=[{
+                'txid': prevtx['txid'],
+                'vout': 0,
+                'amount': prevtx['vout'][0]['value'],
+                'scriptPubKey': prevtx['vout'][0]['scriptPubKey']['hex'],
+            }],
+        )['hex']
+
+    def bytes_recv(self, node, inbound, msg_type):
+        """Bytes received from the first inbound or outbound peer"""
+        peer = [p for p in node.getpeerinfo() if p['inbound'] == inbound][0]
+        return peer['bytesrecv_per_msg'].get(msg_type, 0)
+
+    def mine_block(self):
+        address = self.nodes[0].get_deterministic_priv_key().address
+        return self.nodes[0].generatetoaddress(1, address)[0]
+
+    def run_test(self):
+        node0, node1, node2 = self.nodes
+
+        self.log.info("Check the service flag")
+        for node in [node0, node1]:
+            assert "GRAPHENE" in node.getnetworkinfo()['localservicesnames']
+        assert "GRAPHENE" not in node2.getnetworkinfo()['localservicesnames']
+
+        self.log.info("Relay a block whose transactions are all known")
+        # The coinbases of the first 25 blocks pay to node 0.
+        txids = [node0.sendrawtransaction(self.create_tx(node0, height))
+                 for height in range(1, 21)]
+        self.sync_mempools()
+        blockhash = self.mine_block()
+        self.sync_blocks()
+        block = node1.getblock(blockhash)
+        assert_equal(sorted(block['tx'][1:]), sorted(txids))
+        # Node 1 connects to node 0, and node 2 connects to node 1.
+        assert self.bytes_recv(node1, False, 'grblk') > 0
+        assert_equal(self.bytes_recv(node1, False, 'blocktxn'), 0)
+        assert self.bytes_recv(node0, True, 'getgrblk') > 0
+        # Node 2 does not support it.
+        assert_equal(self.bytes_recv(node1, True, 'getgrblk'), 0)
+        assert_equal(self.bytes_recv(node2, False, 'grblk'), 0)
+
+        self.log.info("Relay a block with transactions node 1 is missing")
+        disconnect_nodes(node1, node0)
+        wait_until(lambda: len(node0.getpeerinfo()) == 0)
+        txids = [node0.sendrawtransaction(self.create_tx(node0, height))
+                 for height in range(21, 26)]
+        blockhash = self.mine_block()
+        connect_nodes(node1, node0)
+        self.sync_blocks()
+        block = node1.getblock(blockhash)
+        assert_equal(sorted(block['tx'][1:]), sorted(txids))
+        assert self.bytes_recv(node1, False, 'grblk') > 0
+        assert self.bytes_recv(node1, False, 'blocktxn') > 0
+
+
+if __name__ == '__main__':
+    GrapheneTest().main()
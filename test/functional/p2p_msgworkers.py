@@ -0,0 +1,102 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the processing of messages by the message workers.
+
+Block requests and pings are processed by the message workers, while headers
+requests are processed by the message handler thread. Check that the replies
+are sent in the order of the requests of each peer either way.
+"""
+
+from test_framework.messages import (
+    CInv,
+    MSG_BLOCK,
+    msg_getdata,
+    msg_getheaders,
+    msg_ping,
+)
+from test_framework.mininode import P2PInterface, mininode_lock
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, wait_until
+
+NUM_PEERS = 4
+NUM_ROUNDS = 10
+
+
+class ReplyRecorder(P2PInterface):
+    def __init__(self):
+        super().__init__()
+        self.replies = []
+
+    def on_block(self, message):
+        message.block.calc_sha256()
+        self.replies.append(('block', message.block.sha256))
+
+    def on_pong(self, message):
+        self.replies.append(('pong', message.nonce))
+
+    def on_headers(self, message):
+        self.replies.append(('headers', len(message.headers)))
+
+
+class MessageWorkersTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 2
+        self.setup_clean_chain = True
+        self.extra_args = [['-msgworkers=4'], ['-msgworkers=0']]
+
+    def check_reply_order(self, node, block_hashes):
+        peers = [node.add_p2p_connection(ReplyRecorder())
+                 for _ in range(NUM_PEERS)]
+        # Forget about the ping sent while connecting.
+        with mininode_lock:
+            for peer in peers:
+                peer.replies.clear()
+
+        expected = []
+        for i in range(NUM_ROUNDS):
+            block_hash = block_hashes[i % len(block_hashes)]
+            expected += [
+                ('block', block_hash),
+                ('pong', i),
+                ('headers', 0),
+            ]
+        for i in range(NUM_ROUNDS):
+            block_hash = block_hashes[i % len(block_hashes)]
+            for peer in peers:
+                peer.send_message(msg_getdata([CInv(MSG_BLOCK, block_hash)]))
+                peer.send_message(msg_ping(nonce=i))
+                # Requesting the headers after the tip gets an empty reply.
+                getheaders = msg_getheaders()
+                getheaders.locator.vHave = [int(node.getbestblockhash(), 16)]
+                peer.send_message(getheaders)
+
+        for peer in peers:
+            wait_until(lambda: len(peer.replies) == len(expected),
+                       lock=mininode_lock)
+            with mininode_lock:
+                assert_equal(peer.replies, expected)
+
+        node.disconnect_p2ps()
+
+    def run_test(self):
+        block_hashes = [int(h, 16) for h in self.nodes[0].generate(5)]
+        self.sync_all()
+
+        self.log.info("Check the reply order with message workers")
+        self.check_reply_order(self.nodes[0], block_hashes)
+
+        self.log.info("Check the reply order without message workers")
+        self.check_reply_order(self.nodes[1], block_hashes)
+
+        self.log.info("Check the startup errors")
+        self.stop_node(1)
+        self.nodes[1].assert_start_raises_init_error(
+            ['-msgworkers=-1'], 'Error: msgworkers must be between 0 and 64')
+        self.nodes[1].assert_start_raises_init_error(
+            ['-msgworkers=65'], 'Error: msgworkers must be between 0 and 64')
+
+
+if __name__ == '__main__':
+    MessageWorkersTest().main()
@@ -0,0 +1,124 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the establishment of automatic outbound connections.
+
+Check that the connection attempts to the addresses learned from peers do not
+wait for each other, even when the proxy they go through never replies, and
+that they complete their SOCKS5 handshake once the proxy does.
+"""
+
+import os
+import socket
+import threading
+import time
+
+from test_framework.messages import CAddress, NODE_NETWORK, msg_addr
+from test_framework.mininode import P2PInterface
+from test_framework.socks5 import (
+    AddressType,
+    Socks5Command,
+    Socks5Configuration,
+    Socks5Server,
+)
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    PORT_MIN,
+    PORT_RANGE,
+    wait_until,
+)
+
+RANGE_BEGIN = PORT_MIN + 2 * PORT_RANGE  # Start after p2p and rpc ports
+NUM_ADDRESSES = 16
+REGTEST_PORT = 18444
+
+
+class StallingProxy():
+    """Accept connections and never reply to them."""
+
+    def __init__(self, addr):
+        self.s = socket.socket(socket.AF_INET)
+        self.s.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+        self.s.bind(addr)
+        self.s.listen(NUM_ADDRESSES)
+        self.s.settimeout(0.1)
+        self.conns = []
+        self.running = True
+        self.thread = threading.Thread(None, self.run)
+        self.thread.daemon = True
+        self.thread.start()
+
+    def run(self):
+        while self.running:
+            try:
+                conn, _ = self.s.accept()
+                self.conns.append(conn)
+            except socket.timeout:
+                pass
+
+    def stop(self):
+        self.running = False
+        self.thread.join()
+        for conn in self.conns:
+            conn.close()
+        self.s.close()
+
+
+class OutboundConnectTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+
+    def setup_network(self):
+        # The node is started once the proxy is up.
+        self.add_nodes(self.num_nodes)
+
+    def run_test(self):
+        node = self.nodes[0]
+        proxy_addr = ('127.0.0.1', RANGE_BEGIN + 3000 + (os.getpid() % 1000))
+        proxy_arg = '-proxy={}:{}'.format(*proxy_addr)
+
+        self.log.info("Start connection attempts through a stalling proxy")
+        stalling_proxy = StallingProxy(proxy_addr)
+        self.start_node(0, extra_args=[proxy_arg])
+        addresses = []
+        for i in range(NUM_ADDRESSES):
+            addr = CAddress()
+            addr.time = int(time.time())
+            addr.nServices = NODE_NETWORK
+            # Each in its own network group.
+            addr.ip = "15.{}.1.1".format(i + 1)
+            addr.port = REGTEST_PORT
+            addresses.append(addr)
+        msg = msg_addr()
+        msg.addrs = addresses
+        node.add_p2p_connection(P2PInterface()).send_and_ping(msg)
+
+        # Each attempt would otherwise wait for the proxy to time out.
+        wait_until(lambda: len(stalling_proxy.conns) >= 4, timeout=15)
+        assert_equal(len(node.getpeerinfo()), 1)
+        stalling_proxy.stop()
+
+        self.log.info("Complete the connections through a working proxy")
+        conf = Socks5Configuration()
+        conf.addr = proxy_addr
+        conf.unauth = True
+        conf.auth = False
+        proxy = Socks5Server(conf)
+        proxy.start()
+        # The addresses are kept in peers.dat across the restart.
+        self.restart_node(0, extra_args=[proxy_arg])
+        cmd = proxy.queue.get(timeout=30)
+        assert isinstance(cmd, Socks5Command)
+        assert_equal(cmd.atyp, AddressType.DOMAINNAME)
+        assert cmd.addr.decode() in [addr.ip for addr in addresses]
+        assert_equal(cmd.port, REGTEST_PORT)
+        assert_equal(cmd.username, None)
+        self.stop_node(0)
+        proxy.stop()
+
+
+if __name__ == '__main__':
+    OutboundConnectTest().main()
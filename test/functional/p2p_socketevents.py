@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the -socketevents and -socketthreads options."""
+
+import platform
+
+from test_framework.mininode import P2PInterface
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, connect_nodes, wait_until
+
+NUM_P2P_CONNECTIONS = 8
+
+
+class SocketEventsTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 3
+        self.setup_clean_chain = True
+
+    def setup_network(self):
+        self.has_epoll = platform.system() == 'Linux'
+        if self.has_epoll:
+            self.extra_args = [
+                ['-socketevents=epoll', '-socketthreads=3'],
+                ['-socketevents=epoll'],
+                ['-socketevents=poll'],
+            ]
+        self.setup_nodes()
+        connect_nodes(self.nodes[0], self.nodes[1])
+        connect_nodes(self.nodes[0], self.nodes[2])
+        connect_nodes(self.nodes[1], self.nodes[2])
+
+    def run_test(self):
+        node = self.nodes[0]
+
+        self.log.info("Sync blocks between nodes using different modes")
+        node.generate(10)
+        self.sync_all()
+        self.nodes[2].generate(10)
+        self.sync_all()
+
+        self.log.info("Exchange messages with peers spread over I/O threads")
+        peers = [node.add_p2p_connection(P2PInterface())
+                 for _ in range(NUM_P2P_CONNECTIONS)]
+        for _ in range(3):
+            for peer in peers:
+                peer.sync_with_ping()
+        assert_equal(len(node.getpeerinfo()), NUM_P2P_CONNECTIONS + 2)
+
+        self.log.info("Disconnected peers are cleaned up")
+        for peer in peers[:NUM_P2P_CONNECTIONS // 2]:
+            peer.peer_disconnect()
+            peer.wait_for_disconnect()
+        wait_until(
+            lambda: len(node.getpeerinfo()) == NUM_P2P_CONNECTIONS // 2 + 2)
+        for peer in peers[NUM_P2P_CONNECTIONS // 2:]:
+            peer.sync_with_ping()
+
+        self.log.info("Check the startup errors")
+        self.stop_node(2)
+        self.nodes[2].assert_start_raises_init_error(
+            ['-socketevents=kqueue'],
+            'Error: Unsupported socket events mode: -socketevents=kqueue')
+        self.nodes[2].assert_start_raises_init_error(
+            ['-socketthreads=0'],
+            'Error: socketthreads must be between 1 and 64')
+        self.nodes[2].assert_start_raises_init_error(
+            ['-socketthreads=65'],
+            'Error: socketthreads must be between 1 and 64')
+
+
+if __name__ == '__main__':
+    SocketEventsTest().main()
@@ -0,0 +1,97 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test transaction reconciliation.
+
+Check that nodes started with -txreconciliation negotiate it with each other
+but not with other nodes, and that transactions still reach every node when
+some of them are announced through reconciliation rather than flooded.
+"""
+
+from decimal import Decimal
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import assert_equal, connect_nodes, wait_until
+
+NUM_TXS = 20
+FEE = Decimal('0.001')
+
+
+class TxReconciliationTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 3
+        # Nodes 0 and 1 reconcile, node 2 only floods.
+        self.extra_args = [["-txreconciliation"], ["-txreconciliation"], []]
+
+    def create_tx(self, node, height):
+        """Spend the coinbase of the block at the given height, which must pay
+        to the key of the node"""
+        key = node.get_deterministic_priv_key()
+        prevtx = node.getblock(node.getblockhash(height), 2)['tx'][0]
+        rawtx = node.createrawtransaction(
+            inputs=[{'txid': prevtx['txid'], 'vout': 0}],
+            outputs=[{key.address: prevtx['vout'][0]['value'] - FEE}],
+        )
+        return node.signrawtransactionwithkey(
+            hexstring=rawtx,
+            privkeys=[key.key],
+            prevtxs=[{
+                'txid': prevtx['txid'],
+                'vout': 0,
+                'amount': prevtx['vout'][0]['value'],
+                'scriptPubKey': prevtx['vout'][0]['scriptPubKey']['hex'],
+            }],
+        )['hex']
+
+    def run_test(self):
+        self.log.info("Check the service flag and the negotiation")
+        for i in range(2):
+            assert "TXRECONCILIATION" in self.nodes[i].getnetworkinfo()[
+                'localservicesnames']
+        assert "TXRECONCILIATION" not in self.nodes[2].getnetworkinfo()[
+            'localservicesnames']
+
+        # Node 1 connects to node 0, and node 2 connects to node 1.
+        peer_info = self.nodes[0].getpeerinfo()
+        assert_equal(len(peer_info), 1)
+        assert_equal(peer_info[0]['txreconciliation'], True)
+        for peer in self.nodes[1].getpeerinfo():
+            assert_equal(peer['txreconciliation'], not peer['inbound'])
+        assert_equal(self.nodes[2].getpeerinfo()[0]['txreconciliation'], False)
+
+        self.log.info("Relay transactions from the responder")
+        # Most of them are added to the reconciliation set of node 1, which
+        # requests a reconciliation every few seconds.
+        # The coinbases of the first 25 blocks pay to node 0, and the next 25
+        # to node 1.
+        txids = [self.nodes[0].sendrawtransaction(self.create_tx(
+            self.nodes[0], height)) for height in range(1, NUM_TXS + 1)]
+        self.sync_mempools()
+        for node in self.nodes:
+            assert_equal(sorted(node.getrawmempool()), sorted(txids))
+
+        def received_sketch():
+            return any('sketch' in peer['bytesrecv_per_msg']
+                       for peer in self.nodes[1].getpeerinfo())
+        wait_until(received_sketch, timeout=30)
+        assert 'reqtxrcncl' in self.nodes[0].getpeerinfo()[0][
+            'bytesrecv_per_msg']
+
+        self.log.info("Relay transactions from the initiator")
+        txids += [self.nodes[1].sendrawtransaction(self.create_tx(
+            self.nodes[1], height))
+            for height in range(26, 26 + NUM_TXS)]
+        self.sync_mempools()
+        for node in self.nodes:
+            assert_equal(sorted(node.getrawmempool()), sorted(txids))
+
+        self.log.info("Check that only one side supporting it is not enough")
+        self.restart_node(1, extra_args=[])
+        wait_until(lambda: len(self.nodes[0].getpeerinfo()) == 0)
+        connect_nodes(self.nodes[1], self.nodes[0])
+        wait_until(lambda: len(self.nodes[0].getpeerinfo()) == 1)
+        assert_equal(self.nodes[0].getpeerinfo()[0]['txreconciliation'], False)
+
+if __name__ == '__main__':
+    TxReconciliationTest().main()
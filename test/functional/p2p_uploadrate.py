@@ -0,0 +1,114 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the upload rate limits.
+
+Check that -peeruploadrate limits the traffic to each peer, that
+-uploadrate=historicalblocks only slows down the serving of blocks older than
+a week, and that peers with the noban permission are not limited.
+"""
+
+import time
+
+from test_framework.messages import CInv, MSG_BLOCK, msg_getdata
+from test_framework.mininode import P2PInterface, mininode_lock
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import wait_until
+
+NUM_OLD_BLOCKS = 30
+# A rate of 1 kB/s with a burst of 1 kB, in bytes per second.
+RATE = 1000
+
+
+class BlockRecorder(P2PInterface):
+    def __init__(self):
+        super().__init__()
+        self.blocks = []
+
+    def on_block(self, message):
+        message.block.calc_sha256()
+        self.blocks.append(message.block.sha256)
+
+
+class UploadRateTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+
+    def request_blocks(self, node, block_hashes):
+        """Request blocks and return how long it took to receive them"""
+        peer = node.add_p2p_connection(BlockRecorder())
+        start = time.time()
+        peer.send_message(
+            msg_getdata([CInv(MSG_BLOCK, h) for h in block_hashes]))
+        wait_until(lambda: len(peer.blocks) == len(block_hashes),
+                   timeout=60, lock=mininode_lock)
+        elapsed = time.time() - start
+        node.disconnect_p2ps()
+        return elapsed
+
+    def run_test(self):
+        node = self.nodes[0]
+        address = node.get_deterministic_priv_key().address
+
+        # Mine blocks which are more than a week old, then a recent one.
+        now = int(time.time())
+        node.setmocktime(now - 14 * 24 * 60 * 60)
+        old_hashes = [int(h, 16) for h in node.generatetoaddress(
+            NUM_OLD_BLOCKS, address)]
+        node.setmocktime(0)
+        recent_hash = int(node.generatetoaddress(1, address)[0], 16)
+
+        old_size = sum(node.getblock(hex(h)[2:].zfill(64))['size']
+                       for h in old_hashes)
+        # The time needed to send the old blocks once the burst is spent,
+        # with some leeway.
+        min_time = 0.8 * (old_size - RATE) / RATE
+
+        self.log.info("Unlimited upload rate")
+        assert self.request_blocks(node, old_hashes) < min_time
+
+        self.log.info("Per peer upload rate")
+        self.restart_node(0, ['-peeruploadrate=1'])
+        assert self.request_blocks(node, old_hashes) >= min_time
+
+        self.log.info("Historical blocks upload rate")
+        self.restart_node(0, ['-uploadrate=historicalblocks:1'])
+        slow_peer = node.add_p2p_connection(BlockRecorder())
+        slow_peer.send_message(
+            msg_getdata([CInv(MSG_BLOCK, h) for h in old_hashes]))
+        start = time.time()
+        # Recent blocks are served right away to the other peers, while the
+        # historical blocks are still trickling out.
+        fast_peer = node.add_p2p_connection(BlockRecorder())
+        fast_peer.send_message(msg_getdata([CInv(MSG_BLOCK, recent_hash)]))
+        wait_until(lambda: fast_peer.blocks == [recent_hash],
+                   lock=mininode_lock)
+        with mininode_lock:
+            assert len(slow_peer.blocks) < NUM_OLD_BLOCKS
+        wait_until(lambda: len(slow_peer.blocks) == NUM_OLD_BLOCKS,
+                   timeout=60, lock=mininode_lock)
+        assert time.time() - start >= min_time
+        node.disconnect_p2ps()
+
+        self.log.info("Peers with the noban permission are not limited")
+        self.restart_node(0, ['-uploadrate=historicalblocks:1',
+                              '-peeruploadrate=1',
+                              '-whitelist=noban@127.0.0.1'])
+        assert self.request_blocks(node, old_hashes) < min_time
+
+        self.log.info("Invalid rates are rejected")
+        self.stop_node(0)
+        node.assert_start_raises_init_error(
+            ['-uploadrate=blocks:1'], "Error: Invalid -uploadrate=blocks:1")
+        node.assert_start_raises_init_error(
+            ['-uploadrate=historicalblocks'],
+            "Error: Invalid -uploadrate=historicalblocks")
+        node.assert_start_raises_init_error(
+            ['-peeruploadrate=-1'],
+            "Error: peeruploadrate cannot be configured with a negative value.")
+
+
+if __name__ == '__main__':
+    UploadRateTest().main()
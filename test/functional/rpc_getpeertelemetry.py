@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the per-peer activity time series of getpeertelemetry."""
+
+from test_framework.messages import CInv, MSG_BLOCK, msg_getdata, msg_ping
+from test_framework.mininode import P2PInterface
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import (
+    assert_equal,
+    assert_raises_rpc_error,
+    wait_until,
+)
+
+
+class GetPeerTelemetryTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+
+    def totals(self, peer_id):
+        totals = {'bytesrecv': 0, 'bytessent': 0, 'blocksserved': 0,
+                  'msgtypes': {}}
+        telemetry = self.nodes[0].getpeertelemetry(peer_id)
+        assert_equal(len(telemetry), 1)
+        for sample in telemetry[0]['samples']:
+            for key in ['bytesrecv', 'bytessent', 'blocksserved']:
+                totals[key] += sample[key]
+            for msg_type, activity in sample['msgtypes'].items():
+                msg_totals = totals['msgtypes'].setdefault(
+                    msg_type, {'bytesrecv': 0, 'bytessent': 0,
+                               'processed': 0})
+                for key in msg_totals:
+                    msg_totals[key] += activity[key]
+        return totals
+
+    def run_test(self):
+        node = self.nodes[0]
+        block_hash = node.generate(1)[0]
+
+        peer = node.add_p2p_connection(P2PInterface())
+        peer_id = node.getpeerinfo()[0]['id']
+
+        self.log.info("Check the samples are taken every second")
+        wait_until(lambda: len(node.getpeertelemetry(
+            peer_id)[0]['samples']) >= 2)
+        telemetry = node.getpeertelemetry()
+        assert_equal(len(telemetry), 1)
+        assert_equal(telemetry[0]['id'], peer_id)
+        assert_equal(telemetry[0]['addr'], node.getpeerinfo()[0]['addr'])
+        samples = telemetry[0]['samples']
+        for sample in samples:
+            assert_equal(sorted(sample.keys()),
+                         sorted(['time', 'bytesrecv', 'bytessent', 'sendqueue',
+                                 'processqueue', 'blocksserved',
+                                 'blockservingtime', 'msgtypes']))
+        times = [sample['time'] for sample in samples]
+        assert_equal(times, sorted(times))
+
+        self.log.info("Check the activity of the peer is accounted for")
+        for i in range(5):
+            peer.send_message(msg_ping(nonce=i))
+        peer.send_message(msg_getdata([CInv(MSG_BLOCK, int(block_hash, 16))]))
+        peer.wait_for_block(int(block_hash, 16))
+        peer.sync_with_ping()
+
+        def activity_sampled():
+            totals = self.totals(peer_id)
+            return (totals['blocksserved'] == 1 and
+                    totals['msgtypes'].get('ping', {}).get('processed') == 7)
+        # Five pings, and the two used to sync.
+        wait_until(activity_sampled)
+
+        totals = self.totals(peer_id)
+        peerinfo = node.getpeerinfo()[0]
+        assert_equal(totals['msgtypes']['ping']['bytesrecv'],
+                     peerinfo['bytesrecv_per_msg']['ping'])
+        assert_equal(totals['msgtypes']['block']['bytessent'],
+                     peerinfo['bytessent_per_msg']['block'])
+        assert totals['bytesrecv'] <= peerinfo['bytesrecv']
+        assert totals['bytessent'] <= peerinfo['bytessent']
+
+        self.log.info("Check the count and nodeid arguments")
+        assert_equal(len(node.getpeertelemetry(peer_id, 1)[0]['samples']), 1)
+        assert_equal(node.getpeertelemetry(peer_id, 0)[0]['samples'], [])
+        assert_equal(node.getpeertelemetry(peer_id + 1), [])
+        assert_raises_rpc_error(-8, "Sample count out of range",
+                                node.getpeertelemetry, peer_id, -1)
+
+
+if __name__ == '__main__':
+    GetPeerTelemetryTest().main()
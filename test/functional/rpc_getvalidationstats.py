@@ -0,0 +1,105 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test the validation latency histograms of getvalidationstats."""
+
+from test_framework.messages import (
+    COIN,
+    COutPoint,
+    CTransaction,
+    CTxIn,
+    CTxOut,
+    ToHex,
+)
+from test_framework.script import CScript, OP_TRUE
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.txtools import pad_tx
+from test_framework.util import assert_equal
+
+MEMPOOL_PHASES = ['total', 'prechecks', 'coins', 'standardscripts',
+                  'consensusscripts', 'finalize', 'signals']
+CONNECTBLOCK_PHASES = ['check', 'forks', 'connect', 'verify', 'index',
+                       'callbacks']
+CONNECTTIP_PHASES = ['read', 'connect', 'flush', 'chainstate', 'postconnect',
+                     'total']
+
+
+class GetValidationStatsTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+        self.extra_args = [['-acceptnonstdtxn=1']]
+
+    def check_phase(self, phase):
+        assert_equal(sum(b['count'] for b in phase['buckets']),
+                     phase['count'])
+        assert phase['max'] <= phase['total']
+        if phase['count'] == 0:
+            assert_equal(phase['percentiles'], {})
+            return
+        assert_equal(sorted(phase['percentiles'], key=int),
+                     ['50', '90', '99'])
+        percentiles = phase['percentiles']
+        assert percentiles['50'] <= percentiles['90'] <= percentiles['99']
+        assert percentiles['99'] <= phase['max']
+        limits = [b['upto'] for b in phase['buckets']]
+        assert_equal(limits, sorted(limits))
+        assert phase['max'] < limits[-1]
+
+    def run_test(self):
+        node = self.nodes[0]
+
+        self.log.info("Block connection is timed")
+        descriptor = node.getdescriptorinfo('raw(51)')['descriptor']
+        coinbase_txid = node.getblock(
+            node.generatetodescriptor(1, descriptor)[0])['tx'][0]
+        node.generatetodescriptor(100, descriptor)
+        stats = node.getvalidationstats()
+        assert_equal(sorted(stats['connectblock']), sorted(CONNECTBLOCK_PHASES))
+        assert_equal(sorted(stats['connecttip']), sorted(CONNECTTIP_PHASES))
+        # The genesis block is connected at startup, and mined blocks are
+        # also checked when building their template.
+        for phase in CONNECTTIP_PHASES:
+            assert_equal(stats['connecttip'][phase]['count'], 102)
+        for phase in CONNECTBLOCK_PHASES:
+            assert stats['connectblock'][phase]['count'] >= 101
+        for group in stats.values():
+            for phase in group.values():
+                self.check_phase(phase)
+
+        self.log.info("Reset the histograms")
+        node.getvalidationstats(True)
+        stats = node.getvalidationstats()
+        for group in stats.values():
+            for phase in group.values():
+                assert_equal(phase['count'], 0)
+                self.check_phase(phase)
+
+        self.log.info("Mempool acceptance is timed")
+        assert_equal(sorted(stats['mempool']), sorted(MEMPOOL_PHASES))
+        tx = CTransaction()
+        tx.vin.append(CTxIn(COutPoint(int(coinbase_txid, 16), 0)))
+        tx.vout.append(CTxOut(50 * COIN - 1000, CScript([OP_TRUE])))
+        pad_tx(tx)
+        node.sendrawtransaction(ToHex(tx))
+        # An orphan fails in the prechecks, during the coin lookup.
+        orphan = CTransaction()
+        orphan.vin.append(CTxIn(COutPoint(tx.sha256, 100)))
+        orphan.vout.append(CTxOut(1000, CScript([OP_TRUE])))
+        pad_tx(orphan)
+        assert_equal(node.testmempoolaccept([ToHex(orphan)])[0][
+            'reject-reason'], 'missing-inputs')
+
+        mempool = node.getvalidationstats()['mempool']
+        for phase in ['total', 'prechecks', 'coins']:
+            assert_equal(mempool[phase]['count'], 2)
+        for phase in ['standardscripts', 'consensusscripts', 'finalize',
+                      'signals']:
+            assert_equal(mempool[phase]['count'], 1)
+        for phase in mempool.values():
+            self.check_phase(phase)
+
+
+if __name__ == '__main__':
+    GetValidationStatsTest().main()
@@ -0,0 +1,99 @@
+#!/usr/bin/env python3
+# Copyright (c) 2020 The Bitcoin developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+"""Test getmempoolfeehistogram and the confirmation target of estimatefee."""
+
+from test_framework.messages import (
+    COIN,
+    COutPoint,
+    CTransaction,
+    CTxIn,
+    CTxOut,
+    ToHex,
+)
+from test_framework.script import CScript, OP_TRUE
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.txtools import pad_tx
+from test_framework.util import assert_equal, assert_raises_rpc_error
+
+NUM_TXS = 10
+
+
+class MempoolFeeHistogramTest(BitcoinTestFramework):
+    def set_test_params(self):
+        self.num_nodes = 1
+        self.setup_clean_chain = True
+        self.extra_args = [['-acceptnonstdtxn=1']]
+
+    def run_test(self):
+        node = self.nodes[0]
+        descriptor = node.getdescriptorinfo('raw(51)')['descriptor']
+        coinbase_txid = node.getblock(
+            node.generatetodescriptor(1, descriptor)[0])['tx'][0]
+        node.generatetodescriptor(100, descriptor)
+
+        self.log.info("The histogram of an empty mempool is empty")
+        histogram = node.getmempoolfeehistogram()
+        assert_equal(histogram['bytes'], 0)
+        assert_equal(histogram['percentiles'], {})
+        assert_equal(histogram['buckets'], [])
+        min_fee = node.estimatefee()
+        assert_equal(node.estimatefee(1), min_fee)
+
+        self.log.info("Fill the mempool with increasing fee rates")
+        split_tx = CTransaction()
+        split_tx.vin.append(CTxIn(COutPoint(int(coinbase_txid, 16), 0)))
+        for _ in range(NUM_TXS):
+            split_tx.vout.append(
+                CTxOut(50 * COIN // NUM_TXS - 1000, CScript([OP_TRUE])))
+        split_txid = node.sendrawtransaction(ToHex(split_tx))
+        for i in range(NUM_TXS):
+            tx = CTransaction()
+            tx.vin.append(CTxIn(COutPoint(int(split_txid, 16), i)))
+            tx.vout.append(CTxOut(split_tx.vout[i].nValue - 1000 * 2 ** i,
+                                  CScript([OP_TRUE])))
+            pad_tx(tx)
+            node.sendrawtransaction(ToHex(tx), 0)
+
+        mempool = node.getrawmempool(True)
+        histogram = node.getmempoolfeehistogram()
+        assert_equal(histogram['bytes'], node.getmempoolinfo()['bytes'])
+        buckets = histogram['buckets']
+        assert_equal(sum(b['count'] for b in buckets), len(mempool))
+        assert_equal(buckets[-1]['depth'], histogram['bytes'])
+        depth = 0
+        for prev, bucket in zip([None] + buckets, buckets):
+            if prev is not None:
+                assert prev['feerate'] > bucket['feerate']
+            depth += bucket['bytes']
+            assert_equal(bucket['depth'], depth)
+        min_feerate = min(entry['fees']['base'] * 1000 / entry['size']
+                          for entry in mempool.values())
+        assert buckets[-1]['feerate'] <= min_feerate
+
+        percentiles = histogram['percentiles']
+        assert_equal(sorted(percentiles, key=int),
+                     ['5', '10', '25', '50', '75', '90', '95'])
+        assert percentiles['5'] >= percentiles['50'] >= percentiles['95']
+
+        self.log.info("A small mempool only needs the minimum fee")
+        assert_equal(node.estimatefee(1), min_fee)
+        assert_raises_rpc_error(-8, "Invalid nblocks",
+                                node.estimatefee, 0)
+        assert_raises_rpc_error(-8, "Invalid nblocks",
+                                node.estimatefee, 26)
+
+        self.log.info("Confirmed transactions feed the estimates")
+        node.generatetodescriptor(1, descriptor)
+        assert_equal(node.getmempoolfeehistogram()['buckets'], [])
+        lowest_feerate = buckets[-1]['feerate']
+        estimate = node.estimatefee(1)
+        assert estimate >= max(min_fee, lowest_feerate)
+        assert estimate <= buckets[0]['feerate']
+        assert_equal(node.estimatefee(), min_fee)
+        assert node.estimatefee(2) <= estimate
+
+
+if __name__ == '__main__':
+    MempoolFeeHistogramTest().main()
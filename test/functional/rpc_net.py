@@ -109,6 +109,14 @@ class NetTest(BitcoinTestFramework):
                     'ping', 0), before['bytessent_per_msg'].get(
                     'ping', 0) + 32)
 
+        # The socket calls are counted along with the bytes they transfer
+        net_totals = self.nodes[0].getnettotals()
+        for direction in ['recv', 'send']:
+            assert_greater_than(
+                net_totals['total{}calls'.format(direction)], 0)
+            assert_greater_than(
+                net_totals['bytesper{}call'.format(direction)], 0)
+
     def _test_getnetworkinfo(self):
         assert_equal(self.nodes[0].getnetworkinfo()['networkactive'], True)
         assert_equal(self.nodes[0].getnetworkinfo()['connections'], 2)
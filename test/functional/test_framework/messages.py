@@ -52,6 +52,8 @@ NODE_BLOOM = (1 << 2)
 NODE_XTHIN = (1 << 4)
 NODE_NETWORK_LIMITED = (1 << 10)
 NODE_AVALANCHE = (1 << 24)
+NODE_TXRECONCILIATION = (1 << 25)
+NODE_GRAPHENE = (1 << 26)
 
 MSG_TX = 1
 MSG_BLOCK = 2